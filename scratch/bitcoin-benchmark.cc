@@ -0,0 +1,314 @@
+/*
+ * Runs a fixed set of seeded bitcoin network scenarios and reports, for each one, the setup time,
+ * the simulation time, the application events per wall-clock second, the peak RSS and the mean
+ * block propagation time as JSON. The application events are the handlers timed by BitcoinEventProfiler
+ * (mining, validation, block and chunk transfers, timeouts); the socket, channel and TCP events of ns-3
+ * are not included, so the total simulator load is higher. The blockTorrent scenarios run both with and without RarestFirst.
+ *
+ * Every scenario runs in its own forked process, so the peak RSS of one scenario is not inherited
+ * by the next one. Use --maxNodes to include the larger networks (up to 100000 nodes) and --scenario
+ * to run a single scenario.
+ *
+ * The calls of malloc during the simulation are counted by interposing malloc, and reported in total
+ * and per json message built or parsed. Run with --jsonPool=0 to get the numbers without the json pool.
+ *
+ * Run with --trickleInterval=<seconds> to batch the block announcements of every node per peer. The
+ * announcements sent and the application events, which include the SendAnnouncements timers, can then be
+ * compared with a run without it.
+ */
+
+#include <fstream>
+#include <sstream>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/point-to-point-module.h"
+#include "ns3/applications-module.h"
+#include "ns3/point-to-point-layout-module.h"
+
+using namespace ns3;
+
+typedef struct {
+  int                       totalNoNodes;
+  int                       noMiners;
+  enum ProtocolType         protocolType;
+  bool                      blockTorrent;
+  bool                      rarestFirst;
+  enum BlockBroadcastType   blockBroadcastType;
+} benchmarkScenario;
+
+double get_wall_time();
+std::vector<benchmarkScenario> GetBenchmarkScenarios (int maxNodes);
+std::string RunBenchmarkScenario (const benchmarkScenario &scenario, int targetNumberOfBlocks, uint32_t seed, bool jsonPool, double trickleInterval);
+
+NS_LOG_COMPONENT_DEFINE ("BitcoinBenchmark");
+
+/**
+ * Counts the calls of malloc. Relies on glibc exporting __libc_malloc.
+ */
+static uint64_t g_mallocCalls = 0;
+
+extern "C" void *__libc_malloc (size_t size);
+
+extern "C" void *
+malloc (size_t size)
+{
+  g_mallocCalls++;
+  return __libc_malloc (size);
+}
+
+int
+main (int argc, char *argv[])
+{
+  int maxNodes = 10000;
+  int scenarioIndex = -1;
+  int targetNumberOfBlocks = 10;
+  uint32_t seed = 1;
+  std::string outputFile = "bitcoin-benchmark.json";
+  bool jsonPool = true;
+  double trickleInterval = 0;
+
+  CommandLine cmd;
+  cmd.AddValue ("maxNodes", "Skip the scenarios with more nodes than maxNodes", maxNodes);
+  cmd.AddValue ("scenario", "Run only the scenario with this index (-1 runs all)", scenarioIndex);
+  cmd.AddValue ("noBlocks", "The number of generated blocks in each scenario", targetNumberOfBlocks);
+  cmd.AddValue ("seed", "The seed of the random number generators", seed);
+  cmd.AddValue ("output", "The JSON file the results are written to", outputFile);
+  cmd.AddValue ("jsonPool", "Reuse the memory of the json messages", jsonPool);
+  cmd.AddValue ("trickleInterval", "The mean TrickleInterval of the nodes in seconds, 0 to announce the blocks immediately", trickleInterval);
+  cmd.Parse(argc, argv);
+
+  if (seed == 0)
+  {
+    std::cout << "The seed must be positive" << std::endl;
+    return 1;
+  }
+
+  std::vector<benchmarkScenario> scenarios = GetBenchmarkScenarios (maxNodes);
+  std::ofstream output (outputFile.c_str ());
+  bool first = true;
+
+  if (!output.is_open ())
+  {
+    std::cout << "Cannot open " << outputFile << std::endl;
+    return 1;
+  }
+
+  output << "{\"seed\": " << seed << ", \"noBlocks\": " << targetNumberOfBlocks
+         << ", \"jsonPool\": " << (jsonPool ? "true" : "false")
+         << ", \"trickleInterval\": " << trickleInterval << ", \"scenarios\": [";
+
+  for (int i = 0; i < static_cast<int>(scenarios.size ()); i++)
+  {
+    if (scenarioIndex != -1 && scenarioIndex != i)
+      continue;
+
+    int fds[2];
+    if (pipe (fds) != 0)
+    {
+      std::cout << "Cannot create a pipe" << std::endl;
+      return 1;
+    }
+
+    std::cout << "Running scenario " << i << std::endl;
+    pid_t pid = fork ();
+
+    if (pid == 0)
+    {
+      //The models print to std::cout, so the result is passed through the pipe
+      close (fds[0]);
+      if (freopen ("/dev/null", "w", stdout) == NULL)
+        _exit (1);
+
+      std::string result = RunBenchmarkScenario (scenarios[i], targetNumberOfBlocks, seed, jsonPool, trickleInterval);
+      ssize_t written = write (fds[1], result.c_str (), result.size ());
+      close (fds[1]);
+      _exit (written == static_cast<ssize_t>(result.size ()) ? 0 : 1);
+    }
+
+    close (fds[1]);
+
+    std::string result;
+    char buffer[4096];
+    ssize_t count;
+    int status = 0;
+
+    while ((count = read (fds[0], buffer, sizeof(buffer))) > 0)
+      result.append (buffer, count);
+    close (fds[0]);
+    waitpid (pid, &status, 0);
+
+    if (pid < 0 || !WIFEXITED (status) || WEXITSTATUS (status) != 0 || result.empty ())
+    {
+      std::cout << "Scenario " << i << " failed" << std::endl;
+      continue;
+    }
+
+    output << (first ? "\n  " : ",\n  ") << result;
+    first = false;
+    std::cout << result << std::endl;
+  }
+
+  output << "\n]}\n";
+  output.close ();
+
+  return 0;
+}
+
+
+std::vector<benchmarkScenario> GetBenchmarkScenarios (int maxNodes)
+{
+  std::vector<benchmarkScenario> scenarios;
+  int nodes[] = {100, 1000, 10000, 100000};
+
+  for (auto &totalNoNodes : nodes)
+  {
+    if (totalNoNodes <= maxNodes)
+      scenarios.push_back ({totalNoNodes, 16, STANDARD_PROTOCOL, false, false, STANDARD});
+  }
+
+  if (maxNodes >= 1000)
+  {
+    scenarios.push_back ({1000, 32, STANDARD_PROTOCOL, false, false, STANDARD});
+    scenarios.push_back ({1000, 64, STANDARD_PROTOCOL, false, false, STANDARD});
+    scenarios.push_back ({1000, 16, SENDHEADERS, false, false, STANDARD});
+    scenarios.push_back ({1000, 16, STANDARD_PROTOCOL, true, false, STANDARD});
+    scenarios.push_back ({1000, 16, STANDARD_PROTOCOL, true, true, STANDARD});
+    scenarios.push_back ({1000, 16, SENDHEADERS, true, false, STANDARD});
+    scenarios.push_back ({1000, 16, SENDHEADERS, true, true, STANDARD});
+    scenarios.push_back ({1000, 16, STANDARD_PROTOCOL, false, false, UNSOLICITED});
+    scenarios.push_back ({1000, 16, STANDARD_PROTOCOL, false, false, RELAY_NETWORK});
+    scenarios.push_back ({1000, 16, STANDARD_PROTOCOL, false, false, UNSOLICITED_RELAY_NETWORK});
+  }
+
+  return scenarios;
+}
+
+
+std::string RunBenchmarkScenario (const benchmarkScenario &scenario, int targetNumberOfBlocks, uint32_t seed, bool jsonPool, double trickleInterval)
+{
+  const int secsPerMin = 60;
+  const uint16_t bitcoinPort = 8333;
+  const double averageBlockGenIntervalMinutes = 10;
+  const double averageBlockGenIntervalSeconds = averageBlockGenIntervalMinutes * secsPerMin;
+  double stop = targetNumberOfBlocks * averageBlockGenIntervalMinutes;
+  double tStart = get_wall_time(), tStartSimulation, tFinish;
+  int noMiners = scenario.noMiners;
+
+  double bitcoinMinersHash[] = {0.289, 0.196, 0.159, 0.133, 0.066, 0.054,
+                                0.029, 0.016, 0.012, 0.012, 0.012, 0.009,
+                                0.005, 0.005, 0.002, 0.002};
+  enum BitcoinRegion bitcoinMinersRegions[] = {ASIA_PACIFIC, ASIA_PACIFIC, ASIA_PACIFIC, NORTH_AMERICA, ASIA_PACIFIC, NORTH_AMERICA,
+                                               EUROPE, EUROPE, NORTH_AMERICA, NORTH_AMERICA, NORTH_AMERICA, EUROPE,
+                                               NORTH_AMERICA, NORTH_AMERICA, NORTH_AMERICA, NORTH_AMERICA};
+  std::vector<enum BitcoinRegion> minersRegions (noMiners);
+  std::vector<minerSpecification> minersSpecifications (noMiners);
+  nodeStatistics *stats = new nodeStatistics[scenario.totalNoNodes];
+
+  RngSeedManager::SetSeed (seed);
+
+  for (int i = 0; i < noMiners; i++)
+  {
+    minersRegions[i] = bitcoinMinersRegions[i % 16];
+    minersSpecifications[i].minerType = NORMAL_MINER;
+    minersSpecifications[i].hashRate = bitcoinMinersHash[i % 16] * 16 / noMiners;
+    minersSpecifications[i].gamma = 0;
+    minersSpecifications[i].blockBroadcastType = scenario.blockBroadcastType;
+    minersSpecifications[i].fixedBlockIntervalGeneration = 0;
+  }
+
+  BitcoinTopologyHelper bitcoinTopologyHelper (1, scenario.totalNoNodes, noMiners, minersRegions.data (),
+                                               BITCOIN, -1, -1, 5, 0);
+  InternetStackHelper stack;
+  bitcoinTopologyHelper.InstallStack (stack);
+  bitcoinTopologyHelper.AssignIpv4Addresses (Ipv4AddressHelperCustom ("1.0.0.0", "255.255.255.252", false));
+
+  BitcoinNetworkHelper bitcoinNetworkHelper ("ns3::TcpSocketFactory", InetSocketAddress (Ipv4Address::GetAny (), bitcoinPort),
+                                             bitcoinTopologyHelper, minersSpecifications, stats, averageBlockGenIntervalSeconds);
+  bitcoinNetworkHelper.SetAttribute("InvTimeoutMinutes", TimeValue (Minutes (2*averageBlockGenIntervalMinutes)));
+  bitcoinNetworkHelper.SetProtocolType(scenario.protocolType);
+  bitcoinNetworkHelper.SetSeed(seed);
+  if (scenario.blockTorrent)
+    bitcoinNetworkHelper.SetAttribute("BlockTorrent", BooleanValue(true));
+  if (scenario.rarestFirst)
+    bitcoinNetworkHelper.SetAttribute("RarestFirst", BooleanValue(true));
+  bitcoinNetworkHelper.SetAttribute("JsonPool", BooleanValue(jsonPool));
+  bitcoinNetworkHelper.SetAttribute("TrickleInterval", TimeValue (Seconds (trickleInterval)));
+
+  ApplicationContainer bitcoinMiners = bitcoinNetworkHelper.InstallMiners (0);
+  bitcoinMiners.Start (Seconds (0));
+  bitcoinMiners.Stop (Minutes (stop));
+
+  ApplicationContainer bitcoinNodes = bitcoinNetworkHelper.InstallNodes (0);
+  bitcoinNodes.Start (Seconds (0));
+  bitcoinNodes.Stop (Minutes (stop));
+
+  BitcoinEventProfiler::Enable ();
+  tStartSimulation = get_wall_time();
+  uint64_t mallocCalls = g_mallocCalls;
+  uint64_t jsonDocuments = BitcoinJsonPool::GetTotalDocuments ();
+  uint64_t announcements = BitcoinNode::GetTotalAnnouncements ();
+  Simulator::Stop (Minutes (stop + 0.1));
+  Simulator::Run ();
+  mallocCalls = g_mallocCalls - mallocCalls;
+  jsonDocuments = BitcoinJsonPool::GetTotalDocuments () - jsonDocuments;
+  announcements = BitcoinNode::GetTotalAnnouncements () - announcements;
+  tFinish = get_wall_time();
+
+  double simulatedSeconds = Simulator::Now ().GetSeconds ();
+  long applicationEvents = BitcoinEventProfiler::GetTotalCount ();
+  Simulator::Destroy ();
+
+  struct rusage usage;
+  getrusage (RUSAGE_SELF, &usage);
+
+  //Weighted by the blocks received by each node, as in bitcoin-test
+  double meanBlockPropagationTime = 0;
+  long   totalBlocks = 0;
+  for (int i = 0; i < scenario.totalNoNodes; i++)
+  {
+    if (totalBlocks + stats[i].totalBlocks == 0)
+      continue;
+    meanBlockPropagationTime = meanBlockPropagationTime*totalBlocks/(totalBlocks + stats[i].totalBlocks)
+                               + stats[i].meanBlockPropagationTime*stats[i].totalBlocks/(totalBlocks + stats[i].totalBlocks);
+    totalBlocks += stats[i].totalBlocks;
+  }
+
+  std::ostringstream result;
+  result << "{\"nodes\": " << scenario.totalNoNodes
+         << ", \"miners\": " << noMiners
+         << ", \"protocol\": \"" << getProtocolType (scenario.protocolType) << "\""
+         << ", \"blockTorrent\": " << (scenario.blockTorrent ? "true" : "false")
+         << ", \"rarestFirst\": " << (scenario.rarestFirst ? "true" : "false")
+         << ", \"blockBroadcastType\": \"" << getBlockBroadcastType (scenario.blockBroadcastType) << "\""
+         << ", \"setupSeconds\": " << tStartSimulation - tStart
+         << ", \"simulateSeconds\": " << tFinish - tStartSimulation
+         << ", \"simulatedSeconds\": " << simulatedSeconds
+         << ", \"applicationEvents\": " << applicationEvents
+         << ", \"meanBlockPropagationTime\": " << meanBlockPropagationTime
+         << ", \"announcements\": " << announcements
+         << ", \"applicationEventsPerSecond\": " << (tFinish > tStartSimulation ? applicationEvents / (tFinish - tStartSimulation) : 0)
+         << ", \"mallocCalls\": " << mallocCalls
+         << ", \"jsonDocuments\": " << jsonDocuments
+         << ", \"mallocCallsPerJsonDocument\": " << (jsonDocuments > 0 ? static_cast<double>(mallocCalls) / jsonDocuments : 0)
+         << ", \"peakRssKB\": " << usage.ru_maxrss << "}";
+
+  delete[] stats;
+  return result.str ();
+}
+
+
+double get_wall_time()
+{
+    struct timeval time;
+    if (gettimeofday(&time,NULL)){
+        //  Handle error
+        return 0;
+    }
+    return (double)time.tv_sec + (double)time.tv_usec * .000001;
+}
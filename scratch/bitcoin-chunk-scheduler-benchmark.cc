@@ -0,0 +1,207 @@
+/*
+ * Benchmarks the BitcoinChunkScheduler on its own, without the network simulation. Every block is
+ * advertised by --peers synthetic peers: the first one has the whole block and each of the others
+ * has every chunk with probability --availability. The download runs in rounds: in every round each
+ * peer is asked for up to its batch of chunks, as BitcoinNode does when it receives EXT_INV/EXT_HEADERS,
+ * and every request either times out with probability --timeoutRate or delivers its chunk. A timed out
+ * chunk is queued again only if no other request for it is pending, as in BitcoinNode::ChunkTimeoutExpired.
+ *
+ * The wall time spent in the scheduler, the calls of PickChunks, the rounds per block, the requests,
+ * the duplicate chunks received in the endgame and the timeouts are reported. Run with --rarestFirst=0
+ * for the random single-chunk picking of the original blockTorrent.
+ */
+
+#include <chrono>
+#include <iomanip>
+#include "ns3/core-module.h"
+#include "ns3/applications-module.h"
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("BitcoinChunkSchedulerBenchmark");
+
+/**
+ * A chunk requested from a peer and not delivered yet
+ */
+typedef struct {
+  int      peer;
+  int      chunk;
+} pendingRequest;
+
+int
+main (int argc, char *argv[])
+{
+  int      blocks = 1000;
+  int      peers = 8;
+  int      blockSize = 1000000;
+  int      chunkSize = 10000;
+  double   availability = 0.5;
+  double   timeoutRate = 0.05;
+  bool     rarestFirst = true;
+  int      maxChunksInFlight = 8;
+  double   batchSeconds = 0.5;
+  int      endgameChunks = 4;
+  double   minPeerSpeed = 100000;
+  double   maxPeerSpeed = 10000000;
+  int      maxRounds = 10000;
+  uint32_t seed = 1;
+
+  CommandLine cmd;
+  cmd.AddValue ("blocks", "The number of blocks downloaded", blocks);
+  cmd.AddValue ("peers", "The number of peers advertising each block", peers);
+  cmd.AddValue ("blockSize", "The block size in Bytes", blockSize);
+  cmd.AddValue ("chunkSize", "The chunk size in Bytes", chunkSize);
+  cmd.AddValue ("availability", "The probability that a peer other than the first one has a chunk", availability);
+  cmd.AddValue ("timeoutRate", "The probability that a chunk request times out", timeoutRate);
+  cmd.AddValue ("rarestFirst", "Use the rarest-first mode of the scheduler", rarestFirst);
+  cmd.AddValue ("maxChunksInFlight", "The maximum number of chunks in flight per peer", maxChunksInFlight);
+  cmd.AddValue ("batchSeconds", "The time a batch of requests should keep the link to a peer busy", batchSeconds);
+  cmd.AddValue ("endgameChunks", "The number of missing chunks below which the endgame starts", endgameChunks);
+  cmd.AddValue ("minPeerSpeed", "The minimum speed of a peer in Bytes/s", minPeerSpeed);
+  cmd.AddValue ("maxPeerSpeed", "The maximum speed of a peer in Bytes/s", maxPeerSpeed);
+  cmd.AddValue ("maxRounds", "Give up a block after maxRounds rounds", maxRounds);
+  cmd.AddValue ("seed", "The seed of rand()", seed);
+  cmd.Parse(argc, argv);
+
+  if (peers < 1 || blocks < 1 || chunkSize <= 0 || blockSize <= 0)
+  {
+    std::cout << "blocks, peers, blockSize and chunkSize must be positive" << std::endl;
+    return 1;
+  }
+
+  srand (seed);
+
+  int                          noChunks = (blockSize + chunkSize - 1) / chunkSize;
+  BitcoinChunkScheduler        scheduler;
+  std::vector<Ipv4Address>     peerAddresses;
+  std::vector<int>             batchSizes;
+  long                         pickCalls = 0;
+  long                         requests = 0;
+  long                         duplicates = 0;
+  long                         timeouts = 0;
+  long                         rounds = 0;
+  long                         maxSchedulerBytes = 0;
+  int                          unfinishedBlocks = 0;
+  std::chrono::steady_clock::duration schedulerTime = std::chrono::steady_clock::duration::zero ();
+
+  scheduler.SetRarestFirst (rarestFirst);
+  scheduler.SetChunkSize (chunkSize);
+  scheduler.SetMaxChunksInFlight (maxChunksInFlight);
+  scheduler.SetBatchSeconds (batchSeconds);
+  scheduler.SetEndgameChunks (endgameChunks);
+
+  for (int i = 0; i < peers; i++)
+  {
+    double speed = minPeerSpeed + (maxPeerSpeed - minPeerSpeed) * rand () / RAND_MAX;
+
+    peerAddresses.push_back (Ipv4Address (0x0a000001 + i));
+    batchSizes.push_back (scheduler.GetBatchSize (speed));
+  }
+
+  for (int b = 0; b < blocks; b++)
+  {
+    std::ostringstream           hash;
+    ChunkBitmap                  queue (noChunks);
+    ChunkBitmap                  received (noChunks);
+    std::vector<pendingRequest>  pending;
+    std::vector<int>             pendingPerChunk (noChunks, 0);
+    int                          round = 0;
+
+    hash << b << "/0";
+    queue.SetAll ();
+
+    std::vector<ChunkBitmap> peerChunks (peers, ChunkBitmap (noChunks));
+    for (int i = 0; i < peers; i++)
+    {
+      for (int c = 0; c < noChunks; c++)
+      {
+        if (i == 0 || rand () < availability * RAND_MAX)
+          peerChunks[i].Set (c);
+      }
+    }
+
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now ();
+    for (int i = 0; i < peers; i++)
+      scheduler.AddPeerChunks (hash.str (), noChunks, peerAddresses[i], peerChunks[i]);
+    schedulerTime += std::chrono::steady_clock::now () - start;
+
+    while (received.Count () < noChunks && round < maxRounds)
+    {
+      round++;
+
+      start = std::chrono::steady_clock::now ();
+      for (int i = 0; i < peers; i++)
+      {
+        std::vector<int> picked = scheduler.PickChunks (hash.str (), peerAddresses[i], queue, received, batchSizes[i]);
+
+        pickCalls++;
+        for (auto &chunk : picked)
+        {
+          pendingRequest request = {i, chunk};
+          pending.push_back (request);
+          pendingPerChunk[chunk]++;
+        }
+      }
+      schedulerTime += std::chrono::steady_clock::now () - start;
+      requests += pending.size ();
+
+      std::vector<pendingRequest> delivered;
+      std::vector<pendingRequest> expired;
+      for (auto &request : pending)
+      {
+        if (rand () < timeoutRate * RAND_MAX)
+          expired.push_back (request);
+        else
+          delivered.push_back (request);
+      }
+      pending.clear ();
+
+      start = std::chrono::steady_clock::now ();
+      for (auto &request : delivered)
+      {
+        pendingPerChunk[request.chunk]--;
+        if (received.Test (request.chunk))
+        {
+          duplicates++;
+          continue;
+        }
+        received.Set (request.chunk);
+        scheduler.RemoveInFlight (hash.str (), request.chunk);
+      }
+      for (auto &request : expired)
+      {
+        timeouts++;
+        pendingPerChunk[request.chunk]--;
+        scheduler.RemoveInFlight (hash.str (), request.chunk, peerAddresses[request.peer]);
+        if (!received.Test (request.chunk) && pendingPerChunk[request.chunk] == 0)
+          queue.Set (request.chunk);
+      }
+      schedulerTime += std::chrono::steady_clock::now () - start;
+    }
+
+    if (received.Count () < noChunks)
+      unfinishedBlocks++;
+    rounds += round;
+    maxSchedulerBytes = std::max (maxSchedulerBytes, scheduler.GetMemoryUsage ().bytes);
+
+    start = std::chrono::steady_clock::now ();
+    scheduler.RemoveBlock (hash.str ());
+    schedulerTime += std::chrono::steady_clock::now () - start;
+  }
+
+  double seconds = std::chrono::duration<double> (schedulerTime).count ();
+
+  std::cout << "Scheduler: " << (rarestFirst ? "rarest-first" : "random") << ", " << blocks << " blocks of "
+            << noChunks << " chunks, " << peers << " peers\n";
+  std::cout << "Scheduler time = " << seconds << "s (" << (pickCalls > 0 ? seconds / pickCalls * 1e9 : 0)
+            << "ns per PickChunks call, " << pickCalls << " calls)\n";
+  std::cout << "Rounds per block = " << static_cast<double>(rounds) / blocks << " (" << unfinishedBlocks
+            << " blocks not finished in " << maxRounds << " rounds)\n";
+  std::cout << "Requests = " << requests << " (" << static_cast<double>(requests) / blocks << " per block)\n";
+  std::cout << "Duplicate chunks = " << duplicates << " (" << std::fixed << std::setprecision (2)
+            << (requests > 0 ? 100. * duplicates / requests : 0) << "% of the requests)\n";
+  std::cout << "Timeouts = " << timeouts << "\n";
+  std::cout << "Peak scheduler memory = " << maxSchedulerBytes << " Bytes" << std::endl;
+
+  return 0;
+}
@@ -0,0 +1,201 @@
+/*
+ * Checks that a Blockchain pruned below a finality depth k reports the same fork statistics as an unpruned one
+ * and that the keys it keeps for its pruned rows stay bounded. Every run adds the same random chain to both
+ * blockchains: the top is extended most of the time, and forks start from the rows above the finality depth.
+ * The pruned blockchain receives again blocks it has removed, both within the k heights below the pruned rows,
+ * whose keys it keeps, and below them, where it refuses and counts them as dropped. Both blockchains receive
+ * late blocks in the rows of the key window, which the pruned blockchain drops. The late blocks go to rows
+ * whose neighbours hold a single block, since the forks through the pruned rows are not extended. Every
+ * --checkpointInterval blocks the pruned blockchain is rebuilt from its blocks and its blockchainState, as
+ * BitcoinNode::RestoreCheckpoint does.
+ *
+ * GetLongestForkSize, GetBlocksInForks, GetNoStaleBlocks, GetTotalBlocks, GetNoDroppedBlocks and the top block
+ * are compared at the end of every run. After half of the blocks and at the end, the number of keys must not
+ * exceed the siblings of the main chain blocks in the key window, whatever the length of the chain. The program
+ * fails if any check fails.
+ */
+
+#include "ns3/core-module.h"
+#include "ns3/applications-module.h"
+
+using namespace ns3;
+
+NS_LOG_COMPONENT_DEFINE ("BitcoinFinalityCheck");
+
+/**
+ * The blocks besides the main chain block in the rows [fromHeight, toHeight) of the unpruned blockchain
+ */
+static int
+CountSiblings (const Blockchain &full, int fromHeight, int toHeight)
+{
+  int siblings = 0;
+
+  for (int height = std::max (fromHeight, 0); height < toHeight; height++)
+    siblings += full.GetBlocksInSameHeight (height).size () - 1;
+  return siblings;
+}
+
+/**
+ * Rebuilds the blockchain from the blocks and the state a checkpoint saves
+ */
+static Blockchain
+RestoreBlockchain (const Blockchain &blockchain, int finalityDepth)
+{
+  Blockchain restored;
+
+  for (int height = 1; height <= blockchain.GetBlockchainHeight (); height++)
+  {
+    for (auto &block : blockchain.GetBlocksInSameHeight (height))
+      restored.AddBlock (block);
+  }
+  restored.SetState (blockchain.GetState ());
+  restored.SetFinalityDepth (finalityDepth);
+  return restored;
+}
+
+int
+main (int argc, char *argv[])
+{
+  int      runs = 100;
+  int      blocks = 3000;
+  int      minFinalityDepth = 3;
+  int      maxFinalityDepth = 10;
+  double   forkRate = 0.3;
+  double   resendRate = 0.05;
+  double   lateRate = 0.03;
+  int      checkpointInterval = 1000;
+  uint32_t seed = 1;
+
+  CommandLine cmd;
+  cmd.AddValue ("runs", "The number of random chains", runs);
+  cmd.AddValue ("blocks", "The number of steps of each chain", blocks);
+  cmd.AddValue ("minFinalityDepth", "The minimum finality depth of the pruned blockchain", minFinalityDepth);
+  cmd.AddValue ("maxFinalityDepth", "The maximum finality depth of the pruned blockchain", maxFinalityDepth);
+  cmd.AddValue ("forkRate", "The probability that a block starts or extends a fork", forkRate);
+  cmd.AddValue ("resendRate", "The probability that the pruned blockchain receives a removed block again", resendRate);
+  cmd.AddValue ("lateRate", "The probability that a block arrives in the key window below the finality depth", lateRate);
+  cmd.AddValue ("checkpointInterval", "Rebuild the pruned blockchain every checkpointInterval steps (0 never)", checkpointInterval);
+  cmd.AddValue ("seed", "The seed of rand()", seed);
+  cmd.Parse(argc, argv);
+
+  if (minFinalityDepth < 1 || maxFinalityDepth < minFinalityDepth)
+  {
+    std::cout << "The finality depths must satisfy 1 <= minFinalityDepth <= maxFinalityDepth" << std::endl;
+    return 1;
+  }
+
+  srand (seed);
+
+  int failedRuns = 0;
+  long maxKeyBytes = 0;
+
+  for (int run = 0; run < runs; run++)
+  {
+    int                 finalityDepth = minFinalityDepth + rand () % (maxFinalityDepth - minFinalityDepth + 1);
+    Blockchain          full;
+    Blockchain          pruned;
+    std::vector<Block>  added;
+    int                 minerId = 0;
+    int                 droppedBlocks = 0;
+    bool                failed = false;
+
+    pruned.SetFinalityDepth (finalityDepth);
+
+    for (int step = 1; step <= blocks; step++)
+    {
+      Block  top = full.GetCurrentTopBlock ();
+      int    prunedHeight = top.GetBlockHeight () - finalityDepth;
+      int    keyWindowHeight = prunedHeight - finalityDepth;
+      double r = rand () / (RAND_MAX + 1.0);
+      int    height;
+      int    parentId;
+
+      if (step == blocks / 2 || step == blocks)
+      {
+        containerUsage keys = pruned.GetPrunedKeysMemoryUsage ();
+        int            siblings = CountSiblings (full, keyWindowHeight, prunedHeight);
+
+        maxKeyBytes = std::max (maxKeyBytes, keys.bytes);
+        if (keys.elements > siblings)
+        {
+          failed = true;
+          std::cout << "Run " << run << " (finality depth " << finalityDepth << ") keeps " << keys.elements
+                    << " keys (" << keys.bytes << " Bytes) after " << step << " blocks, but the key window has "
+                    << siblings << " siblings\n";
+        }
+      }
+
+      if (r < resendRate && !added.empty ())
+      {
+        Block block = added[rand () % added.size ()];
+
+        if (!pruned.HasBlock (block) && !pruned.IsOrphan (block))
+        {
+          pruned.AddBlock (block);
+          if (block.GetBlockHeight () < keyWindowHeight)
+            droppedBlocks++;
+        }
+        continue;
+      }
+      else if (r < resendRate + lateRate && finalityDepth > 1)
+      {
+        height = prunedHeight - 2 - rand () % (finalityDepth - 1);
+        if (height < 3 || height % 3 != 0 || full.GetBlocksInSameHeight (height - 1).size () != 1
+            || full.GetBlocksInSameHeight (height + 1).size () != 1)
+          continue;
+
+        parentId = full.GetBlocksInSameHeight (height - 1)[0].GetMinerId ();
+        droppedBlocks++;
+      }
+      else if (r < resendRate + lateRate + forkRate && top.GetBlockHeight () >= 3)
+      {
+        Block parent = top;
+        int   back = rand () % std::min (finalityDepth, top.GetBlockHeight ());
+
+        for (int i = 0; i < back; i++)
+          parent = full.GetParent (parent);
+
+        std::vector<Block> sameHeight = full.GetBlocksInSameHeight (parent.GetBlockHeight ());
+        parent = sameHeight[rand () % sameHeight.size ()];
+        if (!pruned.HasBlock (parent))
+          continue;
+
+        height = parent.GetBlockHeight () + 1;
+        parentId = parent.GetMinerId ();
+      }
+      else
+      {
+        height = top.GetBlockHeight () + 1;
+        parentId = top.GetMinerId ();
+      }
+
+      Block newBlock (height, ++minerId, parentId, 100, step, step, Ipv4Address ("0.0.0.0"));
+
+      full.AddBlock (newBlock);
+      pruned.AddBlock (newBlock);
+      added.push_back (newBlock);
+
+      if (checkpointInterval > 0 && step % checkpointInterval == 0)
+        pruned = RestoreBlockchain (pruned, finalityDepth);
+    }
+
+    if (full.GetLongestForkSize () != pruned.GetLongestForkSize () || full.GetBlocksInForks () != pruned.GetBlocksInForks ()
+        || full.GetNoStaleBlocks () != pruned.GetNoStaleBlocks () || full.GetTotalBlocks () != pruned.GetTotalBlocks ()
+        || !(full.GetCurrentTopBlock () == pruned.GetCurrentTopBlock ()) || pruned.GetNoDroppedBlocks () != droppedBlocks)
+    {
+      failed = true;
+      std::cout << "Run " << run << " (finality depth " << finalityDepth << ") differs: longest fork "
+                << full.GetLongestForkSize () << "/" << pruned.GetLongestForkSize () << ", blocks in forks "
+                << full.GetBlocksInForks () << "/" << pruned.GetBlocksInForks () << ", stale blocks "
+                << full.GetNoStaleBlocks () << "/" << pruned.GetNoStaleBlocks () << ", total blocks "
+                << full.GetTotalBlocks () << "/" << pruned.GetTotalBlocks () << ", dropped blocks "
+                << droppedBlocks << "/" << pruned.GetNoDroppedBlocks () << "\n";
+    }
+    if (failed)
+      failedRuns++;
+  }
+
+  std::cout << runs - failedRuns << " of " << runs << " runs match the unpruned blockchain, with at most "
+            << maxKeyBytes << " Bytes of pruned keys" << std::endl;
+  return failedRuns > 0 ? 1 : 0;
+}
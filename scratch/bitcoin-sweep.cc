@@ -0,0 +1,456 @@
+/*
+ * Runs a sweep of selfish mining experiments over the attacker's hash rate, gamma, the block interval and
+ * the protocol type. The sweep is either the full grid of the comma-separated
+ * values given for each parameter, or, with --samples, a random design drawing the continuous parameters
+ * uniformly between the smallest and the largest value given and the others among the values given.
+ *
+ * Each configuration runs in its own forked process, with up to --jobs processes at a time. Every
+ * completed configuration is appended as one json line to --output, keyed by the hash of the configuration.
+ * When the sweep is started again with the same output file, the configurations already in it are skipped,
+ * so an interrupted sweep resumes with the missing ones and never repeats a completed one. The random
+ * design depends only on --designSeed, so it is drawn again identically when resumed.
+ *
+ * The honest hash rate is split equally among --honestMiners miners. The selfish revenue share and the
+ * stale rate are taken from the SelfishMinerStatus shared by the miners, as in selfish-miner-main. The block
+ * broadcast type is not swept: the MY_HONEST_MINER and MY_SELFISH_MINER miners always announce their blocks
+ * with INV/HEADERS, whatever their BlockBroadcastType.
+ */
+
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <set>
+#include <map>
+#include <random>
+#include <algorithm>
+#include <cmath>
+#include <time.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "ns3/core-module.h"
+#include "ns3/network-module.h"
+#include "ns3/internet-module.h"
+#include "ns3/point-to-point-module.h"
+#include "ns3/applications-module.h"
+#include "ns3/point-to-point-layout-module.h"
+
+#include "ns3/selfish-miner-status.h"
+
+using namespace ns3;
+
+typedef struct {
+  double                    attackerHashRate;
+  double                    gamma;
+  double                    blockIntervalMinutes;
+  enum ProtocolType         protocolType;
+  uint32_t                  seed;
+} sweepConfiguration;
+
+double get_wall_time();
+std::vector<double> ParseValues (std::string values);
+std::vector<std::string> ParseNames (std::string names);
+std::string GetConfigurationKey (const sweepConfiguration &config, int targetNumberOfBlocks, int honestMiners);
+std::string GetConfigurationHash (const std::string &key);
+std::set<std::string> ReadCompletedConfigurations (std::string fileName);
+std::string RunSweepConfiguration (const sweepConfiguration &config, int targetNumberOfBlocks, int honestMiners);
+
+NS_LOG_COMPONENT_DEFINE ("BitcoinSweep");
+
+int
+main (int argc, char *argv[])
+{
+  std::string attackerHashRates = "0.1,0.2,0.3,0.4";
+  std::string gammas = "0,0.5,1";
+  std::string blockIntervals = "10";
+  std::string protocols = "STANDARD_PROTOCOL";
+  std::string broadcastTypes;
+  std::string seeds = "1";
+  int targetNumberOfBlocks = 100;
+  int honestMiners = 1;
+  int samples = 0;
+  uint32_t designSeed = 1;
+  int jobs = sysconf (_SC_NPROCESSORS_ONLN);
+  std::string outputFile = "bitcoin-sweep.jsonl";
+
+  CommandLine cmd;
+  cmd.AddValue ("attackerHashRates", "The comma-separated hash rates of the selfish miner", attackerHashRates);
+  cmd.AddValue ("gammas", "The comma-separated gammas of the honest miners", gammas);
+  cmd.AddValue ("blockIntervals", "The comma-separated average block generation intervals in minutes", blockIntervals);
+  cmd.AddValue ("protocols", "The comma-separated protocol types (STANDARD_PROTOCOL, SENDHEADERS)", protocols);
+  cmd.AddValue ("broadcastTypes", "Not supported: the attack miners ignore the block broadcast type", broadcastTypes);
+  cmd.AddValue ("seeds", "The comma-separated seeds every configuration is run with", seeds);
+  cmd.AddValue ("noBlocks", "The number of generated blocks in each run", targetNumberOfBlocks);
+  cmd.AddValue ("honestMiners", "The number of honest miners", honestMiners);
+  cmd.AddValue ("samples", "Run a random design of samples configurations instead of the grid (0 runs the grid)", samples);
+  cmd.AddValue ("designSeed", "The seed of the random design", designSeed);
+  cmd.AddValue ("jobs", "The number of configurations run at the same time", jobs);
+  cmd.AddValue ("output", "The append-only json lines file the results are written to", outputFile);
+  cmd.Parse(argc, argv);
+
+  std::vector<double> hashRateValues = ParseValues (attackerHashRates);
+  std::vector<double> gammaValues = ParseValues (gammas);
+  std::vector<double> intervalValues = ParseValues (blockIntervals);
+  std::vector<double> seedValues = ParseValues (seeds);
+  std::vector<enum ProtocolType> protocolValues;
+
+  for (auto &name : ParseNames (protocols))
+  {
+    if (name == getProtocolType (STANDARD_PROTOCOL))
+      protocolValues.push_back (STANDARD_PROTOCOL);
+    else if (name == getProtocolType (SENDHEADERS))
+      protocolValues.push_back (SENDHEADERS);
+    else
+    {
+      std::cout << "Unknown protocol type " << name << std::endl;
+      return 1;
+    }
+  }
+
+  if (!broadcastTypes.empty ())
+  {
+    std::cout << "The block broadcast type cannot be swept: MY_HONEST_MINER and MY_SELFISH_MINER always announce "
+              << "their blocks with INV/HEADERS" << std::endl;
+    return 1;
+  }
+
+  if (hashRateValues.empty () || gammaValues.empty () || intervalValues.empty () || seedValues.empty ()
+      || protocolValues.empty ())
+  {
+    std::cout << "Every parameter needs at least one value" << std::endl;
+    return 1;
+  }
+
+  if (honestMiners < 1 || jobs < 1)
+  {
+    std::cout << "honestMiners and jobs must be positive" << std::endl;
+    return 1;
+  }
+
+  std::vector<sweepConfiguration> configs;
+
+  if (samples > 0)
+  {
+    std::mt19937 generator (designSeed);
+    auto uniform = [&generator] (const std::vector<double> &values)
+    {
+      std::uniform_real_distribution<double> distribution (*std::min_element (values.begin (), values.end ()),
+                                                           *std::max_element (values.begin (), values.end ()));
+      //Rounded, so that the configuration keys stay readable
+      return std::round (distribution (generator) * 10000) / 10000;
+    };
+    auto pick = [&generator] (size_t size)
+    {
+      return std::uniform_int_distribution<size_t> (0, size - 1) (generator);
+    };
+
+    for (int i = 0; i < samples; i++)
+    {
+      sweepConfiguration config;
+
+      config.attackerHashRate = uniform (hashRateValues);
+      config.gamma = uniform (gammaValues);
+      config.blockIntervalMinutes = uniform (intervalValues);
+      config.protocolType = protocolValues[pick (protocolValues.size ())];
+      config.seed = seedValues[pick (seedValues.size ())];
+      configs.push_back (config);
+    }
+  }
+  else
+  {
+    for (auto &hashRate : hashRateValues)
+      for (auto &gamma : gammaValues)
+        for (auto &interval : intervalValues)
+          for (auto &protocol : protocolValues)
+            for (auto &seed : seedValues)
+              configs.push_back ({hashRate, gamma, interval, protocol, static_cast<uint32_t>(seed)});
+  }
+
+  std::set<std::string> completed = ReadCompletedConfigurations (outputFile);
+  std::vector<int> pending;
+
+  for (int i = 0; i < static_cast<int>(configs.size ()); i++)
+  {
+    std::string hash = GetConfigurationHash (GetConfigurationKey (configs[i], targetNumberOfBlocks, honestMiners));
+
+    //The same point may be drawn twice by the random design
+    if (completed.insert (hash).second)
+      pending.push_back (i);
+  }
+
+  std::cout << "The sweep has " << configs.size () << " configurations, " << configs.size () - pending.size ()
+            << " of them already in " << outputFile << std::endl;
+
+  std::ofstream output (outputFile.c_str (), std::ios::out | std::ios::app);
+  if (!output.is_open ())
+  {
+    std::cout << "Cannot open " << outputFile << std::endl;
+    return 1;
+  }
+
+  std::map<pid_t, std::pair<int, int>> running;   //pid -> (configuration, read end of its pipe)
+  size_t next = 0;
+  int failed = 0;
+
+  while (next < pending.size () || !running.empty ())
+  {
+    while (next < pending.size () && static_cast<int>(running.size ()) < jobs)
+    {
+      int index = pending[next++];
+      int fds[2];
+
+      if (pipe (fds) != 0)
+      {
+        std::cout << "Cannot create a pipe" << std::endl;
+        return 1;
+      }
+
+      pid_t pid = fork ();
+
+      if (pid == 0)
+      {
+        //The models print to std::cout, so the result is passed through the pipe
+        close (fds[0]);
+        if (freopen ("/dev/null", "w", stdout) == NULL)
+          _exit (1);
+
+        std::string result = RunSweepConfiguration (configs[index], targetNumberOfBlocks, honestMiners);
+        ssize_t written = write (fds[1], result.c_str (), result.size ());
+        close (fds[1]);
+        _exit (written == static_cast<ssize_t>(result.size ()) ? 0 : 1);
+      }
+
+      close (fds[1]);
+      if (pid < 0)
+      {
+        close (fds[0]);
+        std::cout << "Cannot fork configuration " << index << std::endl;
+        failed++;
+        continue;
+      }
+
+      running[pid] = std::make_pair (index, fds[0]);
+      std::cout << "Running configuration " << index << std::endl;
+    }
+
+    if (running.empty ())
+      break;
+
+    int status = 0;
+    pid_t pid = waitpid (-1, &status, 0);
+    std::map<pid_t, std::pair<int, int>>::iterator it = running.find (pid);
+
+    if (it == running.end ())
+      continue;
+
+    int index = it->second.first;
+    std::string result;
+    char buffer[4096];
+    ssize_t count;
+
+    while ((count = read (it->second.second, buffer, sizeof(buffer))) > 0)
+      result.append (buffer, count);
+    close (it->second.second);
+    running.erase (it);
+
+    if (!WIFEXITED (status) || WEXITSTATUS (status) != 0 || result.empty ())
+    {
+      std::cout << "Configuration " << index << " failed" << std::endl;
+      failed++;
+      continue;
+    }
+
+    std::string key = GetConfigurationKey (configs[index], targetNumberOfBlocks, honestMiners);
+
+    //One complete line per configuration, flushed at once, so that an interrupted sweep leaves no partial results
+    output << "{\"hash\": \"" << GetConfigurationHash (key) << "\", \"key\": \"" << key
+           << "\", \"results\": " << result << "}" << std::endl;
+    std::cout << "Configuration " << index << ": " << result << std::endl;
+  }
+
+  output.close ();
+
+  std::cout << "The sweep finished with " << failed << " failed configurations" << std::endl;
+  return failed == 0 ? 0 : 1;
+}
+
+
+std::vector<double> ParseValues (std::string values)
+{
+  std::vector<double> parsed;
+
+  for (auto &value : ParseNames (values))
+    parsed.push_back (atof (value.c_str ()));
+  return parsed;
+}
+
+
+std::vector<std::string> ParseNames (std::string names)
+{
+  std::vector<std::string> parsed;
+  std::istringstream stream (names);
+  std::string name;
+
+  while (std::getline (stream, name, ','))
+  {
+    if (!name.empty ())
+      parsed.push_back (name);
+  }
+  return parsed;
+}
+
+
+std::string GetConfigurationKey (const sweepConfiguration &config, int targetNumberOfBlocks, int honestMiners)
+{
+  std::ostringstream key;
+
+  key << std::setprecision (12)
+      << "attackerHashRate=" << config.attackerHashRate
+      << ";gamma=" << config.gamma
+      << ";blockIntervalMinutes=" << config.blockIntervalMinutes
+      << ";protocol=" << getProtocolType (config.protocolType)
+      << ";seed=" << config.seed
+      << ";noBlocks=" << targetNumberOfBlocks
+      << ";honestMiners=" << honestMiners;
+  return key.str ();
+}
+
+
+/**
+ * The 64-bit FNV-1a hash of the configuration key, in hex
+ */
+std::string GetConfigurationHash (const std::string &key)
+{
+  uint64_t hash = 14695981039346656037ULL;
+  std::ostringstream hex;
+
+  for (auto &c : key)
+  {
+    hash ^= static_cast<unsigned char>(c);
+    hash *= 1099511628211ULL;
+  }
+
+  hex << std::hex << std::setw (16) << std::setfill ('0') << hash;
+  return hex.str ();
+}
+
+
+std::set<std::string> ReadCompletedConfigurations (std::string fileName)
+{
+  std::set<std::string> completed;
+  std::ifstream file (fileName.c_str ());
+  std::string line;
+  const std::string prefix = "{\"hash\": \"";
+
+  while (std::getline (file, line))
+  {
+    //A line cut by a crash is not a completed configuration
+    if (line.compare (0, prefix.size (), prefix) != 0 || line[line.size () - 1] != '}')
+      continue;
+
+    completed.insert (line.substr (prefix.size (), 16));
+  }
+  return completed;
+}
+
+
+std::string RunSweepConfiguration (const sweepConfiguration &config, int targetNumberOfBlocks, int honestMiners)
+{
+  const int secsPerMin = 60;
+  const uint16_t bitcoinPort = 8333;
+  double averageBlockGenIntervalSeconds = config.blockIntervalMinutes * secsPerMin;
+  double stop = targetNumberOfBlocks * config.blockIntervalMinutes;
+  double tStart = get_wall_time();
+  int noMiners = honestMiners + 1;
+  int attackerId = noMiners - 1;
+
+  enum BitcoinRegion bitcoinMinersRegions[] = {ASIA_PACIFIC, ASIA_PACIFIC, NORTH_AMERICA, ASIA_PACIFIC, NORTH_AMERICA,
+                                               EUROPE, EUROPE, NORTH_AMERICA, NORTH_AMERICA, NORTH_AMERICA, EUROPE,
+                                               NORTH_AMERICA, NORTH_AMERICA, NORTH_AMERICA, NORTH_AMERICA, ASIA_PACIFIC};
+  std::vector<enum BitcoinRegion> minersRegions (noMiners);
+  std::vector<minerSpecification> minersSpecifications (noMiners);
+  nodeStatistics *stats = new nodeStatistics[noMiners];
+  blockchain_attacks::SelfishMinerStatus selfishStatus = blockchain_attacks::SelfishMinerStatus ();
+
+  srand (config.seed);
+  RngSeedManager::SetSeed (config.seed);
+  Time::SetResolution (Time::NS);
+
+  for (int i = 0; i < noMiners; i++)
+    minersRegions[i] = bitcoinMinersRegions[i % 16];
+
+  BitcoinTopologyHelper bitcoinTopologyHelper (1, noMiners, noMiners, minersRegions.data (),
+                                               BITCOIN, 1, honestMiners, 2, 0);
+  InternetStackHelper stack;
+  bitcoinTopologyHelper.InstallStack (stack);
+  bitcoinTopologyHelper.AssignIpv4Addresses (Ipv4AddressHelperCustom ("1.0.0.0", "255.255.255.252", false));
+
+  for (int i = 0; i < noMiners; i++)
+  {
+    int miner = bitcoinTopologyHelper.GetMiners ()[i];
+
+    minersSpecifications[i].minerType = (miner == attackerId) ? MY_SELFISH_MINER : MY_HONEST_MINER;
+    minersSpecifications[i].hashRate = (miner == attackerId) ? config.attackerHashRate
+                                                             : (1 - config.attackerHashRate) / honestMiners;
+    minersSpecifications[i].gamma = config.gamma;
+    minersSpecifications[i].blockBroadcastType = STANDARD;
+    minersSpecifications[i].fixedBlockIntervalGeneration = 0;
+  }
+
+  BitcoinNetworkHelper bitcoinNetworkHelper ("ns3::TcpSocketFactory", InetSocketAddress (Ipv4Address::GetAny (), bitcoinPort),
+                                             bitcoinTopologyHelper, minersSpecifications, stats, averageBlockGenIntervalSeconds);
+  bitcoinNetworkHelper.SetProtocolType (config.protocolType);
+  bitcoinNetworkHelper.SetSeed (config.seed);
+  bitcoinNetworkHelper.SetSelfishStatus (&selfishStatus);
+
+  ApplicationContainer bitcoinMiners = bitcoinNetworkHelper.InstallMiners (0);
+  bitcoinMiners.Start (Seconds (0));
+  bitcoinMiners.Stop (Minutes (stop));
+
+  Ipv4GlobalRoutingHelper::PopulateRoutingTables ();
+
+  double tStartSimulation = get_wall_time();
+  Simulator::Stop (Minutes (stop + 0.1));
+  Simulator::Run ();
+  Simulator::Destroy ();
+  double tFinish = get_wall_time();
+
+  int winBlock = selfishStatus.SelfishMinerWinBlock + selfishStatus.HonestMinerWinBlock;
+
+  //Weighted by the blocks received by each node, as in bitcoin-test
+  double meanBlockPropagationTime = 0;
+  long   totalBlocks = 0;
+  for (int i = 0; i < noMiners; i++)
+  {
+    if (totalBlocks + stats[i].totalBlocks == 0)
+      continue;
+    meanBlockPropagationTime = meanBlockPropagationTime*totalBlocks/(totalBlocks + stats[i].totalBlocks)
+                               + stats[i].meanBlockPropagationTime*stats[i].totalBlocks/(totalBlocks + stats[i].totalBlocks);
+    totalBlocks += stats[i].totalBlocks;
+  }
+
+  std::ostringstream result;
+  result << "{\"minedBlocks\": " << selfishStatus.MinedBlock
+         << ", \"selfishWinBlocks\": " << selfishStatus.SelfishMinerWinBlock
+         << ", \"honestWinBlocks\": " << selfishStatus.HonestMinerWinBlock
+         << ", \"selfishRevenueShare\": " << (winBlock > 0 ? static_cast<double>(selfishStatus.SelfishMinerWinBlock) / winBlock : 0)
+         << ", \"staleRate\": " << (selfishStatus.MinedBlock > 0 ? static_cast<double>(selfishStatus.MinedBlock - winBlock) / selfishStatus.MinedBlock : 0)
+         << ", \"attackSuccess\": " << stats[attackerId].attackSuccess
+         << ", \"meanBlockPropagationTime\": " << meanBlockPropagationTime
+         << ", \"setupSeconds\": " << tStartSimulation - tStart
+         << ", \"simulateSeconds\": " << tFinish - tStartSimulation << "}";
+
+  delete[] stats;
+  return result.str ();
+}
+
+
+double get_wall_time()
+{
+    struct timeval time;
+    if (gettimeofday(&time,NULL)){
+        //  Handle error
+        return 0;
+    }
+    return (double)time.tv_sec + (double)time.tv_usec * .000001;
+}
@@ -15,6 +15,7 @@
  */
 
 #include <fstream>
+#include <sstream>
 #include <time.h>
 #include <sys/time.h>
 #include "ns3/core-module.h"
@@ -33,10 +34,11 @@
 using namespace ns3;
 
 double get_wall_time();
-int GetNodeIdByIpv4 (Ipv4InterfaceContainer container, Ipv4Address addr);
 void PrintStatsForEachNode (nodeStatistics *stats, int totalNodes);
 void PrintTotalStats (nodeStatistics *stats, int totalNodes, double start, double finish, double averageBlockGenIntervalMinutes, bool relayNetwork);
 void PrintBitcoinRegionStats (uint32_t *bitcoinNodesRegions, uint32_t totalNodes);
+void MergeSketches (ApplicationContainer apps, BitcoinQuantileSketch *sketches);
+void PrintSketches (BitcoinQuantileSketch *sketches);
 
 NS_LOG_COMPONENT_DEFINE ("MyMpiTest");
 
@@ -54,6 +56,18 @@ main (int argc, char *argv[])
   bool sendheaders = false;
   bool blockTorrent = false;
   bool spv = false;
+  bool profileEvents = false;
+  double memorySampleSeconds = 0;
+  double statsSampleMinutes = 0;
+  std::string statsFile = "stats";
+  std::string statsExport = "";
+  bool statsExportBinary = false;
+  double checkpointMinutes = 0;
+  std::string checkpointFile = "checkpoint";
+  std::string restoreFile = "";
+  std::string propagationTrace = "";
+  double sketchAccuracy = 0.01;
+  int finalityDepth = 0;
   long blockSize = -1;
   int invTimeoutMins = -1;
   int chunkSize = -1;
@@ -112,12 +126,6 @@ main (int argc, char *argv[])
   double averageBlockGenIntervalMinutes = averageBlockGenIntervalSeconds/secsPerMin;
   double stop;
 
-  Ipv4InterfaceContainer                               ipv4InterfaceContainer;
-  std::map<uint32_t, std::vector<Ipv4Address>>         nodesConnections;
-  std::map<uint32_t, std::map<Ipv4Address, double>>    peersDownloadSpeeds;
-  std::map<uint32_t, std::map<Ipv4Address, double>>    peersUploadSpeeds;
-  std::map<uint32_t, nodeInternetSpeeds>               nodesInternetSpeeds;
-  std::vector<uint32_t>                                miners;
   int                                                  nodesInSystemId0 = 0;
   
   Time::SetResolution (Time::NS);
@@ -142,6 +150,18 @@ main (int argc, char *argv[])
   cmd.AddValue ("dogecoin", "Imitate the litecoin network behaviour", dogecoin);
   cmd.AddValue ("blockTorrent", "Enable the BlockTorrent protocol", blockTorrent);
   cmd.AddValue ("spv", "Enable the spv mechanism", spv);
+  cmd.AddValue ("profileEvents", "Count and time the events of the bitcoin applications", profileEvents);
+  cmd.AddValue ("memorySampleSeconds", "Sample the memory usage of the nodes every memorySampleSeconds (0 disables sampling)", memorySampleSeconds);
+  cmd.AddValue ("statsSampleMinutes", "Append a snapshot of the node stats to statsFile-<systemId>.csv every statsSampleMinutes (0 disables snapshots)", statsSampleMinutes);
+  cmd.AddValue ("statsFile", "The prefix of the stats snapshot files", statsFile);
+  cmd.AddValue ("statsExport", "Write the stats of every node to statsExport instead of printing them (empty disables the export)", statsExport);
+  cmd.AddValue ("statsExportBinary", "Write statsExport in the binary columnar format instead of csv", statsExportBinary);
+  cmd.AddValue ("checkpointMinutes", "Save the state of the nodes to checkpointFile-<systemId>.json at checkpointMinutes (0 disables checkpoints)", checkpointMinutes);
+  cmd.AddValue ("checkpointFile", "The prefix of the checkpoint files", checkpointFile);
+  cmd.AddValue ("propagationTrace", "Record every validated block to propagationTrace-<systemId>.bin (empty disables the trace)", propagationTrace);
+  cmd.AddValue ("sketchAccuracy", "The relative accuracy of the quantile sketches of the nodes (0 disables the sketches)", sketchAccuracy);
+  cmd.AddValue ("finalityDepth", "Collapse the forks of the blockchains finalityDepth blocks below the top (0 keeps every block)", finalityDepth);
+  cmd.AddValue ("restore", "Start the nodes from the checkpoint restore-<systemId>.json instead of the genesis block", restoreFile);
 
   cmd.Parse(argc, argv);
  
@@ -254,135 +274,114 @@ main (int argc, char *argv[])
   bitcoinTopologyHelper.InstallStack (stack);
 
   // Assign Addresses to Grid
-  bitcoinTopologyHelper.AssignIpv4Addresses (Ipv4AddressHelperCustom ("1.0.0.0", "255.255.255.0", false));
-  ipv4InterfaceContainer = bitcoinTopologyHelper.GetIpv4InterfaceContainer();
-  nodesConnections = bitcoinTopologyHelper.GetNodesConnectionsIps();
-  miners = bitcoinTopologyHelper.GetMiners();
-  peersDownloadSpeeds = bitcoinTopologyHelper.GetPeersDownloadSpeeds();
-  peersUploadSpeeds = bitcoinTopologyHelper.GetPeersUploadSpeeds();
-  nodesInternetSpeeds = bitcoinTopologyHelper.GetNodesInternetSpeeds();
+  bitcoinTopologyHelper.AssignIpv4Addresses (Ipv4AddressHelperCustom ("1.0.0.0", "255.255.255.252", false));
   if (systemId == 0)
     PrintBitcoinRegionStats(bitcoinTopologyHelper.GetBitcoinNodesRegions(), totalNoNodes);
 											   
-  //Install miners
-  BitcoinMinerHelper bitcoinMinerHelper ("ns3::TcpSocketFactory", InetSocketAddress (Ipv4Address::GetAny (), bitcoinPort),
-                                          nodesConnections[miners[0]], noMiners, peersDownloadSpeeds[0], peersUploadSpeeds[0],
-                                          nodesInternetSpeeds[0], stats, minersHash[0], averageBlockGenIntervalSeconds);
-  ApplicationContainer bitcoinMiners;
-  int count = 0;
-  if (testScalability == true)
+  //Install miners and simple nodes
+  std::vector<minerSpecification> minersSpecifications (noMiners);
+  enum BlockBroadcastType blockBroadcastType = STANDARD;
+
+  if(unsolicited)
+    blockBroadcastType = UNSOLICITED;
+  if(relayNetwork)
+    blockBroadcastType = RELAY_NETWORK;
+  if(unsolicitedRelayNetwork)
+    blockBroadcastType = UNSOLICITED_RELAY_NETWORK;
+
+  for(int i = 0; i < noMiners; i++)
   {
-    bitcoinMinerHelper.SetAttribute("FixedBlockIntervalGeneration", DoubleValue(averageBlockGenIntervalSeconds));
+    minersSpecifications[i].minerType = NORMAL_MINER;
+    minersSpecifications[i].hashRate = minersHash[i];
+    minersSpecifications[i].gamma = 0;
+    minersSpecifications[i].blockBroadcastType = blockBroadcastType;
+    minersSpecifications[i].fixedBlockIntervalGeneration = 0;
+	
+    if (testScalability == true)
+      minersSpecifications[i].fixedBlockIntervalGeneration = (i == 0 ? 1 : 3) * averageBlockGenIntervalSeconds;
   }
+
+  BitcoinNetworkHelper bitcoinNetworkHelper ("ns3::TcpSocketFactory", InetSocketAddress (Ipv4Address::GetAny (), bitcoinPort),
+                                             bitcoinTopologyHelper, minersSpecifications, stats, averageBlockGenIntervalSeconds);
   
-  for(auto &miner : miners)
-  {
-	Ptr<Node> targetNode = bitcoinTopologyHelper.GetNode (miner);
-	
-	if (systemId == targetNode->GetSystemId())
-	{
-      bitcoinMinerHelper.SetAttribute("HashRate", DoubleValue(minersHash[count]));
-	  
-      if (invTimeoutMins != -1)	 
-        bitcoinMinerHelper.SetAttribute("InvTimeoutMinutes", TimeValue (Minutes (invTimeoutMins)));
-      else 	  
-        bitcoinMinerHelper.SetAttribute("InvTimeoutMinutes", TimeValue (Minutes (2*averageBlockGenIntervalMinutes)));
-
-      if (litecoin)	  
-        bitcoinMinerHelper.SetAttribute("Cryptocurrency", UintegerValue (LITECOIN));	  
-      else if (dogecoin)	  
-        bitcoinMinerHelper.SetAttribute("Cryptocurrency", UintegerValue (DOGECOIN));
-	
-      if (blockSize != -1)	  
-        bitcoinMinerHelper.SetAttribute("FixedBlockSize", UintegerValue(blockSize));
-
-      if (sendheaders)	  
-        bitcoinMinerHelper.SetProtocolType(SENDHEADERS);	  
-      if (blockTorrent)	
-      {		  
-        bitcoinMinerHelper.SetAttribute("BlockTorrent", BooleanValue(true));
-        if (chunkSize != -1)
-          bitcoinMinerHelper.SetAttribute("ChunkSize", UintegerValue(chunkSize));
-        if (spv)
-          bitcoinMinerHelper.SetAttribute("SPV", BooleanValue(true));
-	  }
-      bitcoinMinerHelper.SetPeersAddresses (nodesConnections[miner]);
-	  bitcoinMinerHelper.SetPeersDownloadSpeeds (peersDownloadSpeeds[miner]);
-	  bitcoinMinerHelper.SetPeersUploadSpeeds (peersUploadSpeeds[miner]);
-	  bitcoinMinerHelper.SetNodeInternetSpeeds (nodesInternetSpeeds[miner]);
-	  bitcoinMinerHelper.SetNodeStats (&stats[miner]);
-      
-	  if(unsolicited)
-	    bitcoinMinerHelper.SetBlockBroadcastType (UNSOLICITED);
-	  if(relayNetwork)
-	    bitcoinMinerHelper.SetBlockBroadcastType (RELAY_NETWORK);
-	  if(unsolicitedRelayNetwork)
-	    bitcoinMinerHelper.SetBlockBroadcastType (UNSOLICITED_RELAY_NETWORK);
+  if (invTimeoutMins != -1)	 
+    bitcoinNetworkHelper.SetAttribute("InvTimeoutMinutes", TimeValue (Minutes (invTimeoutMins)));
+  else 	  
+    bitcoinNetworkHelper.SetAttribute("InvTimeoutMinutes", TimeValue (Minutes (2*averageBlockGenIntervalMinutes)));
+
+  if (litecoin)	  
+    bitcoinNetworkHelper.SetMinerAttribute("Cryptocurrency", UintegerValue (LITECOIN));	  
+  else if (dogecoin)	  
+    bitcoinNetworkHelper.SetMinerAttribute("Cryptocurrency", UintegerValue (DOGECOIN));
 	
-	  bitcoinMiners.Add(bitcoinMinerHelper.Install (targetNode));
-/*       std::cout << "SystemId " << systemId << ": Miner " << miner << " with hash power = " << minersHash[count] 
-	            << " and systemId = " << targetNode->GetSystemId() << " was installed in node " 
-                << targetNode->GetId () << std::endl;  */
-	  
-	  if (systemId == 0)
-        nodesInSystemId0++;
-	}				
-	count++;
-	if (testScalability == true)
-	{
-	  bitcoinMinerHelper.SetAttribute("FixedBlockIntervalGeneration", DoubleValue(3*averageBlockGenIntervalSeconds));
-	}
+  if (blockSize != -1)	  
+    bitcoinNetworkHelper.SetMinerAttribute("FixedBlockSize", UintegerValue(blockSize));
+
+  bitcoinNetworkHelper.SetAttribute("SketchRelativeAccuracy", DoubleValue(sketchAccuracy));
+  bitcoinNetworkHelper.SetAttribute("FinalityDepth", UintegerValue(finalityDepth));
+
+  if (sendheaders)	  
+    bitcoinNetworkHelper.SetProtocolType(SENDHEADERS);	  
+  if (blockTorrent)	
+  {		  
+    bitcoinNetworkHelper.SetAttribute("BlockTorrent", BooleanValue(true));
+    if (chunkSize != -1)
+      bitcoinNetworkHelper.SetAttribute("ChunkSize", UintegerValue(chunkSize));
+    if (spv)
+      bitcoinNetworkHelper.SetAttribute("SPV", BooleanValue(true));
   }
+
+  ApplicationContainer bitcoinMiners = bitcoinNetworkHelper.InstallMiners (systemId);
   bitcoinMiners.Start (Seconds (start));
   bitcoinMiners.Stop (Minutes (stop));
 
-  
-  //Install simple nodes
-  BitcoinNodeHelper bitcoinNodeHelper ("ns3::TcpSocketFactory", InetSocketAddress (Ipv4Address::GetAny (), bitcoinPort), 
-                                        nodesConnections[0], peersDownloadSpeeds[0],  peersUploadSpeeds[0], nodesInternetSpeeds[0], stats);
-  ApplicationContainer bitcoinNodes;
-  
-  for(auto &node : nodesConnections)
-  {
-    Ptr<Node> targetNode = bitcoinTopologyHelper.GetNode (node.first);
-	
-	if (systemId == targetNode->GetSystemId())
-	{
-  
-      if ( std::find(miners.begin(), miners.end(), node.first) == miners.end() )
-	  {
-	    if (invTimeoutMins != -1)	 
-	      bitcoinNodeHelper.SetAttribute("InvTimeoutMinutes", TimeValue (Minutes (invTimeoutMins)));
-	    else 	  
-          bitcoinNodeHelper.SetAttribute("InvTimeoutMinutes", TimeValue (Minutes (2*averageBlockGenIntervalMinutes)));
-	    bitcoinNodeHelper.SetPeersAddresses (node.second);
-	    bitcoinNodeHelper.SetPeersDownloadSpeeds (peersDownloadSpeeds[node.first]);
-	    bitcoinNodeHelper.SetPeersUploadSpeeds (peersUploadSpeeds[node.first]);
-	    bitcoinNodeHelper.SetNodeInternetSpeeds (nodesInternetSpeeds[node.first]);
-		bitcoinNodeHelper.SetNodeStats (&stats[node.first]);
-		
-        if (sendheaders)	  
-          bitcoinNodeHelper.SetProtocolType(SENDHEADERS);	
-        if (blockTorrent)	  
-        {
-          bitcoinNodeHelper.SetAttribute("BlockTorrent", BooleanValue(true));
-          if (chunkSize != -1)
-            bitcoinNodeHelper.SetAttribute("ChunkSize", UintegerValue(chunkSize));
-          if (spv)
-            bitcoinNodeHelper.SetAttribute("SPV", BooleanValue(true));
-		}
-	    bitcoinNodes.Add(bitcoinNodeHelper.Install (targetNode));
-/*         std::cout << "SystemId " << systemId << ": Node " << node.first << " with systemId = " << targetNode->GetSystemId() 
-		          << " was installed in node " << targetNode->GetId () <<  std::endl; */
-				  
-	    if (systemId == 0)
-          nodesInSystemId0++;
-	  }	
-	}	  
-  }
+  ApplicationContainer bitcoinNodes = bitcoinNetworkHelper.InstallNodes (systemId);
   bitcoinNodes.Start (Seconds (start));
   bitcoinNodes.Stop (Minutes (stop));
+
+  if (systemId == 0)
+    nodesInSystemId0 = bitcoinMiners.GetN () + bitcoinNodes.GetN ();
   
+  BitcoinMemorySampler memorySampler (bitcoinMiners);
+  if (memorySampleSeconds > 0)
+  {
+    std::ostringstream memoryFile;
+    memoryFile << "memory-usage-" << systemId << ".csv";
+
+    memorySampler.Add (bitcoinNodes);
+    memorySampler.Start (Seconds (memorySampleSeconds), memoryFile.str ());
+  }
+
+  BitcoinStatsSampler statsSampler (bitcoinMiners);
+  if (statsSampleMinutes > 0)
+  {
+    std::ostringstream statsFileName;
+    statsFileName << statsFile << "-" << systemId << ".csv";
+
+    statsSampler.Add (bitcoinNodes);
+    statsSampler.Start (Minutes (statsSampleMinutes), statsFileName.str ());
+  }
+
+  BitcoinCheckpoint checkpoint (bitcoinMiners);
+  checkpoint.Add (bitcoinNodes);
+  if (restoreFile != "")
+  {
+    std::ostringstream restoreFileName;
+    restoreFileName << restoreFile << "-" << systemId << ".json";
+
+    Time restoreTime = checkpoint.Restore (restoreFileName.str ());
+    bitcoinMiners.Start (restoreTime);
+    bitcoinNodes.Start (restoreTime);
+    if (systemId == 0)
+      std::cout << "The nodes will be restored at " << restoreTime.GetMinutes () << "mins.\n";
+  }
+  if (checkpointMinutes > 0)
+  {
+    std::ostringstream checkpointFileName;
+    checkpointFileName << checkpointFile << "-" << systemId << ".json";
+    checkpoint.Save (Minutes (checkpointMinutes), checkpointFileName.str ());
+  }
+
   if (systemId == 0)
     std::cout << "The applications have been setup.\n";
   
@@ -391,8 +390,35 @@ main (int argc, char *argv[])
   tStartSimulation = get_wall_time();
   if (systemId == 0)
     std::cout << "Setup time = " << tStartSimulation - tStart << "s\n";
+  if (profileEvents)
+    BitcoinEventProfiler::Enable ();
+  if (!propagationTrace.empty ())
+  {
+    std::ostringstream propagationTraceFileName;
+    propagationTraceFileName << propagationTrace << "-" << systemId << ".bin";
+    BitcoinPropagationTrace::Open (propagationTraceFileName.str (), systemId);
+  }
   Simulator::Stop (Minutes (stop + 0.1));
   Simulator::Run ();
+  BitcoinPropagationTrace::Close ();
+
+  //The receive times, propagation times and sizes of the blocks over all the nodes of this system
+  BitcoinQuantileSketch sketches[] = {BitcoinQuantileSketch (sketchAccuracy > 0 ? sketchAccuracy : 0.01),
+                                      BitcoinQuantileSketch (sketchAccuracy > 0 ? sketchAccuracy : 0.01),
+                                      BitcoinQuantileSketch (sketchAccuracy > 0 ? sketchAccuracy : 0.01)};
+  const int noSketches = sizeof(sketches)/sizeof(BitcoinQuantileSketch);
+  MergeSketches (bitcoinMiners, sketches);
+  MergeSketches (bitcoinNodes, sketches);
+  if (profileEvents)
+  {
+    std::cout << "SystemId " << systemId << ":";
+    BitcoinEventProfiler::Print (std::cout, Simulator::Now ().GetSeconds ());
+  }
+  if (memorySampleSeconds > 0)
+  {
+    std::cout << "SystemId " << systemId << ":";
+    memorySampler.PrintBreakdown (std::cout);
+  }
   Simulator::Destroy ();
 
 #ifdef MPI_TEST
@@ -519,14 +545,65 @@ main (int argc, char *argv[])
 	  count++;
     }
   }	  
+
+  if (sketchAccuracy > 0 && systemCount > 1)
+  {
+    /**
+     * Merge the sketches of all the systemIds in systemId == 0
+     */
+    std::vector<double> values;
+
+    if (systemId != 0)
+    {
+      for (int i = 0; i < noSketches; i++)
+      {
+        sketches[i].ToVector (values);
+        int size = values.size ();
+        MPI_Send(&size, 1, MPI_INT, 0, 8889, MPI_COMM_WORLD);
+        MPI_Send(values.data (), size, MPI_DOUBLE, 0, 8890, MPI_COMM_WORLD);
+      }
+    }
+    else
+    {
+      for (uint32_t source = 1; source < systemCount; source++)
+      {
+        for (int i = 0; i < noSketches; i++)
+        {
+          MPI_Status status;
+          BitcoinQuantileSketch recv;
+          int size;
+
+          MPI_Recv(&size, 1, MPI_INT, source, 8889, MPI_COMM_WORLD, &status);
+          values.resize (size);
+          MPI_Recv(values.data (), size, MPI_DOUBLE, source, 8890, MPI_COMM_WORLD, &status);
+          recv.FromVector (values);
+          sketches[i].Merge (recv);
+        }
+      }
+    }
+  }
 #endif
 
   if (systemId == 0)
   {
     tFinish=get_wall_time();
 	
-    //PrintStatsForEachNode(stats, totalNoNodes);
-    PrintTotalStats(stats, totalNoNodes, tStartSimulation, tFinish, averageBlockGenIntervalMinutes, relayNetwork);
+    if (statsExport.empty ())
+    {
+      //PrintStatsForEachNode(stats, totalNoNodes);
+      PrintTotalStats(stats, totalNoNodes, tStartSimulation, tFinish, averageBlockGenIntervalMinutes, relayNetwork);
+    }
+    else
+    {
+      BitcoinStatsExporter exporter (statsExport, statsExportBinary ? STATS_BINARY : STATS_CSV);
+
+      exporter.Add (stats, totalNoNodes, bitcoinTopologyHelper.GetBitcoinNodesRegions());
+      exporter.Close ();
+      exporter.PrintTotals (std::cout);
+      std::cout << "The stats of " << exporter.GetRows () << " nodes were written to " << statsExport << "\n";
+    }
+    if (sketchAccuracy > 0)
+      PrintSketches(sketches);
 	
     if(unsolicited)
       std::cout << "The broadcast type was UNSOLICITED.\n";
@@ -570,17 +647,6 @@ double get_wall_time()
     return (double)time.tv_sec + (double)time.tv_usec * .000001;
 }
 
-int GetNodeIdByIpv4 (Ipv4InterfaceContainer container, Ipv4Address addr)
-{
-  for (auto it = container.Begin(); it != container.End(); it++)
-  {
-	int32_t interface = it->first->GetInterfaceForAddress (addr);
-	if ( interface != -1)
-      return it->first->GetNetDevice (interface)-> GetNode()->GetId();
-  }	  
-  return -1; //if not found
-}
-
 void PrintStatsForEachNode (nodeStatistics *stats, int totalNodes)
 {
   int secPerMin = 60;
@@ -933,6 +999,35 @@ void PrintTotalStats (nodeStatistics *stats, int totalNodes, double start, doubl
   std::cout << "\n";
 }
 
+void MergeSketches (ApplicationContainer apps, BitcoinQuantileSketch *sketches)
+{
+  for (ApplicationContainer::Iterator i = apps.Begin (); i != apps.End (); ++i)
+  {
+    Ptr<BitcoinNode> node = DynamicCast<BitcoinNode> (*i);
+
+    sketches[0].Merge (node->GetBlockReceiveTimeSketch ());
+    sketches[1].Merge (node->GetBlockPropagationTimeSketch ());
+    sketches[2].Merge (node->GetBlockSizeSketch ());
+  }
+}
+
+
+void PrintSketches (BitcoinQuantileSketch *sketches)
+{
+  const char *names[] = {"Block Receive Time (s)", "Block Propagation Time (s)", "Block Size (Bytes)"};
+  const double quantiles[] = {0.1, 0.25, 0.5, 0.75, 0.9, 0.99};
+
+  std::cout << "\nNetwork-wide distributions (within " << sketches[0].GetRelativeAccuracy () * 100 << "%):\n";
+  for (int i = 0; i < 3; i++)
+  {
+    std::cout << names[i] << ": samples = " << sketches[i].GetCount () << ", mean = " << sketches[i].GetMean ();
+    for (auto &q : quantiles)
+      std::cout << ", p" << q * 100 << " = " << sketches[i].GetQuantile (q);
+    std::cout << ", max = " << sketches[i].GetMax () << "\n";
+  }
+}
+
+
 void PrintBitcoinRegionStats (uint32_t *bitcoinNodesRegions, uint32_t totalNodes)
 {
   uint32_t regions[7] = {0, 0, 0, 0, 0, 0, 0};
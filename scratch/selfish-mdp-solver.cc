@@ -0,0 +1,93 @@
+/*
+ * Computes the decision matrices of the BitcoinSelfishMiner with BitcoinSelfishMdp for the grid of the
+ * comma-separated values given for alpha, gamma, the stale rate and the double-spend value, on --threads
+ * threads. Every matrix is kept in --cacheDir, in a file named after its parameters, and the points already
+ * in the cache are not solved again. The relative revenue and the file of each point are printed; a file
+ * is given to the selfish miner with the DecisionMatrixFile attribute, e.g. by selfish-miner-test --decisionMatrix.
+ */
+
+#include <sstream>
+#include <iomanip>
+#include <sys/stat.h>
+#include "ns3/core-module.h"
+#include "ns3/applications-module.h"
+
+using namespace ns3;
+
+std::vector<double> ParseValues (std::string values);
+
+NS_LOG_COMPONENT_DEFINE ("SelfishMdpSolver");
+
+int
+main (int argc, char *argv[])
+{
+  std::string alphas = "0.1,0.2,0.3,0.4";
+  std::string gammas = "0";
+  std::string staleRates = "0.01";
+  std::string doubleSpendValues = "0";
+  int confirmations = 6;
+  int cutoff = 20;
+  int threads = 0;
+  std::string cacheDir = "selfish-mdp-cache";
+
+  CommandLine cmd;
+  cmd.AddValue ("alphas", "The comma-separated hash rates of the attacker", alphas);
+  cmd.AddValue ("gammas", "The comma-separated gammas of the honest miners", gammas);
+  cmd.AddValue ("staleRates", "The comma-separated stale block rates", staleRates);
+  cmd.AddValue ("doubleSpendValues", "The comma-separated double-spent values in block rewards (0 for selfish mining)", doubleSpendValues);
+  cmd.AddValue ("confirmations", "The confirmations the merchant waits for", confirmations);
+  cmd.AddValue ("cutoff", "The maximum attack blocks of the matrices", cutoff);
+  cmd.AddValue ("threads", "The threads solving the points (0 uses all the cores)", threads);
+  cmd.AddValue ("cacheDir", "The directory the matrices are kept in", cacheDir);
+  cmd.Parse(argc, argv);
+
+  std::vector<selfishMdpParameters> points;
+
+  for (auto &alpha : ParseValues (alphas))
+    for (auto &gamma : ParseValues (gammas))
+      for (auto &staleRate : ParseValues (staleRates))
+        for (auto &doubleSpendValue : ParseValues (doubleSpendValues))
+        {
+          selfishMdpParameters point = {alpha, gamma, staleRate, doubleSpendValue, confirmations, cutoff};
+          points.push_back (point);
+        }
+
+  if (points.empty ())
+  {
+    std::cout << "The grid is empty" << std::endl;
+    return 1;
+  }
+
+  mkdir (cacheDir.c_str (), 0755);
+
+  std::vector<std::string> files;
+  std::vector<double> revenues;
+  int solved = BitcoinSelfishMdp::SolveGrid (points, cacheDir, threads, files, revenues);
+
+  std::cout << "Solved " << solved << " of " << points.size () << " points (" << points.size () - solved
+            << " were cached in " << cacheDir << ")\n\n";
+  std::cout << std::setw (10) << "alpha" << std::setw (10) << "gamma" << std::setw (12) << "staleRate"
+            << std::setw (10) << "ud" << std::setw (12) << "revenue" << "  file\n";
+  for (uint32_t i = 0; i < points.size (); i++)
+  {
+    std::cout << std::setw (10) << points[i].alpha << std::setw (10) << points[i].gamma << std::setw (12) << points[i].staleRate
+              << std::setw (10) << points[i].doubleSpendValue << std::setw (12) << revenues[i] << "  " << files[i] << "\n";
+  }
+
+  return 0;
+}
+
+
+std::vector<double> ParseValues (std::string values)
+{
+  std::vector<double> parsed;
+  std::istringstream  stream (values);
+  std::string         value;
+
+  while (std::getline (stream, value, ','))
+  {
+    if (!value.empty ())
+      parsed.push_back (atof (value.c_str ()));
+  }
+  return parsed;
+}
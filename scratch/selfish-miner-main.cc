@@ -12,11 +12,16 @@
 #include "ns3/bitcoin.h"
 
 #include "ns3/selfish-miner-status.h"
+#include "ns3/bitcoin-experiment-controller.h"
 
 uint blockIntervalMinutes;
 uint blockNumber = 1;
 uint iterations = 1;
 uint gammaParameter = 0.99;
+uint minIterations = 5;
+double confidence = 0.95;
+double revenueHalfWidth = 0;
+double staleHalfWidth = 0;
 
 NS_LOG_COMPONENT_DEFINE("selfish-miner-main");
 
@@ -75,15 +80,17 @@ int main(int argc, char *argv[])
     srand(1000);
     Time::SetResolution(Time::NS);
 
-    for(int i{0}; i < iterations; i++){
+    bool earlyStopping = revenueHalfWidth > 0 || staleHalfWidth > 0;
+    ns3::BitcoinExperimentController controller(confidence, earlyStopping ? minIterations : iterations, iterations);
+    int revenueMetric = controller.AddMetric("Selfish Revenue Share", revenueHalfWidth);
+    int staleMetric = controller.AddMetric("Stale Rate", staleHalfWidth);
+    int attackSuccessMetric = controller.AddMetric("Attack Success");
+
+    for(int i{0}; !controller.IsDone(); i++){
         std::cout << "iteration number : " << i << std::endl;
 
-        Ipv4InterfaceContainer ipv4InterfaceContainer;
-        std::map<uint32_t, std::vector<Ipv4Address>> nodesConnections;
-        std::map<uint32_t, std::map<Ipv4Address, double>> peersDownloadSpeeds;
-        std::map<uint32_t, std::map<Ipv4Address, double>> peersUploadSpeeds;
-        std::map<uint32_t, nodeInternetSpeeds> nodesInternetSpeeds;
-        std::vector<uint32_t> miners;
+        auto previousStatus = selfishStatus;
+
 
         BitcoinTopologyHelper bitcoinTopologyHelper(1, totalNoNodes, noMiners, minersRegions,
                                                     Cryptocurrency::BITCOIN, minConnectionsPerNode,
@@ -92,48 +99,26 @@ int main(int argc, char *argv[])
         InternetStackHelper stack;
         bitcoinTopologyHelper.InstallStack(stack);
 
-        bitcoinTopologyHelper.AssignIpv4Addresses(Ipv4AddressHelperCustom("1.0.0.0", "255.255.255.0", false));
-        ipv4InterfaceContainer = bitcoinTopologyHelper.GetIpv4InterfaceContainer();
-        nodesConnections = bitcoinTopologyHelper.GetNodesConnectionsIps();
-        miners = bitcoinTopologyHelper.GetMiners();
-        peersDownloadSpeeds = bitcoinTopologyHelper.GetPeersDownloadSpeeds();
-        peersUploadSpeeds = bitcoinTopologyHelper.GetPeersUploadSpeeds();
-        nodesInternetSpeeds = bitcoinTopologyHelper.GetNodesInternetSpeeds();
-
-        ApplicationContainer bitcoinMiners;
+        bitcoinTopologyHelper.AssignIpv4Addresses(Ipv4AddressHelperCustom("1.0.0.0", "255.255.255.252", false));
 
-        // BitcoinMinerHelper bitcoinMinerHelper("ns3::TcpSocketFactory", InetSocketAddress(Ipv4Address::GetAny(), bitcoinPort),
-        //                                       nodesConnections[miners[0]], noMiners, peersDownloadSpeeds[0], peersUploadSpeeds[0], nodesInternetSpeeds[0],
-        //                                       nodeStatic, minersHash[0], averageBlockGenIntervalSeconds);
+        std::vector<ns3::minerSpecification> minersSpecifications(noMiners);
 
         for(size_t i{0}; i < noMiners; i++){
-            auto miner = miners[i];
-            Ptr<Node> targetNode = bitcoinTopologyHelper.GetNode(miner);
-
-            BitcoinMinerHelper bitcoinMinerHelper("ns3::TcpSocketFactory", InetSocketAddress(Ipv4Address::GetAny(), bitcoinPort),
-                                                  nodesConnections[miner], noMiners, peersDownloadSpeeds[miner], peersUploadSpeeds[miner],
-                                                  nodesInternetSpeeds[miner], nodeStatic, minersHash[miner], averageBlockGenIntervalSeconds);
-
-            if(miner != attackerId){
-                std::cout << "miner id is : " << miner << std::endl;
-                bitcoinMinerHelper.SetMinerType(MY_HONEST_MINER);
-                bitcoinMinerHelper.SetGamma(gammaParameter);
-            }
-            else if (miner == attackerId){
-                std::cout << "attacker id is : " << attackerId << std::endl;
-                bitcoinMinerHelper.SetMinerType(MY_SELFISH_MINER);
-            }
-
-            bitcoinMinerHelper.SetPeersAddresses(nodesConnections[miner]);
-            bitcoinMinerHelper.SetPeersDownloadSpeeds(peersDownloadSpeeds[miner]);
-            bitcoinMinerHelper.SetPeersUploadSpeeds(peersUploadSpeeds[miner]);
-            bitcoinMinerHelper.SetNodeInternetSpeeds(nodesInternetSpeeds[miner]);
-            bitcoinMinerHelper.SetNodeStats(&nodeStatic[miner]);
-            bitcoinMinerHelper.SetSelfishStatus(&selfishStatus);
-
-            bitcoinMiners.Add(bitcoinMinerHelper.Install(targetNode));
+            auto miner = bitcoinTopologyHelper.GetMiners()[i];
+
+            minersSpecifications[i].minerType = (miner == attackerId) ? MY_SELFISH_MINER : MY_HONEST_MINER;
+            minersSpecifications[i].hashRate = minersHash[miner];
+            minersSpecifications[i].gamma = gammaParameter;
+            minersSpecifications[i].blockBroadcastType = STANDARD;
+            minersSpecifications[i].fixedBlockIntervalGeneration = 0;
         }
 
+        BitcoinNetworkHelper bitcoinNetworkHelper("ns3::TcpSocketFactory", InetSocketAddress(Ipv4Address::GetAny(), bitcoinPort),
+                                                  bitcoinTopologyHelper, minersSpecifications, nodeStatic, averageBlockGenIntervalSeconds);
+        bitcoinNetworkHelper.SetSelfishStatus(&selfishStatus);
+
+        ApplicationContainer bitcoinMiners = bitcoinNetworkHelper.InstallMiners(0);
+
         bitcoinMiners.Start(Seconds(start));
         bitcoinMiners.Stop(Minutes(stop));
 
@@ -147,8 +132,21 @@ int main(int argc, char *argv[])
         tSimFinish = get_wall_time();
 
         printSelfishAttackStatus(&selfishStatus);
+
+        int selfishWinBlock = selfishStatus.SelfishMinerWinBlock - previousStatus.SelfishMinerWinBlock;
+        int winBlock = selfishWinBlock + selfishStatus.HonestMinerWinBlock - previousStatus.HonestMinerWinBlock;
+        int minedBlock = selfishStatus.MinedBlock - previousStatus.MinedBlock;
+
+        if(winBlock > 0)
+            controller.AddSample(revenueMetric, (double)selfishWinBlock / winBlock);
+        if(minedBlock > 0)
+            controller.AddSample(staleMetric, (double)(minedBlock - winBlock) / minedBlock);
+        controller.AddSample(attackSuccessMetric, nodeStatic[attackerId].attackSuccess);
+        controller.EndIteration();
     }
 
+    controller.PrintPrecision(std::cout);
+
     return 0;
 }
 
@@ -158,7 +156,11 @@ void getParametersFromCMD(int argc, char* argv[])
 
     cmd.AddValue("blockNumber", "number of blocks", blockNumber);
     cmd.AddValue("blockInterValMinutes", "interval time of mining block", blockIntervalMinutes);
-    cmd.AddValue("iterations", "number of iterations for running algorithm", iterations);
+    cmd.AddValue("iterations", "maximum number of iterations for running algorithm", iterations);
+    cmd.AddValue("minIterations", "number of iterations before checking the confidence intervals", minIterations);
+    cmd.AddValue("confidence", "confidence level of the intervals", confidence);
+    cmd.AddValue("revenueHalfWidth", "stop when the selfish revenue share interval is this narrow (0 disables)", revenueHalfWidth);
+    cmd.AddValue("staleHalfWidth", "stop when the stale rate interval is this narrow (0 disables)", staleHalfWidth);
 
     cmd.Parse(argc, argv);
 }
@@ -168,6 +170,9 @@ void printInputStatics()
     std::cout << "number of blocks is : " << blockNumber << std::endl;
     std::cout << "block interval in minutes is : " << blockIntervalMinutes << std::endl;
     std::cout << "number of iteration is : " << iterations << std::endl;
+    if(revenueHalfWidth > 0 || staleHalfWidth > 0)
+        std::cout << "stopping at " << confidence * 100 << "% confidence half-width : revenue "
+                  << revenueHalfWidth << ", stale rate " << staleHalfWidth << std::endl;
 }
 
 double get_wall_time()
@@ -32,7 +32,6 @@
 using namespace ns3;
 
 double get_wall_time();
-int GetNodeIdByIpv4 (Ipv4InterfaceContainer container, Ipv4Address addr);
 void PrintStatsForEachNode (nodeStatistics *stats, int totalNodes);
 void PrintTotalStats (nodeStatistics *stats, int totalNodes, double start, double finish, double averageBlockGenIntervalMinutes);
 void PrintBitcoinRegionStats (uint32_t *bitcoinNodesRegions, uint32_t totalNodes);
@@ -62,6 +61,7 @@ main (int argc, char *argv[])
   double bandwidth = 8;
   double latency = 40;
   bool test = false;
+  std::string decisionMatrix = "";
   
   
   double minersHash[] = {0.185, 0.159, 0.133, 0.066, 0.054,
@@ -80,6 +80,11 @@ main (int argc, char *argv[])
   int maxConnectionsPerNode = 1;
   
   int iterations = 1;
+  int minIterations = 5;
+  double confidence = 0.95;
+  double revenueHalfWidth = 0;
+  double staleHalfWidth = 0;
+  double attackSuccessHalfWidth = 0;
   int successfullAttacks = 0;
   int secureBlocks = 6;
   
@@ -128,29 +133,35 @@ main (int argc, char *argv[])
   CommandLine cmd;
   cmd.AddValue ("blockIntervalMinutes", "The average block generation interval in minutes", averageBlockGenIntervalMinutes);
   cmd.AddValue ("noBlocks", "The number of generated blocks", targetNumberOfBlocks);
-  cmd.AddValue ("iterations", "The number of iterations of the attack", iterations);
+  cmd.AddValue ("iterations", "The maximum number of iterations of the attack", iterations);
+  cmd.AddValue ("minIterations", "The number of iterations before checking the confidence intervals", minIterations);
+  cmd.AddValue ("confidence", "The confidence level of the intervals", confidence);
+  cmd.AddValue ("revenueHalfWidth", "Stop when the attacker's revenue share interval is this narrow (0 disables)", revenueHalfWidth);
+  cmd.AddValue ("staleHalfWidth", "Stop when the stale rate interval is this narrow (0 disables)", staleHalfWidth);
+  cmd.AddValue ("attackSuccessHalfWidth", "Stop when the successful attacks interval is this narrow (0 disables)", attackSuccessHalfWidth);
   cmd.AddValue ("test", "Test the attack", test);
   cmd.AddValue ("ud", "The transaction value which is double-spent", ud);
   cmd.AddValue ("r", "The stale block rate", r);
   cmd.AddValue ("unsolicited", "Change the miners block broadcast type to UNSOLICITED", unsolicited);
   cmd.AddValue ("relayNetwork", "Change the miners block broadcast type to RELAY_NETWORK", relayNetwork);
   cmd.AddValue ("unsolicitedRelayNetwork", "Change the miners block broadcast type to UNSOLICITED_RELAY_NETWORK", unsolicitedRelayNetwork);
+  cmd.AddValue ("decisionMatrix", "The decision matrix file of the attacker, written by selfish-mdp-solver (empty uses the built-in one)", decisionMatrix);
   
   cmd.Parse(argc, argv);
   
   averageBlockGenIntervalSeconds = averageBlockGenIntervalMinutes * secsPerMin;
   stop = targetNumberOfBlocks * averageBlockGenIntervalMinutes; //seconds
+
+  bool earlyStopping = revenueHalfWidth > 0 || staleHalfWidth > 0 || attackSuccessHalfWidth > 0;
+  BitcoinExperimentController controller (confidence, earlyStopping ? minIterations : iterations, iterations);
+  int revenueMetric = controller.AddMetric ("Attacker Revenue Share", revenueHalfWidth);
+  int staleMetric = controller.AddMetric ("Stale Rate", staleHalfWidth);
+  int attackSuccessMetric = controller.AddMetric ("Attack Success", attackSuccessHalfWidth);
   
-  for (int iter = 0; iter < iterations; iter++)
+  for (int iter = 0; !controller.IsDone (); iter++)
   { 
     std::cout << "Iteration : " << iter + 1 << " " << secureBlocks << " " << averageBlockGenIntervalSeconds 
 	          << " " << averageBlockGenIntervalMinutes << " " << targetNumberOfBlocks << "\n";
-    Ipv4InterfaceContainer                               ipv4InterfaceContainer;
-    std::map<uint32_t, std::vector<Ipv4Address>>         nodesConnections;
-    std::map<uint32_t, std::map<Ipv4Address, double>>    peersDownloadSpeeds;
-    std::map<uint32_t, std::map<Ipv4Address, double>>    peersUploadSpeeds;
-    std::map<uint32_t, nodeInternetSpeeds>               nodesInternetSpeeds;
-    std::vector<uint32_t>                                miners;
   
 	
     BitcoinTopologyHelper bitcoinTopologyHelper (systemCount, totalNoNodes, noMiners, minersRegions,
@@ -162,66 +173,44 @@ main (int argc, char *argv[])
     bitcoinTopologyHelper.InstallStack (stack);
 
     // Assign Addresses to Grid
-    bitcoinTopologyHelper.AssignIpv4Addresses (Ipv4AddressHelperCustom ("1.0.0.0", "255.255.255.0", false));
-    ipv4InterfaceContainer = bitcoinTopologyHelper.GetIpv4InterfaceContainer();
-    nodesConnections = bitcoinTopologyHelper.GetNodesConnectionsIps();
-    miners = bitcoinTopologyHelper.GetMiners();
-    peersDownloadSpeeds = bitcoinTopologyHelper.GetPeersDownloadSpeeds();
-    peersUploadSpeeds = bitcoinTopologyHelper.GetPeersUploadSpeeds();
-    nodesInternetSpeeds = bitcoinTopologyHelper.GetNodesInternetSpeeds();
+    bitcoinTopologyHelper.AssignIpv4Addresses (Ipv4AddressHelperCustom ("1.0.0.0", "255.255.255.252", false));
     if (systemId == 0)
       PrintBitcoinRegionStats(bitcoinTopologyHelper.GetBitcoinNodesRegions(), totalNoNodes);
 
 
     //Install miners
-    BitcoinMinerHelper bitcoinMinerHelper ("ns3::TcpSocketFactory", InetSocketAddress (Ipv4Address::GetAny (), bitcoinPort),
-                                            nodesConnections[miners[0]], noMiners, peersDownloadSpeeds[0], peersUploadSpeeds[0], nodesInternetSpeeds[0], 
-										    stats, minersHash[0], averageBlockGenIntervalSeconds);
-    ApplicationContainer bitcoinMiners;
-    int count = 0;
-	
-    
-    for(auto &miner : miners)
+    std::vector<minerSpecification> minersSpecifications (noMiners);
+    enum BlockBroadcastType blockBroadcastType = STANDARD;
+
+    if(unsolicited)
+      blockBroadcastType = UNSOLICITED;
+    if(relayNetwork)
+      blockBroadcastType = RELAY_NETWORK;
+    if(unsolicitedRelayNetwork)
+      blockBroadcastType = UNSOLICITED_RELAY_NETWORK;
+
+    for (int i = 0; i < noMiners; i++)
     {
-	  Ptr<Node> targetNode = bitcoinTopologyHelper.GetNode (miner);
-	
-	  if (systemId == targetNode->GetSystemId())
-	  {
-		  
-	    if (attackerId == miner)
-        {
-          bitcoinMinerHelper.SetMinerType (SELFISH_MINER);
-        }
-		
-        bitcoinMinerHelper.SetAttribute("HashRate", DoubleValue(minersHash[count]));
-	    bitcoinMinerHelper.SetPeersAddresses (nodesConnections[miner]);
-	    bitcoinMinerHelper.SetNodeStats (&stats[miner]);
-	    bitcoinMinerHelper.SetPeersDownloadSpeeds (peersDownloadSpeeds[miner]);
-	    bitcoinMinerHelper.SetPeersUploadSpeeds (peersUploadSpeeds[miner]);
-
-        if (test == true && attackerId != miner)
-          bitcoinMinerHelper.SetAttribute("FixedBlockIntervalGeneration", DoubleValue(100));
-        else if (test == true && attackerId == miner)
-          bitcoinMinerHelper.SetAttribute("FixedBlockIntervalGeneration", DoubleValue(500));
+      uint32_t miner = bitcoinTopologyHelper.GetMiners ()[i];
 	  
-	    if(unsolicited)
-	      bitcoinMinerHelper.SetBlockBroadcastType (UNSOLICITED);
-	    if(relayNetwork)
-	      bitcoinMinerHelper.SetBlockBroadcastType (RELAY_NETWORK);
-	    if(unsolicitedRelayNetwork)
-	      bitcoinMinerHelper.SetBlockBroadcastType (UNSOLICITED_RELAY_NETWORK);
-	  
-	    bitcoinMiners.Add(bitcoinMinerHelper.Install (targetNode));
-/*         std::cout << "SystemId " << systemId << ": Miner " << miner.first << " with hash power = " << minersHash[count] 
-	              << " and systemId = " << targetNode->GetSystemId() << " was installed in node (" 
-                  << miner.first / ySize << ", " << miner.first % ySize << ")" << std::endl;  */
-	  
-	    if (systemId == 0)
-          nodesInSystemId0++;
-	  }				
-	  count++;
-   
+      minersSpecifications[i].minerType = (attackerId == miner) ? SELFISH_MINER : NORMAL_MINER;
+      minersSpecifications[i].hashRate = minersHash[i];
+      minersSpecifications[i].gamma = 0;
+      minersSpecifications[i].blockBroadcastType = blockBroadcastType;
+      minersSpecifications[i].fixedBlockIntervalGeneration = 0;
+
+      if (test == true)
+        minersSpecifications[i].fixedBlockIntervalGeneration = (attackerId == miner) ? 500 : 100;
     }
+
+    BitcoinNetworkHelper bitcoinNetworkHelper ("ns3::TcpSocketFactory", InetSocketAddress (Ipv4Address::GetAny (), bitcoinPort),
+                                               bitcoinTopologyHelper, minersSpecifications, stats, averageBlockGenIntervalSeconds);
+    bitcoinNetworkHelper.SetDecisionMatrixFile (decisionMatrix);
+    ApplicationContainer bitcoinMiners = bitcoinNetworkHelper.InstallMiners (systemId);
+
+    if (systemId == 0)
+      nodesInSystemId0 += bitcoinMiners.GetN ();
+
     bitcoinMiners.Start (Seconds (start));
     bitcoinMiners.Stop (Minutes (stop));
 
@@ -240,6 +229,15 @@ main (int argc, char *argv[])
     std::cout << "Iteration " << iter+1 << " lasted " << tSimFinish - tSimStart << "s\n";
     std::cout << std::endl;
 
+    int mainChainBlocks = stats[attackerId].totalBlocks - stats[attackerId].staleBlocks - 1;
+
+    if (mainChainBlocks > 0)
+      controller.AddSample (revenueMetric, static_cast<double>(stats[attackerId].minedBlocksInMainChain) / mainChainBlocks);
+    if (stats[attackerId].totalBlocks > 0)
+      controller.AddSample (staleMetric, static_cast<double>(stats[attackerId].staleBlocks) / stats[attackerId].totalBlocks);
+    controller.AddSample (attackSuccessMetric, stats[attackerId].attackSuccess);
+    controller.EndIteration ();
+
 
 
   
@@ -259,9 +257,12 @@ main (int argc, char *argv[])
                 << "min and averageBlockGenIntervalSeconds was " << averageBlockGenIntervalSeconds << ".\n"
                 << "Each attack had a duration of " << targetNumberOfBlocks << " generated blocks.\n"
                 << "The attacker's hash rate was " << minersHash[attackerId] << ".\n"
-                << "The number of iterations was " << iterations << ".\n\n";
+                << "The number of iterations was " << controller.GetIterations () << ".\n\n";
     }
   }  
+
+  if (systemId == 0)
+    controller.PrintPrecision (std::cout);
   
   delete[] stats;  
 
@@ -282,17 +283,6 @@ double get_wall_time()
     return (double)time.tv_sec + (double)time.tv_usec * .000001;
 }
 
-int GetNodeIdByIpv4 (Ipv4InterfaceContainer container, Ipv4Address addr)
-{
-  for (auto it = container.Begin(); it != container.End(); it++)
-  {
-	int32_t interface = it->first->GetInterfaceForAddress (addr);
-	if ( interface != -1)
-      return it->first->GetNetDevice (interface)-> GetNode()->GetId();
-  }	  
-  return -1; //if not found
-}
-
 void PrintStatsForEachNode (nodeStatistics *stats, int totalNodes)
 {
   int secPerMin = 60;
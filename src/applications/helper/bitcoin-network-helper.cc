@@ -0,0 +1,261 @@
+/**
+ * This file contains the definitions of the functions declared in bitcoin-network-helper.h
+ */
+
+#include "ns3/bitcoin-network-helper.h"
+#include "ns3/string.h"
+#include "ns3/inet-socket-address.h"
+#include "ns3/uinteger.h"
+#include "ns3/double.h"
+#include "ns3/boolean.h"
+#include "ns3/log.h"
+#include "ns3/bitcoin-node.h"
+#include "ns3/bitcoin-node-policy.h"
+#include "ns3/bitcoin-miner.h"
+#include "ns3/selfish-miner.h"
+#include "ns3/honest-miner.h"
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("BitcoinNetworkHelper");
+
+BitcoinNetworkHelper::BitcoinNetworkHelper (std::string protocol, Address address, BitcoinTopologyHelper &topology,
+                                            const std::vector<minerSpecification> &miners, nodeStatistics *stats,
+                                            double averageBlockGenIntervalSeconds)
+  : m_protocol (protocol), m_address (address), m_topology (topology), m_miners (miners), m_stats (stats),
+    m_averageBlockGenIntervalSeconds (averageBlockGenIntervalSeconds), m_protocolType (STANDARD_PROTOCOL),
+    m_nodeTypeId ("ns3::BitcoinNode"), m_policyNodes (false), m_blockTorrent (false), m_spv (false), m_selfishMinerStatus (0), m_minerFactoryType (-1), m_secureBlocks (6), m_decisionMatrixFile (""), m_seed (0)
+{
+  if (m_miners.size () != m_topology.GetMiners ().size ())
+    NS_FATAL_ERROR ("BitcoinNetworkHelper: " << m_miners.size () << " miner specifications were given for "
+                    << m_topology.GetMiners ().size () << " miners");
+}
+
+void
+BitcoinNetworkHelper::SetAttribute (std::string name, const AttributeValue &value)
+{
+  m_attributes.push_back (std::make_pair (name, value.Copy ()));
+  m_minerFactoryType = -1;
+}
+
+void
+BitcoinNetworkHelper::SetMinerAttribute (std::string name, const AttributeValue &value)
+{
+  m_minerAttributes.push_back (std::make_pair (name, value.Copy ()));
+  m_minerFactoryType = -1;
+}
+
+void
+BitcoinNetworkHelper::SetProtocolType (enum ProtocolType protocolType)
+{
+  if (m_policyNodes && protocolType != m_protocolType)
+    NS_FATAL_ERROR ("BitcoinNetworkHelper: the nodes of TypeId " << m_nodeTypeId << " use the "
+                    << getProtocolType (m_protocolType) << " protocol, not " << getProtocolType (protocolType));
+  m_protocolType = protocolType;
+}
+
+void
+BitcoinNetworkHelper::SetNodeTypeId (std::string nodeTypeId)
+{
+  m_nodeTypeId = nodeTypeId;
+  m_policyNodes = GetPolicyNodeMode (nodeTypeId, m_protocolType, m_blockTorrent, m_spv);
+  m_minerFactoryType = -1;
+}
+
+void
+BitcoinNetworkHelper::SetSelfishStatus (blockchain_attacks::SelfishMinerStatus *selfishMinerStatus)
+{
+  m_selfishMinerStatus = selfishMinerStatus;
+}
+
+void
+BitcoinNetworkHelper::SetSeed (uint32_t seed)
+{
+  m_seed = seed;
+}
+
+void
+BitcoinNetworkHelper::SetDecisionMatrixFile (std::string decisionMatrixFile)
+{
+  m_decisionMatrixFile = decisionMatrixFile;
+  m_minerFactoryType = -1;
+}
+
+ApplicationContainer
+BitcoinNetworkHelper::InstallMiners (uint32_t systemId)
+{
+  ApplicationContainer apps;
+  const std::vector<uint32_t> &miners = m_topology.GetMiners ();
+
+  for (uint32_t count = 0; count < miners.size (); count++)
+  {
+    uint32_t id = miners[count];
+    const minerSpecification &spec = m_miners[count];
+    Ptr<Node> targetNode = m_topology.GetNode (id);
+
+    if (systemId != targetNode->GetSystemId ())
+      continue;
+
+    SetMinerFactoryType (spec.minerType);
+    m_minerFactory.Set ("HashRate", DoubleValue (spec.hashRate));
+    m_minerFactory.Set ("FixedBlockIntervalGeneration", DoubleValue (spec.fixedBlockIntervalGeneration));
+
+    Ptr<BitcoinMiner> app = m_minerFactory.Create<BitcoinMiner> ();
+    SetTopologyData (app, id);
+    app->SetBlockBroadcastType (spec.blockBroadcastType);
+
+    if (spec.minerType == MY_SELFISH_MINER)
+      DynamicCast<blockchain_attacks::SelfishMiner> (app)->SetStatus (m_selfishMinerStatus);
+    else if (spec.minerType == MY_HONEST_MINER)
+    {
+      Ptr<blockchain_attacks::HonestMiner> honestMiner = DynamicCast<blockchain_attacks::HonestMiner> (app);
+      honestMiner->SetStatus (m_selfishMinerStatus);
+      honestMiner->SetGamma (spec.gamma);
+    }
+
+    targetNode->AddApplication (app);
+    apps.Add (app);
+    NS_LOG_INFO ("Installed " << getMinerType (spec.minerType) << " with hash rate = " << spec.hashRate
+                 << " in node " << id);
+  }
+
+  return apps;
+}
+
+ApplicationContainer
+BitcoinNetworkHelper::InstallNodes (uint32_t systemId)
+{
+  ApplicationContainer apps;
+  const std::vector<uint32_t> &miners = m_topology.GetMiners ();
+  std::vector<bool> isMiner (m_topology.GetTotalNoNodes (), false);
+  ObjectFactory factory;
+
+  for (auto &miner : miners)
+    isMiner[miner] = true;
+
+  factory.SetTypeId (m_nodeTypeId);
+  factory.Set ("Protocol", StringValue (m_protocol));
+  factory.Set ("Local", AddressValue (m_address));
+  for (auto &attribute : m_attributes)
+    factory.Set (attribute.first, *attribute.second);
+
+  for (uint32_t id = 0; id < m_topology.GetTotalNoNodes (); id++)
+  {
+    if (isMiner[id])
+      continue;
+
+    Ptr<Node> targetNode = m_topology.GetNode (id);
+    if (systemId != targetNode->GetSystemId ())
+      continue;
+
+    Ptr<BitcoinNode> app = factory.Create<BitcoinNode> ();
+    SetTopologyData (app, id);
+
+    targetNode->AddApplication (app);
+    apps.Add (app);
+  }
+
+  return apps;
+}
+
+void
+BitcoinNetworkHelper::SetMinerFactoryType (enum MinerType minerType)
+{
+  if (m_minerFactoryType == minerType)
+    return;
+
+  m_minerFactory = ObjectFactory ();
+  switch (minerType)
+  {
+    case NORMAL_MINER:
+      m_minerFactory.SetTypeId ("ns3::BitcoinMiner");
+      break;
+    case SIMPLE_ATTACKER:
+      m_minerFactory.SetTypeId ("ns3::BitcoinSimpleAttacker");
+      m_minerFactory.Set ("SecureBlocks", UintegerValue (m_secureBlocks));
+      break;
+    case SELFISH_MINER:
+      m_minerFactory.SetTypeId ("ns3::BitcoinSelfishMiner");
+      m_minerFactory.Set ("DecisionMatrixFile", StringValue (m_decisionMatrixFile));
+      break;
+    case SELFISH_MINER_TRIALS:
+      m_minerFactory.SetTypeId ("ns3::BitcoinSelfishMinerTrials");
+      m_minerFactory.Set ("SecureBlocks", UintegerValue (m_secureBlocks));
+      break;
+    case MY_SELFISH_MINER:
+      m_minerFactory.SetTypeId ("blockchain_attacks::SelfishMiner");
+      break;
+    case MY_HONEST_MINER:
+      m_minerFactory.SetTypeId ("blockchain_attacks::HonestMiner");
+      break;
+  }
+
+  m_minerFactory.Set ("Protocol", StringValue (m_protocol));
+  m_minerFactory.Set ("Local", AddressValue (m_address));
+  m_minerFactory.Set ("NumberOfMiners", UintegerValue (m_miners.size ()));
+  m_minerFactory.Set ("AverageBlockGenIntervalSeconds", DoubleValue (m_averageBlockGenIntervalSeconds));
+
+  for (auto &attribute : m_attributes)
+    m_minerFactory.Set (attribute.first, *attribute.second);
+  for (auto &attribute : m_minerAttributes)
+    m_minerFactory.Set (attribute.first, *attribute.second);
+
+  //The miners use the mode of the policy nodes, whose handlers abort on the messages of the other modes
+  if (m_policyNodes)
+  {
+    CheckPolicyAttributes (m_attributes);
+    CheckPolicyAttributes (m_minerAttributes);
+    m_minerFactory.Set ("BlockTorrent", BooleanValue (m_blockTorrent));
+    m_minerFactory.Set ("SPV", BooleanValue (m_spv));
+  }
+
+  m_minerFactoryType = minerType;
+}
+
+void
+BitcoinNetworkHelper::CheckPolicyAttributes (const AttributeList &attributes) const
+{
+  Ptr<const AttributeChecker> checker = MakeBooleanChecker ();
+
+  for (auto &attribute : attributes)
+  {
+    bool policyValue;
+
+    if (attribute.first == "BlockTorrent")
+      policyValue = m_blockTorrent;
+    else if (attribute.first == "SPV" && m_blockTorrent)  //spv is used only with blockTorrent
+      policyValue = m_spv;
+    else
+      continue;
+
+    if (attribute.second->SerializeToString (checker) != BooleanValue (policyValue).SerializeToString (checker))
+      NS_FATAL_ERROR ("BitcoinNetworkHelper: the nodes of TypeId " << m_nodeTypeId << " use "
+                      << attribute.first << " = " << BooleanValue (policyValue).SerializeToString (checker)
+                      << ", which the miners must also use");
+  }
+}
+
+void
+BitcoinNetworkHelper::SetTopologyData (Ptr<BitcoinNode> app, uint32_t id)
+{
+  const std::map<uint32_t, std::vector<Ipv4Address>> &connections = m_topology.GetNodesConnectionsIps ();
+  const std::map<uint32_t, std::map<Ipv4Address, double>> &downloadSpeeds = m_topology.GetPeersDownloadSpeeds ();
+  const std::map<uint32_t, std::map<Ipv4Address, double>> &uploadSpeeds = m_topology.GetPeersUploadSpeeds ();
+  const std::map<uint32_t, nodeInternetSpeeds> &internetSpeeds = m_topology.GetNodesInternetSpeeds ();
+
+  auto peers = connections.find (id);
+  if (peers != connections.end ())
+    app->SetPeersAddresses (peers->second);
+
+  auto download = downloadSpeeds.find (id);
+  auto upload = uploadSpeeds.find (id);
+  app->SetSharedPeersSpeeds (download != downloadSpeeds.end () ? &download->second : 0,
+                             upload != uploadSpeeds.end () ? &upload->second : 0);
+
+  app->SetNodeInternetSpeeds (internetSpeeds.at (id));
+  app->SetNodeStats (&m_stats[id]);
+  app->SetProtocolType (m_protocolType);
+  app->SetSeed (m_seed);
+}
+
+} // namespace ns3
@@ -0,0 +1,154 @@
+/**
+ * This file contains declares the BitcoinNetworkHelper class.
+ */
+
+#ifndef BITCOIN_NETWORK_HELPER_H
+#define BITCOIN_NETWORK_HELPER_H
+
+#include "ns3/object-factory.h"
+#include "ns3/ipv4-address.h"
+#include "ns3/application-container.h"
+#include "ns3/bitcoin.h"
+#include "ns3/bitcoin-topology-helper.h"
+#include "ns3/selfish-miner-status.h"
+
+namespace ns3 {
+
+class BitcoinNode;
+
+/**
+ * The specification of a single miner, used by BitcoinNetworkHelper.
+ * The i-th entry describes the i-th miner returned by BitcoinTopologyHelper::GetMiners.
+ */
+typedef struct {
+  enum MinerType            minerType;
+  double                    hashRate;
+  double                    gamma;                           //only used by MY_HONEST_MINER
+  enum BlockBroadcastType   blockBroadcastType;
+  double                    fixedBlockIntervalGeneration;    //0->not fixed
+} minerSpecification;
+
+
+/**
+ * Installs the BitcoinMiner and BitcoinNode applications of the whole network in one pass.
+ * Unlike BitcoinNodeHelper and BitcoinMinerHelper, the per-node topology data are not copied
+ * into the helper. The applications reference the peers' speeds kept by the BitcoinTopologyHelper,
+ * which must therefore outlive the simulation.
+ */
+class BitcoinNetworkHelper
+{
+public:
+  /**
+   * Create a BitcoinNetworkHelper
+   *
+   * \param protocol the name of the protocol to use to receive traffic
+   *        This string identifies the socket factory type used to create
+   *        sockets for the applications.  A typical value would be
+   *        ns3::TcpSocketFactory.
+   * \param address the address of the bitcoin nodes
+   * \param topology the topology holding the nodes, their connections and their speeds
+   * \param miners the specifications of the miners, in the order of BitcoinTopologyHelper::GetMiners
+   * \param stats a pointer to the array holding the statistics of all the nodes
+   * \param averageBlockGenIntervalSeconds the average block generation interval in seconds
+   */
+  BitcoinNetworkHelper (std::string protocol, Address address, BitcoinTopologyHelper &topology,
+                        const std::vector<minerSpecification> &miners, nodeStatistics *stats,
+                        double averageBlockGenIntervalSeconds);
+
+  /**
+   * Set an attribute of all the applications, both miners and simple nodes
+   *
+   * \param name the name of the application attribute to set
+   * \param value the value of the application attribute to set
+   */
+  void SetAttribute (std::string name, const AttributeValue &value);
+
+  /**
+   * Set an attribute of the miners only
+   *
+   * \param name the name of the application attribute to set
+   * \param value the value of the application attribute to set
+   */
+  void SetMinerAttribute (std::string name, const AttributeValue &value);
+
+  /**
+   * Set the protocol type of all the applications. It must agree with the TypeId of the simple nodes,
+   * if it is a BitcoinPolicyNode TypeId.
+   */
+  void SetProtocolType (enum ProtocolType protocolType);
+
+  /**
+   * Set the TypeId of the simple nodes (default: ns3::BitcoinNode). A BitcoinPolicyNode
+   * TypeId, e.g. GetPolicyNodeTypeName (protocolType, blockTorrent, spv), fixes the protocol mode at compile time.
+   * The miners then get the same protocol type, BlockTorrent and SPV, since the simple nodes abort on the
+   * messages of the other modes. The policy overrides an earlier SetProtocolType, while a later SetProtocolType
+   * or BlockTorrent/SPV attributes which disagree with it are fatal errors.
+   */
+  void SetNodeTypeId (std::string nodeTypeId);
+
+  void SetSelfishStatus (blockchain_attacks::SelfishMinerStatus *selfishMinerStatus);
+
+  /**
+   * Fix the seed of the random number generators of all the applications (default: 0, not fixed)
+   */
+  void SetSeed (uint32_t seed);
+
+  /**
+   * Set the decision matrix file of the SELFISH_MINERs, computed by BitcoinSelfishMdp (default: empty, the built-in matrix)
+   */
+  void SetDecisionMatrixFile (std::string decisionMatrixFile);
+
+  /**
+   * Install the miners which belong to systemId
+   * \returns Container of Ptr to the applications installed.
+   */
+  ApplicationContainer InstallMiners (uint32_t systemId);
+
+  /**
+   * Install the simple nodes which belong to systemId
+   * \returns Container of Ptr to the applications installed.
+   */
+  ApplicationContainer InstallNodes (uint32_t systemId);
+
+private:
+  typedef std::vector<std::pair<std::string, Ptr<AttributeValue>>> AttributeList;
+
+  /**
+   * Configures m_minerFactory for a specific miner type, only if the type changes
+   */
+  void SetMinerFactoryType (enum MinerType minerType);
+
+  /**
+   * Aborts if the attributes set a BlockTorrent or SPV other than the one of the policy nodes
+   */
+  void CheckPolicyAttributes (const AttributeList &attributes) const;
+
+  /**
+   * Passes the topology data of the node to the application
+   */
+  void SetTopologyData (Ptr<BitcoinNode> app, uint32_t id);
+
+  std::string                                  m_protocol;             //!< The name of the protocol to use to receive traffic
+  Address                                      m_address;              //!< The address of the bitcoin nodes
+  BitcoinTopologyHelper                       &m_topology;             //!< The topology of the network
+  std::vector<minerSpecification>              m_miners;               //!< The specifications of the miners
+  nodeStatistics                              *m_stats;                //!< The array holding the node statistics
+  double                                       m_averageBlockGenIntervalSeconds;
+  enum ProtocolType                            m_protocolType;         //!< The protocol that the nodes use to advertise new blocks (DEFAULT: STANDARD)
+  std::string                                  m_nodeTypeId;           //!< The TypeId of the simple nodes
+  bool                                         m_policyNodes;          //!< True if m_nodeTypeId is a BitcoinPolicyNode TypeId
+  bool                                         m_blockTorrent;         //!< The blockTorrent of the policy nodes, passed to the miners
+  bool                                         m_spv;                  //!< The spv of the policy nodes, passed to the miners
+  blockchain_attacks::SelfishMinerStatus      *m_selfishMinerStatus;
+  AttributeList                                m_attributes;           //!< Attributes of all the applications
+  AttributeList                                m_minerAttributes;      //!< Attributes of the miners only
+  ObjectFactory                                m_minerFactory;         //!< The factory of the current miner type
+  int                                          m_minerFactoryType;     //!< The miner type m_minerFactory is configured for, -1 if none
+  uint32_t                                     m_secureBlocks;         //!< Passed to the attackers that need it
+  std::string                                  m_decisionMatrixFile;   //!< Passed to the SELFISH_MINERs
+  uint32_t                                     m_seed;                 //!< The seed of the applications, 0 if not fixed
+};
+
+} // namespace ns3
+
+#endif /* BITCOIN_NETWORK_HELPER_H */
@@ -41,7 +41,7 @@ BitcoinTopologyHelper::BitcoinTopologyHelper (uint32_t noCpus, uint32_t totalNoN
 						                      double latencyParetoShapeDivider, uint32_t systemId)
   : m_noCpus(noCpus), m_totalNoNodes (totalNoNodes), m_noMiners (noMiners),
     m_minConnectionsPerNode (minConnectionsPerNode), m_maxConnectionsPerNode (maxConnectionsPerNode), 
-	m_totalNoLinks (0), m_latencyParetoShapeDivider (latencyParetoShapeDivider), 
+	m_totalNoLinks (0), m_linksBaseAddress (0), m_linksSubnetSize (1), m_latencyParetoShapeDivider (latencyParetoShapeDivider), 
 	m_systemId (systemId), m_minConnectionsPerMiner (700), m_maxConnectionsPerMiner (800),
 	m_minerDownloadSpeed (100), m_minerUploadSpeed (100), m_cryptocurrency (cryptocurrency)
 {
@@ -1242,20 +1242,26 @@ BitcoinTopologyHelper::AssignIpv4Addresses (Ipv4AddressHelperCustom ip)
   double tFinish;
   
   // Assign addresses to all devices in the network.
-  // These devices are stored in a vector. 
+  // These devices are stored in a vector, each link has its own subnet.
+  m_linksSubnetSize = ~(ip.GetMask ().Get ()) + 1;
+  m_linksEndpoints.reserve (2 * m_devices.size ());
+
   for (uint32_t i = 0; i < m_devices.size (); ++i)
   {
-    Ipv4InterfaceContainer newInterfaces; 
-    NetDeviceContainer currentContainer = m_devices[i];
-	  
-    newInterfaces.Add (ip.Assign (currentContainer.Get (0))); 
-    newInterfaces.Add (ip.Assign (currentContainer.Get (1)));
-	  
-    auto interfaceAddress1 = newInterfaces.GetAddress (0);
-    auto interfaceAddress2 = newInterfaces.GetAddress (1);
+    NetDeviceContainer &currentContainer = m_devices[i];
+
+    auto interfaceAddresses = ip.AssignLink (currentContainer.Get (0), currentContainer.Get (1), m_interfaces);
+    Ipv4Address interfaceAddress1 = interfaceAddresses.first;
+    Ipv4Address interfaceAddress2 = interfaceAddresses.second;
     uint32_t node1 = (currentContainer.Get (0))->GetNode()->GetId();
     uint32_t node2 = (currentContainer.Get (1))->GetNode()->GetId();
 
+    if (i == 0)
+      m_linksBaseAddress = interfaceAddress1.Get ();
+	
+    m_linksEndpoints.push_back (node1);
+    m_linksEndpoints.push_back (node2);
+
 /*     if (m_systemId == 0)
       std::cout << i << "/" << m_devices.size () << "\n"; */
 /* 	if (m_systemId == 0)
@@ -1264,10 +1270,6 @@ BitcoinTopologyHelper::AssignIpv4Addresses (Ipv4AddressHelperCustom ip)
 				
 	m_nodesConnectionsIps[node1].push_back(interfaceAddress2);
 	m_nodesConnectionsIps[node2].push_back(interfaceAddress1);
-
-    ip.NewNetwork ();
-        
-    m_interfaces.push_back (newInterfaces);
 	
 	m_peersDownloadSpeeds[node1][interfaceAddress2] = m_nodesInternetSpeeds[node2].downloadSpeed;
 	m_peersDownloadSpeeds[node2][interfaceAddress1] = m_nodesInternetSpeeds[node1].downloadSpeed;
@@ -1313,23 +1315,35 @@ BitcoinTopologyHelper::GetNode (uint32_t id)
 Ipv4InterfaceContainer
 BitcoinTopologyHelper::GetIpv4InterfaceContainer (void) const
 {
-  Ipv4InterfaceContainer ipv4InterfaceContainer;
-  
-  for (auto container = m_interfaces.begin(); container != m_interfaces.end(); container++)
-    ipv4InterfaceContainer.Add(*container);
+  return m_interfaces;
+}
 
-  return ipv4InterfaceContainer;
+
+int
+BitcoinTopologyHelper::GetNodeIdByIpv4 (Ipv4Address addr) const
+{
+  if (m_linksEndpoints.empty () || addr.Get () < m_linksBaseAddress)
+    return -1;
+
+  uint32_t offset = addr.Get () - m_linksBaseAddress;
+  uint32_t link = offset / m_linksSubnetSize;
+  uint32_t end = offset % m_linksSubnetSize;
+
+  if (end > 1 || 2 * link + end >= m_linksEndpoints.size ())
+    return -1; //if not found
+
+  return m_linksEndpoints[2 * link + end];
 }
 
 
-std::map<uint32_t, std::vector<Ipv4Address>> 
+const std::map<uint32_t, std::vector<Ipv4Address>>& 
 BitcoinTopologyHelper::GetNodesConnectionsIps (void) const
 {
   return m_nodesConnectionsIps;
 }
 
 
-std::vector<uint32_t> 
+const std::vector<uint32_t>& 
 BitcoinTopologyHelper::GetMiners (void) const
 {
   return m_miners;
@@ -1417,26 +1431,33 @@ BitcoinTopologyHelper::GetBitcoinNodesRegions (void)
 }
 
 
-std::map<uint32_t, std::map<Ipv4Address, double>> 
+const std::map<uint32_t, std::map<Ipv4Address, double>>& 
 BitcoinTopologyHelper::GetPeersDownloadSpeeds (void) const
 {
   return m_peersDownloadSpeeds;
 }
 
 
-std::map<uint32_t, std::map<Ipv4Address, double>> 
+const std::map<uint32_t, std::map<Ipv4Address, double>>& 
 BitcoinTopologyHelper::GetPeersUploadSpeeds (void) const
 {
   return m_peersUploadSpeeds;
 }
 
 
-std::map<uint32_t, nodeInternetSpeeds> 
+const std::map<uint32_t, nodeInternetSpeeds>& 
 BitcoinTopologyHelper::GetNodesInternetSpeeds (void) const
 {
   return m_nodesInternetSpeeds;
 }
 
+
+uint32_t 
+BitcoinTopologyHelper::GetTotalNoNodes (void) const
+{
+  return m_totalNoNodes;
+}
+
 } // namespace ns3
 
 static double GetWallTime()
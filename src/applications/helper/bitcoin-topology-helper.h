@@ -123,17 +123,29 @@ public:
    * Get the interface container
    */
    Ipv4InterfaceContainer GetIpv4InterfaceContainer (void) const;
+
+  /**
+   * Get the id of the node owning an Ipv4 address in constant time.
+   * Every link is given a subnet of the same size by AssignIpv4Addresses,
+   * so the link index is computed from the address and looked up in a flat table.
+   *
+   * \param addr the Ipv4 address
+   * \returns the id of the node or -1 if the address was not assigned by the helper
+   */
+   int GetNodeIdByIpv4 (Ipv4Address addr) const;
    
-   std::map<uint32_t, std::vector<Ipv4Address>> GetNodesConnectionsIps (void) const;
+   const std::map<uint32_t, std::vector<Ipv4Address>>& GetNodesConnectionsIps (void) const;
    
-   std::vector<uint32_t> GetMiners (void) const;
+   const std::vector<uint32_t>& GetMiners (void) const;
    
    uint32_t* GetBitcoinNodesRegions (void);
    
-   std::map<uint32_t, std::map<Ipv4Address, double>> GetPeersDownloadSpeeds(void) const;
-   std::map<uint32_t, std::map<Ipv4Address, double>> GetPeersUploadSpeeds(void) const;
+   const std::map<uint32_t, std::map<Ipv4Address, double>>& GetPeersDownloadSpeeds(void) const;
+   const std::map<uint32_t, std::map<Ipv4Address, double>>& GetPeersUploadSpeeds(void) const;
+
+   const std::map<uint32_t, nodeInternetSpeeds>& GetNodesInternetSpeeds (void) const;
 
-   std::map<uint32_t, nodeInternetSpeeds> GetNodesInternetSpeeds (void) const;
+   uint32_t GetTotalNoNodes (void) const;
 
 private:
 
@@ -160,7 +172,10 @@ private:
   std::map<uint32_t, std::vector<Ipv4Address>>    m_nodesConnectionsIps;     //!< key = nodeId
   std::vector<NodeContainer>                      m_nodes;                   //!< all the nodes in the network
   std::vector<NetDeviceContainer>                 m_devices;                 //!< NetDevices in the network
-  std::vector<Ipv4InterfaceContainer>             m_interfaces;              //!< IPv4 interfaces in the network
+  Ipv4InterfaceContainer                          m_interfaces;              //!< IPv4 interfaces in the network
+  uint32_t                                        m_linksBaseAddress;        //!< The first address assigned to a link
+  uint32_t                                        m_linksSubnetSize;         //!< The number of addresses in each link subnet
+  std::vector<uint32_t>                           m_linksEndpoints;          //!< The node ids of the two ends of each link, indexed by 2*link + end
   uint32_t                                       *m_bitcoinNodesRegion;      //!< The region in which the bitcoin nodes are located
   double                                          m_regionLatencies[6][6];   //!< The inter- and intra-region latencies
   double                                          m_regionDownloadSpeeds[6];     
@@ -0,0 +1,312 @@
+/**
+ * This file contains the definitions of the functions declared in bitcoin-checkpoint.h
+ */
+
+
+#include <fstream>
+#include <sstream>
+#include <map>
+#include "ns3/simulator.h"
+#include "ns3/log.h"
+#include "ns3/node.h"
+#include "bitcoin-node.h"
+#include "bitcoin-checkpoint.h"
+#include "../../rapidjson/writer.h"
+#include "../../rapidjson/stringbuffer.h"
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("BitcoinCheckpoint");
+
+BitcoinCheckpoint::BitcoinCheckpoint (ApplicationContainer apps)
+{
+  NS_LOG_FUNCTION (this);
+  Add (apps);
+}
+
+
+BitcoinCheckpoint::~BitcoinCheckpoint (void)
+{
+  NS_LOG_FUNCTION (this);
+  Simulator::Cancel (m_saveEvent);
+}
+
+
+void
+BitcoinCheckpoint::Add (ApplicationContainer apps)
+{
+  NS_LOG_FUNCTION (this);
+
+  for (ApplicationContainer::Iterator i = apps.Begin (); i != apps.End (); ++i)
+  {
+    Ptr<BitcoinNode> node = DynamicCast<BitcoinNode> (*i);
+    if (node)
+      m_nodes.push_back (node);
+  }
+}
+
+
+void
+BitcoinCheckpoint::Save (Time at, std::string fileName)
+{
+  NS_LOG_FUNCTION (this << at << fileName);
+
+  Simulator::Cancel (m_saveEvent);
+  m_saveEvent = Simulator::Schedule (at - Simulator::Now (), &BitcoinCheckpoint::Write, this, fileName);
+}
+
+
+void
+BitcoinCheckpoint::Write (std::string fileName)
+{
+  NS_LOG_FUNCTION (this << fileName);
+
+  rapidjson::Document d;
+  rapidjson::Value    value;
+  rapidjson::Value    nodes(rapidjson::kArrayType);
+
+  d.SetObject();
+
+  value = Simulator::Now ().GetSeconds ();
+  d.AddMember("time", value, d.GetAllocator());
+
+  for (auto &node : m_nodes)
+  {
+    rapidjson::Value state(rapidjson::kObjectType);
+
+    node->SaveCheckpoint (state, d.GetAllocator());
+    nodes.PushBack(state, d.GetAllocator());
+  }
+  d.AddMember("nodes", nodes, d.GetAllocator());
+
+  std::ofstream file (fileName.c_str (), std::ios::out | std::ios::trunc);
+  if (!file.is_open ())
+    NS_FATAL_ERROR ("BitcoinCheckpoint: cannot open " << fileName);
+
+  rapidjson::StringBuffer buffer;
+  rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+  d.Accept(writer);
+  file << buffer.GetString() << "\n";
+
+  NS_LOG_INFO ("BitcoinCheckpoint: At time " << Simulator::Now ().GetSeconds ()
+               << "s saved " << m_nodes.size () << " nodes to " << fileName);
+}
+
+
+Time
+BitcoinCheckpoint::Restore (std::string fileName)
+{
+  NS_LOG_FUNCTION (this << fileName);
+
+  std::ifstream file (fileName.c_str ());
+  if (!file.is_open ())
+    NS_FATAL_ERROR ("BitcoinCheckpoint: cannot open " << fileName);
+
+  std::stringstream  contents;
+  rapidjson::Document d;
+
+  contents << file.rdbuf ();
+  d.Parse(contents.str ().c_str ());
+  if (d.HasParseError () || !d.IsObject () || !d.HasMember("nodes"))
+    NS_FATAL_ERROR ("BitcoinCheckpoint: " << fileName << " is not a checkpoint");
+
+  const rapidjson::Value &nodes = GetCheckpointMember (d, "nodes", &rapidjson::Value::IsArray);
+  double                  time = GetCheckpointMember (d, "time", &rapidjson::Value::IsNumber).GetDouble();
+
+  std::map<uint32_t, const rapidjson::Value*> states;
+  for (rapidjson::SizeType j = 0; j < nodes.Size(); j++)
+    states[GetCheckpointMember (nodes[j], "nodeId", &rapidjson::Value::IsUint).GetUint()] = &nodes[j];
+
+  for (auto &node : m_nodes)
+  {
+    std::map<uint32_t, const rapidjson::Value*>::iterator it = states.find (node->GetNode ()->GetId ());
+
+    if (it == states.end ())
+      NS_FATAL_ERROR ("BitcoinCheckpoint: " << fileName << " has no state for node " << node->GetNode ()->GetId ());
+
+    rapidjson::StringBuffer buffer;
+    rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+    it->second->Accept(writer);
+    node->SetCheckpoint (buffer.GetString());
+  }
+
+  NS_LOG_INFO ("BitcoinCheckpoint: restored " << m_nodes.size () << " nodes from " << fileName
+               << " at time " << time << "s");
+  return Seconds (time);
+}
+
+
+void
+CheckpointBlock (const Block &block, rapidjson::Value &value, rapidjson::Document::AllocatorType &allocator)
+{
+  rapidjson::Value field;
+
+  value.SetArray();
+
+  field = block.GetBlockHeight ();
+  value.PushBack(field, allocator);
+  field = block.GetMinerId ();
+  value.PushBack(field, allocator);
+  field = block.GetParentBlockMinerId ();
+  value.PushBack(field, allocator);
+  field = block.GetBlockSizeBytes ();
+  value.PushBack(field, allocator);
+  field = block.GetTimeCreated ();
+  value.PushBack(field, allocator);
+  field = block.GetTimeReceived ();
+  value.PushBack(field, allocator);
+  field = block.GetReceivedFromIpv4 ().Get ();
+  value.PushBack(field, allocator);
+}
+
+
+Block
+RestoreBlock (const rapidjson::Value &value)
+{
+  if (!value.IsArray() || value.Size() != 7 || !value[0].IsInt() || !value[1].IsInt() || !value[2].IsInt()
+      || !value[3].IsInt() || !value[4].IsNumber() || !value[5].IsNumber() || !value[6].IsUint())
+    NS_FATAL_ERROR ("BitcoinCheckpoint: malformed block in the checkpoint");
+
+  return Block (value[0].GetInt(), value[1].GetInt(), value[2].GetInt(), value[3].GetInt(),
+                value[4].GetDouble(), value[5].GetDouble(), Ipv4Address (value[6].GetUint()));
+}
+
+
+/**
+ * Writes the keys of the pruned or dropped blocks as an array of [height, minerId] arrays
+ */
+static void
+CheckpointBlockKeys (const std::vector<blockKey> &keys, rapidjson::Value &value,
+                     rapidjson::Document::AllocatorType &allocator)
+{
+  rapidjson::Value field;
+
+  value.SetArray();
+  for (auto &key : keys)
+  {
+    rapidjson::Value keyArray(rapidjson::kArrayType);
+
+    field = key.height;
+    keyArray.PushBack(field, allocator);
+    field = key.minerId;
+    keyArray.PushBack(field, allocator);
+    value.PushBack(keyArray, allocator);
+  }
+}
+
+
+static void
+RestoreBlockKeys (const rapidjson::Value &value, const char *name, std::vector<blockKey> &keys)
+{
+  for (rapidjson::SizeType j = 0; j < value.Size(); j++)
+  {
+    const rapidjson::Value &keyArray = CheckCheckpointValue (value[j], name, &rapidjson::Value::IsArray);
+
+    if (keyArray.Size() != 2 || !keyArray[0u].IsInt() || !keyArray[1u].IsInt())
+      NS_FATAL_ERROR ("BitcoinCheckpoint: " << name << " has a malformed key in the checkpoint");
+
+    blockKey key = {keyArray[0u].GetInt(), keyArray[1u].GetInt()};
+    keys.push_back(key);
+  }
+}
+
+
+void
+CheckpointBlockchainState (const blockchainState &state, rapidjson::Value &value,
+                           rapidjson::Document::AllocatorType &allocator)
+{
+  rapidjson::Value field;
+  rapidjson::Value forks(rapidjson::kArrayType);
+  rapidjson::Value newForks(rapidjson::kArrayType);
+
+  value.SetObject();
+
+  field = state.noStaleBlocks;
+  value.AddMember("noStaleBlocks", field, allocator);
+  field = state.totalBlocks;
+  value.AddMember("totalBlocks", field, allocator);
+  field = state.noDroppedBlocks;
+  value.AddMember("noDroppedBlocks", field, allocator);
+  field = state.prunedHeight;
+  value.AddMember("prunedHeight", field, allocator);
+  field = state.prunedBlocksInForks;
+  value.AddMember("prunedBlocksInForks", field, allocator);
+  field = state.prunedMaxForkSize;
+  value.AddMember("prunedMaxForkSize", field, allocator);
+
+  for (auto &fork : state.prunedForks)
+  {
+    rapidjson::Value forkArray(rapidjson::kArrayType);
+
+    field = fork.first;
+    forkArray.PushBack(field, allocator);
+    field = fork.second;
+    forkArray.PushBack(field, allocator);
+    forks.PushBack(forkArray, allocator);
+  }
+  value.AddMember("prunedForks", forks, allocator);
+
+  for (auto &minerId : state.prunedNewForks)
+  {
+    field = minerId;
+    newForks.PushBack(field, allocator);
+  }
+  value.AddMember("prunedNewForks", newForks, allocator);
+
+  CheckpointBlockKeys (state.prunedBlocks, field, allocator);
+  value.AddMember("prunedBlocks", field, allocator);
+  CheckpointBlockKeys (state.droppedOrphans, field, allocator);
+  value.AddMember("droppedOrphans", field, allocator);
+}
+
+
+blockchainState
+RestoreBlockchainState (const rapidjson::Value &value)
+{
+  blockchainState state;
+
+  state.noStaleBlocks = GetCheckpointMember (value, "noStaleBlocks", &rapidjson::Value::IsInt).GetInt();
+  state.totalBlocks = GetCheckpointMember (value, "totalBlocks", &rapidjson::Value::IsInt).GetInt();
+  state.noDroppedBlocks = GetCheckpointMember (value, "noDroppedBlocks", &rapidjson::Value::IsInt).GetInt();
+  state.prunedHeight = GetCheckpointMember (value, "prunedHeight", &rapidjson::Value::IsInt).GetInt();
+  state.prunedBlocksInForks = GetCheckpointMember (value, "prunedBlocksInForks", &rapidjson::Value::IsInt).GetInt();
+  state.prunedMaxForkSize = GetCheckpointMember (value, "prunedMaxForkSize", &rapidjson::Value::IsInt).GetInt();
+
+  const rapidjson::Value &forks = GetCheckpointMember (value, "prunedForks", &rapidjson::Value::IsArray);
+  for (rapidjson::SizeType j = 0; j < forks.Size(); j++)
+  {
+    const rapidjson::Value &fork = CheckCheckpointValue (forks[j], "prunedForks", &rapidjson::Value::IsArray);
+
+    if (fork.Size() != 2 || !fork[0u].IsInt() || !fork[1u].IsInt())
+      NS_FATAL_ERROR ("BitcoinCheckpoint: malformed fork in the checkpoint");
+    state.prunedForks[fork[0u].GetInt()] = fork[1u].GetInt();
+  }
+
+  const rapidjson::Value &newForks = GetCheckpointMember (value, "prunedNewForks", &rapidjson::Value::IsArray);
+  for (rapidjson::SizeType j = 0; j < newForks.Size(); j++)
+    state.prunedNewForks.push_back(CheckCheckpointValue (newForks[j], "prunedNewForks", &rapidjson::Value::IsInt).GetInt());
+
+  RestoreBlockKeys (GetCheckpointMember (value, "prunedBlocks", &rapidjson::Value::IsArray), "prunedBlocks", state.prunedBlocks);
+  RestoreBlockKeys (GetCheckpointMember (value, "droppedOrphans", &rapidjson::Value::IsArray), "droppedOrphans", state.droppedOrphans);
+  return state;
+}
+
+
+const rapidjson::Value&
+CheckCheckpointValue (const rapidjson::Value &value, const char *name, bool (rapidjson::Value::*check) (void) const)
+{
+  if (!(value.*check) ())
+    NS_FATAL_ERROR ("BitcoinCheckpoint: " << name << " has the wrong type in the checkpoint");
+  return value;
+}
+
+
+const rapidjson::Value&
+GetCheckpointMember (const rapidjson::Value &object, const char *name, bool (rapidjson::Value::*check) (void) const)
+{
+  if (!object.IsObject() || !object.HasMember(name))
+    NS_FATAL_ERROR ("BitcoinCheckpoint: " << name << " is missing from the checkpoint");
+  return CheckCheckpointValue (object[name], name, check);
+}
+
+}// Namespace ns3
@@ -0,0 +1,111 @@
+/**
+ * This file declares the BitcoinCheckpoint class and the functions converting blocks from and to
+ * their checkpoint representation.
+ */
+
+
+#ifndef BITCOIN_CHECKPOINT_H
+#define BITCOIN_CHECKPOINT_H
+
+#include <vector>
+#include <string>
+#include "ns3/ptr.h"
+#include "ns3/nstime.h"
+#include "ns3/event-id.h"
+#include "ns3/application-container.h"
+#include "bitcoin.h"
+#include "../../rapidjson/document.h"
+
+namespace ns3 {
+
+class BitcoinNode;
+
+/**
+ * Saves the state of the bitcoin applications installed in this system to a json file and restores it
+ * in a later run, so that many simulations can branch off one warm-up instead of simulating it again.
+ * A checkpoint holds the Blockchain of each node, its pending requests (m_queueInv, the time left of
+ * m_invTimeouts, m_receivedNotValidated, m_onlyHeadersReceived), its bandwidth queues and statistics,
+ * and for the miners the state of the random generator and the time left until the next block.
+ * The restored run must build the same topology and start the applications at the time returned by Restore.
+ * The messages in flight, the partially received data and the blockTorrent downloads are not saved:
+ * the requests pending at the checkpoint are sent again when their timeouts expire.
+ */
+class BitcoinCheckpoint
+{
+public:
+  /**
+   * \param apps the applications to checkpoint. Applications which are not BitcoinNodes are ignored.
+   */
+  BitcoinCheckpoint (ApplicationContainer apps);
+
+  virtual ~BitcoinCheckpoint (void);
+
+  /**
+   * \brief Add more applications to checkpoint
+   */
+  void Add (ApplicationContainer apps);
+
+  /**
+   * \brief Schedule a checkpoint
+   * \param at the simulation time of the checkpoint
+   * \param fileName the file the checkpoint is written to
+   */
+  void Save (Time at, std::string fileName);
+
+  /**
+   * \brief Read a checkpoint and hand each application its state, which it restores when it starts.
+   * The applications are matched by node id.
+   * \param fileName the file written by Save
+   * \return the simulation time of the checkpoint, at which the applications must start
+   */
+  Time Restore (std::string fileName);
+
+private:
+  void Write (std::string fileName);
+
+  std::vector<Ptr<BitcoinNode>>   m_nodes;             //!< The checkpointed applications
+  EventId                         m_saveEvent;         //!< Event of the next checkpoint
+};
+
+/**
+ * \brief Write a block as a json array: [height, minerId, parentBlockMinerId, size, timeCreated, timeReceived, receivedFromIpv4]
+ */
+void CheckpointBlock (const Block &block, rapidjson::Value &value, rapidjson::Document::AllocatorType &allocator);
+
+/**
+ * \return the block written by CheckpointBlock. Aborts the simulation if value is not such a block.
+ */
+Block RestoreBlock (const rapidjson::Value &value);
+
+/**
+ * \brief Write the blockchainState of a Blockchain as a json object
+ */
+void CheckpointBlockchainState (const blockchainState &state, rapidjson::Value &value,
+                                rapidjson::Document::AllocatorType &allocator);
+
+/**
+ * \return the blockchainState written by CheckpointBlockchainState. Aborts the simulation if value is not such a state.
+ */
+blockchainState RestoreBlockchainState (const rapidjson::Value &value);
+
+/**
+ * \brief Check the type of a value read from a checkpoint, so that a malformed checkpoint aborts the
+ * simulation with an error instead of failing an assertion of rapidjson
+ * \param value the value
+ * \param name the name of the value, used in the error
+ * \param check the type check, e.g. &rapidjson::Value::IsArray
+ * \return value
+ */
+const rapidjson::Value& CheckCheckpointValue (const rapidjson::Value &value, const char *name,
+                                              bool (rapidjson::Value::*check) (void) const);
+
+/**
+ * \return the member name of a checkpoint object, checked by CheckCheckpointValue. Aborts the simulation
+ * if object is not an object or has no such member.
+ */
+const rapidjson::Value& GetCheckpointMember (const rapidjson::Value &object, const char *name,
+                                             bool (rapidjson::Value::*check) (void) const);
+
+}// Namespace ns3
+
+#endif /* BITCOIN_CHECKPOINT_H */
@@ -0,0 +1,234 @@
+/**
+ * This file contains the definitions of the functions declared in bitcoin-chunk-scheduler.h
+ */
+
+
+#include <algorithm>
+#include <stdlib.h>
+#include "ns3/log.h"
+#include "bitcoin-memory-usage.h"
+#include "bitcoin-chunk-scheduler.h"
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("BitcoinChunkScheduler");
+
+BitcoinChunkScheduler::BitcoinChunkScheduler (void) : m_rarestFirst (false), m_chunkSize (100000), m_maxChunksInFlight (8),
+                                                      m_batchSeconds (0.5), m_endgameChunks (4)
+{
+  NS_LOG_FUNCTION (this);
+}
+
+
+BitcoinChunkScheduler::~BitcoinChunkScheduler (void)
+{
+  NS_LOG_FUNCTION (this);
+}
+
+
+void
+BitcoinChunkScheduler::SetRarestFirst (bool rarestFirst)
+{
+  m_rarestFirst = rarestFirst;
+}
+
+
+void
+BitcoinChunkScheduler::SetChunkSize (int chunkSize)
+{
+  if (chunkSize <= 0)
+    NS_FATAL_ERROR ("BitcoinChunkScheduler: the chunk size must be positive");
+  m_chunkSize = chunkSize;
+}
+
+
+void
+BitcoinChunkScheduler::SetMaxChunksInFlight (int maxChunksInFlight)
+{
+  if (maxChunksInFlight <= 0)
+    NS_FATAL_ERROR ("BitcoinChunkScheduler: the maximum number of chunks in flight must be positive");
+  m_maxChunksInFlight = maxChunksInFlight;
+}
+
+
+void
+BitcoinChunkScheduler::SetBatchSeconds (double batchSeconds)
+{
+  m_batchSeconds = batchSeconds;
+}
+
+
+void
+BitcoinChunkScheduler::SetEndgameChunks (int endgameChunks)
+{
+  m_endgameChunks = endgameChunks;
+}
+
+
+int
+BitcoinChunkScheduler::GetBatchSize (double bytesPerSecond) const
+{
+  if (!m_rarestFirst)
+    return 1;
+
+  int batchSize = bytesPerSecond * m_batchSeconds / m_chunkSize;
+  return std::max (1, std::min (batchSize, m_maxChunksInFlight));
+}
+
+
+void
+BitcoinChunkScheduler::AddPeerChunks (const std::string &blockHash, int noChunks, Ipv4Address peer, const ChunkBitmap &chunks)
+{
+  NS_LOG_FUNCTION (this << blockHash << noChunks << peer);
+
+  scheduledBlock &block = m_blocks[blockHash];
+
+  if (block.noChunks != noChunks)
+  {
+    block.noChunks = noChunks;
+    block.peersPerChunk.resize (noChunks, 0);
+  }
+
+  ChunkBitmap &peerChunks = block.peerChunks[peer];
+
+  for (auto &chunk : chunks.GetChunks ())
+  {
+    if (chunk < noChunks && !peerChunks.Test (chunk))
+    {
+      peerChunks.Set (chunk);
+      block.peersPerChunk[chunk]++;
+    }
+  }
+}
+
+
+std::vector<int>
+BitcoinChunkScheduler::PickChunks (const std::string &blockHash, Ipv4Address peer, ChunkBitmap &queue,
+                                   const ChunkBitmap &received, int maxChunks)
+{
+  NS_LOG_FUNCTION (this << blockHash << peer << maxChunks);
+
+  std::vector<int>  picked;
+  auto              block_it = m_blocks.find (blockHash);
+
+  if (block_it == m_blocks.end ())
+    return picked;
+
+  scheduledBlock   &block = block_it->second;
+  ChunkBitmap      &inFlight = block.inFlight[peer];
+  const ChunkBitmap &peerChunks = block.peerChunks[peer];
+  std::vector<int>  candidateChunks = queue.Intersect (peerChunks).GetChunks ();
+
+  if (!m_rarestFirst)
+  {
+    if (candidateChunks.size () > 0)
+      picked.push_back (candidateChunks[rand () % candidateChunks.size ()]);
+  }
+  else
+  {
+    maxChunks = std::min (maxChunks, m_maxChunksInFlight - inFlight.Count ());
+
+    /**
+     * Endgame: every chunk has been requested and only a few are missing,
+     * so ask this peer too for the ones it has and are still in flight elsewhere
+     */
+    if (candidateChunks.empty () && queue.Count () == 0 && block.noChunks - received.Count () <= m_endgameChunks)
+    {
+      for (auto &chunk : peerChunks.GetChunks ())
+      {
+        if (!received.Test (chunk) && !inFlight.Test (chunk))
+          candidateChunks.push_back (chunk);
+      }
+      NS_LOG_INFO ("BitcoinChunkScheduler: endgame for block " << blockHash << " with " << candidateChunks.size () << " candidate chunks");
+    }
+
+    //Shuffle first, so that equally rare chunks are picked randomly
+    for (int i = candidateChunks.size () - 1; i > 0; i--)
+      std::swap (candidateChunks[i], candidateChunks[rand () % (i + 1)]);
+    std::stable_sort (candidateChunks.begin (), candidateChunks.end (),
+                      [&block](int a, int b) { return block.peersPerChunk[a] < block.peersPerChunk[b]; });
+
+    for (int i = 0; i < maxChunks && i < static_cast<int>(candidateChunks.size ()); i++)
+      picked.push_back (candidateChunks[i]);
+  }
+
+  for (auto &chunk : picked)
+  {
+    queue.Reset (chunk);
+    inFlight.Set (chunk);
+  }
+
+  return picked;
+}
+
+
+void
+BitcoinChunkScheduler::RemoveInFlight (const std::string &blockHash, int chunk)
+{
+  NS_LOG_FUNCTION (this << blockHash << chunk);
+
+  auto block_it = m_blocks.find (blockHash);
+
+  if (block_it == m_blocks.end ())
+    return;
+
+  for (auto &peer : block_it->second.inFlight)
+    peer.second.Reset (chunk);
+}
+
+
+void
+BitcoinChunkScheduler::RemoveInFlight (const std::string &blockHash, int chunk, Ipv4Address peer)
+{
+  NS_LOG_FUNCTION (this << blockHash << chunk << peer);
+
+  auto block_it = m_blocks.find (blockHash);
+
+  if (block_it == m_blocks.end ())
+    return;
+
+  auto peer_it = block_it->second.inFlight.find (peer);
+  if (peer_it != block_it->second.inFlight.end ())
+    peer_it->second.Reset (chunk);
+}
+
+
+void
+BitcoinChunkScheduler::RemoveBlock (const std::string &blockHash)
+{
+  NS_LOG_FUNCTION (this << blockHash);
+  m_blocks.erase (blockHash);
+}
+
+
+int
+BitcoinChunkScheduler::GetInFlight (const std::string &blockHash, Ipv4Address peer) const
+{
+  auto block_it = m_blocks.find (blockHash);
+
+  if (block_it == m_blocks.end ())
+    return 0;
+
+  auto peer_it = block_it->second.inFlight.find (peer);
+  return peer_it == block_it->second.inFlight.end () ? 0 : peer_it->second.Count ();
+}
+
+
+containerUsage
+BitcoinChunkScheduler::GetMemoryUsage (void) const
+{
+  containerUsage usage;
+
+  usage.bytes = sizeof(m_blocks);
+  usage.elements = m_blocks.size ();
+
+  for (auto &block : m_blocks)
+  {
+    usage.bytes += sizeof(std::map<std::string, scheduledBlock>::value_type) + MAP_NODE_OVERHEAD_BYTES
+                   + HeapBytes (block.first) + HeapBytes (block.second.peersPerChunk)
+                   + HeapBytes (block.second.peerChunks) + HeapBytes (block.second.inFlight);
+  }
+  return usage;
+}
+
+}// Namespace ns3
@@ -0,0 +1,125 @@
+/**
+ * This file declares the BitcoinChunkScheduler class.
+ */
+
+
+#ifndef BITCOIN_CHUNK_SCHEDULER_H
+#define BITCOIN_CHUNK_SCHEDULER_H
+
+#include <map>
+#include <string>
+#include <vector>
+#include "ns3/ipv4-address.h"
+#include "bitcoin.h"
+
+namespace ns3 {
+
+/**
+ * Decides which chunks of a block a BitcoinNode requests from each peer, when blockTorrent is used.
+ * It keeps the chunks advertised by every peer and the chunks requested from every peer, which
+ * are still in flight.
+ *
+ * In the rarest-first mode the chunks advertised by the fewest peers are requested first, the initial
+ * requests to a peer are batched according to the bandwidth between the two nodes, the number of chunks
+ * in flight per peer is limited and, when only a few chunks are missing, the chunks already in flight
+ * are requested from the other peers too (endgame). Otherwise a single random chunk is picked, as
+ * in the original blockTorrent implementation.
+ */
+class BitcoinChunkScheduler
+{
+public:
+  BitcoinChunkScheduler (void);
+
+  virtual ~BitcoinChunkScheduler (void);
+
+  void SetRarestFirst (bool rarestFirst);
+
+  /**
+   * \brief Set the size of the chunks in Bytes
+   */
+  void SetChunkSize (int chunkSize);
+
+  /**
+   * \brief Set the maximum number of chunks in flight per peer, used only in the rarest-first mode
+   */
+  void SetMaxChunksInFlight (int maxChunksInFlight);
+
+  /**
+   * \brief Set the time a batch of requests should keep the link to a peer busy, used only in the rarest-first mode
+   */
+  void SetBatchSeconds (double batchSeconds);
+
+  /**
+   * \brief Set the number of missing chunks below which the endgame starts, used only in the rarest-first mode
+   */
+  void SetEndgameChunks (int endgameChunks);
+
+  /**
+   * \brief Get the number of chunks which should be requested at once from a peer
+   * \param bytesPerSecond the speed at which the node can receive from the peer in Bytes/s
+   * \return the batch size, always 1 if the rarest-first mode is not used
+   */
+  int GetBatchSize (double bytesPerSecond) const;
+
+  /**
+   * \brief Add the chunks advertised by a peer to the chunks known to be available at the peer
+   * \param blockHash the block hash
+   * \param noChunks the number of chunks of the block
+   * \param peer the Ipv4 address of the peer
+   * \param chunks the chunks advertised by the peer
+   */
+  void AddPeerChunks (const std::string &blockHash, int noChunks, Ipv4Address peer, const ChunkBitmap &chunks);
+
+  /**
+   * \brief Pick the chunks which will be requested from a peer and mark them as in flight
+   * \param blockHash the block hash
+   * \param peer the Ipv4 address of the peer
+   * \param queue the chunks which have not been requested yet. The picked chunks are removed from it
+   * \param received the chunks which have been received
+   * \param maxChunks the maximum number of chunks to pick
+   * \return the picked chunks, empty if the peer does not have any chunks we need
+   */
+  std::vector<int> PickChunks (const std::string &blockHash, Ipv4Address peer, ChunkBitmap &queue,
+                               const ChunkBitmap &received, int maxChunks);
+
+  /**
+   * \brief A chunk has been received, so it is no longer in flight from any peer
+   */
+  void RemoveInFlight (const std::string &blockHash, int chunk);
+
+  /**
+   * \brief The request of a chunk to a peer has timed out, so it is no longer in flight from this peer
+   */
+  void RemoveInFlight (const std::string &blockHash, int chunk, Ipv4Address peer);
+
+  /**
+   * \brief Remove all the information kept about a block
+   */
+  void RemoveBlock (const std::string &blockHash);
+
+  /**
+   * \return the number of chunks of the block in flight from the peer
+   */
+  int GetInFlight (const std::string &blockHash, Ipv4Address peer) const;
+
+  containerUsage GetMemoryUsage (void) const;
+
+private:
+  typedef struct {
+    int                                  noChunks;
+    std::vector<int>                     peersPerChunk;       //the number of peers which have advertised each chunk
+    std::map<Ipv4Address, ChunkBitmap>   peerChunks;          //the chunks advertised by each peer
+    std::map<Ipv4Address, ChunkBitmap>   inFlight;            //the chunks requested from each peer and not received yet
+  } scheduledBlock;
+
+  bool                                   m_rarestFirst;          //!< True if the rarest-first mode is used, False otherwise
+  int                                    m_chunkSize;            //!< The size of the chunks in Bytes
+  int                                    m_maxChunksInFlight;    //!< The maximum number of chunks in flight per peer
+  double                                 m_batchSeconds;         //!< The time a batch of requests should keep the link to a peer busy
+  int                                    m_endgameChunks;        //!< The number of missing chunks below which the endgame starts
+  std::map<std::string, scheduledBlock>  m_blocks;               //!< The blocks being downloaded, key = block_hash
+};
+
+}// Namespace ns3
+
+#endif /* BITCOIN_CHUNK_SCHEDULER_H */
@@ -0,0 +1,170 @@
+/**
+ * This file contains the definitions of the functions declared in bitcoin-event-profiler.h
+ */
+
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include "ns3/simulator.h"
+#include "ns3/log.h"
+#include "bitcoin-event-profiler.h"
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("BitcoinEventProfiler");
+
+const double                  BitcoinEventProfiler::HISTOGRAM_MIN_US = 0.01;
+const double                  BitcoinEventProfiler::HISTOGRAM_GROWTH = 1.05;
+bool                          BitcoinEventProfiler::m_enabled = false;
+BitcoinEventProfiler::Scope  *BitcoinEventProfiler::m_current = 0;
+long                          BitcoinEventProfiler::m_counts[NO_OF_BITCOIN_EVENTS];
+long                          BitcoinEventProfiler::m_cancellations[NO_OF_BITCOIN_EVENTS];
+double                        BitcoinEventProfiler::m_totalSeconds[NO_OF_BITCOIN_EVENTS];
+long                          BitcoinEventProfiler::m_histograms[NO_OF_BITCOIN_EVENTS][HISTOGRAM_BUCKETS];
+
+
+const char* getBitcoinEventName(enum BitcoinEventType e)
+{
+  switch (e)
+  {
+    case MINE_BLOCK_EVENT: return "MineBlock";
+    case AFTER_BLOCK_VALIDATION_EVENT: return "AfterBlockValidation";
+    case RECEIVED_BLOCK_MESSAGE_EVENT: return "ReceivedBlockMessage";
+    case RECEIVED_CHUNK_MESSAGE_EVENT: return "ReceivedChunkMessage";
+    case SEND_BLOCK_EVENT: return "SendBlock";
+    case SEND_CHUNK_EVENT: return "SendChunk";
+    case REMOVE_SEND_TIME_EVENT: return "RemoveSendTime";
+    case REMOVE_COMPRESSED_BLOCK_SEND_TIME_EVENT: return "RemoveCompressedBlockSendTime";
+    case REMOVE_RECEIVE_TIME_EVENT: return "RemoveReceiveTime";
+    case REMOVE_COMPRESSED_BLOCK_RECEIVE_TIME_EVENT: return "RemoveCompressedBlockReceiveTime";
+    case INV_TIMEOUT_EXPIRED_EVENT: return "InvTimeoutExpired";
+    case CHUNK_TIMEOUT_EXPIRED_EVENT: return "ChunkTimeoutExpired";
+    case SEND_ANNOUNCEMENTS_EVENT: return "SendAnnouncements";
+    case NO_OF_BITCOIN_EVENTS: break;
+  }
+  return "";
+}
+
+
+void
+BitcoinEventProfiler::Enable (void)
+{
+  NS_LOG_FUNCTION_NOARGS ();
+  m_enabled = true;
+}
+
+
+void
+BitcoinEventProfiler::Disable (void)
+{
+  NS_LOG_FUNCTION_NOARGS ();
+  m_enabled = false;
+}
+
+
+bool
+BitcoinEventProfiler::IsEnabled (void)
+{
+  return m_enabled;
+}
+
+
+void
+BitcoinEventProfiler::Reset (void)
+{
+  NS_LOG_FUNCTION_NOARGS ();
+
+  for (int i = 0; i < NO_OF_BITCOIN_EVENTS; i++)
+  {
+    m_counts[i] = 0;
+    m_cancellations[i] = 0;
+    m_totalSeconds[i] = 0;
+    for (int j = 0; j < HISTOGRAM_BUCKETS; j++)
+      m_histograms[i][j] = 0;
+  }
+}
+
+
+void
+BitcoinEventProfiler::Cancel (EventId &event, enum BitcoinEventType type)
+{
+  if (m_enabled && event.IsRunning ())
+    m_cancellations[type]++;
+
+  Simulator::Cancel (event);
+}
+
+
+long
+BitcoinEventProfiler::GetTotalCount (void)
+{
+  long total = 0;
+
+  for (int i = 0; i < NO_OF_BITCOIN_EVENTS; i++)
+    total += m_counts[i];
+  return total;
+}
+
+
+void
+BitcoinEventProfiler::Record (enum BitcoinEventType type, std::chrono::steady_clock::duration duration)
+{
+  double seconds = std::chrono::duration<double> (duration).count ();
+  int    bucket = 0;
+
+  if (seconds * 1e6 > HISTOGRAM_MIN_US)
+    bucket = std::min (static_cast<int>(std::ceil (std::log (seconds * 1e6 / HISTOGRAM_MIN_US) / std::log (HISTOGRAM_GROWTH))),
+                       HISTOGRAM_BUCKETS - 1);
+
+  m_counts[type]++;
+  m_totalSeconds[type] += seconds;
+  m_histograms[type][bucket]++;
+}
+
+
+void
+BitcoinEventProfiler::Print (std::ostream &out, double simulatedSeconds)
+{
+  long    totalCount = 0;
+  long    totalCancellations = 0;
+  double  totalSeconds = 0;
+
+  out << "\nEvent profile over " << simulatedSeconds << "s of simulated time:\n";
+  out << std::left << std::setw(34) << "Event" << std::right
+      << std::setw(12) << "Count" << std::setw(14) << "Total(s)" << std::setw(14) << "p99(us)"
+      << std::setw(14) << "Events/sec" << std::setw(14) << "Cancelled" << "\n";
+
+  for (int i = 0; i < NO_OF_BITCOIN_EVENTS; i++)
+  {
+    long   rank = static_cast<long>(std::ceil (0.99 * m_counts[i]));
+    long   executions = 0;
+    double p99 = 0;
+
+    for (int j = 0; j < HISTOGRAM_BUCKETS && m_counts[i] > 0; j++)
+    {
+      executions += m_histograms[i][j];
+      if (executions >= rank)
+      {
+        p99 = HISTOGRAM_MIN_US * std::pow (HISTOGRAM_GROWTH, j);   //the upper bound of the bucket
+        break;
+      }
+    }
+
+    out << std::left << std::setw(34) << getBitcoinEventName (static_cast<enum BitcoinEventType>(i)) << std::right
+        << std::setw(12) << m_counts[i] << std::setw(14) << m_totalSeconds[i] << std::setw(14) << p99
+        << std::setw(14) << (simulatedSeconds > 0 ? m_counts[i] / simulatedSeconds : 0)
+        << std::setw(14) << m_cancellations[i] << "\n";
+
+    totalCount += m_counts[i];
+    totalCancellations += m_cancellations[i];
+    totalSeconds += m_totalSeconds[i];
+  }
+
+  out << std::left << std::setw(34) << "Total" << std::right
+      << std::setw(12) << totalCount << std::setw(14) << totalSeconds << std::setw(14) << ""
+      << std::setw(14) << (simulatedSeconds > 0 ? totalCount / simulatedSeconds : 0)
+      << std::setw(14) << totalCancellations << "\n" << std::endl;
+}
+
+}// Namespace ns3
@@ -0,0 +1,142 @@
+/**
+ * This file declares the BitcoinEventProfiler, which counts and times the simulator events
+ * scheduled by the bitcoin applications.
+ */
+
+
+#ifndef BITCOIN_EVENT_PROFILER_H
+#define BITCOIN_EVENT_PROFILER_H
+
+#include <ostream>
+#include <chrono>
+#include "ns3/event-id.h"
+
+namespace ns3 {
+
+/**
+ * The simulator events of the bitcoin applications that are profiled.
+ */
+enum BitcoinEventType
+{
+  MINE_BLOCK_EVENT,                          //0
+  AFTER_BLOCK_VALIDATION_EVENT,              //1
+  RECEIVED_BLOCK_MESSAGE_EVENT,              //2
+  RECEIVED_CHUNK_MESSAGE_EVENT,              //3
+  SEND_BLOCK_EVENT,                          //4
+  SEND_CHUNK_EVENT,                          //5
+  REMOVE_SEND_TIME_EVENT,                    //6
+  REMOVE_COMPRESSED_BLOCK_SEND_TIME_EVENT,   //7
+  REMOVE_RECEIVE_TIME_EVENT,                 //8
+  REMOVE_COMPRESSED_BLOCK_RECEIVE_TIME_EVENT,//9
+  INV_TIMEOUT_EXPIRED_EVENT,                 //10
+  CHUNK_TIMEOUT_EXPIRED_EVENT,               //11
+  SEND_ANNOUNCEMENTS_EVENT,                  //12
+  NO_OF_BITCOIN_EVENTS                       //must always be the last one
+};
+
+const char* getBitcoinEventName(enum BitcoinEventType e);
+
+
+/**
+ * Collects the number of executions, the wall time spent and the number of cancellations of every
+ * BitcoinEventType. It is disabled by default; when disabled, every hook costs a single branch.
+ *
+ * The executions are timed by placing a BitcoinEventProfiler::Scope at the beginning of the event handler.
+ * The times are exclusive: a scope of another type opened inside a handler is counted as an execution of its
+ * own type, and its time is subtracted from the enclosing one. A nested scope of the same type (e.g. an
+ * overridden MineBlock calling the one of its base class) is part of the enclosing execution.
+ *
+ * The wall times are kept in a fixed-size histogram per type, with geometric buckets HISTOGRAM_GROWTH apart,
+ * so the memory used does not grow with the number of events and the p99 is accurate to the bucket width.
+ */
+class BitcoinEventProfiler
+{
+public:
+  /**
+   * Times the enclosing scope as one execution of an event.
+   */
+  class Scope
+  {
+  public:
+    Scope (enum BitcoinEventType type)
+      : m_timed (false)
+    {
+      if (m_enabled && (m_current == 0 || m_current->m_type != type))
+      {
+        m_timed = true;
+        m_type = type;
+        m_parent = m_current;
+        m_childDuration = std::chrono::steady_clock::duration::zero ();
+        m_current = this;
+        m_start = std::chrono::steady_clock::now ();
+      }
+    }
+
+    ~Scope (void)
+    {
+      if (m_timed)
+      {
+        std::chrono::steady_clock::duration duration = std::chrono::steady_clock::now () - m_start;
+
+        Record (m_type, duration - m_childDuration);
+        if (m_parent)
+          m_parent->m_childDuration += duration;
+        m_current = m_parent;
+      }
+    }
+
+  private:
+    Scope (const Scope &);
+    Scope& operator= (const Scope &);
+
+    bool                                   m_timed;         //!< Whether this scope times an execution
+    enum BitcoinEventType                  m_type;
+    Scope                                 *m_parent;        //!< The enclosing timed scope, 0 if none
+    std::chrono::steady_clock::duration    m_childDuration; //!< The time spent in the nested timed scopes
+    std::chrono::steady_clock::time_point  m_start;
+  };
+
+  static const int    HISTOGRAM_BUCKETS = 512;
+  static const double HISTOGRAM_MIN_US;      //!< The upper bound of the first bucket in microseconds
+  static const double HISTOGRAM_GROWTH;      //!< The ratio of the bounds of consecutive buckets
+
+  static void Enable (void);
+  static void Disable (void);
+  static bool IsEnabled (void);
+
+  /**
+   * Clears all the collected data.
+   */
+  static void Reset (void);
+
+  /**
+   * Cancels a pending event. The cancellation is recorded only if the event had not expired yet.
+   */
+  static void Cancel (EventId &event, enum BitcoinEventType type);
+
+  /**
+   * \return the number of executions of all the event types
+   */
+  static long GetTotalCount (void);
+
+  /**
+   * Prints a table with the count, total and 99th percentile wall time of every event type,
+   * as well as the events per simulated second.
+   * \param simulatedSeconds the simulated time over which the events were collected
+   */
+  static void Print (std::ostream &out, double simulatedSeconds);
+
+private:
+  static void Record (enum BitcoinEventType type, std::chrono::steady_clock::duration duration);
+
+  static bool                   m_enabled;           //!< Whether the events are profiled (DEFAULT: false)
+  static Scope                 *m_current;          //!< The innermost timed scope, 0 if none
+  static long                   m_counts[NO_OF_BITCOIN_EVENTS];
+  static long                   m_cancellations[NO_OF_BITCOIN_EVENTS];
+  static double                 m_totalSeconds[NO_OF_BITCOIN_EVENTS];
+  static long                   m_histograms[NO_OF_BITCOIN_EVENTS][HISTOGRAM_BUCKETS]; //!< The executions per wall time bucket
+};
+
+}// Namespace ns3
+
+#endif /* BITCOIN_EVENT_PROFILER_H */
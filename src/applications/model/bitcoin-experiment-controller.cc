@@ -0,0 +1,215 @@
+/**
+ * This file contains the definitions of the functions declared in bitcoin-experiment-controller.h
+ */
+
+
+#include <cmath>
+#include "ns3/log.h"
+#include "bitcoin-experiment-controller.h"
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("BitcoinExperimentController");
+
+BitcoinExperimentController::BitcoinExperimentController (double confidence, uint32_t minIterations, uint32_t maxIterations)
+  : m_confidence (confidence), m_minIterations (minIterations), m_maxIterations (maxIterations), m_iterations (0)
+{
+  NS_LOG_FUNCTION (this);
+
+  if (m_confidence <= 0 || m_confidence >= 1)
+    NS_FATAL_ERROR ("BitcoinExperimentController: the confidence must be in (0, 1)");
+  if (m_minIterations < 2)
+    m_minIterations = 2;
+}
+
+
+BitcoinExperimentController::~BitcoinExperimentController (void)
+{
+  NS_LOG_FUNCTION (this);
+}
+
+
+int
+BitcoinExperimentController::AddMetric (std::string name, double targetHalfWidth)
+{
+  NS_LOG_FUNCTION (this << name << targetHalfWidth);
+
+  Metric metric;
+
+  metric.name = name;
+  metric.targetHalfWidth = targetHalfWidth;
+  metric.samples = 0;
+  metric.mean = 0;
+  metric.m2 = 0;
+  m_metrics.push_back (metric);
+
+  return m_metrics.size () - 1;
+}
+
+
+void
+BitcoinExperimentController::AddSample (int metric, double value)
+{
+  NS_LOG_FUNCTION (this << metric << value);
+
+  Metric &m = m_metrics[metric];
+  double  delta = value - m.mean;
+
+  m.samples++;
+  m.mean += delta / m.samples;
+  m.m2 += delta * (value - m.mean);
+}
+
+
+void
+BitcoinExperimentController::EndIteration (void)
+{
+  NS_LOG_FUNCTION (this);
+
+  m_iterations++;
+
+  for (uint32_t i = 0; i < m_metrics.size (); i++)
+    NS_LOG_INFO ("BitcoinExperimentController: Iteration " << m_iterations << " " << m_metrics[i].name
+                 << " = " << m_metrics[i].mean << " +- " << GetHalfWidth (i));
+}
+
+
+bool
+BitcoinExperimentController::IsDone (void) const
+{
+  if (m_iterations >= m_maxIterations)
+    return true;
+  if (m_iterations < m_minIterations)
+    return false;
+  return IsPrecise ();
+}
+
+
+bool
+BitcoinExperimentController::IsPrecise (void) const
+{
+  for (uint32_t i = 0; i < m_metrics.size (); i++)
+  {
+    if (m_metrics[i].targetHalfWidth <= 0)
+      continue;
+
+    double halfWidth = GetHalfWidth (i);
+    if (halfWidth < 0 || halfWidth > m_metrics[i].targetHalfWidth)
+      return false;
+  }
+  return true;
+}
+
+
+uint32_t
+BitcoinExperimentController::GetIterations (void) const
+{
+  return m_iterations;
+}
+
+
+double
+BitcoinExperimentController::GetMean (int metric) const
+{
+  return m_metrics[metric].mean;
+}
+
+
+double
+BitcoinExperimentController::GetVariance (int metric) const
+{
+  if (m_metrics[metric].samples < 2)
+    return 0;
+  return m_metrics[metric].m2 / (m_metrics[metric].samples - 1);
+}
+
+
+double
+BitcoinExperimentController::GetHalfWidth (int metric) const
+{
+  uint32_t samples = m_metrics[metric].samples;
+
+  if (samples < 2)
+    return -1;
+  return GetCriticalValue (samples - 1) * std::sqrt (GetVariance (metric) / samples);
+}
+
+
+void
+BitcoinExperimentController::PrintPrecision (std::ostream &out) const
+{
+  out << "The experiment stopped after " << m_iterations << " iterations ";
+  if (IsPrecise ())
+    out << "having reached the target precision.\n";
+  else
+    out << "without reaching the target precision.\n";
+
+  for (uint32_t i = 0; i < m_metrics.size (); i++)
+  {
+    double halfWidth = GetHalfWidth (i);
+
+    out << m_metrics[i].name << " = " << m_metrics[i].mean
+        << " (standard deviation " << std::sqrt (GetVariance (i)) << ")";
+    if (halfWidth >= 0)
+      out << " +- " << halfWidth << " at " << m_confidence * 100 << "% confidence";
+    if (m_metrics[i].targetHalfWidth > 0)
+      out << ", target +- " << m_metrics[i].targetHalfWidth;
+    out << "\n";
+  }
+}
+
+
+double
+BitcoinExperimentController::GetCriticalValue (uint32_t degreesOfFreedom) const
+{
+  double p = 1 - (1 - m_confidence) / 2;
+  double v = degreesOfFreedom;
+
+  /**
+   * The t distributions with 1 and 2 degrees of freedom have closed-form quantiles
+   */
+  if (degreesOfFreedom == 1)
+    return std::tan (M_PI * (p - 0.5));
+  if (degreesOfFreedom == 2)
+    return (2 * p - 1) / std::sqrt (2 * p * (1 - p));
+
+  /**
+   * The normal quantile, by Acklam's rational approximation of the upper region
+   */
+  const double a[] = {-3.969683028665376e+01, 2.209460984245205e+02, -2.759285104469687e+02,
+                      1.383577518672690e+02, -3.066479806614716e+01, 2.506628277459239e+00};
+  const double b[] = {-5.447609879822406e+01, 1.615858368580409e+02, -1.556989798598866e+02,
+                      6.680131188771972e+01, -1.328068155288572e+01};
+  const double c[] = {-7.784894002430293e-03, -3.223964580411365e-01, -2.400758277161838e+00,
+                      -2.549732539343734e+00, 4.374664141464968e+00, 2.938163982698783e+00};
+  const double d[] = {7.784695709041462e-03, 3.224671290700398e-01, 2.445134137142996e+00,
+                      3.754408661907416e+00};
+  double z;
+
+  if (p <= 0.97575)
+  {
+    double q = p - 0.5;
+    double r = q * q;
+    z = (((((a[0]*r + a[1])*r + a[2])*r + a[3])*r + a[4])*r + a[5])*q
+      / (((((b[0]*r + b[1])*r + b[2])*r + b[3])*r + b[4])*r + 1);
+  }
+  else
+  {
+    double q = std::sqrt (-2 * std::log (1 - p));
+    z = -(((((c[0]*q + c[1])*q + c[2])*q + c[3])*q + c[4])*q + c[5])
+      / ((((d[0]*q + d[1])*q + d[2])*q + d[3])*q + 1);
+  }
+
+  /**
+   * The Cornish-Fisher expansion of the t quantile around the normal one
+   */
+  double z2 = z * z;
+  double g1 = z * (z2 + 1) / 4;
+  double g2 = z * ((5 * z2 + 16) * z2 + 3) / 96;
+  double g3 = z * (((3 * z2 + 19) * z2 + 17) * z2 - 15) / 384;
+  double g4 = z * ((((79 * z2 + 776) * z2 + 1482) * z2 - 1920) * z2 - 945) / 92160;
+
+  return z + g1 / v + g2 / (v * v) + g3 / (v * v * v) + g4 / (v * v * v * v);
+}
+
+}// Namespace ns3
@@ -0,0 +1,109 @@
+/**
+ * This file declares the BitcoinExperimentController class.
+ */
+
+
+#ifndef BITCOIN_EXPERIMENT_CONTROLLER_H
+#define BITCOIN_EXPERIMENT_CONTROLLER_H
+
+#include <vector>
+#include <string>
+#include <ostream>
+#include <stdint.h>
+
+namespace ns3 {
+
+/**
+ * Decides how many iterations of an experiment to run. After every iteration, the results of interest
+ * (e.g. the revenue share of the attacker, the stale rate) are added as samples of their metric,
+ * whose mean and variance are updated online. The experiment is done when the half-width of the
+ * confidence interval of the mean of every metric with a target is at most its target, or when
+ * the maximum number of iterations is reached. The half-width is computed with the Student t
+ * distribution, as the iterations are independent but few.
+ */
+class BitcoinExperimentController
+{
+public:
+  /**
+   * \param confidence the confidence level of the intervals, e.g. 0.95
+   * \param minIterations the iterations run before the precision is checked, at least 2
+   * \param maxIterations the iterations after which the experiment stops regardless of the precision,
+   *        even if fewer than minIterations
+   */
+  BitcoinExperimentController (double confidence = 0.95, uint32_t minIterations = 5, uint32_t maxIterations = 100);
+
+  virtual ~BitcoinExperimentController (void);
+
+  /**
+   * \brief Track a metric
+   * \param name the name the metric is printed with
+   * \param targetHalfWidth the half-width the confidence interval must reach. If 0, the metric
+   *        is only reported and does not delay the end of the experiment.
+   * \return the index of the metric, used by AddSample
+   */
+  int AddMetric (std::string name, double targetHalfWidth = 0);
+
+  /**
+   * \brief Add the result of the current iteration to a metric
+   */
+  void AddSample (int metric, double value);
+
+  /**
+   * \brief Mark the end of an iteration, after its samples have been added
+   */
+  void EndIteration (void);
+
+  /**
+   * \return true if no more iterations are needed
+   */
+  bool IsDone (void) const;
+
+  /**
+   * \return true if every metric with a target reached it
+   */
+  bool IsPrecise (void) const;
+
+  uint32_t GetIterations (void) const;
+
+  double GetMean (int metric) const;
+
+  double GetVariance (int metric) const;
+
+  /**
+   * \return the half-width of the confidence interval of the mean of the metric, or -1 with less than 2 samples
+   */
+  double GetHalfWidth (int metric) const;
+
+  /**
+   * \brief Print the mean, the standard deviation and the achieved precision of each metric
+   */
+  void PrintPrecision (std::ostream &out) const;
+
+private:
+  /**
+   * \return the quantile of the Student t distribution with degreesOfFreedom for the two-sided confidence level
+   */
+  double GetCriticalValue (uint32_t degreesOfFreedom) const;
+
+  /**
+   * Welford's online estimator of the mean and the variance of a metric
+   */
+  struct Metric
+  {
+    std::string  name;
+    double       targetHalfWidth;
+    uint32_t     samples;
+    double       mean;
+    double       m2;               //!< The sum of the squared differences from the mean
+  };
+
+  std::vector<Metric>   m_metrics;           //!< The tracked metrics
+  double                m_confidence;        //!< The confidence level of the intervals
+  uint32_t              m_minIterations;     //!< The iterations run before the precision is checked
+  uint32_t              m_maxIterations;     //!< The iterations after which the experiment stops
+  uint32_t              m_iterations;        //!< The completed iterations
+};
+
+}// Namespace ns3
+
+#endif /* BITCOIN_EXPERIMENT_CONTROLLER_H */
@@ -0,0 +1,177 @@
+/**
+ * This file contains the definitions of the functions declared in bitcoin-json-pool.h
+ */
+
+
+#include "ns3/log.h"
+#include "ns3/assert.h"
+#include "bitcoin-json-pool.h"
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("BitcoinJsonPool");
+
+uint64_t BitcoinJsonPool::m_totalDocuments = 0;
+uint64_t BitcoinJsonPool::m_totalArenas = 0;
+
+
+/**
+ *
+ * Class BitcoinJsonArena functions
+ *
+ */
+
+BitcoinJsonArena::BitcoinJsonArena (uint32_t size) : m_buffer (size)
+{
+  if (size > 0)
+    m_allocator = new rapidjson::MemoryPoolAllocator<> (&m_buffer[0], m_buffer.size ());
+  else
+    m_allocator = new rapidjson::MemoryPoolAllocator<> ();
+}
+
+
+BitcoinJsonArena::~BitcoinJsonArena (void)
+{
+  delete m_allocator;
+}
+
+
+rapidjson::MemoryPoolAllocator<>*
+BitcoinJsonArena::GetAllocator (void)
+{
+  return m_allocator;
+}
+
+
+void
+BitcoinJsonArena::Clear (void)
+{
+  m_allocator->Clear ();
+}
+
+
+/**
+ *
+ * Class BitcoinJsonPool functions
+ *
+ */
+
+BitcoinJsonPool::BitcoinJsonPool (void) : m_enabled (true), m_arenaSize (16384)
+{
+  NS_LOG_FUNCTION (this);
+}
+
+
+BitcoinJsonPool::~BitcoinJsonPool (void)
+{
+  NS_LOG_FUNCTION (this);
+
+  for (auto &arena : m_freeArenas)
+    delete arena;
+}
+
+
+void
+BitcoinJsonPool::SetEnabled (bool enabled)
+{
+  m_enabled = enabled;
+}
+
+
+void
+BitcoinJsonPool::SetArenaSize (uint32_t arenaSize)
+{
+  m_arenaSize = arenaSize;
+}
+
+
+BitcoinJsonArena*
+BitcoinJsonPool::Acquire (void)
+{
+  m_totalDocuments++;
+
+  if (!m_freeArenas.empty ())
+  {
+    BitcoinJsonArena *arena = m_freeArenas.back ();
+    m_freeArenas.pop_back ();
+    return arena;
+  }
+
+  m_totalArenas++;
+  return new BitcoinJsonArena (m_enabled ? m_arenaSize : 0);
+}
+
+
+void
+BitcoinJsonPool::Release (BitcoinJsonArena *arena)
+{
+  if (!m_enabled)
+  {
+    delete arena;
+    return;
+  }
+
+  arena->Clear ();
+  m_freeArenas.push_back (arena);
+}
+
+
+rapidjson::StringBuffer&
+BitcoinJsonPool::GetBuffer (uint32_t index)
+{
+  NS_ASSERT (index < 2);
+
+  m_buffers[index].Clear ();
+  return m_buffers[index];
+}
+
+
+uint64_t
+BitcoinJsonPool::GetTotalDocuments (void)
+{
+  return m_totalDocuments;
+}
+
+
+uint64_t
+BitcoinJsonPool::GetTotalArenas (void)
+{
+  return m_totalArenas;
+}
+
+
+/**
+ *
+ * Class BitcoinJsonDocument functions
+ *
+ */
+
+BitcoinJsonDocument::BitcoinJsonDocument (BitcoinJsonPool &pool) : BitcoinJsonDocument (pool, pool.Acquire ())
+{
+}
+
+
+BitcoinJsonDocument::BitcoinJsonDocument (BitcoinJsonPool &pool, BitcoinJsonArena *arena)
+  : rapidjson::Document (arena->GetAllocator ()), m_pool (pool), m_arena (arena)
+{
+}
+
+
+BitcoinJsonDocument::~BitcoinJsonDocument (void)
+{
+  //The values need no freeing with a MemoryPoolAllocator, so the arena can be released before the base destructor runs
+  if (m_arena != 0)
+    m_pool.Release (m_arena);
+}
+
+
+BitcoinJsonArena*
+BitcoinJsonDocument::Detach (void)
+{
+  BitcoinJsonArena *arena = m_arena;
+
+  m_arena = 0;
+  return arena;
+}
+
+}// Namespace ns3
@@ -0,0 +1,132 @@
+/**
+ * This file declares the BitcoinJsonArena, BitcoinJsonPool and BitcoinJsonDocument classes.
+ */
+
+
+#ifndef BITCOIN_JSON_POOL_H
+#define BITCOIN_JSON_POOL_H
+
+#include <vector>
+#include <stdint.h>
+#include "../../rapidjson/document.h"
+#include "../../rapidjson/stringbuffer.h"
+
+namespace ns3 {
+
+/**
+ * The memory of a rapidjson MemoryPoolAllocator. The allocator starts from a preallocated buffer,
+ * so it does not call malloc until a document outgrows the buffer, and Clear keeps the buffer.
+ */
+class BitcoinJsonArena
+{
+public:
+  /**
+   * \param size the size of the preallocated buffer in Bytes. If 0, the allocator mallocs its chunks like a default one.
+   */
+  BitcoinJsonArena (uint32_t size);
+
+  virtual ~BitcoinJsonArena (void);
+
+  rapidjson::MemoryPoolAllocator<>* GetAllocator (void);
+
+  /**
+   * \brief Free everything allocated from the arena, except the preallocated buffer
+   */
+  void Clear (void);
+
+private:
+  BitcoinJsonArena (const BitcoinJsonArena &);
+  BitcoinJsonArena& operator= (const BitcoinJsonArena &);
+
+  std::vector<char>                   m_buffer;             //!< The preallocated buffer
+  rapidjson::MemoryPoolAllocator<>   *m_allocator;          //!< The allocator using m_buffer
+};
+
+/**
+ * The arenas and the output buffers used by a BitcoinNode to build and stringify its messages.
+ * The arenas of the destroyed documents are cleared and reused instead of being freed.
+ * When the pool is disabled, every document gets a new default allocator, as before the pool was introduced.
+ */
+class BitcoinJsonPool
+{
+public:
+  BitcoinJsonPool (void);
+
+  virtual ~BitcoinJsonPool (void);
+
+  void SetEnabled (bool enabled);
+
+  /**
+   * \brief Set the size of the preallocated buffer of the new arenas in Bytes
+   */
+  void SetArenaSize (uint32_t arenaSize);
+
+  /**
+   * \brief Get a cleared arena
+   */
+  BitcoinJsonArena* Acquire (void);
+
+  /**
+   * \brief Give back an arena, which must not be used afterwards
+   */
+  void Release (BitcoinJsonArena *arena);
+
+  /**
+   * \brief Get a cleared output buffer. It stays valid until the next call of GetBuffer with the same index.
+   * \param index 0 or 1, so that two messages can be stringified at the same time
+   */
+  rapidjson::StringBuffer& GetBuffer (uint32_t index = 0);
+
+  /**
+   * \return the number of documents built or parsed with the arenas of all the pools
+   */
+  static uint64_t GetTotalDocuments (void);
+
+  /**
+   * \return the number of arenas created by all the pools
+   */
+  static uint64_t GetTotalArenas (void);
+
+private:
+  BitcoinJsonPool (const BitcoinJsonPool &);
+  BitcoinJsonPool& operator= (const BitcoinJsonPool &);
+
+  bool                               m_enabled;            //!< True if the arenas are reused, False otherwise
+  uint32_t                           m_arenaSize;          //!< The size of the preallocated buffer of the new arenas
+  std::vector<BitcoinJsonArena*>     m_freeArenas;         //!< The arenas which are not in use
+  rapidjson::StringBuffer            m_buffers[2];         //!< The output buffers
+
+  static uint64_t                    m_totalDocuments;     //!< The number of documents built or parsed
+  static uint64_t                    m_totalArenas;        //!< The number of arenas created
+};
+
+/**
+ * A rapidjson Document whose values are allocated from an arena of a BitcoinJsonPool.
+ * The arena is given back to the pool when the document is destroyed, unless it has been detached.
+ */
+class BitcoinJsonDocument : public rapidjson::Document
+{
+public:
+  BitcoinJsonDocument (BitcoinJsonPool &pool);
+
+  ~BitcoinJsonDocument (void);
+
+  /**
+   * \brief Stop managing the arena, which is now owned by the caller. Used when the document is swapped
+   * with one which outlives it, since the values of the swapped document still live in the arena.
+   * \return the arena
+   */
+  BitcoinJsonArena* Detach (void);
+
+private:
+  BitcoinJsonDocument (BitcoinJsonPool &pool, BitcoinJsonArena *arena);
+  BitcoinJsonDocument (const BitcoinJsonDocument &);
+  BitcoinJsonDocument& operator= (const BitcoinJsonDocument &);
+
+  BitcoinJsonPool      &m_pool;              //!< The pool the arena is given back to
+  BitcoinJsonArena     *m_arena;             //!< The arena of the document, 0 if detached
+};
+
+}// Namespace ns3
+
+#endif /* BITCOIN_JSON_POOL_H */
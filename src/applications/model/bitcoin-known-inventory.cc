@@ -0,0 +1,60 @@
+/**
+ * This file contains the definitions of the functions declared in bitcoin-known-inventory.h
+ */
+
+
+#include "bitcoin-known-inventory.h"
+
+namespace ns3 {
+
+BitcoinKnownInventory::BitcoinKnownInventory (uint32_t capacity) : m_keys (capacity), m_next (0), m_size (0)
+{
+}
+
+
+BitcoinKnownInventory::~BitcoinKnownInventory (void)
+{
+}
+
+
+void
+BitcoinKnownInventory::Add (int height, int minerId)
+{
+  if (m_keys.empty () || Contains (height, minerId))
+    return;
+
+  m_keys[m_next] = GetKey (height, minerId);
+  m_next = (m_next + 1) % m_keys.size ();
+  if (m_size < m_keys.size ())
+    m_size++;
+}
+
+
+bool
+BitcoinKnownInventory::Contains (int height, int minerId) const
+{
+  uint64_t key = GetKey (height, minerId);
+
+  for (uint32_t i = 0; i < m_size; i++)
+  {
+    if (m_keys[i] == key)
+      return true;
+  }
+  return false;
+}
+
+
+uint32_t
+BitcoinKnownInventory::GetCapacity (void) const
+{
+  return m_keys.size ();
+}
+
+
+uint64_t
+BitcoinKnownInventory::GetKey (int height, int minerId)
+{
+  return (static_cast<uint64_t>(static_cast<uint32_t>(height)) << 32) | static_cast<uint32_t>(minerId);
+}
+
+}// Namespace ns3
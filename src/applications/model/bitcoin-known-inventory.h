@@ -0,0 +1,47 @@
+/**
+ * This file declares the BitcoinKnownInventory class.
+ */
+
+
+#ifndef BITCOIN_KNOWN_INVENTORY_H
+#define BITCOIN_KNOWN_INVENTORY_H
+
+#include <vector>
+#include <stdint.h>
+
+namespace ns3 {
+
+/**
+ * The blocks a peer is known to have, because it announced them or we sent or announced them to it.
+ * The blocks are kept in a fixed-size ring, so the oldest ones are forgotten once it is full.
+ * Forgetting a block only means that it may be announced to the peer again, and, unlike a bloom filter,
+ * the ring never reports a block the peer does not have, so filtering the announcements with it
+ * does not change how blocks propagate.
+ */
+class BitcoinKnownInventory
+{
+public:
+  /**
+   * \param capacity the number of blocks remembered. If 0, no block is ever known.
+   */
+  BitcoinKnownInventory (uint32_t capacity = 64);
+
+  virtual ~BitcoinKnownInventory (void);
+
+  void Add (int height, int minerId);
+
+  bool Contains (int height, int minerId) const;
+
+  uint32_t GetCapacity (void) const;
+
+private:
+  static uint64_t GetKey (int height, int minerId);
+
+  std::vector<uint64_t>   m_keys;               //!< The ring of the known blocks
+  uint32_t                m_next;               //!< The slot overwritten by the next Add
+  uint32_t                m_size;               //!< The number of occupied slots
+};
+
+}// Namespace ns3
+
+#endif /* BITCOIN_KNOWN_INVENTORY_H */
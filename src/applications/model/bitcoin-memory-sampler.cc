@@ -0,0 +1,179 @@
+/**
+ * This file contains the definitions of the functions declared in bitcoin-memory-sampler.h
+ */
+
+
+#include <algorithm>
+#include <iomanip>
+#include "ns3/simulator.h"
+#include "ns3/log.h"
+#include "ns3/node.h"
+#include "bitcoin-node.h"
+#include "bitcoin-memory-usage.h"
+#include "bitcoin-memory-sampler.h"
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("BitcoinMemorySampler");
+
+BitcoinMemorySampler::BitcoinMemorySampler (ApplicationContainer apps)
+  : m_peakBytes (NO_OF_NODE_CONTAINERS, 0)
+{
+  NS_LOG_FUNCTION (this);
+  Add (apps);
+}
+
+
+BitcoinMemorySampler::~BitcoinMemorySampler (void)
+{
+  NS_LOG_FUNCTION (this);
+  Simulator::Cancel (m_nextSample);
+  if (m_file.is_open ())
+    m_file.close ();
+}
+
+
+void
+BitcoinMemorySampler::Add (ApplicationContainer apps)
+{
+  NS_LOG_FUNCTION (this);
+
+  for (ApplicationContainer::Iterator i = apps.Begin (); i != apps.End (); ++i)
+  {
+    Ptr<BitcoinNode> node = DynamicCast<BitcoinNode> (*i);
+    if (node)
+      m_nodes.push_back (node);
+  }
+}
+
+
+void
+BitcoinMemorySampler::Start (Time interval, std::string fileName)
+{
+  NS_LOG_FUNCTION (this << interval << fileName);
+
+  m_interval = interval;
+  m_file.open (fileName.c_str (), std::ios::out | std::ios::trunc);
+  if (!m_file.is_open ())
+    NS_FATAL_ERROR ("BitcoinMemorySampler: cannot open " << fileName);
+
+  m_file << "time";
+  for (int i = 0; i < NO_OF_NODE_CONTAINERS; i++)
+    m_file << "," << getBitcoinNodeContainerName (static_cast<enum BitcoinNodeContainer>(i));
+  m_file << ",TOTAL_BYTES,TOTAL_ELEMENTS\n";
+
+  Simulator::Cancel (m_nextSample);
+  m_nextSample = Simulator::ScheduleNow (&BitcoinMemorySampler::Sample, this);
+}
+
+
+void
+BitcoinMemorySampler::Sample (void)
+{
+  NS_LOG_FUNCTION (this);
+
+  std::vector<long> bytes (NO_OF_NODE_CONTAINERS, 0);
+  long totalBytes = 0;
+  long totalElements = 0;
+
+  for (auto &node : m_nodes)
+  {
+    std::vector<containerUsage> usage = node->GetMemoryUsage ();
+
+    for (int i = 0; i < NO_OF_NODE_CONTAINERS; i++)
+    {
+      bytes[i] += usage[i].bytes;
+      totalElements += usage[i].elements;
+    }
+  }
+
+  m_file << Simulator::Now ().GetSeconds ();
+  for (int i = 0; i < NO_OF_NODE_CONTAINERS; i++)
+  {
+    m_file << "," << bytes[i];
+    totalBytes += bytes[i];
+    m_peakBytes[i] = std::max (m_peakBytes[i], bytes[i]);
+  }
+  m_file << "," << totalBytes << "," << totalElements << "\n";
+
+  m_nextSample = Simulator::Schedule (m_interval, &BitcoinMemorySampler::Sample, this);
+}
+
+
+void
+BitcoinMemorySampler::PrintBreakdown (std::ostream &out, int topNodes) const
+{
+  NS_LOG_FUNCTION (this);
+
+  std::vector<containerUsage>             containers (NO_OF_NODE_CONTAINERS);
+  containerUsage                          roles[2];                    //0->relay, 1->miner
+  int                                     roleNodes[2] = {0, 0};
+  std::vector<std::pair<long, uint32_t>>  nodeBytes;                   //(bytes, nodeId)
+  std::vector<int>                        nodeLargestContainer;
+  uint32_t                                receiveBufferHighWaterMark = 0;
+
+  for (int i = 0; i < NO_OF_NODE_CONTAINERS; i++)
+    containers[i].bytes = containers[i].elements = 0;
+  for (int i = 0; i < 2; i++)
+    roles[i].bytes = roles[i].elements = 0;
+
+  for (auto &node : m_nodes)
+  {
+    std::vector<containerUsage> usage = node->GetMemoryUsage ();
+    containerUsage total = {0, 0};
+    int role = node->IsMiner () ? 1 : 0;
+    int largest = 0;
+
+    for (int i = 0; i < NO_OF_NODE_CONTAINERS; i++)
+    {
+      AddContainerUsage (containers[i], usage[i]);
+      AddContainerUsage (total, usage[i]);
+      if (usage[i].bytes > usage[largest].bytes)
+        largest = i;
+    }
+
+    AddContainerUsage (roles[role], total);
+    roleNodes[role]++;
+    nodeBytes.push_back (std::make_pair (total.bytes, node->GetNode ()->GetId ()));
+    nodeLargestContainer.push_back (largest);
+    receiveBufferHighWaterMark = std::max (receiveBufferHighWaterMark, node->GetReceiveBufferHighWaterMark ());
+  }
+
+  out << "\nMemory usage of " << m_nodes.size () << " nodes at time " << Simulator::Now ().GetSeconds () << "s:\n";
+  out << std::left << std::setw(26) << "Container" << std::right
+      << std::setw(16) << "Bytes" << std::setw(14) << "Elements" << std::setw(16) << "Peak Bytes" << "\n";
+  for (int i = 0; i < NO_OF_NODE_CONTAINERS; i++)
+  {
+    out << std::left << std::setw(26) << getBitcoinNodeContainerName (static_cast<enum BitcoinNodeContainer>(i)) << std::right
+        << std::setw(16) << containers[i].bytes << std::setw(14) << containers[i].elements
+        << std::setw(16) << m_peakBytes[i] << "\n";
+  }
+
+  out << "\n" << std::left << std::setw(26) << "Role" << std::right
+      << std::setw(16) << "Bytes" << std::setw(14) << "Nodes" << std::setw(16) << "Bytes/Node" << "\n";
+  for (int i = 0; i < 2; i++)
+  {
+    out << std::left << std::setw(26) << (i == 1 ? "miner" : "relay") << std::right
+        << std::setw(16) << roles[i].bytes << std::setw(14) << roleNodes[i]
+        << std::setw(16) << (roleNodes[i] > 0 ? roles[i].bytes / roleNodes[i] : 0) << "\n";
+  }
+
+  out << "\nLargest receive buffer: " << receiveBufferHighWaterMark << " Bytes\n";
+
+  std::vector<int> order (nodeBytes.size ());
+  for (uint32_t i = 0; i < order.size (); i++)
+    order[i] = i;
+  std::sort (order.begin (), order.end (), [&nodeBytes](int a, int b) { return nodeBytes[a].first > nodeBytes[b].first; });
+
+  out << "\n" << std::left << std::setw(26) << "Node" << std::right
+      << std::setw(16) << "Bytes" << "  Largest container\n";
+  for (int i = 0; i < topNodes && i < static_cast<int>(order.size ()); i++)
+  {
+    out << std::left << std::setw(26) << nodeBytes[order[i]].second << std::right
+        << std::setw(16) << nodeBytes[order[i]].first << "  "
+        << getBitcoinNodeContainerName (static_cast<enum BitcoinNodeContainer>(nodeLargestContainer[order[i]])) << "\n";
+  }
+  out << std::endl;
+}
+
+}// Namespace ns3
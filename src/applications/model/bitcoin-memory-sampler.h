@@ -0,0 +1,67 @@
+/**
+ * This file declares the BitcoinMemorySampler class.
+ */
+
+
+#ifndef BITCOIN_MEMORY_SAMPLER_H
+#define BITCOIN_MEMORY_SAMPLER_H
+
+#include <vector>
+#include <fstream>
+#include <ostream>
+#include "ns3/ptr.h"
+#include "ns3/nstime.h"
+#include "ns3/event-id.h"
+#include "ns3/application-container.h"
+#include "bitcoin.h"
+
+namespace ns3 {
+
+class BitcoinNode;
+
+/**
+ * Periodically samples the memory usage of the containers of the bitcoin applications installed
+ * in this system. Every sample is written as a single line to a csv file, holding the total Bytes
+ * of each BitcoinNodeContainer over all the nodes. At the end of the run, PrintBreakdown reports the usage
+ * by container, by role (miner or relay), the largest receive buffer and the nodes with the largest footprint.
+ */
+class BitcoinMemorySampler
+{
+public:
+  /**
+   * \param apps the applications to sample. Applications which are not BitcoinNodes are ignored.
+   */
+  BitcoinMemorySampler (ApplicationContainer apps);
+
+  virtual ~BitcoinMemorySampler (void);
+
+  /**
+   * \brief Add more applications to sample
+   */
+  void Add (ApplicationContainer apps);
+
+  /**
+   * \brief Start sampling now and every interval until the simulation stops
+   * \param interval the interval between two samples
+   * \param fileName the file the time series is written to
+   */
+  void Start (Time interval, std::string fileName);
+
+  /**
+   * \brief Print the current memory usage by container, by role and of the topNodes largest nodes
+   */
+  void PrintBreakdown (std::ostream &out, int topNodes = 10) const;
+
+private:
+  void Sample (void);
+
+  std::vector<Ptr<BitcoinNode>>   m_nodes;             //!< The sampled applications
+  Time                            m_interval;          //!< The interval between two samples
+  std::ofstream                   m_file;              //!< The time series file
+  EventId                         m_nextSample;        //!< Event of the next sample
+  std::vector<long>               m_peakBytes;         //!< The peak Bytes of each BitcoinNodeContainer over all the samples
+};
+
+}// Namespace ns3
+
+#endif /* BITCOIN_MEMORY_SAMPLER_H */
@@ -0,0 +1,105 @@
+/**
+ * This file contains the functions used to estimate the memory footprint of the standard containers
+ * held by the bitcoin applications. The estimates assume a libstdc++-like layout: map nodes carry
+ * 32 Bytes of bookkeeping and strings up to 15 characters are stored inline.
+ */
+
+
+#ifndef BITCOIN_MEMORY_USAGE_H
+#define BITCOIN_MEMORY_USAGE_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include "bitcoin.h"
+#include "bitcoin-receive-buffer.h"
+#include "bitcoin-known-inventory.h"
+#include "bitcoin-quantile-sketch.h"
+
+namespace ns3 {
+
+const long MAP_NODE_OVERHEAD_BYTES = 32;
+const long STRING_SSO_CAPACITY = 15;
+
+/**
+ * The heap Bytes owned by an object, excluding sizeof the object itself.
+ */
+template <typename T>
+long HeapBytes (const T &)
+{
+  return 0;
+}
+
+inline long HeapBytes (const std::string &s)
+{
+  return s.capacity () > STRING_SSO_CAPACITY ? s.capacity () + 1 : 0;
+}
+
+inline long HeapBytes (const ChunkBitmap &b)
+{
+  return (b.GetNoChunks () + 63) / 64 * sizeof(uint64_t);
+}
+
+inline long HeapBytes (const BitcoinReceiveBuffer &b)
+{
+  return b.GetCapacity ();
+}
+
+inline long HeapBytes (const BitcoinKnownInventory &i)
+{
+  return i.GetCapacity () * sizeof(uint64_t);
+}
+
+inline long HeapBytes (const BitcoinQuantileSketch &s)
+{
+  return s.GetNoBuckets () * sizeof(uint64_t);
+}
+
+template <typename T>
+long HeapBytes (const std::vector<T> &v);
+
+template <typename K, typename V>
+long HeapBytes (const std::map<K, V> &m);
+
+template <typename T>
+long HeapBytes (const std::vector<T> &v)
+{
+  long bytes = v.capacity () * sizeof(T);
+
+  for (auto &element : v)
+    bytes += HeapBytes (element);
+  return bytes;
+}
+
+template <typename K, typename V>
+long HeapBytes (const std::map<K, V> &m)
+{
+  long bytes = m.size () * (sizeof(typename std::map<K, V>::value_type) + MAP_NODE_OVERHEAD_BYTES);
+
+  for (auto &element : m)
+    bytes += HeapBytes (element.first) + HeapBytes (element.second);
+  return bytes;
+}
+
+/**
+ * The containerUsage of a standard container, counting its top-level elements
+ */
+template <typename C>
+containerUsage GetContainerUsage (const C &container)
+{
+  containerUsage usage;
+
+  usage.bytes = sizeof(C) + HeapBytes (container);
+  usage.elements = container.size ();
+  return usage;
+}
+
+inline void AddContainerUsage (containerUsage &total, const containerUsage &usage)
+{
+  total.bytes += usage.bytes;
+  total.elements += usage.elements;
+}
+
+}// Namespace ns3
+
+#endif /* BITCOIN_MEMORY_USAGE_H */
@@ -0,0 +1,142 @@
+/**
+ * This file contains the sizes of the bitcoin protocol messages, which are used for the Byte
+ * accounting of the nodeStatistics. A message consists of the message header, a fixed part,
+ * a count of its items and a fixed size per item. Any other Bytes, e.g. the block payload or
+ * the bitmap of the available chunks, are passed as variable Bytes by the caller, who already knows them.
+ */
+
+
+#ifndef BITCOIN_MESSAGE_SIZE_H
+#define BITCOIN_MESSAGE_SIZE_H
+
+#include "bitcoin.h"
+
+namespace ns3 {
+
+const int MESSAGE_HEADER_BYTES = 90;         //!< The bitcoin message header, including the TCP, IP and Ethernet headers
+const int COUNT_BYTES = 4;                   //!< The count variable of the messages with items
+const int INVENTORY_BYTES = 36;              //!< An inventory of INV and GET_DATA messages
+const int GET_HEADERS_BYTES = 72;            //!< The body of GET_HEADERS messages
+const int HEADERS_BYTES = 81;                //!< A block header
+const int FULL_BLOCK_BYTES = 1;              //!< The fullBlock flag of the blockTorrent messages
+const int NO_CHUNKS_BYTES = 4;               //!< The numberOfChunks of EXT_INV and EXT_GET_DATA messages
+const int CHUNK_ID_BYTES = 1;                //!< A chunk id
+
+/**
+ * The fixed sizes of a message type. The primary template describes a message with a header only.
+ */
+template <enum Messages M>
+struct MessageSizeTraits
+{
+  static constexpr int fixedBytes = 0;
+  static constexpr int countBytes = 0;
+  static constexpr int itemBytes = 0;
+};
+
+template <>
+struct MessageSizeTraits<INV>
+{
+  static constexpr int fixedBytes = 0;
+  static constexpr int countBytes = COUNT_BYTES;
+  static constexpr int itemBytes = INVENTORY_BYTES;
+};
+
+template <>
+struct MessageSizeTraits<EXT_INV>
+{
+  static constexpr int fixedBytes = 0;
+  static constexpr int countBytes = COUNT_BYTES;
+  static constexpr int itemBytes = INVENTORY_BYTES + FULL_BLOCK_BYTES + NO_CHUNKS_BYTES;
+};
+
+template <>
+struct MessageSizeTraits<GET_HEADERS>
+{
+  static constexpr int fixedBytes = GET_HEADERS_BYTES;
+  static constexpr int countBytes = 0;
+  static constexpr int itemBytes = 0;
+};
+
+template <>
+struct MessageSizeTraits<EXT_GET_HEADERS> : public MessageSizeTraits<GET_HEADERS>
+{
+};
+
+template <>
+struct MessageSizeTraits<HEADERS>
+{
+  static constexpr int fixedBytes = 0;
+  static constexpr int countBytes = COUNT_BYTES;
+  static constexpr int itemBytes = HEADERS_BYTES;
+};
+
+template <>
+struct MessageSizeTraits<EXT_HEADERS>
+{
+  static constexpr int fixedBytes = 0;
+  static constexpr int countBytes = COUNT_BYTES;
+  static constexpr int itemBytes = HEADERS_BYTES + FULL_BLOCK_BYTES;
+};
+
+template <>
+struct MessageSizeTraits<GET_DATA> : public MessageSizeTraits<INV>
+{
+};
+
+template <>
+struct MessageSizeTraits<EXT_GET_DATA>
+{
+  static constexpr int fixedBytes = 0;
+  static constexpr int countBytes = COUNT_BYTES;
+  static constexpr int itemBytes = INVENTORY_BYTES + FULL_BLOCK_BYTES + NO_CHUNKS_BYTES + CHUNK_ID_BYTES;
+};
+
+template <>
+struct MessageSizeTraits<CHUNK>
+{
+  static constexpr int fixedBytes = 0;
+  static constexpr int countBytes = 0;
+  static constexpr int itemBytes = CHUNK_ID_BYTES + FULL_BLOCK_BYTES;   //the requested chunk + the fullBlock
+};
+
+/**
+ * \return the Bytes of a message of type M with noItems items
+ * \param variableBytes the Bytes which do not have a fixed size, e.g. the block payload
+ */
+template <enum Messages M>
+constexpr long MessageBytes (long noItems, long variableBytes = 0)
+{
+  return MESSAGE_HEADER_BYTES + MessageSizeTraits<M>::fixedBytes + MessageSizeTraits<M>::countBytes
+         + noItems * MessageSizeTraits<M>::itemBytes + variableBytes;
+}
+
+/**
+ * \brief The same as MessageBytes, when the message type is known only at run time
+ */
+inline long GetMessageBytes (enum Messages message, long noItems, long variableBytes = 0)
+{
+  switch (message)
+  {
+    case INV: return MessageBytes<INV> (noItems, variableBytes);
+    case GET_HEADERS: return MessageBytes<GET_HEADERS> (noItems, variableBytes);
+    case HEADERS: return MessageBytes<HEADERS> (noItems, variableBytes);
+    case GET_BLOCKS: return MessageBytes<GET_BLOCKS> (noItems, variableBytes);
+    case BLOCK: return MessageBytes<BLOCK> (noItems, variableBytes);
+    case GET_DATA: return MessageBytes<GET_DATA> (noItems, variableBytes);
+    case NO_MESSAGE: return 0;
+    case EXT_INV: return MessageBytes<EXT_INV> (noItems, variableBytes);
+    case EXT_GET_HEADERS: return MessageBytes<EXT_GET_HEADERS> (noItems, variableBytes);
+    case EXT_HEADERS: return MessageBytes<EXT_HEADERS> (noItems, variableBytes);
+    case EXT_GET_BLOCKS: return MessageBytes<EXT_GET_BLOCKS> (noItems, variableBytes);
+    case CHUNK: return MessageBytes<CHUNK> (noItems, variableBytes);
+    case EXT_GET_DATA: return MessageBytes<EXT_GET_DATA> (noItems, variableBytes);
+  }
+  return 0;
+}
+
+static_assert (MessageBytes<INV> (1) == 130, "An INV message with one inventory takes 130 Bytes");
+static_assert (MessageBytes<EXT_GET_DATA> (1) == 136, "An EXT_GET_DATA message with one chunk takes 136 Bytes");
+
+}// Namespace ns3
+
+#endif /* BITCOIN_MESSAGE_SIZE_H */
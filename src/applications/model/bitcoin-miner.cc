@@ -15,10 +15,12 @@
 #include "ns3/uinteger.h"
 #include "ns3/double.h"
 #include "ns3/bitcoin-miner.h"
+#include "bitcoin-checkpoint.h"
 #include "../../rapidjson/document.h"
 #include "../../rapidjson/writer.h"
 #include "../../rapidjson/stringbuffer.h"
 #include <fstream>
+#include <sstream>
 #include <time.h>
 #include <sys/time.h>
 
@@ -147,10 +149,22 @@ BitcoinMiner::~BitcoinMiner(void)
 }
 
 
+void 
+BitcoinMiner::SeedGenerators (void)
+{
+  NS_LOG_FUNCTION (this);
+
+  BitcoinNode::SeedGenerators ();
+  if (m_seed != 0)
+    m_generator.seed(m_seed + GetNode()->GetId());
+}
+
+
 void 
 BitcoinMiner::StartApplication ()    // Called at time specified by Start
 {
   BitcoinNode::StartApplication ();
+
   NS_LOG_WARN ("Miner " << GetNode()->GetId() << " m_noMiners = " << m_noMiners << "");
   NS_LOG_WARN ("Miner " << GetNode()->GetId() << " m_realAverageBlockGenIntervalSeconds = " << m_realAverageBlockGenIntervalSeconds << "s");
   NS_LOG_WARN ("Miner " << GetNode()->GetId() << " m_averageBlockGenIntervalSeconds = " << m_averageBlockGenIntervalSeconds << "s");
@@ -267,14 +281,17 @@ BitcoinMiner::StartApplication ()    // Called at time specified by Start
   m_nodeStats->hashRate = m_hashRate;
   m_nodeStats->miner = 1;
 
-  ScheduleNextMiningEvent ();
+  if (!m_checkpoint.empty ())
+    RestoreMiningCheckpoint ();
+  else
+    ScheduleNextMiningEvent ();
 }
 
 void 
 BitcoinMiner::StopApplication ()
 {
   BitcoinNode::StopApplication ();  
-  Simulator::Cancel (m_nextMiningEvent);
+  BitcoinEventProfiler::Cancel (m_nextMiningEvent, MINE_BLOCK_EVENT);
   
   NS_LOG_WARN ("The miner " << GetNode ()->GetId () << " with hash rate = " << m_hashRate << " generated " << m_minerGeneratedBlocks 
                 << " blocks "<< "(" << 100. * m_minerGeneratedBlocks / (m_blockchain.GetTotalBlocks() - 1) 
@@ -381,6 +398,83 @@ BitcoinMiner::SetBlockBroadcastType (enum BlockBroadcastType blockBroadcastType)
   m_blockBroadcastType = blockBroadcastType;
 }
 
+
+void
+BitcoinMiner::SaveCheckpoint (rapidjson::Value &state, rapidjson::Document::AllocatorType &allocator) const
+{
+  NS_LOG_FUNCTION (this);
+
+  BitcoinNode::SaveCheckpoint (state, allocator);
+
+  rapidjson::Value   value;
+  rapidjson::Value   miner(rapidjson::kObjectType);
+  std::ostringstream generator;
+
+  generator << m_generator;
+  value.SetString(generator.str().c_str(), generator.str().size(), allocator);
+  miner.AddMember("generator", value, allocator);
+
+  if (m_nextMiningEvent.IsRunning ())
+  {
+    value = Simulator::GetDelayLeft (m_nextMiningEvent).GetSeconds ();
+    miner.AddMember("nextMiningEvent", value, allocator);
+  }
+
+  value = m_nextBlockTime;
+  miner.AddMember("nextBlockTime", value, allocator);
+  value = m_nextBlockSize;
+  miner.AddMember("nextBlockSize", value, allocator);
+  value = m_previousBlockGenerationTime;
+  miner.AddMember("previousBlockGenerationTime", value, allocator);
+  value = m_minerAverageBlockGenInterval;
+  miner.AddMember("minerAverageBlockGenInterval", value, allocator);
+  value = m_minerGeneratedBlocks;
+  miner.AddMember("minerGeneratedBlocks", value, allocator);
+  value = m_minerAverageBlockSize;
+  miner.AddMember("minerAverageBlockSize", value, allocator);
+
+  state.AddMember("miner", miner, allocator);
+}
+
+
+void
+BitcoinMiner::RestoreMiningCheckpoint (void)
+{
+  NS_LOG_FUNCTION (this);
+
+  rapidjson::Document d;
+
+  d.Parse(m_checkpoint.c_str());
+  if (!d.HasMember("miner"))
+  {
+    NS_LOG_WARN ("Miner " << GetNode()->GetId() << " was not a miner in the checkpoint");
+    ScheduleNextMiningEvent ();
+    return;
+  }
+
+  const rapidjson::Value &miner = GetCheckpointMember (d, "miner", &rapidjson::Value::IsObject);
+  std::istringstream      generator (GetCheckpointMember (miner, "generator", &rapidjson::Value::IsString).GetString());
+
+  generator >> m_generator;
+  m_nextBlockTime = GetCheckpointMember (miner, "nextBlockTime", &rapidjson::Value::IsNumber).GetDouble();
+  m_nextBlockSize = GetCheckpointMember (miner, "nextBlockSize", &rapidjson::Value::IsInt).GetInt();
+  m_previousBlockGenerationTime = GetCheckpointMember (miner, "previousBlockGenerationTime", &rapidjson::Value::IsNumber).GetDouble();
+  m_minerAverageBlockGenInterval = GetCheckpointMember (miner, "minerAverageBlockGenInterval", &rapidjson::Value::IsNumber).GetDouble();
+  m_minerGeneratedBlocks = GetCheckpointMember (miner, "minerGeneratedBlocks", &rapidjson::Value::IsInt).GetInt();
+  m_minerAverageBlockSize = GetCheckpointMember (miner, "minerAverageBlockSize", &rapidjson::Value::IsNumber).GetDouble();
+
+  if (miner.HasMember("nextMiningEvent"))
+  {
+    double nextMiningEvent = GetCheckpointMember (miner, "nextMiningEvent", &rapidjson::Value::IsNumber).GetDouble();
+
+    m_nextMiningEvent = Simulator::Schedule (Seconds (nextMiningEvent), &BitcoinMiner::MineBlock, this);
+    NS_LOG_WARN ("Time " << Simulator::Now ().GetSeconds () << ": Miner " << GetNode ()->GetId () << " will generate a block in " 
+                 << nextMiningEvent << "s, as scheduled before the checkpoint");
+  }
+  else
+    ScheduleNextMiningEvent ();
+}
+
 void
 BitcoinMiner::ScheduleNextMiningEvent (void)
 {
@@ -415,14 +509,15 @@ BitcoinMiner::ScheduleNextMiningEvent (void)
 void 
 BitcoinMiner::MineBlock (void)
 {
+  BitcoinEventProfiler::Scope profile (MINE_BLOCK_EVENT);
   std::cout << "honest number : " << m_hashRate  << " mine a block" << std::endl;
   NS_LOG_FUNCTION (this);
-  rapidjson::Document inv; 
-  rapidjson::Document block; 
+  BitcoinJsonDocument inv (m_jsonPool); 
+  BitcoinJsonDocument block (m_jsonPool); 
 
-  int height =  m_blockchain.GetCurrentTopBlock()->GetBlockHeight() + 1;
+  int height =  m_blockchain.GetCurrentTopBlock().GetBlockHeight() + 1;
   int minerId = GetNode ()->GetId ();
-  int parentBlockMinerId = m_blockchain.GetCurrentTopBlock()->GetMinerId();
+  int parentBlockMinerId = m_blockchain.GetCurrentTopBlock().GetMinerId();
   double currentTime = Simulator::Now ().GetSeconds ();
   std::ostringstream stringStream;  
   std::string blockHash;
@@ -775,6 +870,8 @@ BitcoinMiner::MineBlock (void)
   /**
    * Update m_meanBlockReceiveTime with the timeCreated of the newly generated block
    */
+  AddToSketches (currentTime - m_previousBlockReceiveTime, 0, m_nextBlockSize);
+
   m_meanBlockReceiveTime = (m_blockchain.GetTotalBlocks() - 1)/static_cast<double>(m_blockchain.GetTotalBlocks())*m_meanBlockReceiveTime 
                          + (currentTime - m_previousBlockReceiveTime)/(m_blockchain.GetTotalBlocks());
   m_previousBlockReceiveTime = currentTime;	
@@ -787,53 +884,30 @@ BitcoinMiner::MineBlock (void)
   m_blockchain.AddBlock(newBlock);
 
   // Stringify the DOM
-  rapidjson::StringBuffer invInfo;
+  rapidjson::StringBuffer &invInfo = m_jsonPool.GetBuffer (0);
   rapidjson::Writer<rapidjson::StringBuffer> invWriter(invInfo);
   inv.Accept(invWriter);
   
-  rapidjson::StringBuffer blockInfo;
+  rapidjson::StringBuffer &blockInfo = m_jsonPool.GetBuffer (1);
   rapidjson::Writer<rapidjson::StringBuffer> blockWriter(blockInfo);
   block.Accept(blockWriter);
   
+  // Serialize the messages once, they are shared by all the peers
+  Ptr<Packet> invPacket = CreateMessagePacket (invInfo);
+  Ptr<Packet> blockPacket = CreateMessagePacket (blockInfo);
+  int         noInvs = 0;
+
   int count = 0;
 
   for (std::vector<Ipv4Address>::const_iterator i = m_peersAddresses.begin(); i != m_peersAddresses.end(); ++i, ++count)
   {
-    
-    const uint8_t delimiter[] = "#";
-
     switch(m_blockBroadcastType)				  
     {
       case STANDARD:
       {
-        m_peersSockets[*i]->Send (reinterpret_cast<const uint8_t*>(invInfo.GetString()), invInfo.GetSize(), 0);
-        m_peersSockets[*i]->Send (delimiter, 1, 0);
-		
-        if (m_protocolType == STANDARD_PROTOCOL && !m_blockTorrent)
-          m_nodeStats->invSentBytes += m_bitcoinMessageHeader + m_countBytes + inv["inv"].Size()*m_inventorySizeBytes;
-        else if (m_protocolType == SENDHEADERS && !m_blockTorrent)
-          m_nodeStats->headersSentBytes += m_bitcoinMessageHeader + m_countBytes + inv["blocks"].Size()*m_headersSizeBytes;
-        else if (m_protocolType == STANDARD_PROTOCOL && m_blockTorrent)
-        {
-          m_nodeStats->extInvSentBytes += m_bitcoinMessageHeader + m_countBytes + inv["inv"].Size()*m_inventorySizeBytes;
-          for (int j=0; j<inv["inv"].Size(); j++)
-          {
-            m_nodeStats->extInvSentBytes += 5; //1Byte(fullBlock) + 4Bytes(numberOfChunks)
-            if (!inv["inv"][j]["fullBlock"].GetBool())
-              m_nodeStats->extInvSentBytes += inv["inv"][j]["availableChunks"].Size()*1;
-          }
-        }
-        else if (m_protocolType == SENDHEADERS && m_blockTorrent)
-        {
-          m_nodeStats->extHeadersSentBytes += m_bitcoinMessageHeader + m_countBytes + inv["blocks"].Size()*m_headersSizeBytes;
-          for (int j=0; j<inv["blocks"].Size(); j++)
-          {
-            m_nodeStats->extHeadersSentBytes += 1;//fullBlock
-            if (!inv["blocks"][j]["fullBlock"].GetBool())
-              m_nodeStats->extHeadersSentBytes += inv["inv"][j]["availableChunks"].Size();
-          }	
-        }
-		
+        m_peersSockets[*i]->Send (invPacket->Copy ());
+        noInvs++;
+
         NS_LOG_INFO ("At time " << Simulator::Now ().GetSeconds ()
                      << "s bitcoin miner " << GetNode ()->GetId () 
                      << " sent a packet " << invInfo.GetString() 
@@ -848,7 +922,7 @@ BitcoinMiner::MineBlock (void)
         double eventTime;	
 				
 /*                 std::cout << "Node " << GetNode()->GetId() << "-" << InetSocketAddress::ConvertFrom(from).GetIpv4 () 
-                          << " " << m_peersDownloadSpeeds[InetSocketAddress::ConvertFrom(from).GetIpv4 ()] << " Mbps , time = "
+                          << " " << GetPeerDownloadSpeed (InetSocketAddress::ConvertFrom(from).GetIpv4 ()) << " Mbps , time = "
                           << Simulator::Now ().GetSeconds() << "s \n"; */
                 
         if (m_sendBlockTimes.size() == 0 || Simulator::Now ().GetSeconds() >  m_sendBlockTimes.back())
@@ -867,8 +941,7 @@ BitcoinMiner::MineBlock (void)
         NS_LOG_INFO("Node " << GetNode()->GetId() << " will start sending the block to " << *i 
                     << " at " << Simulator::Now ().GetSeconds() + eventTime << "\n");
 
-        std::string packet = blockInfo.GetString();
-        Simulator::Schedule (Seconds(eventTime), &BitcoinMiner::SendBlock, this, packet, m_peersSockets[*i]);
+        Simulator::Schedule (Seconds(eventTime), &BitcoinMiner::SendBlock, this, blockPacket, m_peersSockets[*i]);
         Simulator::Schedule (Seconds(eventTime + sendTime), &BitcoinMiner::RemoveSendTime, this);
 
         break;
@@ -885,7 +958,7 @@ BitcoinMiner::MineBlock (void)
           m_nodeStats->blockSentBytes += m_bitcoinMessageHeader + blockSize;
 			  
 /* 				std::cout << "Node " << GetNode()->GetId() << "-" << *i 
-                            << " " << m_peersDownloadSpeeds[*i] << " Mbps , time = "
+                            << " " << GetPeerDownloadSpeed (*i) << " Mbps , time = "
                             << Simulator::Now ().GetSeconds() << "s \n"; */
                 
           if (m_sendCompressedBlockTimes.size() == 0 || Simulator::Now ().GetSeconds() >  m_sendCompressedBlockTimes.back())
@@ -906,41 +979,15 @@ BitcoinMiner::MineBlock (void)
           //sendTime = blockSize / m_uploadSpeed * count;		  
           //std::cout << sendTime << std::endl;
 
-          std::string packet = blockInfo.GetString();
-          Simulator::Schedule (Seconds(sendTime), &BitcoinMiner::SendBlock, this, packet, m_peersSockets[*i]);
+          Simulator::Schedule (Seconds(sendTime), &BitcoinMiner::SendBlock, this, blockPacket, m_peersSockets[*i]);
           Simulator::Schedule (Seconds(eventTime + sendTime), &BitcoinMiner::RemoveCompressedBlockSendTime, this);
 
         }
         else
         {	    
-          m_peersSockets[*i]->Send (reinterpret_cast<const uint8_t*>(invInfo.GetString()), invInfo.GetSize(), 0);
-          m_peersSockets[*i]->Send (delimiter, 1, 0);
-	  
-          if (m_protocolType == STANDARD_PROTOCOL && !m_blockTorrent)
-            m_nodeStats->invSentBytes += m_bitcoinMessageHeader + m_countBytes + inv["inv"].Size()*m_inventorySizeBytes;
-          else if (m_protocolType == SENDHEADERS && !m_blockTorrent)
-            m_nodeStats->headersSentBytes += m_bitcoinMessageHeader + m_countBytes + inv["blocks"].Size()*m_headersSizeBytes;
-          else if (m_protocolType == STANDARD_PROTOCOL && m_blockTorrent)
-          {
-            m_nodeStats->extInvSentBytes += m_bitcoinMessageHeader + m_countBytes + inv["inv"].Size()*m_inventorySizeBytes;
-            for (int j=0; j<inv["inv"].Size(); j++)
-            {
-              m_nodeStats->extInvSentBytes += 5; //1Byte(fullBlock) + 4Bytes(numberOfChunks)
-              if (!inv["inv"][j]["fullBlock"].GetBool())
-                m_nodeStats->extInvSentBytes += inv["inv"][j]["availableChunks"].Size()*1;
-            }
-          }
-          else if (m_protocolType == SENDHEADERS && m_blockTorrent)
-          {
-            m_nodeStats->extHeadersSentBytes += m_bitcoinMessageHeader + m_countBytes + inv["blocks"].Size()*m_headersSizeBytes;
-            for (int j=0; j<inv["blocks"].Size(); j++)
-            {
-            m_nodeStats->extHeadersSentBytes += 1;//fullBlock
-            if (!inv["blocks"][j]["fullBlock"].GetBool())
-                m_nodeStats->extHeadersSentBytes += inv["blocks"][j]["availableChunks"].Size()*1;
-            }	
-          }
-	  
+          m_peersSockets[*i]->Send (invPacket->Copy ());
+          noInvs++;
+
           NS_LOG_INFO ("At time " << Simulator::Now ().GetSeconds ()
                        << "s bitcoin miner " << GetNode ()->GetId () 
                        << " sent a packet " << invInfo.GetString() 
@@ -952,10 +999,9 @@ BitcoinMiner::MineBlock (void)
       {
         double sendTime;
         double eventTime;
-        std::string packet;
 			  
 /* 				std::cout << "Node " << GetNode()->GetId() << "-" << *i 
-                            << " " << m_peersDownloadSpeeds[*i] << " Mbps , time = "
+                            << " " << GetPeerDownloadSpeed (*i) << " Mbps , time = "
                             << Simulator::Now ().GetSeconds() << "s \n"; */
 							
         if(count < m_noMiners - 1)
@@ -984,8 +1030,7 @@ BitcoinMiner::MineBlock (void)
           //sendTime = blockSize / m_uploadSpeed * count;		  
           //std::cout << sendTime << std::endl;
 
-          std::string packet = blockInfo.GetString();
-          Simulator::Schedule (Seconds(sendTime), &BitcoinMiner::SendBlock, this, packet, m_peersSockets[*i]);
+          Simulator::Schedule (Seconds(sendTime), &BitcoinMiner::SendBlock, this, blockPacket, m_peersSockets[*i]);
           Simulator::Schedule (Seconds(eventTime + sendTime), &BitcoinMiner::RemoveCompressedBlockSendTime, this);
         }
         else
@@ -1002,13 +1047,12 @@ BitcoinMiner::MineBlock (void)
             eventTime = m_sendBlockTimes.back() - Simulator::Now ().GetSeconds(); 
           }
           m_sendBlockTimes.push_back(Simulator::Now ().GetSeconds() + eventTime + sendTime);
-          packet = invInfo.GetString();
 		  
           /* std::cout << sendTime << " " << eventTime << " " << m_sendBlockTimes.size() << std::endl; */
           NS_LOG_INFO("Node " << GetNode()->GetId() << " will send the block to " << *i 
                       << " at " << Simulator::Now ().GetSeconds() + eventTime << ", eventTime = " << eventTime  << "\n");
 
-          Simulator::Schedule (Seconds(eventTime), &BitcoinMiner::SendBlock, this, packet, m_peersSockets[*i]);
+          Simulator::Schedule (Seconds(eventTime), &BitcoinMiner::SendBlock, this, invPacket, m_peersSockets[*i]);
           Simulator::Schedule (Seconds(eventTime + sendTime), &BitcoinMiner::RemoveSendTime, this);
 
         }
@@ -1027,6 +1071,14 @@ BitcoinMiner::MineBlock (void)
 	
 
   }
+
+  if (noInvs > 0)
+  {
+    //The inv announces a single full block, so it has no variable Bytes
+    enum Messages invMessage = m_protocolType == SENDHEADERS ? (m_blockTorrent ? EXT_HEADERS : HEADERS)
+                                                             : (m_blockTorrent ? EXT_INV : INV);
+    CountSentBytes (invMessage, noInvs * ns3::GetMessageBytes (invMessage, 1));
+  }
   
   m_minerAverageBlockGenInterval = m_minerGeneratedBlocks/static_cast<double>(m_minerGeneratedBlocks+1)*m_minerAverageBlockGenInterval 
                                  + (Simulator::Now ().GetSeconds () - m_previousBlockGenerationTime)/(m_minerGeneratedBlocks+1);
@@ -1043,32 +1095,23 @@ BitcoinMiner::ReceivedHigherBlock(const Block &newBlock)
 {
   NS_LOG_FUNCTION (this);
   NS_LOG_WARN("Bitcoin miner " << GetNode ()->GetId () << " added a new block in the m_blockchain with higher height: " << newBlock);
-  Simulator::Cancel (m_nextMiningEvent);
+  BitcoinEventProfiler::Cancel (m_nextMiningEvent, MINE_BLOCK_EVENT);
   ScheduleNextMiningEvent ();
 }
 
 
 void 
-BitcoinMiner::SendBlock(std::string packetInfo, Ptr<Socket> to) 
+BitcoinMiner::SendBlock(Ptr<const Packet> message, Ptr<Socket> to) 
 {
+  BitcoinEventProfiler::Scope profile (SEND_BLOCK_EVENT);
   NS_LOG_FUNCTION (this);
 
   NS_LOG_INFO ("SendBlock: At time " << Simulator::Now ().GetSeconds ()
-               << "s bitcoin miner " << GetNode ()->GetId () << " send " 
-               << packetInfo << " to " << to);
+               << "s bitcoin miner " << GetNode ()->GetId () << " send a block message of " 
+               << message->GetSize () << " Bytes to " << to);
 
-  rapidjson::Document d;
-  
-  rapidjson::StringBuffer buffer;
-  rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
-
-  d.Parse(packetInfo.c_str());  
-  d.Accept(writer);
-  
-/*   if (d["type"] != "compressed-block")
-    m_sendBlockTimes.erase(m_sendBlockTimes.begin()); */				
-  SendMessage(NO_MESSAGE, BLOCK, d, to);
-  m_nodeStats->blockSentBytes -= m_bitcoinMessageHeader + d["blocks"][0]["size"].GetInt();
+  //The Bytes of the block were counted when it was scheduled
+  to->Send (message->Copy ());
 }
 } // Namespace ns3
 
@@ -108,6 +108,12 @@ public:
    * set the type of block broadcast
    */
   void SetBlockBroadcastType (enum BlockBroadcastType blockBroadcastType);
+
+  /**
+   * \brief Write the state of the node to a checkpoint, with the state of the random generator
+   * and the time left until the next block
+   */
+  virtual void SaveCheckpoint (rapidjson::Value &state, rapidjson::Document::AllocatorType &allocator) const;
    
 protected:
   // inherited from Application base class.
@@ -116,10 +122,21 @@ protected:
 
   virtual void DoDispose (void);
 
+  /**
+   * \brief Seed rand() and m_generator, which was seeded from std::random_device in the constructor
+   */
+  virtual void SeedGenerators (void);
+
   /**
    * \brief Schedule the next mining event
    */
   void ScheduleNextMiningEvent (void);
+
+  /**
+   * \brief Restore the mining state set by SetCheckpoint and schedule the next mining event
+   * at the time it was scheduled before the checkpoint
+   */
+  void RestoreMiningCheckpoint (void);
   
   /**
    * \brief Mines a new block and advertises it to its peers
@@ -133,11 +150,11 @@ protected:
   virtual void ReceivedHigherBlock(const Block &newBlock);	
 
   /**
-   * \brief Sends a BLOCK message as a response to a GET_DATA message
-   * \param packetInfo the info of the BLOCK message
+   * \brief Sends a BLOCK message of a newly mined block
+   * \param message the BLOCK message, serialized once and shared by all the peers
    * \param to the socket of the receiving peer
    */
-  void SendBlock(std::string packetInfo, Ptr<Socket> to);				   
+  void SendBlock(Ptr<const Packet> message, Ptr<Socket> to);				   
 
   int               m_noMiners;                
   uint32_t          m_fixedBlockSize;  
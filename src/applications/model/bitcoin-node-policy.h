@@ -0,0 +1,164 @@
+/**
+ * This file declares the protocol policies of the bitcoin nodes and the BitcoinPolicyNode class.
+ * A policy fixes the protocol mode (protocol type, blockTorrent, spv) at compile time, so that
+ * the message handlers of each mode are compiled separately without the branches of the other modes.
+ * The handlers of the blockTorrent messages (HandleTorrentMessage, ReceivedChunkMessage) are
+ * instantiated only for the blockTorrent policies.
+ */
+
+
+#ifndef BITCOIN_NODE_POLICY_H
+#define BITCOIN_NODE_POLICY_H
+
+#include "bitcoin.h"
+#include "bitcoin-node.h"
+
+namespace ns3 {
+
+/**
+ * The protocol mode of a bitcoin node. spv is used only in conjuction with blockTorrent.
+ */
+template <enum ProtocolType P, bool BlockTorrent, bool Spv>
+struct BitcoinProtocolPolicy
+{
+  static const enum ProtocolType protocolType = P;
+  static const bool blockTorrent = BlockTorrent;
+  static const bool spv = BlockTorrent && Spv;
+  static const enum Messages announcement = P == SENDHEADERS ? (BlockTorrent ? EXT_HEADERS : HEADERS)
+                                                             : (BlockTorrent ? EXT_INV : INV);   //!< The message announcing full blocks
+};
+
+struct StandardPolicy : public BitcoinProtocolPolicy<STANDARD_PROTOCOL, false, false>
+{
+  static const char* GetTypeName (void) { return "ns3::BitcoinStandardNode"; }
+};
+
+struct StandardTorrentPolicy : public BitcoinProtocolPolicy<STANDARD_PROTOCOL, true, false>
+{
+  static const char* GetTypeName (void) { return "ns3::BitcoinStandardTorrentNode"; }
+};
+
+struct StandardSpvPolicy : public BitcoinProtocolPolicy<STANDARD_PROTOCOL, true, true>
+{
+  static const char* GetTypeName (void) { return "ns3::BitcoinStandardSpvNode"; }
+};
+
+struct SendHeadersPolicy : public BitcoinProtocolPolicy<SENDHEADERS, false, false>
+{
+  static const char* GetTypeName (void) { return "ns3::BitcoinSendHeadersNode"; }
+};
+
+struct SendHeadersTorrentPolicy : public BitcoinProtocolPolicy<SENDHEADERS, true, false>
+{
+  static const char* GetTypeName (void) { return "ns3::BitcoinSendHeadersTorrentNode"; }
+};
+
+struct SendHeadersSpvPolicy : public BitcoinProtocolPolicy<SENDHEADERS, true, true>
+{
+  static const char* GetTypeName (void) { return "ns3::BitcoinSendHeadersSpvNode"; }
+};
+
+/**
+ * \return the TypeId name of the BitcoinPolicyNode of a protocol mode
+ */
+inline const char* GetPolicyNodeTypeName (enum ProtocolType protocolType, bool blockTorrent, bool spv)
+{
+  if (protocolType == STANDARD_PROTOCOL)
+  {
+    if (!blockTorrent)
+      return StandardPolicy::GetTypeName ();
+    return spv ? StandardSpvPolicy::GetTypeName () : StandardTorrentPolicy::GetTypeName ();
+  }
+
+  if (!blockTorrent)
+    return SendHeadersPolicy::GetTypeName ();
+  return spv ? SendHeadersSpvPolicy::GetTypeName () : SendHeadersTorrentPolicy::GetTypeName ();
+}
+
+/**
+ * \brief Finds the protocol mode of a BitcoinPolicyNode from its TypeId name
+ * \return false if typeName is not the TypeId name of a BitcoinPolicyNode
+ */
+inline bool GetPolicyNodeMode (const std::string &typeName, enum ProtocolType &protocolType, bool &blockTorrent, bool &spv)
+{
+  const enum ProtocolType protocolTypes[] = {STANDARD_PROTOCOL, SENDHEADERS};
+
+  for (auto type : protocolTypes)
+  {
+    for (int mode = 0; mode < 3; mode++)    //no blockTorrent, blockTorrent, blockTorrent with spv
+    {
+      if (typeName == GetPolicyNodeTypeName (type, mode > 0, mode == 2))
+      {
+        protocolType = type;
+        blockTorrent = mode > 0;
+        spv = mode == 2;
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+/**
+ * A BitcoinNode whose protocol mode is fixed by its Policy. The ProtocolType set by the helpers
+ * and the BlockTorrent and SPV attributes are ignored.
+ */
+template <class Policy>
+class BitcoinPolicyNode : public BitcoinNode
+{
+public:
+  /**
+   * \brief Get the type ID.
+   * \return the object TypeId
+   */
+  static TypeId GetTypeId (void);
+  BitcoinPolicyNode (void);
+
+  virtual ~BitcoinPolicyNode (void);
+
+protected:
+  virtual void SelectProtocolPolicy (void);
+};
+
+template <class Policy>
+TypeId
+BitcoinPolicyNode<Policy>::GetTypeId (void)
+{
+  static TypeId tid = TypeId (Policy::GetTypeName ())
+    .SetParent<BitcoinNode> ()
+    .SetGroupName("Applications")
+    .AddConstructor<BitcoinPolicyNode<Policy> > ()
+  ;
+  return tid;
+}
+
+template <class Policy>
+BitcoinPolicyNode<Policy>::BitcoinPolicyNode (void) : BitcoinNode ()
+{
+}
+
+template <class Policy>
+BitcoinPolicyNode<Policy>::~BitcoinPolicyNode (void)
+{
+}
+
+template <class Policy>
+void
+BitcoinPolicyNode<Policy>::SelectProtocolPolicy (void)
+{
+  m_protocolType = Policy::protocolType;
+  m_blockTorrent = Policy::blockTorrent;
+  m_spv = Policy::spv;
+  BitcoinNode::SelectProtocolPolicy ();
+}
+
+typedef BitcoinPolicyNode<StandardPolicy>             BitcoinStandardNode;
+typedef BitcoinPolicyNode<StandardTorrentPolicy>      BitcoinStandardTorrentNode;
+typedef BitcoinPolicyNode<StandardSpvPolicy>          BitcoinStandardSpvNode;
+typedef BitcoinPolicyNode<SendHeadersPolicy>          BitcoinSendHeadersNode;
+typedef BitcoinPolicyNode<SendHeadersTorrentPolicy>   BitcoinSendHeadersTorrentNode;
+typedef BitcoinPolicyNode<SendHeadersSpvPolicy>       BitcoinSendHeadersSpvNode;
+
+}// Namespace ns3
+
+#endif /* BITCOIN_NODE_POLICY_H */
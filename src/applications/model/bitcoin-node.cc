@@ -19,12 +19,84 @@
 #include "ns3/uinteger.h"
 #include "ns3/double.h"
 #include "bitcoin-node.h"
+#include "bitcoin-node-policy.h"
+#include "bitcoin-memory-usage.h"
+#include "bitcoin-checkpoint.h"
+#include "bitcoin-propagation-trace.h"
 
 namespace ns3 {
 
 NS_LOG_COMPONENT_DEFINE ("BitcoinNode");
 
 NS_OBJECT_ENSURE_REGISTERED (BitcoinNode);
+NS_OBJECT_ENSURE_REGISTERED (BitcoinStandardNode);
+NS_OBJECT_ENSURE_REGISTERED (BitcoinStandardTorrentNode);
+NS_OBJECT_ENSURE_REGISTERED (BitcoinStandardSpvNode);
+NS_OBJECT_ENSURE_REGISTERED (BitcoinSendHeadersNode);
+NS_OBJECT_ENSURE_REGISTERED (BitcoinSendHeadersTorrentNode);
+NS_OBJECT_ENSURE_REGISTERED (BitcoinSendHeadersSpvNode);
+
+uint64_t BitcoinNode::m_totalAnnouncements = 0;
+
+/**
+ * Stringifies a rapidjson value. Only used for logging.
+ */
+static std::string
+JsonToString (const rapidjson::Value &value)
+{
+  rapidjson::StringBuffer buffer;
+  rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+  value.Accept(writer);
+  return buffer.GetString();
+}
+
+/**
+ * The nodeStatistics counters which are accumulated while the simulation runs and saved in the checkpoints.
+ */
+static long nodeStatistics::* const checkpointCounters[] = {
+  &nodeStatistics::invReceivedBytes, &nodeStatistics::invSentBytes,
+  &nodeStatistics::getHeadersReceivedBytes, &nodeStatistics::getHeadersSentBytes,
+  &nodeStatistics::headersReceivedBytes, &nodeStatistics::headersSentBytes,
+  &nodeStatistics::getDataReceivedBytes, &nodeStatistics::getDataSentBytes,
+  &nodeStatistics::blockReceivedBytes, &nodeStatistics::blockSentBytes,
+  &nodeStatistics::extInvReceivedBytes, &nodeStatistics::extInvSentBytes,
+  &nodeStatistics::extGetHeadersReceivedBytes, &nodeStatistics::extGetHeadersSentBytes,
+  &nodeStatistics::extHeadersReceivedBytes, &nodeStatistics::extHeadersSentBytes,
+  &nodeStatistics::extGetDataReceivedBytes, &nodeStatistics::extGetDataSentBytes,
+  &nodeStatistics::chunkReceivedBytes, &nodeStatistics::chunkSentBytes,
+  &nodeStatistics::blockTimeouts, &nodeStatistics::chunkTimeouts
+};
+
+
+BitcoinMessage::BitcoinMessage (void) : m_arena (0)
+{
+}
+
+BitcoinMessage::~BitcoinMessage (void)
+{
+  //The values of m_document need no freeing, so the arena can be deleted before m_document
+  delete m_arena;
+}
+
+void
+BitcoinMessage::Take (BitcoinJsonDocument &d)
+{
+  m_document.Swap(d);
+  m_arena = d.Detach();
+}
+
+rapidjson::Document&
+BitcoinMessage::GetDocument (void)
+{
+  return m_document;
+}
+
+std::string
+BitcoinMessage::ToString (void) const
+{
+  return JsonToString (m_document);
+}
+
 
 TypeId 
 BitcoinNode::GetTypeId (void)
@@ -63,6 +135,66 @@ BitcoinNode::GetTypeId (void)
                    UintegerValue (100000),
                    MakeUintegerAccessor (&BitcoinNode::m_chunkSize),
                    MakeUintegerChecker<uint32_t> ())
+    .AddAttribute ("ReceiveBufferSize",
+                   "The initial size of the receive buffer of each connection in Bytes. The buffers grow when needed",
+                   UintegerValue (4096),
+                   MakeUintegerAccessor (&BitcoinNode::m_receiveBufferSize),
+                   MakeUintegerChecker<uint32_t> (1))
+    .AddAttribute ("RarestFirst",
+                   "Request the chunks rarest-first, in batches sized to the bandwidth of each peer. Used only with BlockTorrent",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&BitcoinNode::m_rarestFirst),
+                   MakeBooleanChecker ())
+    .AddAttribute ("MaxChunksInFlight",
+                   "The maximum number of chunks in flight per peer, when RarestFirst is used",
+                   UintegerValue (8),
+                   MakeUintegerAccessor (&BitcoinNode::m_maxChunksInFlight),
+                   MakeUintegerChecker<uint32_t> (1))
+    .AddAttribute ("ChunkBatchTime",
+                   "The time a batch of chunk requests should keep the link to a peer busy, when RarestFirst is used",
+                   TimeValue (Seconds (0.5)),
+                   MakeTimeAccessor (&BitcoinNode::m_chunkBatchTime),
+                   MakeTimeChecker())
+    .AddAttribute ("EndgameChunks",
+                   "The number of missing chunks below which the chunks in flight are also requested from other peers, when RarestFirst is used",
+                   UintegerValue (4),
+                   MakeUintegerAccessor (&BitcoinNode::m_endgameChunks),
+                   MakeUintegerChecker<uint32_t> ())
+    .AddAttribute ("JsonPool",
+                   "Reuse the memory of the json messages instead of allocating it for every message",
+                   BooleanValue (true),
+                   MakeBooleanAccessor (&BitcoinNode::m_jsonPoolEnabled),
+                   MakeBooleanChecker ())
+    .AddAttribute ("JsonArenaSize",
+                   "The preallocated size of each json arena in Bytes, when JsonPool is used",
+                   UintegerValue (16384),
+                   MakeUintegerAccessor (&BitcoinNode::m_jsonArenaSize),
+                   MakeUintegerChecker<uint32_t> ())
+    .AddAttribute ("TrickleInterval",
+                   "The mean of the exponentially distributed interval at which the announcements of the validated blocks, queued per peer, are sent in one INV/HEADERS (EXT_INV/EXT_HEADERS with BlockTorrent) message. 0 sends them immediately",
+                   TimeValue (Seconds (0)),
+                   MakeTimeAccessor (&BitcoinNode::m_trickleInterval),
+                   MakeTimeChecker())
+    .AddAttribute ("MergeGetData",
+                   "Answer INV messages with a single GET_DATA, which also requests the headers, instead of GET_HEADERS and GET_DATA",
+                   BooleanValue (false),
+                   MakeBooleanAccessor (&BitcoinNode::m_mergeGetData),
+                   MakeBooleanChecker ())
+    .AddAttribute ("KnownInventorySize",
+                   "The number of blocks remembered per peer, which are not announced to it because it is known to have them. 0 announces every block to every peer",
+                   UintegerValue (64),
+                   MakeUintegerAccessor (&BitcoinNode::m_knownInventorySize),
+                   MakeUintegerChecker<uint32_t> ())
+    .AddAttribute ("SketchRelativeAccuracy",
+                   "The relative accuracy of the quantile sketches of the block receive times, propagation times and sizes. 0 disables the sketches",
+                   DoubleValue (0.01),
+                   MakeDoubleAccessor (&BitcoinNode::m_sketchRelativeAccuracy),
+                   MakeDoubleChecker<double> (0, 0.5))
+    .AddAttribute ("FinalityDepth",
+                   "The number of blocks below the top after which the forks of the blockchain are collapsed to the main chain block and the orphans are dropped. 0 keeps every block",
+                   UintegerValue (0),
+                   MakeUintegerAccessor (&BitcoinNode::m_finalityDepth),
+                   MakeUintegerChecker<uint32_t> ())
     .AddTraceSource ("Rx",
                      "A packet has been received",
                      MakeTraceSourceAccessor (&BitcoinNode::m_rxTrace),
@@ -71,8 +203,8 @@ BitcoinNode::GetTypeId (void)
   return tid;
 }
 
-BitcoinNode::BitcoinNode (void) : m_bitcoinPort (8333), m_secondsPerMin(60), m_isMiner (false), m_countBytes (4), m_bitcoinMessageHeader (90),
-                                  m_inventorySizeBytes (36), m_getHeadersSizeBytes (72), m_headersSizeBytes (81), m_blockHeadersSizeBytes (81),
+BitcoinNode::BitcoinNode (void) : m_bitcoinPort (8333), m_secondsPerMin(60), m_isMiner (false), m_countBytes (COUNT_BYTES), m_bitcoinMessageHeader (MESSAGE_HEADER_BYTES),
+                                  m_inventorySizeBytes (INVENTORY_BYTES), m_getHeadersSizeBytes (GET_HEADERS_BYTES), m_headersSizeBytes (HEADERS_BYTES), m_blockHeadersSizeBytes (HEADERS_BYTES),
                                   m_averageTransactionSize (522.4), m_transactionIndexSize (2)
 {
   NS_LOG_FUNCTION (this);
@@ -82,6 +214,12 @@ BitcoinNode::BitcoinNode (void) : m_bitcoinPort (8333), m_secondsPerMin(60), m_i
   m_meanBlockPropagationTime = 0;
   m_meanBlockSize = 0;
   m_numberOfPeers = m_peersAddresses.size();
+  m_sharedPeersDownloadSpeeds = 0;
+  m_sharedPeersUploadSpeeds = 0;
+  m_seed = 0;
+  m_nodeStats = 0;
+  m_protocolType = STANDARD_PROTOCOL;
+  UseProtocolPolicy<StandardPolicy> ();
   
 }
 
@@ -106,6 +244,111 @@ BitcoinNode::GetPeersAddresses (void) const
 }
 
 
+bool
+BitcoinNode::IsMiner (void) const
+{
+  return m_isMiner;
+}
+
+
+std::vector<containerUsage>
+BitcoinNode::GetMemoryUsage (void) const
+{
+  NS_LOG_FUNCTION (this);
+
+  std::vector<containerUsage> usage (NO_OF_NODE_CONTAINERS);
+
+  usage[BLOCKCHAIN_BLOCKS] = m_blockchain.GetBlocksMemoryUsage ();
+  usage[BLOCKCHAIN_ORPHANS] = m_blockchain.GetOrphansMemoryUsage ();
+  usage[QUEUE_INV] = GetContainerUsage (m_queueInv);
+  usage[QUEUE_CHUNK_PEERS] = GetContainerUsage (m_queueChunkPeers);
+  usage[QUEUE_CHUNKS] = GetContainerUsage (m_queueChunks);
+  usage[RECEIVED_CHUNKS] = GetContainerUsage (m_receivedChunks);
+  usage[INV_TIMEOUTS] = GetContainerUsage (m_invTimeouts);
+  usage[CHUNK_TIMEOUTS] = GetContainerUsage (m_chunkTimeouts);
+  usage[BUFFERED_DATA] = GetContainerUsage (m_bufferedData);
+  usage[RECEIVED_NOT_VALIDATED] = GetContainerUsage (m_receivedNotValidated);
+  usage[ONLY_HEADERS_RECEIVED] = GetContainerUsage (m_onlyHeadersReceived);
+  usage[CHUNK_SCHEDULER] = m_chunkScheduler.GetMemoryUsage ();
+
+  usage[QUANTILE_SKETCHES].elements = m_blockReceiveTimeSketch.GetNoBuckets () + m_blockPropagationTimeSketch.GetNoBuckets ()
+                                      + m_blockSizeSketch.GetNoBuckets ();
+  usage[QUANTILE_SKETCHES].bytes = HeapBytes (m_blockReceiveTimeSketch) + HeapBytes (m_blockPropagationTimeSketch)
+                                   + HeapBytes (m_blockSizeSketch);
+
+  usage[SEND_RECEIVE_TIMES] = GetContainerUsage (m_sendBlockTimes);
+  AddContainerUsage (usage[SEND_RECEIVE_TIMES], GetContainerUsage (m_sendCompressedBlockTimes));
+  AddContainerUsage (usage[SEND_RECEIVE_TIMES], GetContainerUsage (m_receiveBlockTimes));
+  AddContainerUsage (usage[SEND_RECEIVE_TIMES], GetContainerUsage (m_receiveCompressedBlockTimes));
+
+  //The shared peers' speeds belong to the topology and are not counted
+  usage[PEERS] = GetContainerUsage (m_peersAddresses);
+  AddContainerUsage (usage[PEERS], GetContainerUsage (m_peersDownloadSpeeds));
+  AddContainerUsage (usage[PEERS], GetContainerUsage (m_peersUploadSpeeds));
+  AddContainerUsage (usage[PEERS], GetContainerUsage (m_peersSockets));
+  AddContainerUsage (usage[PEERS], GetContainerUsage (m_knownInventory));
+
+  return usage;
+}
+
+
+const BitcoinQuantileSketch&
+BitcoinNode::GetBlockReceiveTimeSketch (void) const
+{
+  return m_blockReceiveTimeSketch;
+}
+
+
+const BitcoinQuantileSketch&
+BitcoinNode::GetBlockPropagationTimeSketch (void) const
+{
+  return m_blockPropagationTimeSketch;
+}
+
+
+const BitcoinQuantileSketch&
+BitcoinNode::GetBlockSizeSketch (void) const
+{
+  return m_blockSizeSketch;
+}
+
+
+uint32_t
+BitcoinNode::GetReceiveBufferHighWaterMark (void) const
+{
+  uint32_t highWaterMark = 0;
+
+  for (auto &buffer : m_bufferedData)
+    highWaterMark = std::max (highWaterMark, buffer.second.GetHighWaterMark ());
+  return highWaterMark;
+}
+
+
+const nodeStatistics*
+BitcoinNode::GetNodeStats (void) const
+{
+  return m_nodeStats;
+}
+
+
+void
+BitcoinNode::UpdateNodeStats (void)
+{
+  NS_LOG_FUNCTION (this);
+
+  if (m_nodeStats == 0)
+    return;
+
+  m_nodeStats->meanBlockReceiveTime = m_meanBlockReceiveTime;
+  m_nodeStats->meanBlockPropagationTime = m_meanBlockPropagationTime;
+  m_nodeStats->meanBlockSize = m_meanBlockSize;
+  m_nodeStats->totalBlocks = m_blockchain.GetTotalBlocks();
+  m_nodeStats->staleBlocks = m_blockchain.GetNoStaleBlocks();
+  m_nodeStats->longestFork = m_blockchain.GetLongestForkSize();
+  m_nodeStats->blocksInForks = m_blockchain.GetBlocksInForks();
+}
+
+
 void 
 BitcoinNode::SetPeersAddresses (const std::vector<Ipv4Address> &peers)
 {
@@ -120,6 +363,7 @@ BitcoinNode::SetPeersDownloadSpeeds (const std::map<Ipv4Address, double> &peersD
 {
   NS_LOG_FUNCTION (this);
   m_peersDownloadSpeeds = peersDownloadSpeeds;
+  m_sharedPeersDownloadSpeeds = 0;
 }
 
 
@@ -128,6 +372,17 @@ BitcoinNode::SetPeersUploadSpeeds (const std::map<Ipv4Address, double> &peersUpl
 {
   NS_LOG_FUNCTION (this);
   m_peersUploadSpeeds = peersUploadSpeeds;
+  m_sharedPeersUploadSpeeds = 0;
+}
+
+
+void 
+BitcoinNode::SetSharedPeersSpeeds (const std::map<Ipv4Address, double> *peersDownloadSpeeds, 
+                                   const std::map<Ipv4Address, double> *peersUploadSpeeds)
+{
+  NS_LOG_FUNCTION (this);
+  m_sharedPeersDownloadSpeeds = peersDownloadSpeeds;
+  m_sharedPeersUploadSpeeds = peersUploadSpeeds;
 }
 
 void 
@@ -154,6 +409,166 @@ BitcoinNode::SetProtocolType (enum ProtocolType protocolType)
   m_protocolType = protocolType;
 }
 
+
+void
+BitcoinNode::SetSeed (uint32_t seed)
+{
+  NS_LOG_FUNCTION (this);
+  m_seed = seed;
+}
+
+
+void
+BitcoinNode::SeedGenerators (void)
+{
+  NS_LOG_FUNCTION (this);
+
+  if (m_seed != 0)
+    srand(m_seed + GetNode()->GetId());
+  else
+    srand(time(NULL) + GetNode()->GetId());
+}
+
+
+void
+BitcoinNode::SaveCheckpoint (rapidjson::Value &state, rapidjson::Document::AllocatorType &allocator) const
+{
+  NS_LOG_FUNCTION (this);
+
+  rapidjson::Value value;
+  rapidjson::Value blocks(rapidjson::kArrayType);
+  rapidjson::Value orphans(rapidjson::kArrayType);
+  rapidjson::Value queueInv(rapidjson::kObjectType);
+  rapidjson::Value invTimeouts(rapidjson::kObjectType);
+  rapidjson::Value receivedNotValidated(rapidjson::kArrayType);
+  rapidjson::Value onlyHeadersReceived(rapidjson::kArrayType);
+  rapidjson::Value counters(rapidjson::kArrayType);
+
+  if (m_blockTorrent)
+    NS_LOG_WARN ("Node " << GetNode ()->GetId () << ": the blockTorrent downloads are not saved in the checkpoint");
+
+  value = GetNode ()->GetId ();
+  state.AddMember("nodeId", value, allocator);
+
+  for (int height = 1; height <= m_blockchain.GetBlockchainHeight (); height++)
+  {
+    std::vector<Block> sameHeight = m_blockchain.GetBlocksInSameHeight (height);
+
+    for (auto &block : sameHeight)
+    {
+      CheckpointBlock (block, value, allocator);
+      blocks.PushBack(value, allocator);
+    }
+  }
+  state.AddMember("blocks", blocks, allocator);
+
+  CheckpointBlockchainState (m_blockchain.GetState (), value, allocator);
+  state.AddMember("blockchain", value, allocator);
+
+  for (auto &block : m_blockchain.GetOrphans ())
+  {
+    CheckpointBlock (block, value, allocator);
+    orphans.PushBack(value, allocator);
+  }
+  state.AddMember("orphans", orphans, allocator);
+
+  for (auto &inv : m_queueInv)
+  {
+    rapidjson::Value peers(rapidjson::kArrayType);
+    rapidjson::Value blockHash(inv.first.c_str(), inv.first.size(), allocator);
+
+    for (auto &peer : inv.second)
+    {
+      value = InetSocketAddress::ConvertFrom(peer).GetIpv4 ().Get ();
+      peers.PushBack(value, allocator);
+    }
+    queueInv.AddMember(blockHash, peers, allocator);
+  }
+  state.AddMember("queueInv", queueInv, allocator);
+
+  for (auto &timeout : m_invTimeouts)
+  {
+    if (!timeout.second.IsRunning ())
+      continue;
+
+    rapidjson::Value blockHash(timeout.first.c_str(), timeout.first.size(), allocator);
+    value = Simulator::GetDelayLeft (timeout.second).GetSeconds ();
+    invTimeouts.AddMember(blockHash, value, allocator);
+  }
+  state.AddMember("invTimeouts", invTimeouts, allocator);
+
+  for (auto &block : m_receivedNotValidated)
+  {
+    CheckpointBlock (block.second, value, allocator);
+    receivedNotValidated.PushBack(value, allocator);
+  }
+  state.AddMember("receivedNotValidated", receivedNotValidated, allocator);
+
+  for (auto &block : m_onlyHeadersReceived)
+  {
+    CheckpointBlock (block.second, value, allocator);
+    onlyHeadersReceived.PushBack(value, allocator);
+  }
+  state.AddMember("onlyHeadersReceived", onlyHeadersReceived, allocator);
+
+  const std::vector<double> *times[] = {&m_sendBlockTimes, &m_sendCompressedBlockTimes, &m_receiveBlockTimes, &m_receiveCompressedBlockTimes};
+  const char                *timesNames[] = {"sendBlockTimes", "sendCompressedBlockTimes", "receiveBlockTimes", "receiveCompressedBlockTimes"};
+
+  for (int i = 0; i < 4; i++)
+  {
+    rapidjson::Value queue(rapidjson::kArrayType);
+
+    for (auto &time : *times[i])
+    {
+      value = time;
+      queue.PushBack(value, allocator);
+    }
+    state.AddMember(rapidjson::StringRef(timesNames[i]), queue, allocator);
+  }
+
+  value = m_meanBlockReceiveTime;
+  state.AddMember("meanBlockReceiveTime", value, allocator);
+  value = m_previousBlockReceiveTime;
+  state.AddMember("previousBlockReceiveTime", value, allocator);
+  value = m_meanBlockPropagationTime;
+  state.AddMember("meanBlockPropagationTime", value, allocator);
+  value = m_meanBlockSize;
+  state.AddMember("meanBlockSize", value, allocator);
+
+  const BitcoinQuantileSketch *sketches[] = {&m_blockReceiveTimeSketch, &m_blockPropagationTimeSketch, &m_blockSizeSketch};
+  rapidjson::Value sketchesArray(rapidjson::kArrayType);
+
+  for (auto sketch : sketches)
+  {
+    rapidjson::Value    sketchArray(rapidjson::kArrayType);
+    std::vector<double> values;
+
+    sketch->ToVector (values);
+    for (auto &v : values)
+    {
+      value = v;
+      sketchArray.PushBack(value, allocator);
+    }
+    sketchesArray.PushBack(sketchArray, allocator);
+  }
+  state.AddMember("sketches", sketchesArray, allocator);
+
+  for (auto counter : checkpointCounters)
+  {
+    value.SetInt64(m_nodeStats->*counter);
+    counters.PushBack(value, allocator);
+  }
+  state.AddMember("counters", counters, allocator);
+}
+
+
+void
+BitcoinNode::SetCheckpoint (const std::string &state)
+{
+  NS_LOG_FUNCTION (this);
+  m_checkpoint = state;
+}
+
 void 
 BitcoinNode::DoDispose (void)
 {
@@ -172,26 +587,32 @@ BitcoinNode::StartApplication ()    // Called at time specified by Start
   NS_LOG_FUNCTION (this);
   // Create the socket if not already
   
-  srand(time(NULL) + GetNode()->GetId());
+  SeedGenerators ();
   NS_LOG_INFO ("Node " << GetNode()->GetId() << ": download speed = " << m_downloadSpeed << " B/s");
   NS_LOG_INFO ("Node " << GetNode()->GetId() << ": upload speed = " << m_uploadSpeed << " B/s");
   NS_LOG_INFO ("Node " << GetNode()->GetId() << ": m_numberOfPeers = " << m_numberOfPeers);
   NS_LOG_INFO ("Node " << GetNode()->GetId() << ": m_invTimeoutMinutes = " << m_invTimeoutMinutes.GetMinutes() << "mins");
+  SelectProtocolPolicy ();
   NS_LOG_WARN ("Node " << GetNode()->GetId() << ": m_protocolType = " << getProtocolType(m_protocolType));
   NS_LOG_WARN ("Node " << GetNode()->GetId() << ": m_blockTorrent = " << m_blockTorrent);
   NS_LOG_WARN ("Node " << GetNode()->GetId() << ": m_chunkSize = " << m_chunkSize << " Bytes");
+  NS_LOG_WARN ("Node " << GetNode()->GetId() << ": m_rarestFirst = " << m_rarestFirst);
+
+  m_chunkScheduler.SetRarestFirst (m_rarestFirst);
+  m_chunkScheduler.SetChunkSize (m_chunkSize);
+  m_chunkScheduler.SetMaxChunksInFlight (m_maxChunksInFlight);
+  m_chunkScheduler.SetBatchSeconds (m_chunkBatchTime.GetSeconds ());
+  m_chunkScheduler.SetEndgameChunks (m_endgameChunks);
+  m_jsonPool.SetEnabled (m_jsonPoolEnabled);
+  m_jsonPool.SetArenaSize (m_jsonArenaSize);
 
   NS_LOG_INFO ("Node " << GetNode()->GetId() << ": My peers are");
   
   for (auto it = m_peersAddresses.begin(); it != m_peersAddresses.end(); it++)
     NS_LOG_INFO("\t" << *it);
 
-  double currentMax = 0;
-  
-  for(auto it = m_peersDownloadSpeeds.begin(); it != m_peersDownloadSpeeds.end(); ++it ) 
-  {
-    //std::cout << "Node " << GetNode()->GetId() << ": peer " << it->first << "download speed = " << it->second << " Mbps" << std::endl;
-  }
+  for (auto it = m_peersAddresses.begin(); it != m_peersAddresses.end(); it++)
+    NS_LOG_DEBUG("Node " << GetNode()->GetId() << ": peer " << *it << " download speed = " << GetPeerDownloadSpeed (*it) << " Mbps");
   
   if (!m_socket)
   {
@@ -268,6 +689,149 @@ BitcoinNode::StartApplication ()    // Called at time specified by Start
   m_nodeStats->blockTimeouts = 0;
   m_nodeStats->chunkTimeouts = 0;
   m_nodeStats->minedBlocksInMainChain = 0;
+
+  if (m_sketchRelativeAccuracy > 0)
+  {
+    m_blockReceiveTimeSketch = BitcoinQuantileSketch (m_sketchRelativeAccuracy);
+    m_blockPropagationTimeSketch = BitcoinQuantileSketch (m_sketchRelativeAccuracy);
+    m_blockSizeSketch = BitcoinQuantileSketch (m_sketchRelativeAccuracy);
+  }
+
+  if (!m_checkpoint.empty ())
+    RestoreCheckpoint ();
+
+  m_blockchain.SetFinalityDepth (m_finalityDepth);
+}
+
+
+void
+BitcoinNode::RestoreCheckpoint (void)
+{
+  NS_LOG_FUNCTION (this);
+
+  rapidjson::Document d;
+
+  d.Parse(m_checkpoint.c_str());
+  if (d.HasParseError ())
+    NS_FATAL_ERROR ("Node " << GetNode()->GetId() << ": the checkpoint state is not valid json");
+
+  const rapidjson::Value &blocks = GetCheckpointMember (d, "blocks", &rapidjson::Value::IsArray);
+  for (rapidjson::SizeType j = 0; j < blocks.Size(); j++)
+    m_blockchain.AddBlock (RestoreBlock (blocks[j]));
+
+  /* The pruned rows hold only their main chain block, so their counters are restored separately */
+  if (d.HasMember("blockchain"))
+    m_blockchain.SetState (RestoreBlockchainState (GetCheckpointMember (d, "blockchain", &rapidjson::Value::IsObject)));
+
+  const rapidjson::Value &orphans = GetCheckpointMember (d, "orphans", &rapidjson::Value::IsArray);
+  for (rapidjson::SizeType j = 0; j < orphans.Size(); j++)
+    m_blockchain.AddOrphan (RestoreBlock (orphans[j]));
+
+  const rapidjson::Value &queueInv = GetCheckpointMember (d, "queueInv", &rapidjson::Value::IsObject);
+  for (rapidjson::Value::ConstMemberIterator it = queueInv.MemberBegin(); it != queueInv.MemberEnd(); ++it)
+  {
+    const rapidjson::Value &peers = CheckCheckpointValue (it->value, "queueInv", &rapidjson::Value::IsArray);
+
+    for (rapidjson::SizeType j = 0; j < peers.Size(); j++)
+    {
+      Ipv4Address peer (CheckCheckpointValue (peers[j], "queueInv", &rapidjson::Value::IsUint).GetUint());
+      m_queueInv[it->name.GetString()].push_back(InetSocketAddress (peer, m_bitcoinPort));
+    }
+  }
+
+  const rapidjson::Value &invTimeouts = GetCheckpointMember (d, "invTimeouts", &rapidjson::Value::IsObject);
+  for (rapidjson::Value::ConstMemberIterator it = invTimeouts.MemberBegin(); it != invTimeouts.MemberEnd(); ++it)
+  {
+    std::string blockHash = it->name.GetString();
+    double      timeLeft = CheckCheckpointValue (it->value, "invTimeouts", &rapidjson::Value::IsNumber).GetDouble();
+
+    m_invTimeouts[blockHash] = Simulator::Schedule (Seconds (timeLeft), &BitcoinNode::InvTimeoutExpired, this, blockHash);
+  }
+
+  const rapidjson::Value &onlyHeadersReceived = GetCheckpointMember (d, "onlyHeadersReceived", &rapidjson::Value::IsArray);
+  for (rapidjson::SizeType j = 0; j < onlyHeadersReceived.Size(); j++)
+  {
+    Block              block = RestoreBlock (onlyHeadersReceived[j]);
+    std::ostringstream stringStream;
+
+    stringStream << block.GetBlockHeight () << "/" << block.GetMinerId ();
+    m_onlyHeadersReceived[stringStream.str()] = block;
+  }
+
+  const rapidjson::Value &receivedNotValidated = GetCheckpointMember (d, "receivedNotValidated", &rapidjson::Value::IsArray);
+  for (rapidjson::SizeType j = 0; j < receivedNotValidated.Size(); j++)
+  {
+    Block              block = RestoreBlock (receivedNotValidated[j]);
+    std::ostringstream stringStream;
+
+    stringStream << block.GetBlockHeight () << "/" << block.GetMinerId ();
+    m_receivedNotValidated[stringStream.str()] = block;
+    if (!m_blockchain.IsOrphan (block))
+      ValidateBlock (block);
+  }
+
+  /**
+   * Only the send and receive times which have not passed are restored, each with the event removing it
+   */
+  std::vector<double> BitcoinNode::*times[] = {&BitcoinNode::m_sendBlockTimes, &BitcoinNode::m_sendCompressedBlockTimes,
+                                               &BitcoinNode::m_receiveBlockTimes, &BitcoinNode::m_receiveCompressedBlockTimes};
+  void (BitcoinNode::*removeTimes[]) (void) = {&BitcoinNode::RemoveSendTime, &BitcoinNode::RemoveCompressedBlockSendTime,
+                                               &BitcoinNode::RemoveReceiveTime, &BitcoinNode::RemoveCompressedBlockReceiveTime};
+  const char *timesNames[] = {"sendBlockTimes", "sendCompressedBlockTimes", "receiveBlockTimes", "receiveCompressedBlockTimes"};
+
+  for (int i = 0; i < 4; i++)
+  {
+    const rapidjson::Value &queue = GetCheckpointMember (d, timesNames[i], &rapidjson::Value::IsArray);
+
+    for (rapidjson::SizeType j = 0; j < queue.Size(); j++)
+    {
+      double time = CheckCheckpointValue (queue[j], timesNames[i], &rapidjson::Value::IsNumber).GetDouble();
+
+      if (time > Simulator::Now ().GetSeconds ())
+      {
+        (this->*times[i]).push_back(time);
+        Simulator::Schedule (Seconds (time) - Simulator::Now (), removeTimes[i], this);
+      }
+    }
+  }
+
+  m_meanBlockReceiveTime = GetCheckpointMember (d, "meanBlockReceiveTime", &rapidjson::Value::IsNumber).GetDouble();
+  m_previousBlockReceiveTime = GetCheckpointMember (d, "previousBlockReceiveTime", &rapidjson::Value::IsNumber).GetDouble();
+  m_meanBlockPropagationTime = GetCheckpointMember (d, "meanBlockPropagationTime", &rapidjson::Value::IsNumber).GetDouble();
+  m_meanBlockSize = GetCheckpointMember (d, "meanBlockSize", &rapidjson::Value::IsNumber).GetDouble();
+
+  //The checkpoints written before the sketches were added have no "sketches"
+  if (m_sketchRelativeAccuracy > 0 && d.HasMember("sketches"))
+  {
+    BitcoinQuantileSketch    *sketches[] = {&m_blockReceiveTimeSketch, &m_blockPropagationTimeSketch, &m_blockSizeSketch};
+    const rapidjson::SizeType noSketches = sizeof(sketches) / sizeof(sketches[0]);
+    const rapidjson::Value   &savedSketches = GetCheckpointMember (d, "sketches", &rapidjson::Value::IsArray);
+
+    for (rapidjson::SizeType j = 0; j < std::min(savedSketches.Size(), noSketches); j++)
+    {
+      const rapidjson::Value &sketch = CheckCheckpointValue (savedSketches[j], "sketches", &rapidjson::Value::IsArray);
+      std::vector<double>     values;
+
+      for (rapidjson::SizeType k = 0; k < sketch.Size(); k++)
+        values.push_back(CheckCheckpointValue (sketch[k], "sketches", &rapidjson::Value::IsNumber).GetDouble());
+
+      //A sketch of another accuracy could not be merged with the sketches of the other nodes
+      if (!values.empty () && values[0] == m_sketchRelativeAccuracy)
+        sketches[j]->FromVector (values);
+    }
+  }
+
+  const rapidjson::Value &counters = GetCheckpointMember (d, "counters", &rapidjson::Value::IsArray);
+  const rapidjson::SizeType noCounters = sizeof(checkpointCounters) / sizeof(checkpointCounters[0]);
+
+  if (counters.Size() != noCounters)
+    NS_LOG_WARN ("Node " << GetNode()->GetId() << ": the checkpoint has " << counters.Size()
+                 << " counters instead of " << noCounters << ", only the first ones are restored");
+  for (rapidjson::SizeType j = 0; j < std::min(counters.Size(), noCounters); j++)
+    m_nodeStats->*checkpointCounters[j] = CheckCheckpointValue (counters[j], "counters", &rapidjson::Value::IsInt64).GetInt64();
+
+  NS_LOG_WARN ("Node " << GetNode()->GetId() << ": restored " << m_blockchain.GetTotalBlocks ()
+               << " blocks from the checkpoint at time " << Simulator::Now ().GetSeconds () << "s");
 }
 
 void 
@@ -280,6 +844,11 @@ BitcoinNode::StopApplication ()     // Called at time specified by Stop
     m_peersSockets[*i]->Close ();
   }
   
+  for (std::map<Ipv4Address, EventId>::iterator it = m_trickleEvents.begin(); it != m_trickleEvents.end(); it++)
+    BitcoinEventProfiler::Cancel (it->second, SEND_ANNOUNCEMENTS_EVENT);
+  m_trickleEvents.clear ();
+  m_pendingAnnouncements.clear ();
+  m_knownInventory.clear ();
 
   if (m_socket) 
   {
@@ -288,7 +857,7 @@ BitcoinNode::StopApplication ()     // Called at time specified by Stop
   }
 
   NS_LOG_WARN ("\n\nBITCOIN NODE " << GetNode ()->GetId () << ":");
-  NS_LOG_WARN ("Current Top Block is:\n" << *(m_blockchain.GetCurrentTopBlock()));
+  NS_LOG_WARN ("Current Top Block is:\n" << m_blockchain.GetCurrentTopBlock());
   NS_LOG_WARN ("Current Blockchain is:\n" << m_blockchain);
   //m_blockchain.PrintOrphans();
   //PrintQueueInv();
@@ -307,15 +876,9 @@ BitcoinNode::StopApplication ()     // Called at time specified by Stop
   NS_LOG_WARN("m_receiveBlockTimes size = " << m_receiveBlockTimes.size());
   NS_LOG_WARN("longest fork = " << m_blockchain.GetLongestForkSize());
   NS_LOG_WARN("blocks in forks = " << m_blockchain.GetBlocksInForks());
+  NS_LOG_WARN("blocks dropped below the finality depth = " << m_blockchain.GetNoDroppedBlocks());
   
-  m_nodeStats->meanBlockReceiveTime = m_meanBlockReceiveTime;
-  m_nodeStats->meanBlockPropagationTime = m_meanBlockPropagationTime;
-  m_nodeStats->meanBlockSize = m_meanBlockSize;
-  m_nodeStats->totalBlocks = m_blockchain.GetTotalBlocks();
-  m_nodeStats->staleBlocks = m_blockchain.GetNoStaleBlocks();
-  m_nodeStats->longestFork = m_blockchain.GetLongestForkSize();
-  m_nodeStats->blocksInForks = m_blockchain.GetBlocksInForks();
-
+  UpdateNodeStats ();
 }
 
 void 
@@ -337,1505 +900,1401 @@ BitcoinNode::HandleRead (Ptr<Socket> socket)
       {
         /**
          * We may receive more than one packets simultaneously on the socket,
-         * so we have to parse each one of them.
-         */
-        std::string delimiter = "#";
-        std::string parsedPacket;
-        size_t pos = 0;
-        char *packetInfo = new char[packet->GetSize () + 1];
-        std::ostringstream totalStream;
-		
-        packet->CopyData (reinterpret_cast<uint8_t*>(packetInfo), packet->GetSize ());
-        packetInfo[packet->GetSize ()] = '\0'; // ensure that it is null terminated to avoid bugs
-		  
-        /**
-         * Add the buffered data to complete the packet
+         * so we have to parse each one of them. The data are appended to the
+         * buffer of the connection, which completes the partially received messages.
          */
-        totalStream << m_bufferedData[from] << packetInfo; 
-        std::string totalReceivedData(totalStream.str());
-        NS_LOG_INFO("Node " << GetNode ()->GetId () << " Total Received Data: " << totalReceivedData);
+        auto buffer_it = m_bufferedData.find(from);
+        const char *parsedPacket;
+        uint32_t parsedPacketSize;
+
+        if (buffer_it == m_bufferedData.end())
+          buffer_it = m_bufferedData.insert(std::make_pair(from, BitcoinReceiveBuffer (m_receiveBufferSize))).first;
+
+        BitcoinReceiveBuffer &buffer = buffer_it->second;
+        buffer.Append (packet);
+        NS_LOG_INFO("Node " << GetNode ()->GetId () << " Total Buffered Data: " << buffer.GetSize () << " Bytes");
 		  
-        while ((pos = totalReceivedData.find(delimiter)) != std::string::npos) 
+        while ((parsedPacket = buffer.NextMessage (parsedPacketSize)) != 0) 
         {
-          parsedPacket = totalReceivedData.substr(0, pos);
           NS_LOG_INFO("Node " << GetNode ()->GetId () << " Parsed Packet: " << parsedPacket);
 		  
-          rapidjson::Document d;
-          d.Parse(parsedPacket.c_str());
+          BitcoinJsonDocument d (m_jsonPool);
+          d.Parse(parsedPacket);
 		  
           if(!d.IsObject())
           {
             NS_LOG_WARN("The parsed packet is corrupted");
-            totalReceivedData.erase(0, pos + delimiter.length()); 
             continue;
           }			
 		  
-          rapidjson::StringBuffer buffer;
-          rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
-          d.Accept(writer);
-		  
           NS_LOG_INFO ("At time "  << Simulator::Now ().GetSeconds ()
                         << "s bitcoin node " << GetNode ()->GetId () << " received "
                         <<  packet->GetSize () << " bytes from "
                         << InetSocketAddress::ConvertFrom(from).GetIpv4 ()
                         << " port " << InetSocketAddress::ConvertFrom (from).GetPort () 
-                        << " with info = " << buffer.GetString());	
+                        << " with info = " << JsonToString (d));	
 						
-          switch (d["message"].GetInt())
-          {
-            case INV:
-            {
-              //NS_LOG_INFO ("INV");
-              int j;
-              std::vector<std::string>            requestBlocks;
-              std::vector<std::string>::iterator  block_it;
-			  
-              m_nodeStats->invReceivedBytes += m_bitcoinMessageHeader + m_countBytes + d["inv"].Size()*m_inventorySizeBytes;
-			  
-              for (j=0; j<d["inv"].Size(); j++)
-              {  
-                std::string   invDelimiter = "/";
-                std::string   parsedInv = d["inv"][j].GetString();
-                size_t        invPos = parsedInv.find(invDelimiter);
-                EventId       timeout;
-
-                int height = atoi(parsedInv.substr(0, invPos).c_str());
-                int minerId = atoi(parsedInv.substr(invPos+1, parsedInv.size()).c_str());
-				  
-                								  
-                if (m_blockchain.HasBlock(height, minerId) || m_blockchain.IsOrphan(height, minerId) || ReceivedButNotValidated(parsedInv))
-                {
-                  NS_LOG_INFO("INV: Bitcoin node " << GetNode ()->GetId () 
-                              << " has already received the block with height = " 
-                              << height << " and minerId = " << minerId);				  
-                }
-                else
-                {
-                  NS_LOG_INFO("INV: Bitcoin node " << GetNode ()->GetId () 
-                              << " does not have the block with height = " 
-                              << height << " and minerId = " << minerId);
-				  
-                  /**
-                   * Check if we have already requested the block
-                   */
-				   
-                  if (m_invTimeouts.find(parsedInv) == m_invTimeouts.end())
-                  {
-                    NS_LOG_INFO("INV: Bitcoin node " << GetNode ()->GetId ()
-                                 << " has not requested the block yet");
-                    requestBlocks.push_back(parsedInv);
-                    timeout = Simulator::Schedule (m_invTimeoutMinutes, &BitcoinNode::InvTimeoutExpired, this, parsedInv);
-                    m_invTimeouts[parsedInv] = timeout;
-                  }
-                  else
-                  {
-                    NS_LOG_INFO("INV: Bitcoin node " << GetNode ()->GetId ()
-                                 << " has already requested the block");
-                  }
-				  
-                  m_queueInv[parsedInv].push_back(from);
-                  //PrintQueueInv();
-                  //PrintInvTimeouts();
-                }								  
-              }
-			
-              if (!requestBlocks.empty())
-              {
-                rapidjson::Value   value;
-                rapidjson::Value   array(rapidjson::kArrayType);
-                d.RemoveMember("inv");
-
-                for (block_it = requestBlocks.begin(); block_it < requestBlocks.end(); block_it++) 
-                {
-                  value.SetString(block_it->c_str(), block_it->size(), d.GetAllocator());
-                  array.PushBack(value, d.GetAllocator());
-                }		
-			  
-                d.AddMember("blocks", array, d.GetAllocator());
-					
-                SendMessage(INV, GET_HEADERS, d, from);				
-                SendMessage(INV, GET_DATA, d, from);	
-				
-              }
-              break;
-            }
-            case EXT_INV:
-            {
-              //NS_LOG_INFO ("EXT_INV");
-              int j;
-              std::vector<std::string>            requestHeaders;
-              std::vector<std::string>            requestChunks;
+          (this->*m_handleMessage) (d, from);
+        }
+      }
+      else if (Inet6SocketAddress::IsMatchingType (from))
+      {
+        NS_LOG_INFO ("At time " << Simulator::Now ().GetSeconds ()
+                     << "s bitcoin node " << GetNode ()->GetId () << " received "
+                     <<  packet->GetSize () << " bytes from "
+                     << Inet6SocketAddress::ConvertFrom(from).GetIpv6 ()
+                     << " port " << Inet6SocketAddress::ConvertFrom (from).GetPort ());
+      }
+      m_rxTrace (packet, from);
+  }
+}
 
-              std::vector<std::string>::iterator  block_it;
-			  
-              m_nodeStats->extInvReceivedBytes += m_bitcoinMessageHeader + m_countBytes + d["inv"].Size()*m_inventorySizeBytes;
+
+template <class Policy>
+void
+BitcoinNode::HandleMessage (BitcoinJsonDocument &d, Address &from)
+{
+  NS_LOG_FUNCTION (this);
+
+  switch (d["message"].GetInt())
+  {
+    case INV:
+    {
+      //NS_LOG_INFO ("INV");
+      int j;
+      std::vector<std::string>            requestBlocks;
+      std::vector<std::string>::iterator  block_it;
 			  
-              for (j=0; j<d["inv"].Size(); j++)
-              {  
-                std::string   invDelimiter = "/";
-                std::string   blockHash = d["inv"][j]["hash"].GetString();
-                int           blockSize = d["inv"][j]["size"].GetInt();
-                size_t        invPos = blockHash.find(invDelimiter);
-                EventId       timeout;
-
-                int height = atoi(blockHash.substr(0, invPos).c_str());
-                int minerId = atoi(blockHash.substr(invPos+1, blockHash.size()).c_str());
-
-                m_nodeStats->extInvReceivedBytes += 5;
-                if (!d["inv"][j]["fullBlock"].GetBool())
-                  m_nodeStats->extInvReceivedBytes += d["inv"][j]["availableChunks"].Size();
+      CountReceivedBytes (d);
 			  
-                if (m_blockchain.HasBlock(height, minerId) || m_blockchain.IsOrphan(height, minerId) || ReceivedButNotValidated(blockHash))
-                {
-                  NS_LOG_INFO("EXT_INV: Bitcoin node " << GetNode ()->GetId () 
-                              << " has already received the block with height = " 
-                              << height << " and minerId = " << minerId);				  
-                }
-                else
-                {
-                  NS_LOG_INFO("EXT_INV: Bitcoin node " << GetNode ()->GetId () 
-                              << " does not have the block with height = " 
-                              << height << " and minerId = " << minerId);
-				  
-                  if (m_queueChunks.find(blockHash) == m_queueChunks.end())
-                  {
-                    NS_LOG_INFO("EXT_INV: Bitcoin node " << GetNode ()->GetId ()
-                                << " does not have an entry in m_queueChunks");			       
-                    for (int i = 0; i < ceil(blockSize/static_cast<double>(m_chunkSize)); i++)
-                      m_queueChunks[blockHash].push_back(i);
-                  }
-                  //PrintQueueChunks();
-				  
-				  
-                  /**
-                   * Check if we have already requested all the chunks
-                   */
+      for (j=0; j<d["inv"].Size(); j++)
+      {  
+        std::string   invDelimiter = "/";
+        std::string   parsedInv = d["inv"][j].GetString();
+        size_t        invPos = parsedInv.find(invDelimiter);
+        EventId       timeout;
+
+        int height = atoi(parsedInv.substr(0, invPos).c_str());
+        int minerId = atoi(parsedInv.substr(invPos+1, parsedInv.size()).c_str());
+
+        AddKnownBlock (InetSocketAddress::ConvertFrom(from).GetIpv4 (), height, minerId);
+				  
+        								  
+        if (m_blockchain.HasBlock(height, minerId) || m_blockchain.IsOrphan(height, minerId) || m_blockchain.IsPruned(height, minerId)
+            || ReceivedButNotValidated(parsedInv))
+        {
+          NS_LOG_INFO("INV: Bitcoin node " << GetNode ()->GetId () 
+                      << " has already received the block with height = " 
+                      << height << " and minerId = " << minerId);				  
+        }
+        else
+        {
+          NS_LOG_INFO("INV: Bitcoin node " << GetNode ()->GetId () 
+                      << " does not have the block with height = " 
+                      << height << " and minerId = " << minerId);
+				  
+          /**
+           * Check if we have already requested the block
+           */
 				   
-                  if (m_queueChunks[blockHash].size() > 0)
-                  {
-                    NS_LOG_INFO("EXT_INV: Bitcoin node " << GetNode ()->GetId ()
-                                 << " has not requested all the chunks yet");
-                    if (!OnlyHeadersReceived(blockHash))
-                      requestHeaders.push_back(blockHash);
-                    //timeout = Simulator::Schedule (m_invTimeoutMinutes, &BitcoinNode::InvTimeoutExpired, this, blockHash);
-                    //m_invTimeouts[blockHash] = timeout;
-					
-                    
-                    std::vector<int> candidateChunks;
-                    if (d["inv"][j]["fullBlock"].GetBool())
-                    {
-                      for (auto &chunk : m_queueChunks[blockHash])
-                        candidateChunks.push_back(chunk);
-                    }
-                    else
-                    {
-                      for (int k = 0; k < d["inv"][j]["availableChunks"].Size(); k++)
-                      {
-                        
-                        if (std::find(m_queueChunks[blockHash].begin(), m_queueChunks[blockHash].end(), d["inv"][j]["availableChunks"][k].GetInt()) != m_queueChunks[blockHash].end())
-                          candidateChunks.push_back(d["inv"][j]["availableChunks"][k].GetInt());
-                      }
-                    }
-					
-/*                     std::cout << "candidateChunks = ";
-                    for (auto chunk : candidateChunks)
-                      std::cout << chunk << ", ";
-                    std::cout << "\n"; */
-
-                    if (candidateChunks.size() > 0)
-                    {
-                      int randomIndex = rand() % candidateChunks.size();
-                      NS_LOG_INFO("EXT_INV: Bitcoin node " << GetNode ()->GetId ()
-                                  << " will request the chunk with index = " << randomIndex << " and value = " << candidateChunks[randomIndex]);	
-                      m_queueChunks[blockHash].erase(std::remove(m_queueChunks[blockHash].begin(),
-                                                                 m_queueChunks[blockHash].end(), candidateChunks[randomIndex]),
-                                                                 m_queueChunks[blockHash].end());
-																		  
-                      std::ostringstream chunk;
-                      chunk << blockHash << "/" << candidateChunks[randomIndex];
-                      requestChunks.push_back(chunk.str());
-					  
-                      timeout = Simulator::Schedule (Minutes(m_invTimeoutMinutes.GetMinutes() / ceil(blockSize/static_cast<double>(m_chunkSize))),
-                                                     &BitcoinNode::ChunkTimeoutExpired, this, chunk.str());
-													 
-                      m_chunkTimeouts[chunk.str()] = timeout;
-                      m_queueChunkPeers[blockHash].push_back(from);
-                    }
-                    else
-                    {
-                      NS_LOG_INFO("EXT_INV: Bitcoin node " << GetNode ()->GetId ()
-                                  << " will not request any chunks from this peer, because it has already all the available ones");
-                    }
-					
-/*                     PrintQueueChunks();
-                    PrintChunkTimeouts();
-                    PrintQueueChunkPeers();
-                    PrintReceivedChunks(); */
-                  }
-                  else
-                  {
-                    NS_LOG_INFO("EXT_INV: Bitcoin node " << GetNode ()->GetId ()
-                                 << " has already requested all the chunks");
-                  }
-				  
-                }								  
-              }
+          if (m_invTimeouts.find(parsedInv) == m_invTimeouts.end())
+          {
+            NS_LOG_INFO("INV: Bitcoin node " << GetNode ()->GetId ()
+                         << " has not requested the block yet");
+            requestBlocks.push_back(parsedInv);
+            timeout = Simulator::Schedule (m_invTimeoutMinutes, &BitcoinNode::InvTimeoutExpired, this, parsedInv);
+            m_invTimeouts[parsedInv] = timeout;
+          }
+          else
+          {
+            NS_LOG_INFO("INV: Bitcoin node " << GetNode ()->GetId ()
+                         << " has already requested the block");
+          }
+				  
+          m_queueInv[parsedInv].push_back(from);
+          //PrintQueueInv();
+          //PrintInvTimeouts();
+        }								  
+      }
 			
-              d.RemoveMember("inv");
+      if (!requestBlocks.empty())
+      {
+        rapidjson::Value   value;
+        rapidjson::Value   array(rapidjson::kArrayType);
+        d.RemoveMember("inv");
+
+        for (block_it = requestBlocks.begin(); block_it < requestBlocks.end(); block_it++) 
+        {
+          value.SetString(block_it->c_str(), block_it->size(), d.GetAllocator());
+          array.PushBack(value, d.GetAllocator());
+        }		
 			  
-              if (!requestHeaders.empty())
-              {
-                rapidjson::Value   value;
-                rapidjson::Value   array(rapidjson::kArrayType);
-                
-                for (block_it = requestHeaders.begin(); block_it < requestHeaders.end(); block_it++) 
-                {
-                  value.SetString(block_it->c_str(), block_it->size(), d.GetAllocator());
-                  array.PushBack(value, d.GetAllocator());
-                }		
+        d.AddMember("blocks", array, d.GetAllocator());
+					
+        if (m_mergeGetData)
+        {
+          value = true;
+          d.AddMember("getHeaders", value, d.GetAllocator());
+          SendMessage(INV, GET_DATA, d, MessageBytes<GET_DATA> (requestBlocks.size()), from);	
+        }
+        else
+        {
+          SendMessage(INV, GET_HEADERS, d, MessageBytes<GET_HEADERS> (0), from);				
+          SendMessage(INV, GET_DATA, d, MessageBytes<GET_DATA> (requestBlocks.size()), from);	
+        }
+				
+      }
+      break;
+    }
+    case GET_HEADERS:
+    {
+      CountReceivedBytes (d);
+      SendHeaders (GET_HEADERS, d, from);
+      break;
+    }
+    case GET_DATA:
+    {
+      NS_LOG_INFO ("GET_DATA");
 			  
-                d.AddMember("blocks", array, d.GetAllocator());
-                
-                SendMessage(EXT_INV, EXT_GET_HEADERS, d, from);				
-                
-              }
+      int j;
+      int totalBlockMessageSize = 0;
+      std::vector<Block>              requestBlocks;
+      std::vector<Block>::iterator    block_it;
+
+      CountReceivedBytes (d);
+
+      if (d.HasMember("getHeaders") && d["getHeaders"].GetBool())
+        SendHeaders (GET_DATA, d, from);
+
+      for (j=0; j<d["blocks"].Size(); j++)
+      {  
+        std::string    invDelimiter = "/";
+        std::string    parsedInv = d["blocks"][j].GetString();
+        size_t         invPos = parsedInv.find(invDelimiter);
+				  
+        int height = atoi(parsedInv.substr(0, invPos).c_str());
+        int minerId = atoi(parsedInv.substr(invPos+1, parsedInv.size()).c_str());
+				
+        if (m_blockchain.HasBlock(height, minerId))
+        {
+          NS_LOG_INFO("GET_DATA: Bitcoin node " << GetNode ()->GetId () 
+                      << " has already received the block with height = " 
+                      << height << " and minerId = " << minerId);
+          Block newBlock (m_blockchain.ReturnBlock (height, minerId));
+          requestBlocks.push_back(newBlock);
+          AddKnownBlock (InetSocketAddress::ConvertFrom(from).GetIpv4 (), height, minerId);
+        }
+        else
+        {
+          NS_LOG_INFO("GET_DATA: Bitcoin node " << GetNode ()->GetId () 
+          << " does not have the block with height = " 
+          << height << " and minerId = " << minerId);                
+        }	
+      }
 			  
-              if (!requestChunks.empty())
-              {
-                rapidjson::Value   value;
-                rapidjson::Value   chunkArray(rapidjson::kArrayType);
-                rapidjson::Value   availableChunks(rapidjson::kArrayType);
-                rapidjson::Value   chunkInfo(rapidjson::kObjectType);
+      if (!requestBlocks.empty())
+      {
+        rapidjson::Value value;
+        rapidjson::Value array(rapidjson::kArrayType);
+        
+
+        d.RemoveMember("blocks");
+				
+        for (block_it = requestBlocks.begin(); block_it < requestBlocks.end(); block_it++) 
+        {
+          rapidjson::Value blockInfo(rapidjson::kObjectType);
+          NS_LOG_INFO ("In requestBlocks " << *block_it);
+
+          value = block_it->GetBlockHeight ();
+          blockInfo.AddMember("height", value, d.GetAllocator ());
+
+          value = block_it->GetMinerId ();
+          blockInfo.AddMember("minerId", value, d.GetAllocator ());
+
+          value = block_it->GetParentBlockMinerId ();
+          blockInfo.AddMember("parentBlockMinerId", value, d.GetAllocator ());
+
+          value = block_it->GetBlockSizeBytes ();
+          totalBlockMessageSize += value.GetInt();
+          blockInfo.AddMember("size", value, d.GetAllocator ());
+
+          value = block_it->GetTimeCreated ();
+          blockInfo.AddMember("timeCreated", value, d.GetAllocator ());
 
-                d.RemoveMember("type");
-                d.RemoveMember("blocks");
+          value = block_it->GetTimeReceived ();							
+          blockInfo.AddMember("timeReceived", value, d.GetAllocator ());
+				  
+          array.PushBack(blockInfo, d.GetAllocator());
+        }	
 				
-                value.SetString("chunk");	
-                d.AddMember("type", value, d.GetAllocator());
+        d.AddMember("blocks", array, d.GetAllocator());
 				
-                for (auto chunk_it = requestChunks.begin(); chunk_it < requestChunks.end(); chunk_it++) 
-                {
-					
-                  std::string            invDelimiter = "/";
-                  std::string            chunkHash = *chunk_it;
-                  std::string            chunkHashHelp = chunkHash.substr(0);
-                  std::ostringstream     help;
-                  std::string            blockHash;
-                  size_t                 invPos = chunkHashHelp.find(invDelimiter);
-				  
-                  int height = atoi(chunkHashHelp.substr(0, invPos).c_str());
-				  
-                  chunkHashHelp.erase(0, invPos + invDelimiter.length());
-                  invPos = chunkHashHelp.find(invDelimiter);
-                  int minerId = atoi(chunkHashHelp.substr(0, invPos).c_str());
-				  
-                  chunkHashHelp.erase(0, invPos + invDelimiter.length());
-                  int chunkId = atoi(chunkHashHelp.substr(0).c_str());
-                  help << height << "/" << minerId;
-                  blockHash = help.str();
-				
-                  if (m_receivedChunks.find(blockHash) != m_receivedChunks.end())
-                  {
-                    for ( auto k : m_receivedChunks[blockHash])
-                    {
-                      value = k;
-                      availableChunks.PushBack(value, d.GetAllocator());
-                    }
-                  }
-                  chunkInfo.AddMember("availableChunks", availableChunks, d.GetAllocator());
-				  
-                  value = false;
-                  chunkInfo.AddMember("fullBlock", value, d.GetAllocator());
-				  
-                  value.SetString(chunk_it->c_str(), chunk_it->size(), d.GetAllocator());
-                  chunkInfo.AddMember("chunk", value, d.GetAllocator());
-				  
-                  chunkArray.PushBack(chunkInfo, d.GetAllocator());
-                }		
-                d.AddMember("chunks", chunkArray, d.GetAllocator());
-				
-                SendMessage(EXT_INV, EXT_GET_DATA, d, from);	
+        double sendTime = totalBlockMessageSize / m_uploadSpeed;
+            double eventTime;	
 				
-              }
-              break;
-            }
-            case GET_HEADERS:
-            {
-              int j;
-              std::vector<Block>              requestHeaders;
-              std::vector<Block>::iterator    block_it;
-			  
-              m_nodeStats->getHeadersReceivedBytes += m_bitcoinMessageHeader + m_getHeadersSizeBytes;
-			  
-              for (j=0; j<d["blocks"].Size(); j++)
-              {  
-                std::string   invDelimiter = "/";
-                std::string   blockHash = d["blocks"][j].GetString();
-                size_t        invPos = blockHash.find(invDelimiter);
-				
-                int height = atoi(blockHash.substr(0, invPos).c_str());
-                int minerId = atoi(blockHash.substr(invPos+1, blockHash.size()).c_str());
-				
-                if (m_blockchain.HasBlock(height, minerId) || m_blockchain.IsOrphan(height, minerId))
-                {
-                  NS_LOG_INFO("GET_HEADERS: Bitcoin node " << GetNode ()->GetId () 
-                              << " has the block with height = " 
-                              << height << " and minerId = " << minerId);
-                  Block newBlock (m_blockchain.ReturnBlock (height, minerId));
-                  requestHeaders.push_back(newBlock);
-                }
-                else if (ReceivedButNotValidated(blockHash))
-                {
-                  NS_LOG_INFO("GET_HEADERS: Bitcoin node " << GetNode ()->GetId () 
-                              << " has received but not yet validated the block with height = " 
-                              << height << " and minerId = " << minerId);
-                  requestHeaders.push_back(m_receivedNotValidated[blockHash]);
-                }
-                else
-                {
-                  NS_LOG_INFO("GET_HEADERS: Bitcoin node " << GetNode ()->GetId () 
-                              << " does not have the full block with height = " 
-                              << height << " and minerId = " << minerId);   
-				  
-                }	
-              }
-			  
-              if (!requestHeaders.empty())
-              {
-                rapidjson::Value value;
-                rapidjson::Value array(rapidjson::kArrayType);
+/*                 std::cout << "Node " << GetNode()->GetId() << "-" << InetSocketAddress::ConvertFrom(from).GetIpv4 () 
+	  		          << " " << GetPeerDownloadSpeed (InetSocketAddress::ConvertFrom(from).GetIpv4 ()) << " Mbps , time = "
+	  		          << Simulator::Now ().GetSeconds() << "s \n"; */
+        
+        if (m_sendBlockTimes.size() == 0 || Simulator::Now ().GetSeconds() >  m_sendBlockTimes.back())
+        {
+          eventTime = 0; 
+        }
+        else
+        {
+          //std::cout << "m_sendBlockTimes.back() = m_sendBlockTimes.back() = " << m_sendBlockTimes.back() << std::endl;
+          eventTime = m_sendBlockTimes.back() - Simulator::Now ().GetSeconds(); 
+        }
+        m_sendBlockTimes.push_back(Simulator::Now ().GetSeconds() + eventTime + sendTime);
 
-                d.RemoveMember("blocks");
+        //std::cout << sendTime << " " << eventTime << " " << m_sendBlockTimes.size() << std::endl;
+        NS_LOG_INFO("Node " << GetNode()->GetId() << " will start sending the block to " << InetSocketAddress::ConvertFrom(from).GetIpv4 () 
+                    << " at " << Simulator::Now ().GetSeconds() + eventTime << "\n");
+							
+       
+        // Stringify the DOM
+        rapidjson::StringBuffer &packetInfo = m_jsonPool.GetBuffer ();
+        rapidjson::Writer<rapidjson::StringBuffer> writer(packetInfo);
+        d.Accept(writer);
+        std::string packet = packetInfo.GetString();
+        NS_LOG_INFO ("DEBUG: " << packetInfo.GetString());
 				
-                for (block_it = requestHeaders.begin(); block_it < requestHeaders.end(); block_it++) 
-                {
-                  rapidjson::Value blockInfo(rapidjson::kObjectType);
-                  NS_LOG_INFO ("In requestHeaders " << *block_it);
-                  
-                  value = block_it->GetBlockHeight ();
-                  blockInfo.AddMember("height", value, d.GetAllocator ());
+        Simulator::Schedule (Seconds(eventTime), &BitcoinNode::SendBlock, this, packet, 
+                             MessageBytes<BLOCK> (requestBlocks.size(), totalBlockMessageSize), from);
+        Simulator::Schedule (Seconds(eventTime + sendTime), &BitcoinNode::RemoveSendTime, this);
+
+      }
+      break;
+    }
+    case HEADERS:
+    {
+      NS_LOG_INFO ("HEADERS");
 
-                  value = block_it->GetMinerId ();
-                  blockInfo.AddMember("minerId", value, d.GetAllocator ());
+      std::vector<std::string>              requestHeaders;
+      std::vector<std::string>              requestBlocks;
+      std::vector<std::string>::iterator    block_it;
+      int j;
 
-                  value = block_it->GetParentBlockMinerId ();
-                  blockInfo.AddMember("parentBlockMinerId", value, d.GetAllocator ());
-  
-                  value = block_it->GetBlockSizeBytes ();
-                  blockInfo.AddMember("size", value, d.GetAllocator ());
-  
-                  value = block_it->GetTimeCreated ();
-                  blockInfo.AddMember("timeCreated", value, d.GetAllocator ());
-  
-                  value = block_it->GetTimeReceived ();							
-                  blockInfo.AddMember("timeReceived", value, d.GetAllocator ());
-				  
-                  array.PushBack(blockInfo, d.GetAllocator());
-                }	
+      CountReceivedBytes (d);
+
+      
+      for (j=0; j<d["blocks"].Size(); j++)
+      {  
+        int parentHeight = d["blocks"][j]["height"].GetInt() - 1;
+        int parentMinerId = d["blocks"][j]["parentBlockMinerId"].GetInt();
+        int height = d["blocks"][j]["height"].GetInt();
+        int minerId = d["blocks"][j]["minerId"].GetInt();
+
+        AddKnownBlock (InetSocketAddress::ConvertFrom(from).GetIpv4 (), height, minerId);
 				
-                d.AddMember("blocks", array, d.GetAllocator());
 				
-                SendMessage(GET_HEADERS, HEADERS, d, from);
-              }
-              break;
-            }
-            case EXT_GET_HEADERS:
+        EventId              timeout;
+        std::ostringstream   stringStream;  
+        std::string          blockHash;
+        std::string          parentBlockHash ;
+
+        stringStream << height << "/" << minerId;
+        blockHash = stringStream.str();
+        Block newBlockHeaders(d["blocks"][j]["height"].GetInt(), d["blocks"][j]["minerId"].GetInt(), d["blocks"][j]["parentBlockMinerId"].GetInt(), 
+                              d["blocks"][j]["size"].GetInt(), d["blocks"][j]["timeCreated"].GetDouble(), 
+                              Simulator::Now ().GetSeconds (), InetSocketAddress::ConvertFrom(from).GetIpv4 ());
+        m_onlyHeadersReceived[blockHash] = Block (d["blocks"][j]["height"].GetInt(), d["blocks"][j]["minerId"].GetInt(), d["blocks"][j]["parentBlockMinerId"].GetInt(), 
+                                                  d["blocks"][j]["size"].GetInt(), d["blocks"][j]["timeCreated"].GetDouble(), 
+                                                  Simulator::Now ().GetSeconds (), InetSocketAddress::ConvertFrom(from).GetIpv4 ());
+        //PrintOnlyHeadersReceived();
+				
+        stringStream.clear();
+        stringStream.str("");
+				
+        stringStream << parentHeight << "/" << parentMinerId;
+        parentBlockHash = stringStream.str();
+				
+        if(Policy::protocolType == SENDHEADERS && !m_blockchain.HasBlock(height, minerId) && !m_blockchain.IsOrphan(height, minerId) && !ReceivedButNotValidated(blockHash))
+        {
+          NS_LOG_INFO("We have not received an INV for the block with height = " << d["blocks"][j]["height"].GetInt() 
+                       << " and minerId = " << d["blocks"][j]["minerId"].GetInt());
+				  
+          /**
+           * Acquire block
+           */
+	  
+          if (m_invTimeouts.find(blockHash) == m_invTimeouts.end())
+          {
+            NS_LOG_INFO("HEADERS: Bitcoin node " << GetNode ()->GetId ()
+                         << " has not requested the block yet");
+            requestBlocks.push_back(blockHash.c_str());
+            timeout = Simulator::Schedule (m_invTimeoutMinutes, &BitcoinNode::InvTimeoutExpired, this, blockHash);
+            m_invTimeouts[blockHash] = timeout;
+          }
+          else
+          {
+            NS_LOG_INFO("HEADERS: Bitcoin node " << GetNode ()->GetId ()
+                         << " has already requested the block");
+          }
+				  
+          m_queueInv[blockHash].push_back(from); 
+
+        }
+				  
+				  
+        if (!m_blockchain.HasBlock(parentHeight, parentMinerId) && !m_blockchain.IsOrphan(parentHeight, parentMinerId) && !ReceivedButNotValidated(parentBlockHash))
+        {				  
+          NS_LOG_INFO("The Block with height = " << d["blocks"][j]["height"].GetInt() 
+                       << " and minerId = " << d["blocks"][j]["minerId"].GetInt() 
+                       << " is an orphan\n");
+				  
+          /**
+           * Acquire parent
+           */
+	  
+          if (m_invTimeouts.find(parentBlockHash) == m_invTimeouts.end())
+          {
+            NS_LOG_INFO("HEADERS: Bitcoin node " << GetNode ()->GetId ()
+                         << " has not requested its parent block yet");
+								 
+            if(Policy::protocolType == STANDARD_PROTOCOL || 
+              (Policy::protocolType == SENDHEADERS && std::find(requestBlocks.begin(), requestBlocks.end(), parentBlockHash) == requestBlocks.end()))
             {
-              int j;
-              std::vector<Block>              requestHeaders;
-              std::vector<Block>::iterator    block_it;
+              if (!OnlyHeadersReceived(parentBlockHash))
+                requestHeaders.push_back(parentBlockHash.c_str());
+              timeout = Simulator::Schedule (m_invTimeoutMinutes, &BitcoinNode::InvTimeoutExpired, this, parentBlockHash);
+              m_invTimeouts[parentBlockHash] = timeout;
+            }
+          }
+          else
+          {
+            NS_LOG_INFO("HEADERS: Bitcoin node " << GetNode ()->GetId ()
+                         << " has already requested the block");
+          }
+				  
+          if(Policy::protocolType == STANDARD_PROTOCOL || 
+            (Policy::protocolType == SENDHEADERS && std::find(requestBlocks.begin(), requestBlocks.end(), parentBlockHash) == requestBlocks.end()))
+            m_queueInv[parentBlockHash].push_back(from); 
+
+          //PrintQueueInv();
+          //PrintInvTimeouts();
+				  
+        }
+        else
+        {
+          /**
+               * Block is not orphan, so we can go on validating
+               */
+          NS_LOG_INFO("The Block with height = " << d["blocks"][j]["height"].GetInt() 
+                      << " and minerId = " << d["blocks"][j]["minerId"].GetInt() 
+                      << " is NOT an orphan\n");			   
+        }
+      }
 			  
-              m_nodeStats->extGetHeadersReceivedBytes += m_bitcoinMessageHeader + m_getHeadersSizeBytes;
+      if (!requestHeaders.empty())
+      {
+        rapidjson::Value   value;
+        rapidjson::Value   array(rapidjson::kArrayType);
+        Time               timeout;
+
+        d.RemoveMember("blocks");
+
+        for (block_it = requestHeaders.begin(); block_it < requestHeaders.end(); block_it++) 
+        {
+          value.SetString(block_it->c_str(), block_it->size(), d.GetAllocator());
+          array.PushBack(value, d.GetAllocator());
+        }		
 			  
-              for (j=0; j<d["blocks"].Size(); j++)
-              {  
-                std::string   invDelimiter = "/";
-                std::string   blockHash = d["blocks"][j].GetString();
-                size_t        invPos = blockHash.find(invDelimiter);
-				  
-                int height = atoi(blockHash.substr(0, invPos).c_str());
-                int minerId = atoi(blockHash.substr(invPos+1, blockHash.size()).c_str());
-				
-                if (m_blockchain.HasBlock(height, minerId) || m_blockchain.IsOrphan(height, minerId))
-                {
-                  NS_LOG_INFO("EXT_GET_HEADERS: Bitcoin node " << GetNode ()->GetId () 
-                              << " has the block with height = " 
-                              << height << " and minerId = " << minerId);
-                  Block newBlock (m_blockchain.ReturnBlock (height, minerId));
-                  requestHeaders.push_back(newBlock); 
-                }
-                else if (ReceivedButNotValidated(blockHash))
-                {
-                  NS_LOG_INFO("EXT_GET_HEADERS: Bitcoin node " << GetNode ()->GetId () 
-                  << " has received but not yet validated the block with height = " 
-                  << height << " and minerId = " << minerId);
-                  requestHeaders.push_back(m_receivedNotValidated[blockHash]); 
-                }
-                else if (OnlyHeadersReceived(blockHash))	
-                {	
-                  NS_LOG_INFO("EXT_GET_HEADERS: Bitcoin node " << GetNode ()->GetId () 
-                  << " has received only the headers of the block with hash = " << blockHash); 
-                  requestHeaders.push_back(m_onlyHeadersReceived[blockHash]);
-                }
-                else
-                {
-                  NS_LOG_INFO("EXT_GET_HEADERS: Bitcoin node " << GetNode ()->GetId () 
-                  << " has neither the block nor the headers of the block hash = " << blockHash); 
+        d.AddMember("blocks", array, d.GetAllocator());
+
+					
+        SendMessage(HEADERS, GET_HEADERS, d, MessageBytes<GET_HEADERS> (0), from);			
+        SendMessage(HEADERS, GET_DATA, d, MessageBytes<GET_DATA> (requestHeaders.size()), from);	
+      }
 			  
-                }	
-              }
+      if (!requestBlocks.empty())
+      {
+        rapidjson::Value   value;
+        rapidjson::Value   array(rapidjson::kArrayType);
+        Time               timeout;
+
+        d.RemoveMember("blocks");
+
+        for (block_it = requestBlocks.begin(); block_it < requestBlocks.end(); block_it++) 
+        {
+          value.SetString(block_it->c_str(), block_it->size(), d.GetAllocator());
+          array.PushBack(value, d.GetAllocator());
+        }		
 			  
-              if (!requestHeaders.empty())
-              {
-                rapidjson::Value     value;
-                rapidjson::Value     array(rapidjson::kArrayType);
-                rapidjson::Value     chunkArray(rapidjson::kArrayType);
-                rapidjson::Value     chunkInfo(rapidjson::kObjectType);
-                std::ostringstream   blockHashHelp;
-                std::string          blockHash;
-				
-                d.RemoveMember("blocks");
-				
-                for (block_it = requestHeaders.begin(); block_it < requestHeaders.end(); block_it++) 
-                {
-                  NS_LOG_INFO ("In requestHeaders " << *block_it);
-				  
-                  blockHashHelp << block_it->GetBlockHeight () << "/" << block_it->GetMinerId ();
-                  blockHash = blockHashHelp.str();
-				  
-                  value = block_it->GetBlockHeight ();
-                  chunkInfo.AddMember("height", value, d.GetAllocator ());
-  
-                  value = block_it->GetMinerId ();
-                  chunkInfo.AddMember("minerId", value, d.GetAllocator ());
-
-                  value = block_it->GetParentBlockMinerId ();
-                  chunkInfo.AddMember("parentBlockMinerId", value, d.GetAllocator ());
-  
-                  value = block_it->GetBlockSizeBytes ();
-                  chunkInfo.AddMember("size", value, d.GetAllocator ());
-  
-                  value = block_it->GetTimeCreated ();
-                  chunkInfo.AddMember("timeCreated", value, d.GetAllocator ());
-  
-                  value = block_it->GetTimeReceived ();							
-                  chunkInfo.AddMember("timeReceived", value, d.GetAllocator ());
-
-                  if (m_blockchain.HasBlock(block_it->GetBlockHeight (), block_it->GetMinerId ()) 
-                      || m_blockchain.IsOrphan(block_it->GetBlockHeight (), block_it->GetMinerId ())
-                      || ReceivedButNotValidated(blockHash))
-                  {
-                    value = true;							
-                    chunkInfo.AddMember("fullBlock", value, d.GetAllocator ());
-                  }
-                  else if (OnlyHeadersReceived(blockHash))
-                  {
-                    int noChunks = ceil(block_it->GetBlockSizeBytes ()/static_cast<double>(m_chunkSize));
+        d.AddMember("blocks", array, d.GetAllocator());
+
+        SendMessage(HEADERS, GET_DATA, d, MessageBytes<GET_DATA> (requestBlocks.size()), from);	
+      }
+      break;
+    }
+    case BLOCK:
+    {
+      NS_LOG_INFO ("BLOCK");
+      long blockMessageSize = 0;
+      long blockPayload = 0;
+      double receiveTime = 0;
+      double eventTime = 0;
+      double minSpeed = std::min(m_downloadSpeed, GetPeerUploadSpeed (InetSocketAddress::ConvertFrom(from).GetIpv4 ()) * 1000000 / 8);
+			  
+      std::string blockType = d["type"].GetString();
+			  
+      for (int j=0; j<d["blocks"].Size(); j++)
+      {  
+        AddKnownBlock (InetSocketAddress::ConvertFrom(from).GetIpv4 (), d["blocks"][j]["height"].GetInt(), d["blocks"][j]["minerId"].GetInt());
+
+        if (blockType == "block")
+          blockPayload += d["blocks"][j]["size"].GetInt();
+        else if (blockType == "compressed-block")
+        {
+          int    noTransactions = static_cast<int>((d["blocks"][j]["size"].GetInt() - m_blockHeadersSizeBytes)/m_averageTransactionSize);
+          long   blockSize = m_blockHeadersSizeBytes + m_transactionIndexSize*noTransactions;
+          blockPayload += blockSize;
+        }
+      }
+      blockMessageSize = MessageBytes<BLOCK> (d["blocks"].Size(), blockPayload);
+
+      m_nodeStats->blockReceivedBytes += blockMessageSize;
+      
+      NS_LOG_INFO("BLOCK: At time " << Simulator::Now ().GetSeconds () 
+                  << " Node " << GetNode()->GetId() << " received a block message " << JsonToString (d));
+      NS_LOG_INFO(m_downloadSpeed << " " << GetPeerUploadSpeed (InetSocketAddress::ConvertFrom(from).GetIpv4 ()) * 1000000 / 8 << " " << minSpeed);
+			  
+      Ptr<BitcoinMessage> blockInfo = Create<BitcoinMessage> ();
+      blockInfo->Take (d);
+			  
+      if (blockType == "block")
+      {
+        if (m_receiveBlockTimes.size() == 0 || Simulator::Now ().GetSeconds() >  m_receiveBlockTimes.back())
+        {
+          receiveTime = blockMessageSize / m_downloadSpeed; 
+          eventTime = blockMessageSize / minSpeed;
+        }
+        else
+        {
+          receiveTime = blockMessageSize / m_downloadSpeed + m_receiveBlockTimes.back() - Simulator::Now ().GetSeconds(); 
+          eventTime = blockMessageSize / minSpeed + m_receiveBlockTimes.back() - Simulator::Now ().GetSeconds(); 
+        }
+        m_receiveBlockTimes.push_back(Simulator::Now ().GetSeconds() + receiveTime);
+			  
+
+        Simulator::Schedule (Seconds(eventTime), &BitcoinNode::ReceivedBlockMessage, this, blockInfo, from);
+        Simulator::Schedule (Seconds(receiveTime), &BitcoinNode::RemoveReceiveTime, this);
+      }
+      else if (blockType == "compressed-block")
+      {
+        if (m_receiveCompressedBlockTimes.size() == 0 || Simulator::Now ().GetSeconds() >  m_receiveCompressedBlockTimes.back())
+        {
+          receiveTime = blockMessageSize / m_downloadSpeed; 
+          eventTime = blockMessageSize / minSpeed;
+        }
+        else
+        {
+          receiveTime = blockMessageSize / m_downloadSpeed + m_receiveCompressedBlockTimes.back() - Simulator::Now ().GetSeconds(); 
+          eventTime = blockMessageSize / minSpeed + m_receiveCompressedBlockTimes.back() - Simulator::Now ().GetSeconds(); 
+        }
+        m_receiveCompressedBlockTimes.push_back(Simulator::Now ().GetSeconds() + receiveTime);
+			  
+
+        Simulator::Schedule (Seconds(eventTime), &BitcoinNode::ReceivedBlockMessage, this, blockInfo, from);
+        Simulator::Schedule (Seconds(receiveTime), &BitcoinNode::RemoveCompressedBlockReceiveTime, this);
+      }
+			  
+      NS_LOG_INFO("BLOCK:  Node " << GetNode()->GetId() << " will receive the full block message at " << Simulator::Now ().GetSeconds() + eventTime);
+
+      break;
+    }
+    case EXT_INV:
+    case EXT_GET_HEADERS:
+    case EXT_GET_DATA:
+    case EXT_HEADERS:
+    case CHUNK:
+      HandleTorrentMessage<Policy> (d, from, std::integral_constant<bool, Policy::blockTorrent> ());
+      break;
+    default:
+      NS_LOG_INFO ("Default");
+      break;
+  }
+}
+
+
+template <class Policy>
+void
+BitcoinNode::HandleTorrentMessage (BitcoinJsonDocument &d, Address &from, std::true_type)
+{
+  NS_LOG_FUNCTION (this);
+
+  switch (d["message"].GetInt())
+  {
+    case EXT_INV:
+    {
+      //NS_LOG_INFO ("EXT_INV");
+      int j;
+      std::vector<std::string>            requestHeaders;
+      std::vector<std::string>            requestChunks;
+
+      std::vector<std::string>::iterator  block_it;
+			  
+      CountReceivedBytes (d);
+			  
+      for (j=0; j<d["inv"].Size(); j++)
+      {  
+        std::string   invDelimiter = "/";
+        std::string   blockHash = d["inv"][j]["hash"].GetString();
+        int           blockSize = d["inv"][j]["size"].GetInt();
+        size_t        invPos = blockHash.find(invDelimiter);
+        EventId       timeout;
+
+        int height = atoi(blockHash.substr(0, invPos).c_str());
+        int minerId = atoi(blockHash.substr(invPos+1, blockHash.size()).c_str());
+
+        if (d["inv"][j]["fullBlock"].GetBool())
+          AddKnownBlock (InetSocketAddress::ConvertFrom(from).GetIpv4 (), height, minerId);
+
+        if (m_blockchain.HasBlock(height, minerId) || m_blockchain.IsOrphan(height, minerId) || m_blockchain.IsPruned(height, minerId)
+            || ReceivedButNotValidated(blockHash))
+        {
+          NS_LOG_INFO("EXT_INV: Bitcoin node " << GetNode ()->GetId () 
+                      << " has already received the block with height = " 
+                      << height << " and minerId = " << minerId);				  
+        }
+        else
+        {
+          NS_LOG_INFO("EXT_INV: Bitcoin node " << GetNode ()->GetId () 
+                      << " does not have the block with height = " 
+                      << height << " and minerId = " << minerId);
+				  
+          if (m_queueChunks.find(blockHash) == m_queueChunks.end())
+          {
+            NS_LOG_INFO("EXT_INV: Bitcoin node " << GetNode ()->GetId ()
+                        << " does not have an entry in m_queueChunks");			       
+            m_queueChunks[blockHash] = ChunkBitmap(ceil(blockSize/static_cast<double>(m_chunkSize)));
+            m_queueChunks[blockHash].SetAll();
+          }
+          //PrintQueueChunks();
+				  
+				  
+          /**
+           * Check if we have already requested all the chunks
+           */
+				   
+          if (m_queueChunks[blockHash].Count() > 0)
+          {
+            NS_LOG_INFO("EXT_INV: Bitcoin node " << GetNode ()->GetId ()
+                         << " has not requested all the chunks yet");
+            if (!OnlyHeadersReceived(blockHash))
+              requestHeaders.push_back(blockHash);
+            //timeout = Simulator::Schedule (m_invTimeoutMinutes, &BitcoinNode::InvTimeoutExpired, this, blockHash);
+            //m_invTimeouts[blockHash] = timeout;
 					
-                    if (m_receivedChunks[blockHash].size() == noChunks)
-                    {
-                      value = true;
-                      chunkInfo.AddMember("fullBlock", value, d.GetAllocator ());
-                    }
-                    else
-                    {
-                      value = false;							
-                      chunkInfo.AddMember("fullBlock", value, d.GetAllocator ());
-
-                      for (auto &chunk : m_receivedChunks[blockHash])
-                      {
-                        value = chunk;
-                        chunkArray.PushBack(value, d.GetAllocator());
-                      }
-                      chunkInfo.AddMember("availableChunks", chunkArray, d.GetAllocator ());
-                    }
-				  }
-				  
-                  array.PushBack(chunkInfo, d.GetAllocator());
-                }	
-				
-                d.AddMember("blocks", array, d.GetAllocator());
-				
-                SendMessage(EXT_GET_HEADERS, EXT_HEADERS, d, from); 
-              }
-              break;
+            
+            std::vector<int> pickedChunks;
+
+            AddPeerChunks (blockHash, blockSize, d["inv"][j], from);
+            pickedChunks = PickChunks (blockHash, from, GetChunkBatchSize (from));
+
+            for (auto &pickedChunk : pickedChunks)
+            {
+              NS_LOG_INFO("EXT_INV: Bitcoin node " << GetNode ()->GetId ()
+                          << " will request the chunk " << pickedChunk);
+
+              std::ostringstream chunk;
+              chunk << blockHash << "/" << pickedChunk;
+              requestChunks.push_back(chunk.str());
+              ScheduleChunkTimeout (chunk.str(), from, blockSize);
+              m_queueChunkPeers[blockHash].push_back(from);
             }
-            case GET_DATA:
+
+            if (pickedChunks.empty())
             {
-              NS_LOG_INFO ("GET_DATA");
+              NS_LOG_INFO("EXT_INV: Bitcoin node " << GetNode ()->GetId ()
+                          << " will not request any chunks from this peer, because it has already all the available ones");
+            }
+					
+/*                     PrintQueueChunks();
+            PrintChunkTimeouts();
+            PrintQueueChunkPeers();
+            PrintReceivedChunks(); */
+          }
+          else
+          {
+            NS_LOG_INFO("EXT_INV: Bitcoin node " << GetNode ()->GetId ()
+                         << " has already requested all the chunks");
+          }
+				  
+        }								  
+      }
+			
+      d.RemoveMember("inv");
 			  
-              int j;
-              int totalBlockMessageSize = 0;
-              std::vector<Block>              requestBlocks;
-              std::vector<Block>::iterator    block_it;
-
-              m_nodeStats->getDataReceivedBytes += m_bitcoinMessageHeader + m_countBytes + d["blocks"].Size()*m_inventorySizeBytes;
-
-              for (j=0; j<d["blocks"].Size(); j++)
-              {  
-                std::string    invDelimiter = "/";
-                std::string    parsedInv = d["blocks"][j].GetString();
-                size_t         invPos = parsedInv.find(invDelimiter);
-				  
-                int height = atoi(parsedInv.substr(0, invPos).c_str());
-                int minerId = atoi(parsedInv.substr(invPos+1, parsedInv.size()).c_str());
-				
-                if (m_blockchain.HasBlock(height, minerId))
-                {
-                  NS_LOG_INFO("GET_DATA: Bitcoin node " << GetNode ()->GetId () 
-                              << " has already received the block with height = " 
-                              << height << " and minerId = " << minerId);
-                  Block newBlock (m_blockchain.ReturnBlock (height, minerId));
-                  requestBlocks.push_back(newBlock);
-                }
-                else
-                {
-                  NS_LOG_INFO("GET_DATA: Bitcoin node " << GetNode ()->GetId () 
-                  << " does not have the block with height = " 
-                  << height << " and minerId = " << minerId);                
-                }	
-              }
+      if (!requestHeaders.empty())
+      {
+        rapidjson::Value   value;
+        rapidjson::Value   array(rapidjson::kArrayType);
+        
+        for (block_it = requestHeaders.begin(); block_it < requestHeaders.end(); block_it++) 
+        {
+          value.SetString(block_it->c_str(), block_it->size(), d.GetAllocator());
+          array.PushBack(value, d.GetAllocator());
+        }		
 			  
-              if (!requestBlocks.empty())
-              {
-                rapidjson::Value value;
-                rapidjson::Value array(rapidjson::kArrayType);
-                
+        d.AddMember("blocks", array, d.GetAllocator());
+        
+        SendMessage(EXT_INV, EXT_GET_HEADERS, d, MessageBytes<EXT_GET_HEADERS> (0), from);				
+        
+      }
+			  
+      if (!requestChunks.empty())
+      {
+        rapidjson::Value   value;
+        rapidjson::Value   chunkArray(rapidjson::kArrayType);
+        rapidjson::Value   chunkInfo(rapidjson::kObjectType);
 
-                d.RemoveMember("blocks");
+        d.RemoveMember("type");
+        d.RemoveMember("blocks");
 				
-                for (block_it = requestBlocks.begin(); block_it < requestBlocks.end(); block_it++) 
-                {
-                  rapidjson::Value blockInfo(rapidjson::kObjectType);
-                  NS_LOG_INFO ("In requestBlocks " << *block_it);
-    
-                  value = block_it->GetBlockHeight ();
-                  blockInfo.AddMember("height", value, d.GetAllocator ());
-  
-                  value = block_it->GetMinerId ();
-                  blockInfo.AddMember("minerId", value, d.GetAllocator ());
-
-                  value = block_it->GetParentBlockMinerId ();
-                  blockInfo.AddMember("parentBlockMinerId", value, d.GetAllocator ());
-  
-                  value = block_it->GetBlockSizeBytes ();
-                  totalBlockMessageSize += value.GetInt();
-                  blockInfo.AddMember("size", value, d.GetAllocator ());
-  
-                  value = block_it->GetTimeCreated ();
-                  blockInfo.AddMember("timeCreated", value, d.GetAllocator ());
-  
-                  value = block_it->GetTimeReceived ();							
-                  blockInfo.AddMember("timeReceived", value, d.GetAllocator ());
+        value.SetString("chunk");	
+        d.AddMember("type", value, d.GetAllocator());
+				
+        long availableChunkBytes = 0;
+        for (auto chunk_it = requestChunks.begin(); chunk_it < requestChunks.end(); chunk_it++) 
+        {
+					
+          std::string            invDelimiter = "/";
+          std::string            chunkHash = *chunk_it;
+          std::string            chunkHashHelp = chunkHash.substr(0);
+          std::ostringstream     help;
+          std::string            blockHash;
+          size_t                 invPos = chunkHashHelp.find(invDelimiter);
+				  
+          int height = atoi(chunkHashHelp.substr(0, invPos).c_str());
+				  
+          chunkHashHelp.erase(0, invPos + invDelimiter.length());
+          invPos = chunkHashHelp.find(invDelimiter);
+          int minerId = atoi(chunkHashHelp.substr(0, invPos).c_str());
 				  
-                  array.PushBack(blockInfo, d.GetAllocator());
-                }	
+          chunkHashHelp.erase(0, invPos + invDelimiter.length());
+          int chunkId = atoi(chunkHashHelp.substr(0).c_str());
+          help << height << "/" << minerId;
+          blockHash = help.str();
 				
-                d.AddMember("blocks", array, d.GetAllocator());
+          std::string packedChunks;
+          if (m_receivedChunks.find(blockHash) != m_receivedChunks.end())
+            packedChunks = m_receivedChunks[blockHash].Pack();
+          availableChunkBytes += packedChunks.size()/2;
+          value.SetString(packedChunks.c_str(), packedChunks.size(), d.GetAllocator());
+          chunkInfo.AddMember("availableChunks", value, d.GetAllocator());
+				  
+          value = false;
+          chunkInfo.AddMember("fullBlock", value, d.GetAllocator());
+				  
+          value.SetString(chunk_it->c_str(), chunk_it->size(), d.GetAllocator());
+          chunkInfo.AddMember("chunk", value, d.GetAllocator());
+				  
+          chunkArray.PushBack(chunkInfo, d.GetAllocator());
+        }		
+        d.AddMember("chunks", chunkArray, d.GetAllocator());
 				
-                double sendTime = totalBlockMessageSize / m_uploadSpeed;
-	            double eventTime;	
+        SendMessage(EXT_INV, EXT_GET_DATA, d, MessageBytes<EXT_GET_DATA> (requestChunks.size(), availableChunkBytes), from);	
 				
-/*                 std::cout << "Node " << GetNode()->GetId() << "-" << InetSocketAddress::ConvertFrom(from).GetIpv4 () 
-		  		          << " " << m_peersDownloadSpeeds[InetSocketAddress::ConvertFrom(from).GetIpv4 ()] << " Mbps , time = "
-		  		          << Simulator::Now ().GetSeconds() << "s \n"; */
-                
-                if (m_sendBlockTimes.size() == 0 || Simulator::Now ().GetSeconds() >  m_sendBlockTimes.back())
-                {
-                  eventTime = 0; 
-                }
-                else
-                {
-                  //std::cout << "m_sendBlockTimes.back() = m_sendBlockTimes.back() = " << m_sendBlockTimes.back() << std::endl;
-                  eventTime = m_sendBlockTimes.back() - Simulator::Now ().GetSeconds(); 
-                }
-                m_sendBlockTimes.push_back(Simulator::Now ().GetSeconds() + eventTime + sendTime);
- 
-                //std::cout << sendTime << " " << eventTime << " " << m_sendBlockTimes.size() << std::endl;
-                NS_LOG_INFO("Node " << GetNode()->GetId() << " will start sending the block to " << InetSocketAddress::ConvertFrom(from).GetIpv4 () 
-                            << " at " << Simulator::Now ().GetSeconds() + eventTime << "\n");
-							
-               
-                // Stringify the DOM
-                rapidjson::StringBuffer packetInfo;
-                rapidjson::Writer<rapidjson::StringBuffer> writer(packetInfo);
-                d.Accept(writer);
-                std::string packet = packetInfo.GetString();
-                NS_LOG_INFO ("DEBUG: " << packetInfo.GetString());
+      }
+      break;
+    }
+    case EXT_GET_HEADERS:
+    {
+      int j;
+      std::vector<Block>              requestHeaders;
+      std::vector<Block>::iterator    block_it;
+			  
+      CountReceivedBytes (d);
+			  
+      for (j=0; j<d["blocks"].Size(); j++)
+      {  
+        std::string   invDelimiter = "/";
+        std::string   blockHash = d["blocks"][j].GetString();
+        size_t        invPos = blockHash.find(invDelimiter);
+				  
+        int height = atoi(blockHash.substr(0, invPos).c_str());
+        int minerId = atoi(blockHash.substr(invPos+1, blockHash.size()).c_str());
+				
+        if (m_blockchain.HasBlock(height, minerId) || m_blockchain.IsOrphan(height, minerId))
+        {
+          NS_LOG_INFO("EXT_GET_HEADERS: Bitcoin node " << GetNode ()->GetId () 
+                      << " has the block with height = " 
+                      << height << " and minerId = " << minerId);
+          Block newBlock (m_blockchain.ReturnBlock (height, minerId));
+          requestHeaders.push_back(newBlock); 
+        }
+        else if (ReceivedButNotValidated(blockHash))
+        {
+          NS_LOG_INFO("EXT_GET_HEADERS: Bitcoin node " << GetNode ()->GetId () 
+          << " has received but not yet validated the block with height = " 
+          << height << " and minerId = " << minerId);
+          requestHeaders.push_back(m_receivedNotValidated[blockHash]); 
+        }
+        else if (OnlyHeadersReceived(blockHash))	
+        {	
+          NS_LOG_INFO("EXT_GET_HEADERS: Bitcoin node " << GetNode ()->GetId () 
+          << " has received only the headers of the block with hash = " << blockHash); 
+          requestHeaders.push_back(m_onlyHeadersReceived[blockHash]);
+        }
+        else
+        {
+          NS_LOG_INFO("EXT_GET_HEADERS: Bitcoin node " << GetNode ()->GetId () 
+          << " has neither the block nor the headers of the block hash = " << blockHash); 
+			  
+        }	
+      }
+			  
+      if (!requestHeaders.empty())
+      {
+        rapidjson::Value     value;
+        rapidjson::Value     array(rapidjson::kArrayType);
+        rapidjson::Value     chunkInfo(rapidjson::kObjectType);
+        std::ostringstream   blockHashHelp;
+        std::string          blockHash;
+        long                 availableChunkBytes = 0;
+				
+        d.RemoveMember("blocks");
 				
-                Simulator::Schedule (Seconds(eventTime), &BitcoinNode::SendBlock, this, packet, from);
-                Simulator::Schedule (Seconds(eventTime + sendTime), &BitcoinNode::RemoveSendTime, this);
+        for (block_it = requestHeaders.begin(); block_it < requestHeaders.end(); block_it++) 
+        {
+          NS_LOG_INFO ("In requestHeaders " << *block_it);
+				  
+          blockHashHelp << block_it->GetBlockHeight () << "/" << block_it->GetMinerId ();
+          blockHash = blockHashHelp.str();
+				  
+          value = block_it->GetBlockHeight ();
+          chunkInfo.AddMember("height", value, d.GetAllocator ());
 
-              }
-              break;
+          value = block_it->GetMinerId ();
+          chunkInfo.AddMember("minerId", value, d.GetAllocator ());
+
+          value = block_it->GetParentBlockMinerId ();
+          chunkInfo.AddMember("parentBlockMinerId", value, d.GetAllocator ());
+
+          value = block_it->GetBlockSizeBytes ();
+          chunkInfo.AddMember("size", value, d.GetAllocator ());
+
+          value = block_it->GetTimeCreated ();
+          chunkInfo.AddMember("timeCreated", value, d.GetAllocator ());
+
+          value = block_it->GetTimeReceived ();							
+          chunkInfo.AddMember("timeReceived", value, d.GetAllocator ());
+
+          if (m_blockchain.HasBlock(block_it->GetBlockHeight (), block_it->GetMinerId ()) 
+              || m_blockchain.IsOrphan(block_it->GetBlockHeight (), block_it->GetMinerId ())
+              || ReceivedButNotValidated(blockHash))
+          {
+            value = true;							
+            chunkInfo.AddMember("fullBlock", value, d.GetAllocator ());
+          }
+          else if (OnlyHeadersReceived(blockHash))
+          {
+            int noChunks = ceil(block_it->GetBlockSizeBytes ()/static_cast<double>(m_chunkSize));
+					
+            if (m_receivedChunks[blockHash].Count() == noChunks)
+            {
+              value = true;
+              chunkInfo.AddMember("fullBlock", value, d.GetAllocator ());
             }
-            case EXT_GET_DATA:
+            else
             {
-              NS_LOG_INFO ("EXT_GET_DATA");
+              value = false;							
+              chunkInfo.AddMember("fullBlock", value, d.GetAllocator ());
+
+              std::string packedChunks = m_receivedChunks[blockHash].Pack();
+              availableChunkBytes += packedChunks.size()/2;
+              value.SetString(packedChunks.c_str(), packedChunks.size(), d.GetAllocator());
+              chunkInfo.AddMember("availableChunks", value, d.GetAllocator ());
+            }
+			  }
+				  
+          array.PushBack(chunkInfo, d.GetAllocator());
+        }	
+				
+        d.AddMember("blocks", array, d.GetAllocator());
+				
+        SendMessage(EXT_GET_HEADERS, EXT_HEADERS, d, MessageBytes<EXT_HEADERS> (requestHeaders.size(), availableChunkBytes), from); 
+      }
+      break;
+    }
+    case EXT_GET_DATA:
+    {
+      NS_LOG_INFO ("EXT_GET_DATA");
 			  
-              int j;
-              int totalChunkMessageSize = 0;
-              std::map<std::string, int>            requestedChunks;
-              std::vector<std::string>::iterator    chunk_it;
-              
-              m_nodeStats->extGetDataReceivedBytes += m_bitcoinMessageHeader + m_countBytes + d["chunks"].Size()*m_inventorySizeBytes;
-
-              for (j=0; j<d["chunks"].Size(); j++)
-              {  
-                std::string            invDelimiter = "/";
-                std::string            chunkHash = d["chunks"][j]["chunk"].GetString();
-                std::string            chunkHashHelp = chunkHash.substr(0);
-                std::ostringstream     help;
-                std::string            blockHash;
-                size_t                 invPos = chunkHashHelp.find(invDelimiter);
-                std::vector<int>       candidateChunks;
-                int                    blockSize = -1;
-				
-                int height = atoi(chunkHashHelp.substr(0, invPos).c_str());
-				  
-                chunkHashHelp.erase(0, invPos + invDelimiter.length());
-                invPos = chunkHashHelp.find(invDelimiter);
-                int minerId = atoi(chunkHashHelp.substr(0, invPos).c_str());
-				  
-                chunkHashHelp.erase(0, invPos + invDelimiter.length());
-                int chunkId = atoi(chunkHashHelp.substr(0).c_str());
-                help << height << "/" << minerId;
-                blockHash = help.str();
-				
-                m_nodeStats->extGetDataReceivedBytes += 6; //1Byte(fullBlock) + 4Bytes(numberOfChunks) + 1Byte(requested chunk)
-                if (!d["chunks"][j]["fullBlock"].GetBool())
-                  m_nodeStats->extGetDataReceivedBytes += d["chunks"][j]["availableChunks"].Size();
-				
-                if (m_blockchain.HasBlock(height, minerId) || m_blockchain.IsOrphan(height, minerId) || ReceivedButNotValidated(blockHash))
-                {
-                  NS_LOG_INFO("EXT_GET_DATA: Bitcoin node " << GetNode ()->GetId () 
-                  << " has already received the block with height = " 
-                  << height << " and minerId = " << minerId);
-                  requestedChunks[chunkHash] = -1;
-                }
-                else if (OnlyHeadersReceived(blockHash))	
-                {	
-                  NS_LOG_INFO("EXT_GET_DATA: Bitcoin node " << GetNode ()->GetId () 
-                              << " has received the headers (and maybe some chunks) of the block with hash = " << blockHash); 
-                  if (HasChunk(blockHash, chunkId))
-                    requestedChunks[chunkHash] = -1;
-                  blockSize = m_onlyHeadersReceived[blockHash].GetBlockSizeBytes();
-				  
-                  if (d["chunks"][j]["fullBlock"].GetBool())
-                  {
-                    for (auto &chunk : m_queueChunks[blockHash])
-                      candidateChunks.push_back(chunk);
-                  }
-                  else
-                  {
-                    for (int k = 0; k < d["chunks"][j]["availableChunks"].Size(); k++)
-                    {
-                      if (std::find(m_queueChunks[blockHash].begin(), m_queueChunks[blockHash].end(), d["chunks"][j]["availableChunks"][k].GetInt()) != m_queueChunks[blockHash].end())
-                        candidateChunks.push_back(d["chunks"][j]["availableChunks"][k].GetInt());
-                    }
-                  }
-                }
-                else
-                {
-                  NS_LOG_INFO("EXT_GET_DATA: Bitcoin node " << GetNode ()->GetId () 
-                  << " does not have the block with height = " 
-                  << height << " and minerId = " << minerId);                
-                }
-
-
-/*                     std::cout << "candidateChunks = ";
-                    for (auto chunk : candidateChunks)
-                      std::cout << chunk << ", ";
-                    std::cout << "\n"; */
-
-                if (candidateChunks.size() > 0)
-                {
-                  EventId              timeout;
-                  int randomIndex = rand() % candidateChunks.size();
-				  
-                  NS_LOG_INFO("EXT_GET_DATA: Bitcoin node " << GetNode ()->GetId ()
-                               << " will request the chunk with index = " << randomIndex << " and value = " << candidateChunks[randomIndex]);	
-                  m_queueChunks[blockHash].erase(std::remove(m_queueChunks[blockHash].begin(),
-                                                             m_queueChunks[blockHash].end(), candidateChunks[randomIndex]),
-                                                             m_queueChunks[blockHash].end());
+      int j;
+      int totalChunkMessageSize = 0;
+      long availableChunkBytes = 0;
+      std::map<std::string, int>            requestedChunks;
+      std::vector<std::string>::iterator    chunk_it;
+      
+      CountReceivedBytes (d);
+
+      for (j=0; j<d["chunks"].Size(); j++)
+      {  
+        std::string            invDelimiter = "/";
+        std::string            chunkHash = d["chunks"][j]["chunk"].GetString();
+        std::string            chunkHashHelp = chunkHash.substr(0);
+        std::ostringstream     help;
+        std::string            blockHash;
+        size_t                 invPos = chunkHashHelp.find(invDelimiter);
+        std::vector<int>       pickedChunks;
+        int                    blockSize = -1;
+				
+        int height = atoi(chunkHashHelp.substr(0, invPos).c_str());
+				  
+        chunkHashHelp.erase(0, invPos + invDelimiter.length());
+        invPos = chunkHashHelp.find(invDelimiter);
+        int minerId = atoi(chunkHashHelp.substr(0, invPos).c_str());
+				  
+        chunkHashHelp.erase(0, invPos + invDelimiter.length());
+        int chunkId = atoi(chunkHashHelp.substr(0).c_str());
+        help << height << "/" << minerId;
+        blockHash = help.str();
+				
+        if (m_blockchain.HasBlock(height, minerId) || m_blockchain.IsOrphan(height, minerId) || ReceivedButNotValidated(blockHash))
+        {
+          NS_LOG_INFO("EXT_GET_DATA: Bitcoin node " << GetNode ()->GetId () 
+          << " has already received the block with height = " 
+          << height << " and minerId = " << minerId);
+          requestedChunks[chunkHash] = -1;
+        }
+        else if (OnlyHeadersReceived(blockHash))	
+        {	
+          NS_LOG_INFO("EXT_GET_DATA: Bitcoin node " << GetNode ()->GetId () 
+                      << " has received the headers (and maybe some chunks) of the block with hash = " << blockHash); 
+          if (HasChunk(blockHash, chunkId))
+            requestedChunks[chunkHash] = -1;
+          blockSize = m_onlyHeadersReceived[blockHash].GetBlockSizeBytes();
+				  
+          AddPeerChunks (blockHash, blockSize, d["chunks"][j], from);
+          pickedChunks = PickChunks (blockHash, from, 1);
+        }
+        else
+        {
+          NS_LOG_INFO("EXT_GET_DATA: Bitcoin node " << GetNode ()->GetId () 
+          << " does not have the block with height = " 
+          << height << " and minerId = " << minerId);                
+        }
+
+
+        if (pickedChunks.size() > 0)
+        {
+          NS_LOG_INFO("EXT_GET_DATA: Bitcoin node " << GetNode ()->GetId ()
+                       << " will request the chunk " << pickedChunks[0]);	
 																		  
-                  std::ostringstream chunk;
-                  chunk << blockHash << "/" << candidateChunks[randomIndex];
-                  requestedChunks[chunkHash] = candidateChunks[randomIndex];
+          std::ostringstream chunk;
+          chunk << blockHash << "/" << pickedChunks[0];
+          requestedChunks[chunkHash] = pickedChunks[0];
 
 
-                  if (blockSize == -1)
-                    NS_FATAL_ERROR ("blockSize == -1");
+          if (blockSize == -1)
+            NS_FATAL_ERROR ("blockSize == -1");
 				
-                  timeout = Simulator::Schedule (Minutes(m_invTimeoutMinutes.GetMinutes() / ceil(blockSize/static_cast<double>(m_chunkSize))),
-                                                     &BitcoinNode::ChunkTimeoutExpired, this, chunk.str());
-
-                  m_chunkTimeouts[chunk.str()] = timeout;
-                  m_queueChunkPeers[blockHash].push_back(from);
-                }
-                else
-                {
-                  NS_LOG_INFO("EXT_GET_DATA: Bitcoin node " << GetNode ()->GetId ()
-                              << " will not request any chunks from this peer, because it has already all the available ones");
-                }
-              }
+          ScheduleChunkTimeout (chunk.str(), from, blockSize);
+          m_queueChunkPeers[blockHash].push_back(from);
+        }
+        else
+        {
+          NS_LOG_INFO("EXT_GET_DATA: Bitcoin node " << GetNode ()->GetId ()
+                      << " will not request any chunks from this peer, because it has already all the available ones");
+        }
+      }
 			  
 
-              if (!requestedChunks.empty())
-              {
-                rapidjson::Value value;
-                rapidjson::Value chunkArray(rapidjson::kArrayType);
-
-                d.RemoveMember("chunks");
-				
-                for (auto &requestedChunk : requestedChunks) 
-                {
-                  NS_LOG_INFO ("In requestedChunks " << requestedChunk.first);
-				  
-                  rapidjson::Value availableChunks(rapidjson::kArrayType);
-                  rapidjson::Value requestChunks(rapidjson::kArrayType);
-                  rapidjson::Value chunkInfo(rapidjson::kObjectType);
-				  
-                  std::string            invDelimiter = "/";
-                  std::ostringstream     help;
-                  std::string            blockHash;
-                  std::string            chunkHash = requestedChunk.first.substr(0);
-                  size_t                 invPos = chunkHash.find(invDelimiter);
-                  Block                  newBlock;
-                  int                    blockSize;
-                  int height = atoi(chunkHash.substr(0, invPos).c_str());
-				  
-                  chunkHash.erase(0, invPos + invDelimiter.length());
-                  invPos = chunkHash.find(invDelimiter);
-                  int minerId = atoi(chunkHash.substr(0, invPos).c_str());
-				  
-                  chunkHash.erase(0, invPos + invDelimiter.length());
-                  int chunkId = atoi(chunkHash.substr(0).c_str());
-                  help << height << "/" << minerId;
-                  blockHash = help.str();
-				  
-				  
-                  if (m_blockchain.HasBlock(height, minerId) || m_blockchain.IsOrphan(height, minerId))
-                  {
-                    newBlock = m_blockchain.ReturnBlock (height, minerId);
-                    value = true;
-                    chunkInfo.AddMember("fullBlock", value, d.GetAllocator ());
-                    blockSize = newBlock.GetBlockSizeBytes ();
-                  }
-                  else if (ReceivedButNotValidated(blockHash))
-                  {
-                    newBlock = m_receivedNotValidated[blockHash];
-                    value = true;
-                    chunkInfo.AddMember("fullBlock", value, d.GetAllocator ());
-                    blockSize = newBlock.GetBlockSizeBytes ();
-                  }
-                  else if (OnlyHeadersReceived(blockHash))	
-                  {
-                    newBlock = m_onlyHeadersReceived[blockHash];
-                    blockSize = newBlock.GetBlockSizeBytes ();
-                    int noChunks = ceil(blockSize/static_cast<double>(m_chunkSize));
+      if (!requestedChunks.empty())
+      {
+        rapidjson::Value value;
+        rapidjson::Value chunkArray(rapidjson::kArrayType);
+
+        d.RemoveMember("chunks");
+				
+        for (auto &requestedChunk : requestedChunks) 
+        {
+          NS_LOG_INFO ("In requestedChunks " << requestedChunk.first);
+				  
+          rapidjson::Value requestChunks(rapidjson::kArrayType);
+          rapidjson::Value chunkInfo(rapidjson::kObjectType);
+				  
+          std::string            invDelimiter = "/";
+          std::ostringstream     help;
+          std::string            blockHash;
+          std::string            chunkHash = requestedChunk.first.substr(0);
+          size_t                 invPos = chunkHash.find(invDelimiter);
+          Block                  newBlock;
+          int                    blockSize;
+          int height = atoi(chunkHash.substr(0, invPos).c_str());
+				  
+          chunkHash.erase(0, invPos + invDelimiter.length());
+          invPos = chunkHash.find(invDelimiter);
+          int minerId = atoi(chunkHash.substr(0, invPos).c_str());
+				  
+          chunkHash.erase(0, invPos + invDelimiter.length());
+          int chunkId = atoi(chunkHash.substr(0).c_str());
+          help << height << "/" << minerId;
+          blockHash = help.str();
+				  
+				  
+          if (m_blockchain.HasBlock(height, minerId) || m_blockchain.IsOrphan(height, minerId))
+          {
+            newBlock = m_blockchain.ReturnBlock (height, minerId);
+            value = true;
+            chunkInfo.AddMember("fullBlock", value, d.GetAllocator ());
+            blockSize = newBlock.GetBlockSizeBytes ();
+          }
+          else if (ReceivedButNotValidated(blockHash))
+          {
+            newBlock = m_receivedNotValidated[blockHash];
+            value = true;
+            chunkInfo.AddMember("fullBlock", value, d.GetAllocator ());
+            blockSize = newBlock.GetBlockSizeBytes ();
+          }
+          else if (OnlyHeadersReceived(blockHash))	
+          {
+            newBlock = m_onlyHeadersReceived[blockHash];
+            blockSize = newBlock.GetBlockSizeBytes ();
+            int noChunks = ceil(blockSize/static_cast<double>(m_chunkSize));
 					
-                    if (m_receivedChunks[blockHash].size() == noChunks)
-                    {
-                      value = true;
-                      chunkInfo.AddMember("fullBlock", value, d.GetAllocator ());
-                      NS_LOG_DEBUG("1 " << m_receivedChunks[blockHash].size());
-                    }
-                    else
-                    {
-                      NS_LOG_DEBUG("2 " << m_receivedChunks[blockHash].size());
-
-                      value = false;
-                      chunkInfo.AddMember("fullBlock", value, d.GetAllocator ());
+            if (m_receivedChunks[blockHash].Count() == noChunks)
+            {
+              value = true;
+              chunkInfo.AddMember("fullBlock", value, d.GetAllocator ());
+              NS_LOG_DEBUG("1 " << m_receivedChunks[blockHash].Count());
+            }
+            else
+            {
+              NS_LOG_DEBUG("2 " << m_receivedChunks[blockHash].Count());
+
+              value = false;
+              chunkInfo.AddMember("fullBlock", value, d.GetAllocator ());
 					  
-                      for (auto &c : m_receivedChunks[blockHash])
-                      {
-                        value = c;
-                        availableChunks.PushBack(value, d.GetAllocator());
-                      }
-                      chunkInfo.AddMember("availableChunks", availableChunks, d.GetAllocator ());
-                    }
-                  }
+              std::string packedChunks = m_receivedChunks[blockHash].Pack();
+              availableChunkBytes += packedChunks.size()/2;
+              value.SetString(packedChunks.c_str(), packedChunks.size(), d.GetAllocator());
+              chunkInfo.AddMember("availableChunks", value, d.GetAllocator ());
+            }
+          }
 					  
-                  value = newBlock.GetBlockHeight ();
-                  chunkInfo.AddMember("height", value, d.GetAllocator ());
-  
-                  value = newBlock.GetMinerId ();
-                  chunkInfo.AddMember("minerId", value, d.GetAllocator ());
+          value = newBlock.GetBlockHeight ();
+          chunkInfo.AddMember("height", value, d.GetAllocator ());
 
-                  value = chunkId;
-                  chunkInfo.AddMember("chunk", value, d.GetAllocator ());
+          value = newBlock.GetMinerId ();
+          chunkInfo.AddMember("minerId", value, d.GetAllocator ());
+
+          value = chunkId;
+          chunkInfo.AddMember("chunk", value, d.GetAllocator ());
 				  
-                  value = newBlock.GetParentBlockMinerId ();
-                  chunkInfo.AddMember("parentBlockMinerId", value, d.GetAllocator ());
-  
-                  value = newBlock.GetBlockSizeBytes ();
-                  if (chunkId == ceil(newBlock.GetBlockSizeBytes () / static_cast<double>(m_chunkSize) - 1) && 
-                      newBlock.GetBlockSizeBytes () % m_chunkSize > 0)
-                    totalChunkMessageSize += newBlock.GetBlockSizeBytes () % m_chunkSize;
-                  else
-                    totalChunkMessageSize += m_chunkSize;
+          value = newBlock.GetParentBlockMinerId ();
+          chunkInfo.AddMember("parentBlockMinerId", value, d.GetAllocator ());
 
-                  chunkInfo.AddMember("size", value, d.GetAllocator ());
-                  
-                  value = newBlock.GetTimeCreated ();
-                  chunkInfo.AddMember("timeCreated", value, d.GetAllocator ());
-  
-                  value = newBlock.GetTimeReceived ();							
-                  chunkInfo.AddMember("timeReceived", value, d.GetAllocator ());
+          value = newBlock.GetBlockSizeBytes ();
+          if (chunkId == ceil(newBlock.GetBlockSizeBytes () / static_cast<double>(m_chunkSize) - 1) && 
+              newBlock.GetBlockSizeBytes () % m_chunkSize > 0)
+            totalChunkMessageSize += newBlock.GetBlockSizeBytes () % m_chunkSize;
+          else
+            totalChunkMessageSize += m_chunkSize;
+
+          chunkInfo.AddMember("size", value, d.GetAllocator ());
+          
+          value = newBlock.GetTimeCreated ();
+          chunkInfo.AddMember("timeCreated", value, d.GetAllocator ());
+
+          value = newBlock.GetTimeReceived ();							
+          chunkInfo.AddMember("timeReceived", value, d.GetAllocator ());
 				  
-                  if (requestedChunk.second != -1)
-                  {
-                    value = requestedChunk.second;
-                    requestChunks.PushBack(value, d.GetAllocator());
-                  }
-                  chunkInfo.AddMember("requestChunks", requestChunks, d.GetAllocator ());
+          if (requestedChunk.second != -1)
+          {
+            value = requestedChunk.second;
+            requestChunks.PushBack(value, d.GetAllocator());
+          }
+          chunkInfo.AddMember("requestChunks", requestChunks, d.GetAllocator ());
 				  
 /*                  //Test chunk to chunk messages
-                  value = 1;
-                  requestChunks.PushBack(value, d.GetAllocator());
-                  chunkInfo.AddMember("requestChunks", requestChunks, d.GetAllocator ()); */
+          value = 1;
+          requestChunks.PushBack(value, d.GetAllocator());
+          chunkInfo.AddMember("requestChunks", requestChunks, d.GetAllocator ()); */
 				  
-                  chunkArray.PushBack(chunkInfo, d.GetAllocator());
-                }	
+          chunkArray.PushBack(chunkInfo, d.GetAllocator());
+        }	
 				
-                d.AddMember("chunks", chunkArray, d.GetAllocator());
+        d.AddMember("chunks", chunkArray, d.GetAllocator());
 				
-                double sendTime = totalChunkMessageSize / m_uploadSpeed;
-                double eventTime;
+        double sendTime = totalChunkMessageSize / m_uploadSpeed;
+        double eventTime;
 				
 /*                 std::cout << "Node " << GetNode()->GetId() << "-" << InetSocketAddress::ConvertFrom(from).GetIpv4 () 
-		  		          << " " << m_peersDownloadSpeeds[InetSocketAddress::ConvertFrom(from).GetIpv4 ()] << " Mbps , time = "
-		  		          << Simulator::Now ().GetSeconds() << "s \n"; */
-                
-                if (m_sendBlockTimes.size() == 0 || Simulator::Now ().GetSeconds() >  m_sendBlockTimes.back())
-                {
-                  eventTime = 0; 
-                }
-                else
-                {
-                  //std::cout << "m_sendBlockTimes.back() = m_sendBlockTimes.back() = " << m_sendBlockTimes.back() << std::endl;
-                  eventTime = m_sendBlockTimes.back() - Simulator::Now ().GetSeconds(); 
-                }
-                m_sendBlockTimes.push_back(Simulator::Now ().GetSeconds() + eventTime + sendTime);
- 
-                //std::cout << sendTime << " " << eventTime << " " << m_sendBlockTimes.size() << std::endl;
-                NS_LOG_INFO("Node " << GetNode()->GetId() << " will start sending the chunk to " << InetSocketAddress::ConvertFrom(from).GetIpv4 () 
-                            << " at " << Simulator::Now ().GetSeconds() + eventTime << "\n");
-							
-               
-                // Stringify the DOM
-                rapidjson::StringBuffer packetInfo;
-                rapidjson::Writer<rapidjson::StringBuffer> writer(packetInfo);
-                d.Accept(writer);
-                std::string packet = packetInfo.GetString();
-                NS_LOG_INFO ("DEBUG: " << packetInfo.GetString());
-				
-                Simulator::Schedule (Seconds(eventTime), &BitcoinNode::SendChunk, this, packet, from);
-                Simulator::Schedule (Seconds(eventTime + sendTime), &BitcoinNode::RemoveSendTime, this);
-              }
-              break;
-            }
-            case HEADERS:
-            {
-              NS_LOG_INFO ("HEADERS");
-
-              std::vector<std::string>              requestHeaders;
-              std::vector<std::string>              requestBlocks;
-              std::vector<std::string>::iterator    block_it;
-              int j;
-
-              m_nodeStats->headersReceivedBytes += m_bitcoinMessageHeader + m_countBytes + d["blocks"].Size()*m_headersSizeBytes;
-
-              
-              for (j=0; j<d["blocks"].Size(); j++)
-              {  
-                int parentHeight = d["blocks"][j]["height"].GetInt() - 1;
-                int parentMinerId = d["blocks"][j]["parentBlockMinerId"].GetInt();
-                int height = d["blocks"][j]["height"].GetInt();
-                int minerId = d["blocks"][j]["minerId"].GetInt();
-				
-				
-                EventId              timeout;
-                std::ostringstream   stringStream;  
-                std::string          blockHash;
-                std::string          parentBlockHash ;
-
-                stringStream << height << "/" << minerId;
-                blockHash = stringStream.str();
-                Block newBlockHeaders(d["blocks"][j]["height"].GetInt(), d["blocks"][j]["minerId"].GetInt(), d["blocks"][j]["parentBlockMinerId"].GetInt(), 
-                                      d["blocks"][j]["size"].GetInt(), d["blocks"][j]["timeCreated"].GetDouble(), 
-                                      Simulator::Now ().GetSeconds (), InetSocketAddress::ConvertFrom(from).GetIpv4 ());
-                m_onlyHeadersReceived[blockHash] = Block (d["blocks"][j]["height"].GetInt(), d["blocks"][j]["minerId"].GetInt(), d["blocks"][j]["parentBlockMinerId"].GetInt(), 
-                                                          d["blocks"][j]["size"].GetInt(), d["blocks"][j]["timeCreated"].GetDouble(), 
-                                                          Simulator::Now ().GetSeconds (), InetSocketAddress::ConvertFrom(from).GetIpv4 ());
-                //PrintOnlyHeadersReceived();
-				
-                stringStream.clear();
-                stringStream.str("");
-				
-                stringStream << parentHeight << "/" << parentMinerId;
-                parentBlockHash = stringStream.str();
-				
-                if(m_protocolType == SENDHEADERS && !m_blockchain.HasBlock(height, minerId) && !m_blockchain.IsOrphan(height, minerId) && !ReceivedButNotValidated(blockHash))
-                {
-                  NS_LOG_INFO("We have not received an INV for the block with height = " << d["blocks"][j]["height"].GetInt() 
-                               << " and minerId = " << d["blocks"][j]["minerId"].GetInt());
-				  
-                  /**
-                   * Acquire block
-                   */
-	  
-                  if (m_invTimeouts.find(blockHash) == m_invTimeouts.end())
-                  {
-                    NS_LOG_INFO("HEADERS: Bitcoin node " << GetNode ()->GetId ()
-                                 << " has not requested the block yet");
-                    requestBlocks.push_back(blockHash.c_str());
-                    timeout = Simulator::Schedule (m_invTimeoutMinutes, &BitcoinNode::InvTimeoutExpired, this, blockHash);
-                    m_invTimeouts[blockHash] = timeout;
-                  }
-                  else
-                  {
-                    NS_LOG_INFO("HEADERS: Bitcoin node " << GetNode ()->GetId ()
-                                 << " has already requested the block");
-                  }
-				  
-                  m_queueInv[blockHash].push_back(from); 
-
-                }
-				  
-				  
-                if (!m_blockchain.HasBlock(parentHeight, parentMinerId) && !m_blockchain.IsOrphan(parentHeight, parentMinerId) && !ReceivedButNotValidated(parentBlockHash))
-                {				  
-                  NS_LOG_INFO("The Block with height = " << d["blocks"][j]["height"].GetInt() 
-                               << " and minerId = " << d["blocks"][j]["minerId"].GetInt() 
-                               << " is an orphan\n");
-				  
-                  /**
-                   * Acquire parent
-                   */
-	  
-                  if (m_invTimeouts.find(parentBlockHash) == m_invTimeouts.end())
-                  {
-                    NS_LOG_INFO("HEADERS: Bitcoin node " << GetNode ()->GetId ()
-                                 << " has not requested its parent block yet");
-								 
-                    if(m_protocolType == STANDARD_PROTOCOL || 
-                      (m_protocolType == SENDHEADERS && std::find(requestBlocks.begin(), requestBlocks.end(), parentBlockHash) == requestBlocks.end()))
-                    {
-                      if (!OnlyHeadersReceived(parentBlockHash))
-                        requestHeaders.push_back(parentBlockHash.c_str());
-                      timeout = Simulator::Schedule (m_invTimeoutMinutes, &BitcoinNode::InvTimeoutExpired, this, parentBlockHash);
-                      m_invTimeouts[parentBlockHash] = timeout;
-                    }
-                  }
-                  else
-                  {
-                    NS_LOG_INFO("HEADERS: Bitcoin node " << GetNode ()->GetId ()
-                                 << " has already requested the block");
-                  }
-				  
-                  if(m_protocolType == STANDARD_PROTOCOL || 
-                    (m_protocolType == SENDHEADERS && std::find(requestBlocks.begin(), requestBlocks.end(), parentBlockHash) == requestBlocks.end()))
-                    m_queueInv[parentBlockHash].push_back(from); 
-
-                  //PrintQueueInv();
-                  //PrintInvTimeouts();
-				  
-                }
-                else
-                {
-                  /**
-	               * Block is not orphan, so we can go on validating
-	               */
-                  NS_LOG_INFO("The Block with height = " << d["blocks"][j]["height"].GetInt() 
-                              << " and minerId = " << d["blocks"][j]["minerId"].GetInt() 
-                              << " is NOT an orphan\n");			   
-                }
-              }
-			  
-              if (!requestHeaders.empty())
-              {
-                rapidjson::Value   value;
-                rapidjson::Value   array(rapidjson::kArrayType);
-                Time               timeout;
-
-                d.RemoveMember("blocks");
-
-                for (block_it = requestHeaders.begin(); block_it < requestHeaders.end(); block_it++) 
-                {
-                  value.SetString(block_it->c_str(), block_it->size(), d.GetAllocator());
-                  array.PushBack(value, d.GetAllocator());
-                }		
-			  
-                d.AddMember("blocks", array, d.GetAllocator());
-
-					
-                SendMessage(HEADERS, GET_HEADERS, d, from);			
-                SendMessage(HEADERS, GET_DATA, d, from);	
-              }
-			  
-              if (!requestBlocks.empty())
-              {
-                rapidjson::Value   value;
-                rapidjson::Value   array(rapidjson::kArrayType);
-                Time               timeout;
-
-                d.RemoveMember("blocks");
+	  		          << " " << GetPeerDownloadSpeed (InetSocketAddress::ConvertFrom(from).GetIpv4 ()) << " Mbps , time = "
+	  		          << Simulator::Now ().GetSeconds() << "s \n"; */
+        
+        if (m_sendBlockTimes.size() == 0 || Simulator::Now ().GetSeconds() >  m_sendBlockTimes.back())
+        {
+          eventTime = 0; 
+        }
+        else
+        {
+          //std::cout << "m_sendBlockTimes.back() = m_sendBlockTimes.back() = " << m_sendBlockTimes.back() << std::endl;
+          eventTime = m_sendBlockTimes.back() - Simulator::Now ().GetSeconds(); 
+        }
+        m_sendBlockTimes.push_back(Simulator::Now ().GetSeconds() + eventTime + sendTime);
 
-                for (block_it = requestBlocks.begin(); block_it < requestBlocks.end(); block_it++) 
-                {
-                  value.SetString(block_it->c_str(), block_it->size(), d.GetAllocator());
-                  array.PushBack(value, d.GetAllocator());
-                }		
-			  
-                d.AddMember("blocks", array, d.GetAllocator());
+        //std::cout << sendTime << " " << eventTime << " " << m_sendBlockTimes.size() << std::endl;
+        NS_LOG_INFO("Node " << GetNode()->GetId() << " will start sending the chunk to " << InetSocketAddress::ConvertFrom(from).GetIpv4 () 
+                    << " at " << Simulator::Now ().GetSeconds() + eventTime << "\n");
+							
+       
+        // Stringify the DOM
+        rapidjson::StringBuffer &packetInfo = m_jsonPool.GetBuffer ();
+        rapidjson::Writer<rapidjson::StringBuffer> writer(packetInfo);
+        d.Accept(writer);
+        std::string packet = packetInfo.GetString();
+        NS_LOG_INFO ("DEBUG: " << packetInfo.GetString());
+				
+        Simulator::Schedule (Seconds(eventTime), &BitcoinNode::SendChunk, this, packet, 
+                             MessageBytes<CHUNK> (requestedChunks.size(), totalChunkMessageSize + availableChunkBytes), from);
+        Simulator::Schedule (Seconds(eventTime + sendTime), &BitcoinNode::RemoveSendTime, this);
+      }
+      break;
+    }
+    case EXT_HEADERS:
+    {
+      NS_LOG_INFO ("EXT_HEADERS");
 
-                SendMessage(HEADERS, GET_DATA, d, from);	
-              }
-              break;
-            }
-            case EXT_HEADERS:
-            {
-              NS_LOG_INFO ("EXT_HEADERS");
+      std::vector<std::string>              requestHeaders;
+      std::vector<std::string>              requestChunks;
+      std::vector<std::string>::iterator    block_it;
+      int j;
 
-              std::vector<std::string>              requestHeaders;
-              std::vector<std::string>              requestChunks;
-              std::vector<std::string>::iterator    block_it;
-              int j;
+      CountReceivedBytes (d);
 
-              m_nodeStats->extHeadersReceivedBytes += m_bitcoinMessageHeader + m_countBytes + d["blocks"].Size()*m_headersSizeBytes;
+      
+      for (j=0; j<d["blocks"].Size(); j++)
+      {  
+        int parentHeight = d["blocks"][j]["height"].GetInt() - 1;
+        int parentMinerId = d["blocks"][j]["parentBlockMinerId"].GetInt();
+        int height = d["blocks"][j]["height"].GetInt();
+        int minerId = d["blocks"][j]["minerId"].GetInt();
+        int blockSize = d["blocks"][j]["size"].GetInt();
 
-              
-              for (j=0; j<d["blocks"].Size(); j++)
-              {  
-                int parentHeight = d["blocks"][j]["height"].GetInt() - 1;
-                int parentMinerId = d["blocks"][j]["parentBlockMinerId"].GetInt();
-                int height = d["blocks"][j]["height"].GetInt();
-                int minerId = d["blocks"][j]["minerId"].GetInt();
-                int blockSize = d["blocks"][j]["size"].GetInt();
+        if (d["blocks"][j]["fullBlock"].GetBool())
+          AddKnownBlock (InetSocketAddress::ConvertFrom(from).GetIpv4 (), height, minerId);
 
 				
-                EventId              timeout;
-                std::ostringstream   stringStream;  
-                std::string          blockHash;
-                std::string          parentBlockHash ;
-
-                m_nodeStats->extHeadersReceivedBytes += 1;//fullBlock
-                if (!d["blocks"][j]["fullBlock"].GetBool())
-                  m_nodeStats->extHeadersReceivedBytes += d["blocks"][j]["availableChunks"].Size();
-			  
-                stringStream << height << "/" << minerId;
-                blockHash = stringStream.str();
-                Block newBlockHeaders(d["blocks"][j]["height"].GetInt(), d["blocks"][j]["minerId"].GetInt(), d["blocks"][j]["parentBlockMinerId"].GetInt(), 
-                                                         d["blocks"][j]["size"].GetInt(), d["blocks"][j]["timeCreated"].GetDouble(), 
-                                                         Simulator::Now ().GetSeconds (), InetSocketAddress::ConvertFrom(from).GetIpv4 ());
-                if (!OnlyHeadersReceived(blockHash))														 
-                {
-                  m_onlyHeadersReceived[blockHash] = Block (d["blocks"][j]["height"].GetInt(), d["blocks"][j]["minerId"].GetInt(), d["blocks"][j]["parentBlockMinerId"].GetInt(), 
-                                                            d["blocks"][j]["size"].GetInt(), d["blocks"][j]["timeCreated"].GetDouble(), 
-                                                            Simulator::Now ().GetSeconds (), InetSocketAddress::ConvertFrom(from).GetIpv4 ());
-                }
-                //PrintOnlyHeadersReceived();
-				
-                stringStream.clear();
-                stringStream.str("");
-				
-                stringStream << parentHeight << "/" << parentMinerId;
-                parentBlockHash = stringStream.str();
-				
-                if(!m_blockchain.HasBlock(height, minerId) && !m_blockchain.IsOrphan(height, minerId) && !ReceivedButNotValidated(blockHash))
-                {
+        std::ostringstream   stringStream;  
+        std::string          blockHash;
+        std::string          parentBlockHash ;
+
+        stringStream << height << "/" << minerId;
+        blockHash = stringStream.str();
+        Block newBlockHeaders(d["blocks"][j]["height"].GetInt(), d["blocks"][j]["minerId"].GetInt(), d["blocks"][j]["parentBlockMinerId"].GetInt(), 
+                                                 d["blocks"][j]["size"].GetInt(), d["blocks"][j]["timeCreated"].GetDouble(), 
+                                                 Simulator::Now ().GetSeconds (), InetSocketAddress::ConvertFrom(from).GetIpv4 ());
+        if (!OnlyHeadersReceived(blockHash))														 
+        {
+          m_onlyHeadersReceived[blockHash] = Block (d["blocks"][j]["height"].GetInt(), d["blocks"][j]["minerId"].GetInt(), d["blocks"][j]["parentBlockMinerId"].GetInt(), 
+                                                    d["blocks"][j]["size"].GetInt(), d["blocks"][j]["timeCreated"].GetDouble(), 
+                                                    Simulator::Now ().GetSeconds (), InetSocketAddress::ConvertFrom(from).GetIpv4 ());
+        }
+        //PrintOnlyHeadersReceived();
+				
+        stringStream.clear();
+        stringStream.str("");
+				
+        stringStream << parentHeight << "/" << parentMinerId;
+        parentBlockHash = stringStream.str();
+				
+        if(!m_blockchain.HasBlock(height, minerId) && !m_blockchain.IsOrphan(height, minerId) && !ReceivedButNotValidated(blockHash))
+        {
 /*                   NS_LOG_INFO("We have not received an INV for the block with height = " << d["blocks"][j]["height"].GetInt() 
-                               << " and minerId = " << d["blocks"][j]["minerId"].GetInt()); */
+                       << " and minerId = " << d["blocks"][j]["minerId"].GetInt()); */
 							   
-                  NS_LOG_INFO("EXT_HEADERS: Bitcoin node " << GetNode ()->GetId () 
-                              << " does not have the block with height = " 
-                              << height << " and minerId = " << minerId);
-				  
-                  if (m_queueChunks.find(blockHash) == m_queueChunks.end())
-                  {
-                    NS_LOG_INFO("EXT_HEADERS: Bitcoin node " << GetNode ()->GetId ()
-                                << " does not have an entry in m_queueChunks");			       
-                    for (int i = 0; i < ceil(blockSize/static_cast<double>(m_chunkSize)); i++)
-                      m_queueChunks[blockHash].push_back(i);
-                  }
-                  //PrintQueueChunks();
-				  
-				  
-                  /**
-                   * Check if we have already requested all the chunks
-                   */
+          NS_LOG_INFO("EXT_HEADERS: Bitcoin node " << GetNode ()->GetId () 
+                      << " does not have the block with height = " 
+                      << height << " and minerId = " << minerId);
+				  
+          if (m_queueChunks.find(blockHash) == m_queueChunks.end())
+          {
+            NS_LOG_INFO("EXT_HEADERS: Bitcoin node " << GetNode ()->GetId ()
+                        << " does not have an entry in m_queueChunks");			       
+            m_queueChunks[blockHash] = ChunkBitmap(ceil(blockSize/static_cast<double>(m_chunkSize)));
+            m_queueChunks[blockHash].SetAll();
+          }
+          //PrintQueueChunks();
+				  
+				  
+          /**
+           * Check if we have already requested all the chunks
+           */
 				   
-                  if (m_queueChunks[blockHash].size() > 0)
-                  {
-                    NS_LOG_INFO("EXT_HEADERS: Bitcoin node " << GetNode ()->GetId ()
-                                 << " has not requested all the chunks yet");
+          if (m_queueChunks[blockHash].Count() > 0)
+          {
+            NS_LOG_INFO("EXT_HEADERS: Bitcoin node " << GetNode ()->GetId ()
+                         << " has not requested all the chunks yet");
 
 								 
-                    std::vector<int> candidateChunks;
-                    if (d["blocks"][j]["fullBlock"].GetBool())
-                    {
-                      for (auto &chunk : m_queueChunks[blockHash])
-                        candidateChunks.push_back(chunk);
-                    }
-                    else
-                    {
-                      for (int k = 0; k < d["blocks"][j]["availableChunks"].Size(); k++)
-                      {
-                        if (std::find(m_queueChunks[blockHash].begin(), m_queueChunks[blockHash].end(), d["blocks"][j]["availableChunks"][k].GetInt()) != m_queueChunks[blockHash].end())
-                          candidateChunks.push_back(d["blocks"][j]["availableChunks"][k].GetInt());
-                      }
-                    }
-					
-/*                     std::cout << "candidateChunks = ";
-                    for (auto chunk : candidateChunks)
-                      std::cout << chunk << ", ";
-                    std::cout << "\n"; */
-
-                    if (candidateChunks.size() > 0 && 
-                        std::find(m_queueChunkPeers[blockHash].begin(), m_queueChunkPeers[blockHash].end(), from) == m_queueChunkPeers[blockHash].end())
-                    {
-                      int randomIndex = rand() % candidateChunks.size();
-                      NS_LOG_INFO("EXT_HEADERS: Bitcoin node " << GetNode ()->GetId ()
-                                  << " will request the chunk with index = " << randomIndex << " and value = " << candidateChunks[randomIndex]);	
-                      m_queueChunks[blockHash].erase(std::remove(m_queueChunks[blockHash].begin(),
-                                                                 m_queueChunks[blockHash].end(), candidateChunks[randomIndex]),
-                                                                 m_queueChunks[blockHash].end());
-																		  
-                      std::ostringstream chunk;
-                      chunk << blockHash << "/" << candidateChunks[randomIndex];
-                      requestChunks.push_back(chunk.str());
-					  
-                      timeout = Simulator::Schedule (Minutes(m_invTimeoutMinutes.GetMinutes() / ceil(blockSize/static_cast<double>(m_chunkSize))),
-                                                     &BitcoinNode::ChunkTimeoutExpired, this, chunk.str());
-													 
-                      m_chunkTimeouts[chunk.str()] = timeout;
-                      m_queueChunkPeers[blockHash].push_back(from);
-                    }
-                    else
-                    {
-                      if (std::find(m_queueChunkPeers[blockHash].begin(), m_queueChunkPeers[blockHash].end(), from) == m_queueChunkPeers[blockHash].end())
-                        NS_LOG_INFO("EXT_HEADERS: Bitcoin node " << GetNode ()->GetId ()
-                                    << " will not request any chunks from this peer, because it has already all the available ones");
-                      else								 
-                        NS_LOG_INFO("EXT_HEADERS: Bitcoin node " << GetNode ()->GetId ()
-                                     << " has already requested a chunk from this peer");
-
-                    }
+            std::vector<int> pickedChunks;
+
+            AddPeerChunks (blockHash, blockSize, d["blocks"][j], from);
+            if (std::find(m_queueChunkPeers[blockHash].begin(), m_queueChunkPeers[blockHash].end(), from) == m_queueChunkPeers[blockHash].end())
+              pickedChunks = PickChunks (blockHash, from, GetChunkBatchSize (from));
+
+            for (auto &pickedChunk : pickedChunks)
+            {
+              NS_LOG_INFO("EXT_HEADERS: Bitcoin node " << GetNode ()->GetId ()
+                          << " will request the chunk " << pickedChunk);
+
+              std::ostringstream chunk;
+              chunk << blockHash << "/" << pickedChunk;
+              requestChunks.push_back(chunk.str());
+              ScheduleChunkTimeout (chunk.str(), from, blockSize);
+              m_queueChunkPeers[blockHash].push_back(from);
+            }
+
+            if (pickedChunks.empty())
+            {
+              if (std::find(m_queueChunkPeers[blockHash].begin(), m_queueChunkPeers[blockHash].end(), from) == m_queueChunkPeers[blockHash].end())
+                NS_LOG_INFO("EXT_HEADERS: Bitcoin node " << GetNode ()->GetId ()
+                            << " will not request any chunks from this peer, because it has already all the available ones");
+              else								 
+                NS_LOG_INFO("EXT_HEADERS: Bitcoin node " << GetNode ()->GetId ()
+                             << " has already requested a chunk from this peer");
+
+            }
 					
 /*                     PrintQueueChunks();
-                    PrintChunkTimeouts();
-                    PrintQueueChunkPeers();
-                    PrintReceivedChunks(); */
-                  }
-                  else
-                  {
-                    NS_LOG_INFO("EXT_HEADERS: Bitcoin node " << GetNode ()->GetId ()
-                                 << " has already requested a chunk from this peer");
-                  }
-				  
-                }
-                else
-                {
-                  /**
-                   * Block is not orphan, so we can go on validating
-                   */
-                  NS_LOG_INFO("The Block with height = " << d["blocks"][j]["height"].GetInt() 
-                              << " and minerId = " << d["blocks"][j]["minerId"].GetInt() 
-                              << " has already been received\n");			   
-                }
-				
-                if (!m_blockchain.HasBlock(parentHeight, parentMinerId) && !m_blockchain.IsOrphan(parentHeight, parentMinerId) && !ReceivedButNotValidated(parentBlockHash))
-                {				  
-                  NS_LOG_INFO("The Block with height = " << d["blocks"][j]["height"].GetInt() 
-                               << " and minerId = " << d["blocks"][j]["minerId"].GetInt() 
-                               << " is an orphan\n");
-				  
-                  /**
-                   * Acquire parent
-                   */
+            PrintChunkTimeouts();
+            PrintQueueChunkPeers();
+            PrintReceivedChunks(); */
+          }
+          else
+          {
+            NS_LOG_INFO("EXT_HEADERS: Bitcoin node " << GetNode ()->GetId ()
+                         << " has already requested a chunk from this peer");
+          }
+				  
+        }
+        else
+        {
+          /**
+           * Block is not orphan, so we can go on validating
+           */
+          NS_LOG_INFO("The Block with height = " << d["blocks"][j]["height"].GetInt() 
+                      << " and minerId = " << d["blocks"][j]["minerId"].GetInt() 
+                      << " has already been received\n");			   
+        }
+				
+        if (!m_blockchain.HasBlock(parentHeight, parentMinerId) && !m_blockchain.IsOrphan(parentHeight, parentMinerId) && !ReceivedButNotValidated(parentBlockHash))
+        {				  
+          NS_LOG_INFO("The Block with height = " << d["blocks"][j]["height"].GetInt() 
+                       << " and minerId = " << d["blocks"][j]["minerId"].GetInt() 
+                       << " is an orphan\n");
+				  
+          /**
+           * Acquire parent
+           */
 	  
-                  if (m_queueChunks.find(parentBlockHash) == m_queueChunks.end() || 
-                      std::find(m_queueChunkPeers[parentBlockHash].begin(), m_queueChunkPeers[parentBlockHash].end(), from) == m_queueChunkPeers[parentBlockHash].end())
-                  {
-                    NS_LOG_INFO("EXT_HEADERS: Bitcoin node " << GetNode ()->GetId ()
-                                 << " has not requested parent block chunks from this peer yet");
-                      requestHeaders.push_back(parentBlockHash.c_str());
-                  }
-                  else
-                  {
-                    NS_LOG_INFO("EXT_HEADERS: Bitcoin node " << GetNode ()->GetId ()
-                                 << " has already requested the block");
-                  }
-				  
-                  if(m_protocolType == STANDARD_PROTOCOL || 
-                    (m_protocolType == SENDHEADERS && std::find(requestChunks.begin(), requestChunks.end(), parentBlockHash) == requestChunks.end()))
-                    m_queueInv[parentBlockHash].push_back(from); 
-
-                  //PrintQueueInv();
-                  //PrintInvTimeouts();
-				  
-                }
-                else
-                {
-                  /**
-	               * Block is not orphan, so we can go on validating
-	               */
-                  NS_LOG_INFO("The Block with height = " << d["blocks"][j]["height"].GetInt() 
-                              << " and minerId = " << d["blocks"][j]["minerId"].GetInt() 
-                              << " is NOT an orphan\n");			   
-                }
-              }
+          if (m_queueChunks.find(parentBlockHash) == m_queueChunks.end() || 
+              std::find(m_queueChunkPeers[parentBlockHash].begin(), m_queueChunkPeers[parentBlockHash].end(), from) == m_queueChunkPeers[parentBlockHash].end())
+          {
+            NS_LOG_INFO("EXT_HEADERS: Bitcoin node " << GetNode ()->GetId ()
+                         << " has not requested parent block chunks from this peer yet");
+              requestHeaders.push_back(parentBlockHash.c_str());
+          }
+          else
+          {
+            NS_LOG_INFO("EXT_HEADERS: Bitcoin node " << GetNode ()->GetId ()
+                         << " has already requested the block");
+          }
+				  
+          if(Policy::protocolType == STANDARD_PROTOCOL || 
+            (Policy::protocolType == SENDHEADERS && std::find(requestChunks.begin(), requestChunks.end(), parentBlockHash) == requestChunks.end()))
+            m_queueInv[parentBlockHash].push_back(from); 
+
+          //PrintQueueInv();
+          //PrintInvTimeouts();
+				  
+        }
+        else
+        {
+          /**
+               * Block is not orphan, so we can go on validating
+               */
+          NS_LOG_INFO("The Block with height = " << d["blocks"][j]["height"].GetInt() 
+                      << " and minerId = " << d["blocks"][j]["minerId"].GetInt() 
+                      << " is NOT an orphan\n");			   
+        }
+      }
 			  
-              if (!requestHeaders.empty())
-              {
-                rapidjson::Value   value;
-                rapidjson::Value   array(rapidjson::kArrayType);
-                Time               timeout;
+      if (!requestHeaders.empty())
+      {
+        rapidjson::Value   value;
+        rapidjson::Value   array(rapidjson::kArrayType);
+        Time               timeout;
 
-                d.RemoveMember("blocks");
+        d.RemoveMember("blocks");
 
-                for (block_it = requestHeaders.begin(); block_it < requestHeaders.end(); block_it++) 
-                {
-                  value.SetString(block_it->c_str(), block_it->size(), d.GetAllocator());
-                  array.PushBack(value, d.GetAllocator());
-                }		
+        for (block_it = requestHeaders.begin(); block_it < requestHeaders.end(); block_it++) 
+        {
+          value.SetString(block_it->c_str(), block_it->size(), d.GetAllocator());
+          array.PushBack(value, d.GetAllocator());
+        }		
 			  
-                d.AddMember("blocks", array, d.GetAllocator());
+        d.AddMember("blocks", array, d.GetAllocator());
 
 					
-                SendMessage(EXT_HEADERS, EXT_GET_HEADERS, d, from);			
-              }
+        SendMessage(EXT_HEADERS, EXT_GET_HEADERS, d, MessageBytes<EXT_GET_HEADERS> (0), from);			
+      }
 			  
-              if (!requestChunks.empty())
-              {
-                rapidjson::Value   value;
-                rapidjson::Value   chunkArray(rapidjson::kArrayType);
-                rapidjson::Value   availableChunks(rapidjson::kArrayType);
-                rapidjson::Value   chunkInfo(rapidjson::kObjectType);
+      if (!requestChunks.empty())
+      {
+        rapidjson::Value   value;
+        rapidjson::Value   chunkArray(rapidjson::kArrayType);
+        rapidjson::Value   chunkInfo(rapidjson::kObjectType);
 
-                d.RemoveMember("type");
-                d.RemoveMember("blocks");
+        d.RemoveMember("type");
+        d.RemoveMember("blocks");
 				
-                value.SetString("chunk");	
-                d.AddMember("type", value, d.GetAllocator());
+        value.SetString("chunk");	
+        d.AddMember("type", value, d.GetAllocator());
 				
-                for (auto chunk_it = requestChunks.begin(); chunk_it < requestChunks.end(); chunk_it++) 
-                {
+        long availableChunkBytes = 0;
+        for (auto chunk_it = requestChunks.begin(); chunk_it < requestChunks.end(); chunk_it++) 
+        {
 					
-                  std::string            invDelimiter = "/";
-                  std::string            chunkHash = *chunk_it;
-                  std::string            chunkHashHelp = chunkHash.substr(0);
-                  std::ostringstream     help;
-                  std::string            blockHash;
-                  size_t                 invPos = chunkHashHelp.find(invDelimiter);
-				  
-                  int height = atoi(chunkHashHelp.substr(0, invPos).c_str());
-				  
-                  chunkHashHelp.erase(0, invPos + invDelimiter.length());
-                  invPos = chunkHashHelp.find(invDelimiter);
-                  int minerId = atoi(chunkHashHelp.substr(0, invPos).c_str());
-				  
-                  chunkHashHelp.erase(0, invPos + invDelimiter.length());
-                  int chunkId = atoi(chunkHashHelp.substr(0).c_str());
-                  help << height << "/" << minerId;
-                  blockHash = help.str();
-				
-                  if (m_receivedChunks.find(blockHash) != m_receivedChunks.end())
-                  {
-                    for ( auto k : m_receivedChunks[blockHash])
-                    {
-                      value = k;
-                      availableChunks.PushBack(value, d.GetAllocator());
-                    }
-                  }
-                  chunkInfo.AddMember("availableChunks", availableChunks, d.GetAllocator());
-				  
-                  value = false;
-                  chunkInfo.AddMember("fullBlock", value, d.GetAllocator());
-				  
-                  value.SetString(chunk_it->c_str(), chunk_it->size(), d.GetAllocator());
-                  chunkInfo.AddMember("chunk", value, d.GetAllocator());
-				  
-                  chunkArray.PushBack(chunkInfo, d.GetAllocator());
-                }		
-                d.AddMember("chunks", chunkArray, d.GetAllocator());
-				
-                SendMessage(EXT_HEADERS, EXT_GET_DATA, d, from);	
+          std::string            invDelimiter = "/";
+          std::string            chunkHash = *chunk_it;
+          std::string            chunkHashHelp = chunkHash.substr(0);
+          std::ostringstream     help;
+          std::string            blockHash;
+          size_t                 invPos = chunkHashHelp.find(invDelimiter);
+				  
+          int height = atoi(chunkHashHelp.substr(0, invPos).c_str());
+				  
+          chunkHashHelp.erase(0, invPos + invDelimiter.length());
+          invPos = chunkHashHelp.find(invDelimiter);
+          int minerId = atoi(chunkHashHelp.substr(0, invPos).c_str());
+				  
+          chunkHashHelp.erase(0, invPos + invDelimiter.length());
+          int chunkId = atoi(chunkHashHelp.substr(0).c_str());
+          help << height << "/" << minerId;
+          blockHash = help.str();
+				
+          std::string packedChunks;
+          if (m_receivedChunks.find(blockHash) != m_receivedChunks.end())
+            packedChunks = m_receivedChunks[blockHash].Pack();
+          availableChunkBytes += packedChunks.size()/2;
+          value.SetString(packedChunks.c_str(), packedChunks.size(), d.GetAllocator());
+          chunkInfo.AddMember("availableChunks", value, d.GetAllocator());
+				  
+          value = false;
+          chunkInfo.AddMember("fullBlock", value, d.GetAllocator());
+				  
+          value.SetString(chunk_it->c_str(), chunk_it->size(), d.GetAllocator());
+          chunkInfo.AddMember("chunk", value, d.GetAllocator());
+				  
+          chunkArray.PushBack(chunkInfo, d.GetAllocator());
+        }		
+        d.AddMember("chunks", chunkArray, d.GetAllocator());
+				
+        SendMessage(EXT_HEADERS, EXT_GET_DATA, d, MessageBytes<EXT_GET_DATA> (requestChunks.size(), availableChunkBytes), from);	
 	
-              }
-              break;
-            }
-            case BLOCK:
-            {
-              NS_LOG_INFO ("BLOCK");
-              int blockMessageSize = 0;
-              double receiveTime = 0;
-              double eventTime = 0;
-              double minSpeed = std::min(m_downloadSpeed, m_peersUploadSpeeds[InetSocketAddress::ConvertFrom(from).GetIpv4 ()] * 1000000 / 8);
+      }
+      break;
+    }
+    case CHUNK:
+    {
+      NS_LOG_INFO ("CHUNK");
+      long chunkMessageSize = 0;
+      double receiveTime = 0;
+      double eventTime = 0;
+      double minSpeed = std::min(m_downloadSpeed, GetPeerUploadSpeed (InetSocketAddress::ConvertFrom(from).GetIpv4 ()) * 1000000 / 8);
+
+      chunkMessageSize = GetMessageBytes (d);
+      m_nodeStats->chunkReceivedBytes += chunkMessageSize;
 			  
-              std::string blockType = d["type"].GetString();
+      NS_LOG_INFO("CHUNK: At time " << Simulator::Now ().GetSeconds () 
+                  << " Node " << GetNode()->GetId() << " received a chunk message " << JsonToString (d));
+						  
+      Ptr<BitcoinMessage> chunkInfo = Create<BitcoinMessage> ();
+      chunkInfo->Take (d);
+      if (m_receiveBlockTimes.size() == 0 || Simulator::Now ().GetSeconds() >  m_receiveBlockTimes.back())
+      {
+        receiveTime = chunkMessageSize / m_downloadSpeed; 
+        eventTime = chunkMessageSize / minSpeed; 
+      }
+      else
+      {
+        receiveTime = chunkMessageSize / m_downloadSpeed + m_receiveBlockTimes.back() - Simulator::Now ().GetSeconds(); 
+        eventTime = chunkMessageSize / minSpeed + m_receiveBlockTimes.back() - Simulator::Now ().GetSeconds(); 
+      }
+      m_receiveBlockTimes.push_back(Simulator::Now ().GetSeconds() + receiveTime);
 			  
-              blockMessageSize += m_bitcoinMessageHeader;
-
-              for (int j=0; j<d["blocks"].Size(); j++)
-              {  
-                if (blockType == "block")
-                  blockMessageSize += d["blocks"][j]["size"].GetInt();
-                else if (blockType == "compressed-block")
-                {
-                  int    noTransactions = static_cast<int>((d["blocks"][j]["size"].GetInt() - m_blockHeadersSizeBytes)/m_averageTransactionSize);
-                  long   blockSize = m_blockHeadersSizeBytes + m_transactionIndexSize*noTransactions;
-                  blockMessageSize += blockSize;
-                }
-              }
+      NS_LOG_INFO("CHUNK:  Node " << GetNode()->GetId() << " will receive the full chunk message at " << Simulator::Now ().GetSeconds() + eventTime);
+      Simulator::Schedule (Seconds(eventTime), &BitcoinNode::ReceivedChunkMessage<Policy>, this, chunkInfo, from);
+      Simulator::Schedule (Seconds(receiveTime), &BitcoinNode::RemoveReceiveTime, this);
 
-              m_nodeStats->blockReceivedBytes += blockMessageSize;
-              
-              // Stringify the DOM
-              rapidjson::StringBuffer blockInfo;
-              rapidjson::Writer<rapidjson::StringBuffer> blockWriter(blockInfo);
-              d.Accept(blockWriter);
-			  
-  
-              NS_LOG_INFO("BLOCK: At time " << Simulator::Now ().GetSeconds () 
-                          << " Node " << GetNode()->GetId() << " received a block message " << blockInfo.GetString());
-              NS_LOG_INFO(m_downloadSpeed << " " << m_peersUploadSpeeds[InetSocketAddress::ConvertFrom(from).GetIpv4 ()] * 1000000 / 8 << " " << minSpeed);
-			  
-              std::string help = blockInfo.GetString();
-			  
-              if (blockType == "block")
-              {
-                if (m_receiveBlockTimes.size() == 0 || Simulator::Now ().GetSeconds() >  m_receiveBlockTimes.back())
-                {
-                  receiveTime = blockMessageSize / m_downloadSpeed; 
-                  eventTime = blockMessageSize / minSpeed;
-                }
-                else
-                {
-                  receiveTime = blockMessageSize / m_downloadSpeed + m_receiveBlockTimes.back() - Simulator::Now ().GetSeconds(); 
-                  eventTime = blockMessageSize / minSpeed + m_receiveBlockTimes.back() - Simulator::Now ().GetSeconds(); 
-                }
-                m_receiveBlockTimes.push_back(Simulator::Now ().GetSeconds() + receiveTime);
-			  
+      break;
+    }
+    default:
+      NS_LOG_INFO ("Default");
+      break;
+  }
+}
 
-                Simulator::Schedule (Seconds(eventTime), &BitcoinNode::ReceivedBlockMessage, this, help, from);
-                Simulator::Schedule (Seconds(receiveTime), &BitcoinNode::RemoveReceiveTime, this);
-              }
-              else if (blockType == "compressed-block")
-              {
-                if (m_receiveCompressedBlockTimes.size() == 0 || Simulator::Now ().GetSeconds() >  m_receiveCompressedBlockTimes.back())
-                {
-                  receiveTime = blockMessageSize / m_downloadSpeed; 
-                  eventTime = blockMessageSize / minSpeed;
-                }
-                else
-                {
-                  receiveTime = blockMessageSize / m_downloadSpeed + m_receiveCompressedBlockTimes.back() - Simulator::Now ().GetSeconds(); 
-                  eventTime = blockMessageSize / minSpeed + m_receiveCompressedBlockTimes.back() - Simulator::Now ().GetSeconds(); 
-                }
-                m_receiveCompressedBlockTimes.push_back(Simulator::Now ().GetSeconds() + receiveTime);
-			  
 
-                Simulator::Schedule (Seconds(eventTime), &BitcoinNode::ReceivedBlockMessage, this, help, from);
-                Simulator::Schedule (Seconds(receiveTime), &BitcoinNode::RemoveCompressedBlockReceiveTime, this);
-              }
-			  
-              NS_LOG_INFO("BLOCK:  Node " << GetNode()->GetId() << " will receive the full block message at " << Simulator::Now ().GetSeconds() + eventTime);
+template <class Policy>
+void
+BitcoinNode::HandleTorrentMessage (BitcoinJsonDocument &d, Address &from, std::false_type)
+{
+  NS_FATAL_ERROR ("Node " << GetNode ()->GetId () << " received a " << getMessageName ((enum Messages) d["message"].GetInt ())
+                  << " message, but blockTorrent is not enabled");
+}
 
-              break;
-            }
-            case CHUNK:
-            {
-              NS_LOG_INFO ("CHUNK");
-              int chunkMessageSize = 0;
-              double receiveTime = 0;
-              double eventTime = 0;
-              double minSpeed = std::min(m_downloadSpeed, m_peersUploadSpeeds[InetSocketAddress::ConvertFrom(from).GetIpv4 ()] * 1000000 / 8);
-
-              chunkMessageSize += m_bitcoinMessageHeader;
-              for (int j=0; j<d["chunks"].Size(); j++)
-              {  
-                int noChunks = ceil(d["chunks"][j]["size"].GetInt() / static_cast<double>(m_chunkSize));
-                if (d["chunks"][j]["chunk"] == noChunks -1 && d["chunks"][j]["size"].GetInt() % m_chunkSize > 0)
-                  chunkMessageSize += d["chunks"][j]["size"].GetInt() % m_chunkSize;
-                else
-                  chunkMessageSize += m_chunkSize;
-			  
-                m_nodeStats->chunkReceivedBytes += chunkMessageSize + 1 + 1;//the requested chunk + the fullBlock
-                if (!d["chunks"][j]["fullBlock"].GetBool())
-                  m_nodeStats->chunkReceivedBytes += d["chunks"][j]["availableChunks"].Size();
-                if (d["chunks"][j]["requestChunks"].Size() > 0)
-                  m_nodeStats->chunkReceivedBytes += d["chunks"][j]["requestChunks"].Size() - 1;
-              }
-			  
-              // Stringify the DOM
-              rapidjson::StringBuffer chunkInfo;
-              rapidjson::Writer<rapidjson::StringBuffer> blockWriter(chunkInfo);
-              d.Accept(blockWriter);
-			  
-  
-              NS_LOG_INFO("CHUNK: At time " << Simulator::Now ().GetSeconds () 
-                          << " Node " << GetNode()->GetId() << " received a chunk message " << chunkInfo.GetString());
-						  
-              std::string help = chunkInfo.GetString();
-              if (m_receiveBlockTimes.size() == 0 || Simulator::Now ().GetSeconds() >  m_receiveBlockTimes.back())
-              {
-                receiveTime = chunkMessageSize / m_downloadSpeed; 
-                eventTime = chunkMessageSize / minSpeed; 
-              }
-              else
-              {
-                receiveTime = chunkMessageSize / m_downloadSpeed + m_receiveBlockTimes.back() - Simulator::Now ().GetSeconds(); 
-                eventTime = chunkMessageSize / minSpeed + m_receiveBlockTimes.back() - Simulator::Now ().GetSeconds(); 
-              }
-              m_receiveBlockTimes.push_back(Simulator::Now ().GetSeconds() + receiveTime);
-			  
-              NS_LOG_INFO("CHUNK:  Node " << GetNode()->GetId() << " will receive the full chunk message at " << Simulator::Now ().GetSeconds() + eventTime);
-              Simulator::Schedule (Seconds(eventTime), &BitcoinNode::ReceivedChunkMessage, this, help, from);
-              Simulator::Schedule (Seconds(receiveTime), &BitcoinNode::RemoveReceiveTime, this);
 
-              break;
-            }
-            default:
-              NS_LOG_INFO ("Default");
-              break;
-          }
-			
-          totalReceivedData.erase(0, pos + delimiter.length());
-        }
-		
-        /**
-        * Buffer the remaining data
-        */
-		 
-        m_bufferedData[from] = totalReceivedData;
-        delete[] packetInfo;
-      }
-      else if (Inet6SocketAddress::IsMatchingType (from))
-      {
-        NS_LOG_INFO ("At time " << Simulator::Now ().GetSeconds ()
-                     << "s bitcoin node " << GetNode ()->GetId () << " received "
-                     <<  packet->GetSize () << " bytes from "
-                     << Inet6SocketAddress::ConvertFrom(from).GetIpv6 ()
-                     << " port " << Inet6SocketAddress::ConvertFrom (from).GetPort ());
-      }
-      m_rxTrace (packet, from);
+template <class Policy>
+void
+BitcoinNode::UseProtocolPolicy (void)
+{
+  m_handleMessage = &BitcoinNode::HandleMessage<Policy>;
+  m_advertiseBlock = &BitcoinNode::AdvertiseBlock<Policy>;
+}
+
+
+void
+BitcoinNode::SelectProtocolPolicy (void)
+{
+  NS_LOG_FUNCTION (this);
+
+  if (m_protocolType == STANDARD_PROTOCOL)
+  {
+    if (!m_blockTorrent)
+      UseProtocolPolicy<StandardPolicy> ();
+    else if (!m_spv)
+      UseProtocolPolicy<StandardTorrentPolicy> ();
+    else
+      UseProtocolPolicy<StandardSpvPolicy> ();
+  }
+  else if (m_protocolType == SENDHEADERS)
+  {
+    if (!m_blockTorrent)
+      UseProtocolPolicy<SendHeadersPolicy> ();
+    else if (!m_spv)
+      UseProtocolPolicy<SendHeadersTorrentPolicy> ();
+    else
+      UseProtocolPolicy<SendHeadersSpvPolicy> ();
   }
 }
 
 
 void 
-BitcoinNode::ReceivedBlockMessage(std::string &blockInfo, Address &from) 
+BitcoinNode::ReceivedBlockMessage(Ptr<BitcoinMessage> blockInfo, Address &from) 
 {
+  BitcoinEventProfiler::Scope profile (RECEIVED_BLOCK_MESSAGE_EVENT);
   NS_LOG_FUNCTION (this);
 
-  rapidjson::Document d;
-  d.Parse(blockInfo.c_str());
+  rapidjson::Document &d = blockInfo->GetDocument();
   
   NS_LOG_INFO("ReceivedBlockMessage: At time " << Simulator::Now ().GetSeconds () 
-              << " Node " << GetNode()->GetId() << " received a block message " << blockInfo);
+              << " Node " << GetNode()->GetId() << " received a block message " << blockInfo->ToString());
 
   //m_receiveBlockTimes.erase(m_receiveBlockTimes.begin());	
   
@@ -1863,6 +2322,7 @@ BitcoinNode::ReceivedBlockMessage(std::string &blockInfo, Address &from)
       m_queueChunks.erase (blockHash);
     if (m_receivedChunks.find(blockHash) != m_receivedChunks.end())
       m_receivedChunks.erase (blockHash);
+    m_chunkScheduler.RemoveBlock (blockHash);
 	  
     stringStream.clear();
     stringStream.str("");
@@ -1878,7 +2338,7 @@ BitcoinNode::ReceivedBlockMessage(std::string &blockInfo, Address &from)
                  << " is an orphan, so it will be discarded\n");
 							   
       m_queueInv.erase(blockHash);
-      Simulator::Cancel (m_invTimeouts[blockHash]);
+      BitcoinEventProfiler::Cancel (m_invTimeouts[blockHash], INV_TIMEOUT_EXPIRED_EVENT);
       m_invTimeouts.erase(blockHash);
     }
     else
@@ -1893,16 +2353,17 @@ BitcoinNode::ReceivedBlockMessage(std::string &blockInfo, Address &from)
 }
 
 
+template <class Policy>
 void 
-BitcoinNode::ReceivedChunkMessage(std::string &chunkInfo, Address &from) 
+BitcoinNode::ReceivedChunkMessage(Ptr<BitcoinMessage> chunkInfo, Address &from) 
 {
+  BitcoinEventProfiler::Scope profile (RECEIVED_CHUNK_MESSAGE_EVENT);
   NS_LOG_FUNCTION (this);
   
-  rapidjson::Document d;
-  d.Parse(chunkInfo.c_str());
+  rapidjson::Document &d = chunkInfo->GetDocument();
   
   NS_LOG_INFO ("ReceivedChunkMessage: At time " << Simulator::Now ().GetSeconds ()
-               << "s bitcoin node " << GetNode ()->GetId () << " received a  message " << chunkInfo);
+               << "s bitcoin node " << GetNode ()->GetId () << " received a  message " << chunkInfo->ToString());
 			
   //m_receiveBlockTimes.erase(m_receiveBlockTimes.begin());	
 
@@ -1918,13 +2379,12 @@ BitcoinNode::ReceivedChunkMessage(std::string &chunkInfo, Address &from)
     int minerId = d["chunks"][j]["minerId"].GetInt();
     int chunkId = d["chunks"][j]["chunk"].GetInt();
 
-    EventId              timeout;
     std::ostringstream   stringStream;  
     std::string          blockHash;
     std::string          chunkHash;
     std::string          parentBlockHash;
     std::string          blockType;
-    std::vector<int>     candidateChunks;
+    std::vector<int>     pickedChunks;
 
     stringStream << height << "/" << minerId;
     blockHash = stringStream.str();
@@ -1948,11 +2408,7 @@ BitcoinNode::ReceivedChunkMessage(std::string &chunkInfo, Address &from)
     PrintReceivedChunks();
     PrintOnlyHeadersReceived(); */
 
-    if (m_chunkTimeouts.find(chunkHash) != m_chunkTimeouts.end())
-    {
-      Simulator::Cancel (m_chunkTimeouts[chunkHash]);
-      m_chunkTimeouts.erase(chunkHash);
-    }
+    CancelChunkTimeouts (chunkHash);
 
 	
     if (!m_blockchain.HasBlock(height, minerId) && !m_blockchain.IsOrphan(height, minerId) && !ReceivedButNotValidated(blockHash))
@@ -1961,20 +2417,19 @@ BitcoinNode::ReceivedChunkMessage(std::string &chunkInfo, Address &from)
       if(it !=  m_queueChunkPeers[blockHash].end())
         m_queueChunkPeers[blockHash].erase(it);
 		
-      auto it2 = std::find(m_queueChunks[blockHash].begin(), m_queueChunks[blockHash].end(), chunkId);
-      if(it2 !=  m_queueChunks[blockHash].end())
-        m_queueChunks[blockHash].erase(it2);
+      m_queueChunks[blockHash].Reset(chunkId);
+      m_chunkScheduler.RemoveInFlight(blockHash, chunkId);
 	
-      if(std::find(m_receivedChunks[blockHash].begin(), m_receivedChunks[blockHash].end(), chunkId) == m_receivedChunks[blockHash].end())
+      if(!m_receivedChunks[blockHash].Test(chunkId))
       {
-        m_receivedChunks[blockHash].push_back(chunkId);
+        m_receivedChunks[blockHash].Set(chunkId);
 				  
-        if (m_receivedChunks[blockHash].size() == 1 && m_spv)
-          AdvertiseFirstChunk (Block (d["chunks"][j]["height"].GetInt(), d["chunks"][j]["minerId"].GetInt(), d["chunks"][j]["parentBlockMinerId"].GetInt(), 
+        if (Policy::spv && m_receivedChunks[blockHash].Count() == 1)
+          AdvertiseFirstChunk<Policy> (Block (d["chunks"][j]["height"].GetInt(), d["chunks"][j]["minerId"].GetInt(), d["chunks"][j]["parentBlockMinerId"].GetInt(), 
                                       d["chunks"][j]["size"].GetInt(), d["chunks"][j]["timeCreated"].GetDouble(), 
                                       Simulator::Now ().GetSeconds (), InetSocketAddress::ConvertFrom(from).GetIpv4 ()));
 				
-        if (m_receivedChunks[blockHash].size() == ceil(d["chunks"][j]["size"].GetInt()/static_cast<double>(m_chunkSize)))
+        if (m_receivedChunks[blockHash].Count() == ceil(d["chunks"][j]["size"].GetInt()/static_cast<double>(m_chunkSize)))
         {
           if (!m_blockchain.HasBlock(parentHeight, parentMinerId) && !m_blockchain.IsOrphan(parentHeight, parentMinerId)
               && !ReceivedButNotValidated(parentBlockHash) && !OnlyHeadersReceived(parentBlockHash))
@@ -2009,39 +2464,20 @@ BitcoinNode::ReceivedChunkMessage(std::string &chunkInfo, Address &from)
           m_queueChunkPeers.erase (blockHash);	 
           m_queueChunks.erase (blockHash);
           m_receivedChunks.erase (blockHash);
+          m_chunkScheduler.RemoveBlock (blockHash);
         }
         else
         {
-          if (d["chunks"][j]["fullBlock"].GetBool())
-          {
-            for (auto &chunk : m_queueChunks[blockHash])
-              candidateChunks.push_back(chunk);
-          }
-          else
-          {
-            for (int k = 0; k < d["chunks"][j]["availableChunks"].Size(); k++)
-            {
-              if (std::find(m_queueChunks[blockHash].begin(), m_queueChunks[blockHash].end(), d["chunks"][j]["availableChunks"][k].GetInt()) != m_queueChunks[blockHash].end())
-                candidateChunks.push_back(d["chunks"][j]["availableChunks"][k].GetInt());
-            }
-          }
-
-/*           std::cout << "candidateChunks = ";
-          for (auto chunk : candidateChunks)
-            std::cout << chunk << ", ";
-          std::cout << "\n"; */
+          AddPeerChunks (blockHash, d["chunks"][j]["size"].GetInt(), d["chunks"][j], from);
+          pickedChunks = PickChunks (blockHash, from, 1);
 
-          if (candidateChunks.size() > 0)
+          if (pickedChunks.size() > 0)
           {
-            int randomIndex = rand() % candidateChunks.size();
             NS_LOG_INFO("ReceivedChunkMessage: Bitcoin node " << GetNode ()->GetId ()
-                        << " will request the chunk with index = " << randomIndex << " and value = " << candidateChunks[randomIndex]);	
-            m_queueChunks[blockHash].erase(std::remove(m_queueChunks[blockHash].begin(),
-                                                       m_queueChunks[blockHash].end(), candidateChunks[randomIndex]),
-                                                       m_queueChunks[blockHash].end());
+                        << " will request the chunk " << pickedChunks[0]);	
 																		  
             std::ostringstream chunk;
-            chunk << blockHash << "/" << candidateChunks[randomIndex];
+            chunk << blockHash << "/" << pickedChunks[0];
 
             if (d["chunks"][j]["requestChunks"].Size() == 0)
               getDataMessages.push_back(chunk.str());
@@ -2050,17 +2486,14 @@ BitcoinNode::ReceivedChunkMessage(std::string &chunkInfo, Address &from)
               for (int ii = 0; ii < d["chunks"][j]["requestChunks"].Size(); ii++)
               {
                 BitcoinChunk newChunk (d["chunks"][j]["height"].GetInt(), d["chunks"][j]["minerId"].GetInt(), 
-                                       candidateChunks[randomIndex], d["chunks"][j]["parentBlockMinerId"].GetInt(), 
+                                       pickedChunks[0], d["chunks"][j]["parentBlockMinerId"].GetInt(), 
                                        d["chunks"][j]["size"].GetInt(), d["chunks"][j]["timeCreated"].GetDouble(), 
                                        Simulator::Now ().GetSeconds (), InetSocketAddress::ConvertFrom(from).GetIpv4 ());
                 chunkMessages[newChunk].push_back(d["chunks"][j]["requestChunks"][ii].GetInt());
               }
             }
 					  
-            timeout = Simulator::Schedule (Minutes(m_invTimeoutMinutes.GetMinutes() / ceil(d["chunks"][j]["size"].GetInt()/static_cast<double>(m_chunkSize))),
-                                                   &BitcoinNode::ChunkTimeoutExpired, this, chunk.str());
-													 
-            m_chunkTimeouts[chunk.str()] = timeout;
+            ScheduleChunkTimeout (chunk.str(), from, d["chunks"][j]["size"].GetInt());
             m_queueChunkPeers[blockHash].push_back(from);
           }
           else
@@ -2105,11 +2538,11 @@ BitcoinNode::ReceivedChunkMessage(std::string &chunkInfo, Address &from)
   {
     rapidjson::Value   value;
     rapidjson::Value   chunkArray(rapidjson::kArrayType);
-    rapidjson::Value   availableChunks(rapidjson::kArrayType);
     rapidjson::Value   chunkInfo(rapidjson::kObjectType);
 
     d.RemoveMember("chunks");
 				
+    long availableChunkBytes = 0;
     for (auto chunk_it = getDataMessages.begin(); chunk_it < getDataMessages.end(); chunk_it++) 
     {
       NS_LOG_INFO("In getDataMessages: " << *chunk_it);
@@ -2132,15 +2565,12 @@ BitcoinNode::ReceivedChunkMessage(std::string &chunkInfo, Address &from)
       help << height << "/" << minerId;
       blockHash = help.str();
 				
+      std::string packedChunks;
       if (m_receivedChunks.find(blockHash) != m_receivedChunks.end())
-      {
-        for ( auto k : m_receivedChunks[blockHash])
-        {
-          value = k;
-          availableChunks.PushBack(value, d.GetAllocator());
-        }
-      }
-      chunkInfo.AddMember("availableChunks", availableChunks, d.GetAllocator());
+        packedChunks = m_receivedChunks[blockHash].Pack();
+      availableChunkBytes += packedChunks.size()/2;
+      value.SetString(packedChunks.c_str(), packedChunks.size(), d.GetAllocator());
+      chunkInfo.AddMember("availableChunks", value, d.GetAllocator());
 				  
       value = false;
       chunkInfo.AddMember("fullBlock", value, d.GetAllocator());
@@ -2152,7 +2582,7 @@ BitcoinNode::ReceivedChunkMessage(std::string &chunkInfo, Address &from)
     }		
     d.AddMember("chunks", chunkArray, d.GetAllocator());
 				
-    SendMessage(CHUNK, EXT_GET_DATA, d, from);	
+    SendMessage(CHUNK, EXT_GET_DATA, d, MessageBytes<EXT_GET_DATA> (getDataMessages.size(), availableChunkBytes), from);	
   }
 
   
@@ -2162,6 +2592,7 @@ BitcoinNode::ReceivedChunkMessage(std::string &chunkInfo, Address &from)
     rapidjson::Value   value;
     rapidjson::Value   chunkArray(rapidjson::kArrayType);
     rapidjson::Value   chunkInfo(rapidjson::kObjectType);
+    long               availableChunkBytes = 0;
 
     d.RemoveMember("chunks");
 				
@@ -2183,7 +2614,6 @@ BitcoinNode::ReceivedChunkMessage(std::string &chunkInfo, Address &from)
       for (auto requestedChunk_it = chunk.second.begin(); requestedChunk_it != chunk.second.end(); requestedChunk_it++)
       {
         rapidjson::Value   requestChunks(rapidjson::kArrayType);
-        rapidjson::Value   availableChunks(rapidjson::kArrayType);
 
         value = chunk.first.GetBlockHeight ();
         chunkInfo.AddMember("height", value, d.GetAllocator ());
@@ -2224,7 +2654,7 @@ BitcoinNode::ReceivedChunkMessage(std::string &chunkInfo, Address &from)
         {
           int noChunks = ceil(chunk.first.GetBlockSizeBytes () / static_cast<double>(m_chunkSize));
 					
-          if (m_receivedChunks[blockHash].size() == noChunks)
+          if (m_receivedChunks[blockHash].Count() == noChunks)
           {
             value = true;
             chunkInfo.AddMember("fullBlock", value, d.GetAllocator ());
@@ -2234,12 +2664,10 @@ BitcoinNode::ReceivedChunkMessage(std::string &chunkInfo, Address &from)
             value = false;							
             chunkInfo.AddMember("fullBlock", value, d.GetAllocator ());
 
-            for (auto &chunk : m_receivedChunks[blockHash])
-            {
-              value = chunk;
-              availableChunks.PushBack(value, d.GetAllocator());
-            }
-            chunkInfo.AddMember("availableChunks", availableChunks, d.GetAllocator ());
+            std::string packedChunks = m_receivedChunks[blockHash].Pack();
+            availableChunkBytes += packedChunks.size()/2;
+            value.SetString(packedChunks.c_str(), packedChunks.size(), d.GetAllocator());
+            chunkInfo.AddMember("availableChunks", value, d.GetAllocator ());
           }
         }
 		
@@ -2261,7 +2689,7 @@ BitcoinNode::ReceivedChunkMessage(std::string &chunkInfo, Address &from)
     double eventTime;
 				
 /*                 std::cout << "Node " << GetNode()->GetId() << "-" << InetSocketAddress::ConvertFrom(from).GetIpv4 () 
-		  		          << " " << m_peersDownloadSpeeds[InetSocketAddress::ConvertFrom(from).GetIpv4 ()] << " Mbps , time = "
+		  		          << " " << GetPeerDownloadSpeed (InetSocketAddress::ConvertFrom(from).GetIpv4 ()) << " Mbps , time = "
 		  		          << Simulator::Now ().GetSeconds() << "s \n"; */
                 
     if (m_sendBlockTimes.size() == 0 || Simulator::Now ().GetSeconds() >  m_sendBlockTimes.back())
@@ -2281,13 +2709,14 @@ BitcoinNode::ReceivedChunkMessage(std::string &chunkInfo, Address &from)
 							
                
     // Stringify the DOM
-    rapidjson::StringBuffer packetInfo;
+    rapidjson::StringBuffer &packetInfo = m_jsonPool.GetBuffer ();
     rapidjson::Writer<rapidjson::StringBuffer> writer(packetInfo);
     d.Accept(writer);
     std::string packet = packetInfo.GetString();
     NS_LOG_INFO ("DEBUG: " << packetInfo.GetString());
 				
-    Simulator::Schedule (Seconds(eventTime), &BitcoinNode::SendChunk, this, packet, from); 
+    Simulator::Schedule (Seconds(eventTime), &BitcoinNode::SendChunk, this, packet, 
+                         MessageBytes<CHUNK> (d["chunks"].Size(), totalChunkMessageSize + availableChunkBytes), from); 
     Simulator::Schedule (Seconds(eventTime + sendTime), &BitcoinNode::RemoveSendTime, this);
 
   }
@@ -2307,14 +2736,15 @@ BitcoinNode::ReceiveBlock(const Block &newBlock)
   stringStream << newBlock.GetBlockHeight() << "/" << newBlock.GetMinerId();
   blockHash = stringStream.str();
   
-  if (m_blockchain.HasBlock(newBlock) || m_blockchain.IsOrphan(newBlock) || ReceivedButNotValidated(blockHash))
+  if (m_blockchain.HasBlock(newBlock) || m_blockchain.IsOrphan(newBlock) 
+      || m_blockchain.IsPruned(newBlock.GetBlockHeight(), newBlock.GetMinerId()) || ReceivedButNotValidated(blockHash))
   {
     NS_LOG_INFO ("ReceiveBlock: Bitcoin node " << GetNode ()->GetId () << " has already added this block in the m_blockchain: " << newBlock);
     
     if (m_invTimeouts.find(blockHash) != m_invTimeouts.end())
     {
       m_queueInv.erase(blockHash);
-      Simulator::Cancel (m_invTimeouts[blockHash]);
+      BitcoinEventProfiler::Cancel (m_invTimeouts[blockHash], INV_TIMEOUT_EXPIRED_EVENT);
       m_invTimeouts.erase(blockHash);
     }
   }
@@ -2329,7 +2759,7 @@ BitcoinNode::ReceiveBlock(const Block &newBlock)
     if (m_invTimeouts.find(blockHash) != m_invTimeouts.end())
     {
       m_queueInv.erase(blockHash);
-      Simulator::Cancel (m_invTimeouts[blockHash]);
+      BitcoinEventProfiler::Cancel (m_invTimeouts[blockHash], INV_TIMEOUT_EXPIRED_EVENT);
       m_invTimeouts.erase(blockHash);
     }
 	
@@ -2354,7 +2784,8 @@ BitcoinNode::ReceivedLastChunk(const Block &newBlock)
   stringStream << newBlock.GetBlockHeight() << "/" << newBlock.GetMinerId();
   blockHash = stringStream.str();
   
-  if (m_blockchain.HasBlock(newBlock) || m_blockchain.IsOrphan(newBlock) || ReceivedButNotValidated(blockHash))
+  if (m_blockchain.HasBlock(newBlock) || m_blockchain.IsOrphan(newBlock) 
+      || m_blockchain.IsPruned(newBlock.GetBlockHeight(), newBlock.GetMinerId()) || ReceivedButNotValidated(blockHash))
   {
     NS_LOG_INFO ("ReceivedLastChunk: Bitcoin node " << GetNode ()->GetId () << " has already added this block in the m_blockchain: " << newBlock);
   }
@@ -2373,8 +2804,9 @@ BitcoinNode::ReceivedLastChunk(const Block &newBlock)
 
 
 void 
-BitcoinNode::SendBlock(std::string packetInfo, Address& from) 
+BitcoinNode::SendBlock(std::string packetInfo, long messageBytes, Address& from) 
 {
+  BitcoinEventProfiler::Scope profile (SEND_BLOCK_EVENT);
   NS_LOG_FUNCTION (this);
   
   NS_LOG_INFO ("SendBlock: At time " << Simulator::Now ().GetSeconds ()
@@ -2382,13 +2814,14 @@ BitcoinNode::SendBlock(std::string packetInfo, Address& from)
                 << packetInfo << " to " << InetSocketAddress::ConvertFrom(from).GetIpv4 ());
 				
   //m_sendBlockTimes.erase(m_sendBlockTimes.begin());				
-  SendMessage(GET_DATA, BLOCK, packetInfo, from);
+  SendMessage(GET_DATA, BLOCK, packetInfo, messageBytes, from);
 }
 
 
 void 
-BitcoinNode::SendChunk(std::string packetInfo, Address& from) 
+BitcoinNode::SendChunk(std::string packetInfo, long messageBytes, Address& from) 
 {
+  BitcoinEventProfiler::Scope profile (SEND_CHUNK_EVENT);
   NS_LOG_FUNCTION (this);
   
   NS_LOG_INFO ("SendChunk: At time " << Simulator::Now ().GetSeconds ()
@@ -2396,7 +2829,7 @@ BitcoinNode::SendChunk(std::string packetInfo, Address& from)
                 << packetInfo << " to " << InetSocketAddress::ConvertFrom(from).GetIpv4 ());
 				
   //m_sendBlockTimes.erase(m_sendBlockTimes.begin());				
-  SendMessage(EXT_GET_DATA, CHUNK, packetInfo, from);
+  SendMessage(EXT_GET_DATA, CHUNK, packetInfo, messageBytes, from);
 }
 
 
@@ -2413,9 +2846,7 @@ BitcoinNode::ValidateBlock(const Block &newBlock)
 {
   NS_LOG_FUNCTION (this);
   
-  const Block *parent = m_blockchain.GetParent(newBlock);
-  
-  if (parent == nullptr)
+  if (!m_blockchain.HasParent(newBlock))
   {
     NS_LOG_INFO("ValidateBlock: Block " << newBlock << " is an orphan\n"); 
 	 
@@ -2424,7 +2855,7 @@ BitcoinNode::ValidateBlock(const Block &newBlock)
   }
   else 
   {
-    NS_LOG_INFO("ValidateBlock: Block's " << newBlock << " parent is " << *parent << "\n");
+    NS_LOG_INFO("ValidateBlock: Block's " << newBlock << " parent is " << m_blockchain.GetParent(newBlock) << "\n");
 
     /**
      * Block is not orphan, so we can go on validating
@@ -2444,6 +2875,7 @@ BitcoinNode::ValidateBlock(const Block &newBlock)
 void 
 BitcoinNode::AfterBlockValidation(const Block &newBlock) 
 {
+  BitcoinEventProfiler::Scope profile (AFTER_BLOCK_VALIDATION_EVENT);
   NS_LOG_FUNCTION (this);
 
   int height = newBlock.GetBlockHeight();
@@ -2474,6 +2906,9 @@ BitcoinNode::AfterBlockValidation(const Block &newBlock)
    * Update m_meanBlockReceiveTime with the timeReceived of the newly received block.
    */
    
+  AddToSketches (newBlock.GetTimeReceived() - m_previousBlockReceiveTime, newBlock.GetTimeReceived() - newBlock.GetTimeCreated(),
+                 newBlock.GetBlockSizeBytes());
+
   m_meanBlockReceiveTime = (m_blockchain.GetTotalBlocks() - 1)/static_cast<double>(m_blockchain.GetTotalBlocks())*m_meanBlockReceiveTime 
                          + (newBlock.GetTimeReceived() - m_previousBlockReceiveTime)/(m_blockchain.GetTotalBlocks());
   m_previousBlockReceiveTime = newBlock.GetTimeReceived();
@@ -2485,17 +2920,27 @@ BitcoinNode::AfterBlockValidation(const Block &newBlock)
                   + (newBlock.GetBlockSizeBytes())/static_cast<double>(m_blockchain.GetTotalBlocks());
 				  
   m_blockchain.AddBlock(newBlock);
+  BitcoinPropagationTrace::Record (newBlock, GetNode ()->GetId ());
   
-  if (!m_blockTorrent)
-    AdvertiseNewBlock(newBlock); 
-  else
-    AdvertiseFullBlock(newBlock);
+  (this->*m_advertiseBlock) (newBlock);
 
   ValidateOrphanChildren(newBlock);
   
 }  
 
 
+void
+BitcoinNode::AddToSketches (double receiveInterval, double propagationTime, double blockSize)
+{
+  if (m_sketchRelativeAccuracy <= 0)
+    return;
+
+  m_blockReceiveTimeSketch.Add (receiveInterval);
+  m_blockPropagationTimeSketch.Add (propagationTime);
+  m_blockSizeSketch.Add (blockSize);
+}
+
+
 void 
 BitcoinNode::ValidateOrphanChildren(const Block &newBlock) 
 {
@@ -2521,216 +2966,241 @@ BitcoinNode::ValidateOrphanChildren(const Block &newBlock)
 }
 
 
+template <class Policy>
+void 
+BitcoinNode::AdvertiseBlock (const Block &newBlock) 
+{
+  if (!Policy::blockTorrent)
+    AdvertiseNewBlock<Policy> (newBlock); 
+  else
+    AdvertiseFullBlock<Policy> (newBlock);
+}
+
+
+template <class Policy>
 void 
 BitcoinNode::AdvertiseNewBlock (const Block &newBlock) 
 {
   NS_LOG_FUNCTION (this);
 
-  rapidjson::Document d;
+  if (m_trickleInterval.IsStrictlyPositive ())
+  {
+    QueueAnnouncement<Policy> (newBlock, newBlock.GetReceivedFromIpv4 ());
+    return;
+  }
+
+  BitcoinJsonDocument d (m_jsonPool);
+  long messageBytes = BuildAnnouncement<Policy> (d, std::vector<Block> (1, newBlock));
+
+  // Stringify the DOM
+  rapidjson::StringBuffer &packetInfo = m_jsonPool.GetBuffer ();
+  rapidjson::Writer<rapidjson::StringBuffer> writer(packetInfo);
+  d.Accept(writer);
+  
+  int noPeers = BroadcastAnnouncement (CreateMessagePacket (packetInfo), newBlock, newBlock.GetReceivedFromIpv4 ());
+  CountSentBytes (Policy::announcement, noPeers * messageBytes);
+
+  NS_LOG_INFO ("AdvertiseNewBlock: At time " << Simulator::Now ().GetSeconds ()
+               << "s bitcoin node " << GetNode ()->GetId () << " advertised a new Block: " 
+               << newBlock << " to " << noPeers << " peers");
+}
+
+
+template <class Policy>
+void 
+BitcoinNode::QueueAnnouncement (const Block &newBlock, Ipv4Address exceptPeer) 
+{
+  NS_LOG_FUNCTION (this);
+
+  int noPeers = 0;
+
+  for (std::vector<Ipv4Address>::const_iterator i = m_peersAddresses.begin(); i != m_peersAddresses.end(); ++i)
+  {
+    if (*i != exceptPeer && !IsKnownBlock (*i, newBlock.GetBlockHeight (), newBlock.GetMinerId ()))
+    {
+      std::vector<Block> &queue = m_pendingAnnouncements[*i];
+
+      if (queue.empty ())
+      {
+        //Poisson timer per peer, as in Bitcoin Core, so the peers do not learn the block at the same time
+        double delay = -log (1 - rand () / (RAND_MAX + 1.0)) * m_trickleInterval.GetSeconds ();
+        m_trickleEvents[*i] = Simulator::Schedule (Seconds (delay), &BitcoinNode::SendAnnouncements<Policy>, this, *i);
+      }
+      queue.push_back(newBlock);
+      AddKnownBlock (*i, newBlock.GetBlockHeight (), newBlock.GetMinerId ());
+      noPeers++;
+    }
+  }
+
+  NS_LOG_INFO ("QueueAnnouncement: At time " << Simulator::Now ().GetSeconds ()
+               << "s bitcoin node " << GetNode ()->GetId () << " queued the announcement of a new Block: " 
+               << newBlock << " for " << noPeers << " peers");
+}
+
+
+template <class Policy>
+long 
+BitcoinNode::BuildAnnouncement (rapidjson::Document &d, const std::vector<Block> &blocks) 
+{
   rapidjson::Value value;
   rapidjson::Value array(rapidjson::kArrayType);  
-  std::ostringstream stringStream;  
-  std::string blockHash = stringStream.str();
+
   d.SetObject();
   
   value.SetString("block");
   d.AddMember("type", value, d.GetAllocator());
   
-  if (m_protocolType == STANDARD_PROTOCOL)
+  value = Policy::announcement;
+  d.AddMember("message", value, d.GetAllocator());
+
+  if (Policy::protocolType == STANDARD_PROTOCOL)
   {
-    value = INV;
-    d.AddMember("message", value, d.GetAllocator());
+    for (std::vector<Block>::const_iterator block_it = blocks.begin(); block_it != blocks.end(); block_it++)
+    {
+      std::ostringstream stringStream;  
+      stringStream << block_it->GetBlockHeight () << "/" << block_it->GetMinerId ();
+      std::string blockHash = stringStream.str();
+      value.SetString(blockHash.c_str(), blockHash.size(), d.GetAllocator());
 
-    stringStream << newBlock.GetBlockHeight () << "/" << newBlock.GetMinerId ();
-    blockHash = stringStream.str();
-    value.SetString(blockHash.c_str(), blockHash.size(), d.GetAllocator());
-    array.PushBack(value, d.GetAllocator());
+      if (!Policy::blockTorrent)
+        array.PushBack(value, d.GetAllocator());
+      else
+      {
+        rapidjson::Value blockInfo(rapidjson::kObjectType);
+
+        blockInfo.AddMember("hash", value, d.GetAllocator ());
+
+        value = block_it->GetBlockSizeBytes ();
+        blockInfo.AddMember("size", value, d.GetAllocator ());
+		  
+        value = true;
+        blockInfo.AddMember("fullBlock", value, d.GetAllocator ());
+
+        array.PushBack(blockInfo, d.GetAllocator());
+      }
+    }
     d.AddMember("inv", array, d.GetAllocator());
   }
-  else if (m_protocolType == SENDHEADERS)
+  else if (Policy::protocolType == SENDHEADERS)
   {
-    rapidjson::Value blockInfo(rapidjson::kObjectType);
-
-    value = HEADERS;
-    d.AddMember("message", value, d.GetAllocator());
-	
-    value = newBlock.GetBlockHeight ();
-    blockInfo.AddMember("height", value, d.GetAllocator ());
+    for (std::vector<Block>::const_iterator block_it = blocks.begin(); block_it != blocks.end(); block_it++)
+    {
+      rapidjson::Value blockInfo(rapidjson::kObjectType);
 
-    value = newBlock.GetMinerId ();
-    blockInfo.AddMember("minerId", value, d.GetAllocator ());
+      value = block_it->GetBlockHeight ();
+      blockInfo.AddMember("height", value, d.GetAllocator ());
 
-    value = newBlock.GetParentBlockMinerId ();
-    blockInfo.AddMember("parentBlockMinerId", value, d.GetAllocator ());
+      value = block_it->GetMinerId ();
+      blockInfo.AddMember("minerId", value, d.GetAllocator ());
 
-    value = newBlock.GetBlockSizeBytes ();
-    blockInfo.AddMember("size", value, d.GetAllocator ());
+      value = block_it->GetParentBlockMinerId ();
+      blockInfo.AddMember("parentBlockMinerId", value, d.GetAllocator ());
 
-    value = newBlock.GetTimeCreated ();
-    blockInfo.AddMember("timeCreated", value, d.GetAllocator ());
+      value = block_it->GetBlockSizeBytes ();
+      blockInfo.AddMember("size", value, d.GetAllocator ());
 
-    value = newBlock.GetTimeReceived ();							
-    blockInfo.AddMember("timeReceived", value, d.GetAllocator ());
+      value = block_it->GetTimeCreated ();
+      blockInfo.AddMember("timeCreated", value, d.GetAllocator ());
 
-    array.PushBack(blockInfo, d.GetAllocator());
-    d.AddMember("blocks", array, d.GetAllocator());      
-  }	
+      value = block_it->GetTimeReceived ();							
+      blockInfo.AddMember("timeReceived", value, d.GetAllocator ());
 
-  // Stringify the DOM
-  rapidjson::StringBuffer packetInfo;
-  rapidjson::Writer<rapidjson::StringBuffer> writer(packetInfo);
-  d.Accept(writer);
-  
-  for (std::vector<Ipv4Address>::const_iterator i = m_peersAddresses.begin(); i != m_peersAddresses.end(); ++i)
-  {
-    if ( *i != newBlock.GetReceivedFromIpv4 () )
-    {
-      const uint8_t delimiter[] = "#";
+      if (Policy::blockTorrent)
+      {
+        value = true;
+        blockInfo.AddMember("fullBlock", value, d.GetAllocator ());
+      }
 
-      m_peersSockets[*i]->Send (reinterpret_cast<const uint8_t*>(packetInfo.GetString()), packetInfo.GetSize(), 0);
-	  m_peersSockets[*i]->Send (delimiter, 1, 0);
-	  
-      if (m_protocolType == STANDARD_PROTOCOL)
-        m_nodeStats->invSentBytes += m_bitcoinMessageHeader + m_countBytes + d["inv"].Size()*m_inventorySizeBytes;
-      else if (m_protocolType == SENDHEADERS)
-        m_nodeStats->headersSentBytes += m_bitcoinMessageHeader + m_countBytes + d["blocks"].Size()*m_headersSizeBytes;      
-	
-      NS_LOG_INFO ("AdvertiseNewBlock: At time " << Simulator::Now ().GetSeconds ()
-                   << "s bitcoin node " << GetNode ()->GetId () << " advertised a new Block: " 
-                   << newBlock << " to " << *i);
+      array.PushBack(blockInfo, d.GetAllocator());
     }
-  }
+    d.AddMember("blocks", array, d.GetAllocator());      
+  }	
+
+  //The blocks are announced as full blocks, so the message has no variable Bytes
+  return MessageBytes<Policy::announcement> (blocks.size());
 }
 
 
+template <class Policy>
 void 
-BitcoinNode::AdvertiseFullBlock (const Block &newBlock) 
+BitcoinNode::SendAnnouncements (Ipv4Address peer) 
 {
+  BitcoinEventProfiler::Scope profile (SEND_ANNOUNCEMENTS_EVENT);
   NS_LOG_FUNCTION (this);
 
-  rapidjson::Document d;
-  rapidjson::Value value;
-  rapidjson::Value array(rapidjson::kArrayType);  
-  rapidjson::Value blockInfo(rapidjson::kObjectType);
-  std::ostringstream stringStream;  
-  std::string blockHash = stringStream.str();
-  d.SetObject();
-  
-  value.SetString("block");
-  d.AddMember("type", value, d.GetAllocator());
-  
-  if (m_protocolType == STANDARD_PROTOCOL)
-  {
-    value = EXT_INV;
-    d.AddMember("message", value, d.GetAllocator());
-  
-    stringStream << newBlock.GetBlockHeight () << "/" << newBlock.GetMinerId ();
-    blockHash = stringStream.str();
-    value.SetString(blockHash.c_str(), blockHash.size(), d.GetAllocator());
-    blockInfo.AddMember("hash", value, d.GetAllocator ());
+  std::map<Ipv4Address, std::vector<Block>>::iterator peer_it = m_pendingAnnouncements.find (peer);
 
-    value = newBlock.GetBlockSizeBytes ();
-    blockInfo.AddMember("size", value, d.GetAllocator ());
-		  
-    value = true;
-    blockInfo.AddMember("fullBlock", value, d.GetAllocator ());
-	
-    array.PushBack(blockInfo, d.GetAllocator());
-    d.AddMember("inv", array, d.GetAllocator());
-  }
-  else if (m_protocolType == SENDHEADERS)
+  m_trickleEvents.erase (peer);
+  if (peer_it == m_pendingAnnouncements.end())
+    return;
+
+  if (!peer_it->second.empty())
   {
-    rapidjson::Value blockInfo(rapidjson::kObjectType);
+    BitcoinJsonDocument d (m_jsonPool);
+    long messageBytes = BuildAnnouncement<Policy> (d, peer_it->second);
 
-    value = newBlock.GetBlockHeight ();
-    blockInfo.AddMember("height", value, d.GetAllocator ());
+    rapidjson::StringBuffer &packetInfo = m_jsonPool.GetBuffer ();
+    rapidjson::Writer<rapidjson::StringBuffer> writer(packetInfo);
+    d.Accept(writer);
 
-    value = newBlock.GetMinerId ();
-    blockInfo.AddMember("minerId", value, d.GetAllocator ());
+    m_peersSockets[peer]->Send (CreateMessagePacket (packetInfo));
+    CountSentBytes (Policy::announcement, messageBytes);
+    m_totalAnnouncements++;
 
-    value = newBlock.GetParentBlockMinerId ();
-    blockInfo.AddMember("parentBlockMinerId", value, d.GetAllocator ());
+    NS_LOG_INFO ("SendAnnouncements: At time " << Simulator::Now ().GetSeconds ()
+                 << "s bitcoin node " << GetNode ()->GetId () << " announced " << peer_it->second.size () 
+                 << " blocks to " << peer);
+  }
 
-    value = newBlock.GetBlockSizeBytes ();
-    blockInfo.AddMember("size", value, d.GetAllocator ());
+  m_pendingAnnouncements.erase (peer_it);
+}
 
-    value = newBlock.GetTimeCreated ();
-    blockInfo.AddMember("timeCreated", value, d.GetAllocator ());
 
-    value = newBlock.GetTimeReceived ();							
-    blockInfo.AddMember("timeReceived", value, d.GetAllocator ());
+template <class Policy>
+void 
+BitcoinNode::AdvertiseFullBlock (const Block &newBlock) 
+{
+  NS_LOG_FUNCTION (this);
 
-    if (!m_blockTorrent)
-    {
-      value = HEADERS;
-      d.AddMember("message", value, d.GetAllocator()); 
-    }
-    else
-    {
-      value = EXT_HEADERS;
-      d.AddMember("message", value, d.GetAllocator());
-		  
-      value = true;
-      blockInfo.AddMember("fullBlock", value, d.GetAllocator ());
-    }
-	
-    array.PushBack(blockInfo, d.GetAllocator());
-    d.AddMember("blocks", array, d.GetAllocator());      
-  }	
+  //The peer the block was received from is not skipped, because it may have announced only some of its chunks
+  if (m_trickleInterval.IsStrictlyPositive ())
+  {
+    QueueAnnouncement<Policy> (newBlock, Ipv4Address ());
+    return;
+  }
+
+  BitcoinJsonDocument d (m_jsonPool);
+  long messageBytes = BuildAnnouncement<Policy> (d, std::vector<Block> (1, newBlock));
 
   // Stringify the DOM
-  rapidjson::StringBuffer packetInfo;
+  rapidjson::StringBuffer &packetInfo = m_jsonPool.GetBuffer ();
   rapidjson::Writer<rapidjson::StringBuffer> writer(packetInfo);
   d.Accept(writer);
   
-  for (std::vector<Ipv4Address>::const_iterator i = m_peersAddresses.begin(); i != m_peersAddresses.end(); ++i)
-  {
-    const uint8_t delimiter[] = "#";
+  int noPeers = BroadcastAnnouncement (CreateMessagePacket (packetInfo), newBlock);
+  CountSentBytes (Policy::announcement, noPeers * messageBytes);
 
-    m_peersSockets[*i]->Send (reinterpret_cast<const uint8_t*>(packetInfo.GetString()), packetInfo.GetSize(), 0);
-    m_peersSockets[*i]->Send (delimiter, 1, 0);
-	  
-    if (m_protocolType == STANDARD_PROTOCOL)
-    {
-      m_nodeStats->extInvSentBytes += m_bitcoinMessageHeader + m_countBytes + d["inv"].Size()*m_inventorySizeBytes;
-      for (int j=0; j<d["inv"].Size(); j++)
-      {
-        m_nodeStats->extInvSentBytes += 5; //1Byte(fullBlock) + 4Bytes(numberOfChunks)
-        if (!d["inv"][j]["fullBlock"].GetBool())
-          m_nodeStats->extInvSentBytes += d["inv"][j]["availableChunks"].Size();
-      }
-    }
-    else if (m_protocolType == SENDHEADERS)
-    {
-      m_nodeStats->extHeadersSentBytes += m_bitcoinMessageHeader + m_countBytes + d["blocks"].Size()*m_headersSizeBytes;
-      for (int j=0; j<d["blocks"].Size(); j++)
-      {
-        m_nodeStats->extHeadersSentBytes += 1;//fullBlock
-        if (!d["blocks"][j]["fullBlock"].GetBool())
-          m_nodeStats->extHeadersSentBytes += d["blocks"][j]["availableChunks"].Size()*1;
-      }	
-    }
-	
-    NS_LOG_INFO ("AdvertiseFullBlock: At time " << Simulator::Now ().GetSeconds ()
-                 << "s bitcoin node " << GetNode ()->GetId () << " advertised a new Block: " 
-                 << newBlock << " to " << *i);
-  }
+  NS_LOG_INFO ("AdvertiseFullBlock: At time " << Simulator::Now ().GetSeconds ()
+               << "s bitcoin node " << GetNode ()->GetId () << " advertised a new Block: " 
+               << newBlock << " to " << noPeers << " peers");
 }
 
 
+template <class Policy>
 void 
 BitcoinNode::AdvertiseFirstChunk (const Block &newBlock) 
 {
   NS_LOG_FUNCTION (this);
 
-  rapidjson::Document d;
+  BitcoinJsonDocument d (m_jsonPool);
   rapidjson::Value value;
   rapidjson::Value array(rapidjson::kArrayType); 
-  rapidjson::Value chunkArray(rapidjson::kArrayType); 
   rapidjson::Value blockInfo(rapidjson::kObjectType);  
   std::ostringstream stringStream;  
   std::string blockHash;
   int noChunks = ceil(newBlock.GetBlockSizeBytes ()/static_cast<double>(m_chunkSize));
+  enum Messages message = NO_MESSAGE;
+  long availableChunkBytes = 0;
 
   d.SetObject();
   stringStream << newBlock.GetBlockHeight () << "/" << newBlock.GetMinerId ();
@@ -2739,9 +3209,10 @@ BitcoinNode::AdvertiseFirstChunk (const Block &newBlock)
   value.SetString("block");
   d.AddMember("type", value, d.GetAllocator());
   
-  if (m_protocolType == STANDARD_PROTOCOL)
+  if (Policy::protocolType == STANDARD_PROTOCOL)
   {
-    value = EXT_INV;
+    message = EXT_INV;
+    value = message;
     d.AddMember("message", value, d.GetAllocator());
         
     value.SetString(blockHash.c_str(), blockHash.size(), d.GetAllocator());
@@ -2751,7 +3222,7 @@ BitcoinNode::AdvertiseFirstChunk (const Block &newBlock)
     blockInfo.AddMember("size", value, d.GetAllocator ());
 		  
 					
-    if (m_receivedChunks[blockHash].size() == noChunks)
+    if (m_receivedChunks[blockHash].Count() == noChunks)
     {
       value = true;
       blockInfo.AddMember("fullBlock", value, d.GetAllocator ());
@@ -2761,18 +3232,16 @@ BitcoinNode::AdvertiseFirstChunk (const Block &newBlock)
       value = false;							
       blockInfo.AddMember("fullBlock", value, d.GetAllocator ());
 
-      for (auto &chunk : m_receivedChunks[blockHash])
-      {
-        value = chunk;
-        chunkArray.PushBack(value, d.GetAllocator());
-      }
-      blockInfo.AddMember("availableChunks", chunkArray, d.GetAllocator ());
+      std::string packedChunks = m_receivedChunks[blockHash].Pack();
+      availableChunkBytes += packedChunks.size()/2;
+      value.SetString(packedChunks.c_str(), packedChunks.size(), d.GetAllocator());
+      blockInfo.AddMember("availableChunks", value, d.GetAllocator ());
     }
 		  
     array.PushBack(blockInfo, d.GetAllocator());
     d.AddMember("inv", array, d.GetAllocator()); 
   }
-  else if (m_protocolType == SENDHEADERS)
+  else if (Policy::protocolType == SENDHEADERS)
   {
     rapidjson::Value blockInfo(rapidjson::kObjectType);
 
@@ -2794,322 +3263,422 @@ BitcoinNode::AdvertiseFirstChunk (const Block &newBlock)
     value = newBlock.GetTimeReceived ();							
     blockInfo.AddMember("timeReceived", value, d.GetAllocator ());
 
-    if (!m_blockTorrent)
+    if (!Policy::blockTorrent)
     {
-      value = HEADERS;
+      message = HEADERS;
+      value = message;
       d.AddMember("message", value, d.GetAllocator()); 
     }
     else
     {
-      value = EXT_HEADERS;
+      message = EXT_HEADERS;
+      value = message;
       d.AddMember("message", value, d.GetAllocator());
 		  
-      if (m_receivedChunks[blockHash].size() == noChunks)
+      if (m_receivedChunks[blockHash].Count() == noChunks)
       {
         value = true;
         blockInfo.AddMember("fullBlock", value, d.GetAllocator ());
-        NS_LOG_DEBUG("1 " << m_receivedChunks[blockHash].size());
+        NS_LOG_DEBUG("1 " << m_receivedChunks[blockHash].Count());
       }
       else
       {
-        rapidjson::Value availableChunks(rapidjson::kArrayType);
 		
         value = false;
         blockInfo.AddMember("fullBlock", value, d.GetAllocator ());
 					  
-        for (auto &c : m_receivedChunks[blockHash])
-        {
-          value = c;
-          availableChunks.PushBack(value, d.GetAllocator());
-        }
-        blockInfo.AddMember("availableChunks", availableChunks, d.GetAllocator ());
+        std::string packedChunks = m_receivedChunks[blockHash].Pack();
+        availableChunkBytes += packedChunks.size()/2;
+        value.SetString(packedChunks.c_str(), packedChunks.size(), d.GetAllocator());
+        blockInfo.AddMember("availableChunks", value, d.GetAllocator ());
       }
     }
-	
-    array.PushBack(blockInfo, d.GetAllocator());
-    d.AddMember("blocks", array, d.GetAllocator());      
-  }	
+	
+    array.PushBack(blockInfo, d.GetAllocator());
+    d.AddMember("blocks", array, d.GetAllocator());      
+  }	
+
+  // Stringify the DOM
+  rapidjson::StringBuffer &packetInfo = m_jsonPool.GetBuffer ();
+  rapidjson::Writer<rapidjson::StringBuffer> writer(packetInfo);
+  d.Accept(writer);
+  
+  int noPeers = BroadcastMessage (CreateMessagePacket (packetInfo), newBlock.GetReceivedFromIpv4 ());
+  CountSentBytes (message, noPeers * ns3::GetMessageBytes (message, 1, availableChunkBytes));
+
+  NS_LOG_INFO ("AdvertiseFirstChunk: At time " << Simulator::Now ().GetSeconds ()
+               << "s bitcoin node " << GetNode ()->GetId () << " advertised a new chunk: " 
+               << newBlock << " to " << noPeers << " peers");
+}
+
+
+void
+BitcoinNode::SendHeaders (enum Messages receivedMessage, const rapidjson::Document &request, Address &from)
+{
+  NS_LOG_FUNCTION (this);
+
+  std::vector<Block>              requestHeaders;
+  std::vector<Block>::iterator    block_it;
+
+  for (rapidjson::SizeType j = 0; j < request["blocks"].Size(); j++)
+  {  
+    std::string   invDelimiter = "/";
+    std::string   blockHash = request["blocks"][j].GetString();
+    size_t        invPos = blockHash.find(invDelimiter);
+				
+    int height = atoi(blockHash.substr(0, invPos).c_str());
+    int minerId = atoi(blockHash.substr(invPos+1, blockHash.size()).c_str());
+				
+    if (m_blockchain.HasBlock(height, minerId) || m_blockchain.IsOrphan(height, minerId))
+    {
+      NS_LOG_INFO("SendHeaders: Bitcoin node " << GetNode ()->GetId () 
+                  << " has the block with height = " 
+                  << height << " and minerId = " << minerId);
+      Block newBlock (m_blockchain.ReturnBlock (height, minerId));
+      requestHeaders.push_back(newBlock);
+    }
+    else if (ReceivedButNotValidated(blockHash))
+    {
+      NS_LOG_INFO("SendHeaders: Bitcoin node " << GetNode ()->GetId () 
+                  << " has received but not yet validated the block with height = " 
+                  << height << " and minerId = " << minerId);
+      requestHeaders.push_back(m_receivedNotValidated[blockHash]);
+    }
+    else
+    {
+      NS_LOG_INFO("SendHeaders: Bitcoin node " << GetNode ()->GetId () 
+                  << " does not have the full block with height = " 
+                  << height << " and minerId = " << minerId);   
+    }	
+  }
+			  
+  if (requestHeaders.empty())
+    return;
+
+  BitcoinJsonDocument d (m_jsonPool);
+  rapidjson::Value value;
+  rapidjson::Value array(rapidjson::kArrayType);
+
+  d.SetObject();
+
+  value = HEADERS;
+  d.AddMember("message", value, d.GetAllocator());
+
+  value.SetString(request["type"].GetString(), request["type"].GetStringLength(), d.GetAllocator());
+  d.AddMember("type", value, d.GetAllocator());
+				
+  for (block_it = requestHeaders.begin(); block_it < requestHeaders.end(); block_it++) 
+  {
+    rapidjson::Value blockInfo(rapidjson::kObjectType);
+    NS_LOG_INFO ("In requestHeaders " << *block_it);
+          
+    value = block_it->GetBlockHeight ();
+    blockInfo.AddMember("height", value, d.GetAllocator ());
+
+    value = block_it->GetMinerId ();
+    blockInfo.AddMember("minerId", value, d.GetAllocator ());
+
+    value = block_it->GetParentBlockMinerId ();
+    blockInfo.AddMember("parentBlockMinerId", value, d.GetAllocator ());
+
+    value = block_it->GetBlockSizeBytes ();
+    blockInfo.AddMember("size", value, d.GetAllocator ());
+
+    value = block_it->GetTimeCreated ();
+    blockInfo.AddMember("timeCreated", value, d.GetAllocator ());
+
+    value = block_it->GetTimeReceived ();							
+    blockInfo.AddMember("timeReceived", value, d.GetAllocator ());
+				  
+    array.PushBack(blockInfo, d.GetAllocator());
+  }	
+				
+  d.AddMember("blocks", array, d.GetAllocator());
+				
+  SendMessage(receivedMessage, HEADERS, d, MessageBytes<HEADERS> (requestHeaders.size()), from);
+}
+
+
+void
+BitcoinNode::SendMessage(enum Messages receivedMessage,  enum Messages responseMessage, rapidjson::Document &d, long messageBytes, Ptr<Socket> outgoingSocket)
+{
+  NS_LOG_FUNCTION (this);
+
+  rapidjson::StringBuffer &buffer = m_jsonPool.GetBuffer ();
+  rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+				
+  d["message"].SetInt(responseMessage);
+  d.Accept(writer);
+  NS_LOG_INFO ("Node " << GetNode ()->GetId () << " got a " 
+               << getMessageName(receivedMessage) << " message" 
+               << " and sent a " << getMessageName(responseMessage) 
+               << " message: " << buffer.GetString());
+
+  outgoingSocket->Send (CreateMessagePacket (buffer));
+
+  CountSentBytes (responseMessage, messageBytes);
+}
+
+void
+BitcoinNode::SendMessage(enum Messages receivedMessage,  enum Messages responseMessage, rapidjson::Document &d, long messageBytes, Address &outgoingAddress)
+{
+  NS_LOG_FUNCTION (this);
+
+  rapidjson::StringBuffer &buffer = m_jsonPool.GetBuffer ();
+  rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+				
+  d["message"].SetInt(responseMessage);
+  d.Accept(writer);
+  NS_LOG_INFO ("Node " << GetNode ()->GetId () << " got a " 
+               << getMessageName(receivedMessage) << " message" 
+               << " and sent a " << getMessageName(responseMessage) 
+               << " message: " << buffer.GetString());
+			
+  Ipv4Address outgoingIpv4Address = InetSocketAddress::ConvertFrom(outgoingAddress).GetIpv4 ();
+  std::map<Ipv4Address, Ptr<Socket>>::iterator it = m_peersSockets.find(outgoingIpv4Address);
+  
+  if (it == m_peersSockets.end()) //Create the socket if it doesn't exist
+  {
+    m_peersSockets[outgoingIpv4Address] = Socket::CreateSocket (GetNode (), TcpSocketFactory::GetTypeId ());  
+    m_peersSockets[outgoingIpv4Address]->Connect (InetSocketAddress (outgoingIpv4Address, m_bitcoinPort));
+  }
+  
+  m_peersSockets[outgoingIpv4Address]->Send (CreateMessagePacket (buffer));
+
+  CountSentBytes (responseMessage, messageBytes);
+}
+
+
+Ptr<Packet>
+BitcoinNode::CreateMessagePacket (const rapidjson::StringBuffer &message) const
+{
+  const uint8_t delimiter[] = "#";
+  Ptr<Packet>   packet = Create<Packet> (reinterpret_cast<const uint8_t*>(message.GetString()), message.GetSize());
+
+  packet->AddAtEnd (Create<Packet> (delimiter, 1));
+  return packet;
+}
+
+
+int
+BitcoinNode::BroadcastMessage (Ptr<const Packet> message, Ipv4Address exceptPeer)
+{
+  NS_LOG_FUNCTION (this);
+
+  int noPeers = 0;
+
+  for (std::vector<Ipv4Address>::const_iterator i = m_peersAddresses.begin(); i != m_peersAddresses.end(); ++i)
+  {
+    if (*i != exceptPeer)
+    {
+      m_peersSockets[*i]->Send (message->Copy ());
+      noPeers++;
+    }
+  }
+  return noPeers;
+}
+
+
+int
+BitcoinNode::BroadcastAnnouncement (Ptr<const Packet> message, const Block &block, Ipv4Address exceptPeer)
+{
+  NS_LOG_FUNCTION (this);
+
+  int noPeers = 0;
+
+  for (std::vector<Ipv4Address>::const_iterator i = m_peersAddresses.begin(); i != m_peersAddresses.end(); ++i)
+  {
+    if (*i != exceptPeer && !IsKnownBlock (*i, block.GetBlockHeight (), block.GetMinerId ()))
+    {
+      m_peersSockets[*i]->Send (message->Copy ());
+      AddKnownBlock (*i, block.GetBlockHeight (), block.GetMinerId ());
+      noPeers++;
+      m_totalAnnouncements++;
+    }
+  }
+  return noPeers;
+}
+
+
+void
+BitcoinNode::AddKnownBlock (Ipv4Address peer, int height, int minerId)
+{
+  if (m_knownInventorySize == 0)
+    return;
+
+  std::map<Ipv4Address, BitcoinKnownInventory>::iterator it = m_knownInventory.find (peer);
+
+  if (it == m_knownInventory.end ())
+    it = m_knownInventory.insert (std::make_pair (peer, BitcoinKnownInventory (m_knownInventorySize))).first;
+  it->second.Add (height, minerId);
+}
+
+
+bool
+BitcoinNode::IsKnownBlock (Ipv4Address peer, int height, int minerId) const
+{
+  std::map<Ipv4Address, BitcoinKnownInventory>::const_iterator it = m_knownInventory.find (peer);
+
+  return it != m_knownInventory.end () && it->second.Contains (height, minerId);
+}
+
+
+long
+BitcoinNode::GetMessageBytes (const rapidjson::Document &d) const
+{
+  enum Messages message = static_cast<enum Messages>(d["message"].GetInt());
+  const char   *items = 0;
+  long          variableBytes = 0;
+
+  switch (message) 
+  {
+    case INV:
+    case EXT_INV:
+      items = "inv";
+      break;
+    case HEADERS:
+    case EXT_HEADERS:
+    case GET_DATA:
+    case BLOCK:
+      items = "blocks";
+      break;
+    case EXT_GET_DATA:
+    case CHUNK:
+      items = "chunks";
+      break;
+    default:
+      return ns3::GetMessageBytes (message, 0);
+  }
+
+  const rapidjson::Value &array = d[items];
+
+  //Only the blockTorrent messages and the block payloads have variable Bytes
+  if (message == EXT_INV || message == EXT_HEADERS || message == EXT_GET_DATA || message == CHUNK)
+  {
+    for (rapidjson::SizeType j = 0; j < array.Size(); j++)
+    {
+      if (!array[j]["fullBlock"].GetBool())
+        variableBytes += array[j]["availableChunks"].GetStringLength()/2;
+    }
+  }
 
-  // Stringify the DOM
-  rapidjson::StringBuffer packetInfo;
-  rapidjson::Writer<rapidjson::StringBuffer> writer(packetInfo);
-  d.Accept(writer);
-  
-  for (std::vector<Ipv4Address>::const_iterator i = m_peersAddresses.begin(); i != m_peersAddresses.end(); ++i)
+  if (message == BLOCK)
   {
-    if ( *i != newBlock.GetReceivedFromIpv4 () )
+    for (rapidjson::SizeType j = 0; j < array.Size(); j++)
+      variableBytes += array[j]["size"].GetInt();
+  }
+
+  if (message == CHUNK)
+  {
+    for (rapidjson::SizeType j = 0; j < array.Size(); j++)
     {
-      const uint8_t delimiter[] = "#";
+      int blockSize = array[j]["size"].GetInt();
+      int noChunks = ceil(blockSize / static_cast<double>(m_chunkSize));
 
-      m_peersSockets[*i]->Send (reinterpret_cast<const uint8_t*>(packetInfo.GetString()), packetInfo.GetSize(), 0);
-      m_peersSockets[*i]->Send (delimiter, 1, 0);
-	  
-      if (m_protocolType == STANDARD_PROTOCOL)
-      {
-        m_nodeStats->extInvSentBytes += m_bitcoinMessageHeader + m_countBytes + d["inv"].Size()*m_inventorySizeBytes;
-        for (int j=0; j<d["inv"].Size(); j++)
-        {
-          m_nodeStats->extInvSentBytes += 5; //1Byte(fullBlock) + 4Bytes(numberOfChunks)
-          if (!d["inv"][j]["fullBlock"].GetBool())
-            m_nodeStats->extInvSentBytes += d["inv"][j]["availableChunks"].Size();
-        }
-      }
-      else if (m_protocolType == SENDHEADERS)
-      {
-        m_nodeStats->extHeadersSentBytes += m_bitcoinMessageHeader + m_countBytes + d["blocks"].Size()*m_headersSizeBytes;
-        for (int j=0; j<d["blocks"].Size(); j++)
-        {
-          m_nodeStats->extHeadersSentBytes += 1;//fullBlock
-          if (!d["blocks"][j]["fullBlock"].GetBool())
-            m_nodeStats->extHeadersSentBytes += d["blocks"][j]["availableChunks"].Size()*1;
-        }	
-      } 
-	
-      NS_LOG_INFO ("AdvertiseFirstChunk: At time " << Simulator::Now ().GetSeconds ()
-                   << "s bitcoin node " << GetNode ()->GetId () << " advertised a new chunk: " 
-                   << newBlock << " to " << *i);
+      if (array[j]["chunk"] == noChunks - 1 && blockSize % m_chunkSize > 0)
+        variableBytes += blockSize % m_chunkSize;
+      else
+        variableBytes += m_chunkSize;
+
+      if (array[j]["requestChunks"].Size() > 0)
+        variableBytes += (array[j]["requestChunks"].Size() - 1)*CHUNK_ID_BYTES;
     }
   }
+
+  return ns3::GetMessageBytes (message, array.Size(), variableBytes);
 }
 
 
 void
-BitcoinNode::SendMessage(enum Messages receivedMessage,  enum Messages responseMessage, rapidjson::Document &d, Ptr<Socket> outgoingSocket)
+BitcoinNode::CountSentBytes (enum Messages message, long bytes)
 {
-  NS_LOG_FUNCTION (this);
-  
-  const uint8_t delimiter[] = "#";
-
-  rapidjson::StringBuffer buffer;
-  rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
-				
-  d["message"].SetInt(responseMessage);
-  d.Accept(writer);
-  NS_LOG_INFO ("Node " << GetNode ()->GetId () << " got a " 
-               << getMessageName(receivedMessage) << " message" 
-               << " and sent a " << getMessageName(responseMessage) 
-               << " message: " << buffer.GetString());
-
-  outgoingSocket->Send (reinterpret_cast<const uint8_t*>(buffer.GetString()), buffer.GetSize(), 0);
-  outgoingSocket->Send (delimiter, 1, 0);	
-
-  switch (d["message"].GetInt()) 
+  switch (message) 
   {
     case INV:
-    {
-      m_nodeStats->invSentBytes += m_bitcoinMessageHeader + m_countBytes + d["inv"].Size()*m_inventorySizeBytes;
+      m_nodeStats->invSentBytes += bytes;
       break;
-    }
     case EXT_INV:
-    {
-      m_nodeStats->extInvSentBytes += m_bitcoinMessageHeader + m_countBytes + d["inv"].Size()*m_inventorySizeBytes;
-      for (int j=0; j<d["inv"].Size(); j++)
-      {
-        m_nodeStats->extInvSentBytes += 5; //1Byte(fullBlock) + 4Bytes(numberOfChunks)
-        if (!d["inv"][j]["fullBlock"].GetBool())
-          m_nodeStats->extInvSentBytes += d["inv"][j]["availableChunks"].Size();
-      }
+      m_nodeStats->extInvSentBytes += bytes;
       break;
-    }
     case GET_HEADERS:
-    {
-      m_nodeStats->getHeadersSentBytes += m_bitcoinMessageHeader + m_getHeadersSizeBytes;
+      m_nodeStats->getHeadersSentBytes += bytes;
       break;
-    }
     case EXT_GET_HEADERS:
-    {
-      m_nodeStats->extGetHeadersSentBytes += m_bitcoinMessageHeader + m_getHeadersSizeBytes;
+      m_nodeStats->extGetHeadersSentBytes += bytes;
       break;
-    }
     case HEADERS:
-    {
-      m_nodeStats->headersSentBytes += m_bitcoinMessageHeader + m_countBytes + d["blocks"].Size()*m_headersSizeBytes;
+      m_nodeStats->headersSentBytes += bytes;
       break;
-    }
     case EXT_HEADERS:
-    {
-      m_nodeStats->extHeadersSentBytes += m_bitcoinMessageHeader + m_countBytes + d["blocks"].Size()*m_headersSizeBytes;
-      for (int j=0; j<d["blocks"].Size(); j++)
-      {
-        m_nodeStats->extHeadersSentBytes += 1;//fullBlock
-        if (!d["blocks"][j]["fullBlock"].GetBool())
-          m_nodeStats->extHeadersSentBytes += d["blocks"][j]["availableChunks"].Size()*1;
-      }
+      m_nodeStats->extHeadersSentBytes += bytes;
       break;
-    }
     case BLOCK:
-    {
-	  for(int k = 0; k < d["blocks"].Size(); k++)
-        m_nodeStats->blockSentBytes += d["blocks"][k]["size"].GetInt();
-      m_nodeStats->blockSentBytes += m_bitcoinMessageHeader;
+      m_nodeStats->blockSentBytes += bytes;
       break;
-    }
     case CHUNK:
-    {
-      for(int k = 0; k < d["chunks"].Size(); k++)
-      {
-        int noChunks = ceil(d["chunks"][k]["size"].GetInt() / static_cast<double>(m_chunkSize));
-        if (d["chunks"][k]["chunk"] == noChunks -1 && d["chunks"][k]["size"].GetInt() % m_chunkSize > 0)
-          m_nodeStats->chunkSentBytes += d["chunks"][k]["size"].GetInt() % m_chunkSize;
-        else
-          m_nodeStats->chunkSentBytes += m_chunkSize;
-	  
-        m_nodeStats->chunkSentBytes += 1 + 1;//the requested chunk + the fullBlock
-        if (!d["chunks"][k]["fullBlock"].GetBool())
-          m_nodeStats->chunkSentBytes += d["chunks"][k]["availableChunks"].Size();
-        if (d["chunks"][k]["requestChunks"].Size() > 0)
-          m_nodeStats->chunkSentBytes += d["chunks"][k]["requestChunks"].Size() - 1;	  
-      }
-      m_nodeStats->chunkSentBytes += m_bitcoinMessageHeader;
+      m_nodeStats->chunkSentBytes += bytes;
       break;
-    }
     case GET_DATA:
-    {
-      m_nodeStats->getDataSentBytes += m_bitcoinMessageHeader + m_countBytes + d["blocks"].Size()*m_inventorySizeBytes;
+      m_nodeStats->getDataSentBytes += bytes;
       break;
-    }
     case EXT_GET_DATA:
-    {
-      m_nodeStats->extGetDataSentBytes += m_bitcoinMessageHeader + m_countBytes + d["chunks"].Size()*m_inventorySizeBytes;
-      for (int j=0; j<d["chunks"].Size(); j++)
-      {
-        m_nodeStats->extGetDataSentBytes += 6; //1Byte(fullBlock) + 4Bytes(numberOfChunks) + 1Byte(requested chunk)
-        if (!d["chunks"][j]["fullBlock"].GetBool())
-          m_nodeStats->extGetDataSentBytes += d["chunks"][j]["availableChunks"].Size();
-      }
+      m_nodeStats->extGetDataSentBytes += bytes;
       break;
-    }
-  }  
+    default:
+      break;
+  }
 }
 
+
 void
-BitcoinNode::SendMessage(enum Messages receivedMessage,  enum Messages responseMessage, rapidjson::Document &d, Address &outgoingAddress)
+BitcoinNode::CountReceivedBytes (const rapidjson::Document &d)
 {
-  NS_LOG_FUNCTION (this);
-  
-  const uint8_t delimiter[] = "#";
-
-  rapidjson::StringBuffer buffer;
-  rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
-				
-  d["message"].SetInt(responseMessage);
-  d.Accept(writer);
-  NS_LOG_INFO ("Node " << GetNode ()->GetId () << " got a " 
-               << getMessageName(receivedMessage) << " message" 
-               << " and sent a " << getMessageName(responseMessage) 
-               << " message: " << buffer.GetString());
-			
-  Ipv4Address outgoingIpv4Address = InetSocketAddress::ConvertFrom(outgoingAddress).GetIpv4 ();
-  std::map<Ipv4Address, Ptr<Socket>>::iterator it = m_peersSockets.find(outgoingIpv4Address);
-  
-  if (it == m_peersSockets.end()) //Create the socket if it doesn't exist
-  {
-    m_peersSockets[outgoingIpv4Address] = Socket::CreateSocket (GetNode (), TcpSocketFactory::GetTypeId ());  
-    m_peersSockets[outgoingIpv4Address]->Connect (InetSocketAddress (outgoingIpv4Address, m_bitcoinPort));
-  }
-  
-  m_peersSockets[outgoingIpv4Address]->Send (reinterpret_cast<const uint8_t*>(buffer.GetString()), buffer.GetSize(), 0);
-  m_peersSockets[outgoingIpv4Address]->Send (delimiter, 1, 0);	
+  long bytes = GetMessageBytes (d);
 
   switch (d["message"].GetInt()) 
   {
     case INV:
-    {
-      m_nodeStats->invSentBytes += m_bitcoinMessageHeader + m_countBytes + d["inv"].Size()*m_inventorySizeBytes;
+      m_nodeStats->invReceivedBytes += bytes;
       break;
-    }
     case EXT_INV:
-    {
-      m_nodeStats->extInvSentBytes += m_bitcoinMessageHeader + m_countBytes + d["inv"].Size()*m_inventorySizeBytes;
-      for (int j=0; j<d["inv"].Size(); j++)
-      {
-        m_nodeStats->extInvSentBytes += 5; //1Byte(fullBlock) + 4Bytes(numberOfChunks)
-        if (!d["inv"][j]["fullBlock"].GetBool())
-          m_nodeStats->extInvSentBytes += d["inv"][j]["availableChunks"].Size();
-      }
+      m_nodeStats->extInvReceivedBytes += bytes;
       break;
-    }
     case GET_HEADERS:
-    {
-      m_nodeStats->getHeadersSentBytes += m_bitcoinMessageHeader + m_getHeadersSizeBytes;
+      m_nodeStats->getHeadersReceivedBytes += bytes;
       break;
-    }
     case EXT_GET_HEADERS:
-    {
-      m_nodeStats->extGetHeadersSentBytes += m_bitcoinMessageHeader + m_getHeadersSizeBytes;
+      m_nodeStats->extGetHeadersReceivedBytes += bytes;
       break;
-    }
     case HEADERS:
-    {
-      m_nodeStats->headersSentBytes += m_bitcoinMessageHeader + m_countBytes + d["blocks"].Size()*m_headersSizeBytes;
+      m_nodeStats->headersReceivedBytes += bytes;
       break;
-    }
     case EXT_HEADERS:
-    {
-      m_nodeStats->extHeadersSentBytes += m_bitcoinMessageHeader + m_countBytes + d["blocks"].Size()*m_headersSizeBytes;
-      for (int j=0; j<d["blocks"].Size(); j++)
-      {
-        m_nodeStats->extHeadersSentBytes += 1;//fullBlock
-        if (!d["blocks"][j]["fullBlock"].GetBool())
-          m_nodeStats->extHeadersSentBytes += d["blocks"][j]["availableChunks"].Size()*1;
-      }
+      m_nodeStats->extHeadersReceivedBytes += bytes;
       break;
-    }
     case BLOCK:
-    {
-	  for(int k = 0; k < d["blocks"].Size(); k++)
-        m_nodeStats->blockSentBytes += d["blocks"][k]["size"].GetInt();
-      m_nodeStats->blockSentBytes += m_bitcoinMessageHeader;
+      m_nodeStats->blockReceivedBytes += bytes;
       break;
-    }
     case CHUNK:
-    {
-      for(int k = 0; k < d["chunks"].Size(); k++)
-      {
-        int noChunks = ceil(d["chunks"][k]["size"].GetInt() / static_cast<double>(m_chunkSize));
-        if (d["chunks"][k]["chunk"] == noChunks -1 && d["chunks"][k]["size"].GetInt() % m_chunkSize > 0)
-          m_nodeStats->chunkSentBytes += d["chunks"][k]["size"].GetInt() % m_chunkSize;
-        else
-          m_nodeStats->chunkSentBytes += m_chunkSize;
-	  
-        m_nodeStats->chunkSentBytes += 1 + 1;//the requested chunk + the fullBlock
-        if (!d["chunks"][k]["fullBlock"].GetBool())
-          m_nodeStats->chunkSentBytes += d["chunks"][k]["availableChunks"].Size();
-        if (d["chunks"][k]["requestChunks"].Size() > 0)
-          m_nodeStats->chunkSentBytes += d["chunks"][k]["requestChunks"].Size() - 1;
-      }
-      m_nodeStats->chunkSentBytes += m_bitcoinMessageHeader;
+      m_nodeStats->chunkReceivedBytes += bytes;
       break;
-    }
     case GET_DATA:
-    {
-      m_nodeStats->getDataSentBytes += m_bitcoinMessageHeader + m_countBytes + d["blocks"].Size()*m_inventorySizeBytes;
+      m_nodeStats->getDataReceivedBytes += bytes;
       break;
-    }
     case EXT_GET_DATA:
-    {
-      m_nodeStats->extGetDataSentBytes += m_bitcoinMessageHeader + m_countBytes + d["chunks"].Size()*m_inventorySizeBytes;
-      for (int j=0; j<d["chunks"].Size(); j++)
-      {
-        m_nodeStats->extGetDataSentBytes += 6; //1Byte(fullBlock) + 4Bytes(numberOfChunks) + 1Byte(requested chunk)
-        if (!d["chunks"][j]["fullBlock"].GetBool())
-          m_nodeStats->extGetDataSentBytes += d["chunks"][j]["availableChunks"].Size();
-      }
+      m_nodeStats->extGetDataReceivedBytes += bytes;
       break;
-    }
-  } 
+  }
 }
 
 
 void
-BitcoinNode::SendMessage(enum Messages receivedMessage,  enum Messages responseMessage, std::string packet, Address &outgoingAddress)
+BitcoinNode::SendMessage(enum Messages receivedMessage,  enum Messages responseMessage, std::string packet, long messageBytes, Address &outgoingAddress)
 {
   NS_LOG_FUNCTION (this);
   
-  const uint8_t delimiter[] = "#";
-  rapidjson::Document d;
+  BitcoinJsonDocument d (m_jsonPool);
   
-  rapidjson::StringBuffer buffer;
+  rapidjson::StringBuffer &buffer = m_jsonPool.GetBuffer ();
   rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
 
   d.Parse(packet.c_str());  
@@ -3129,97 +3698,9 @@ BitcoinNode::SendMessage(enum Messages receivedMessage,  enum Messages responseM
     m_peersSockets[outgoingIpv4Address]->Connect (InetSocketAddress (outgoingIpv4Address, m_bitcoinPort));
   }
   
-  m_peersSockets[outgoingIpv4Address]->Send (reinterpret_cast<const uint8_t*>(buffer.GetString()), buffer.GetSize(), 0);
-  m_peersSockets[outgoingIpv4Address]->Send (delimiter, 1, 0);	
+  m_peersSockets[outgoingIpv4Address]->Send (CreateMessagePacket (buffer));
 
-  
-  switch (d["message"].GetInt()) 
-  {
-    case INV:
-    {
-      m_nodeStats->invSentBytes += m_bitcoinMessageHeader + m_countBytes + d["inv"].Size()*m_inventorySizeBytes;
-      break;
-    }
-    case EXT_INV:
-    {
-      m_nodeStats->extInvSentBytes += m_bitcoinMessageHeader + m_countBytes + d["inv"].Size()*m_inventorySizeBytes;
-      for (int j=0; j<d["inv"].Size(); j++)
-      {
-        m_nodeStats->extInvSentBytes += 5; //1Byte(fullBlock) + 4Bytes(numberOfChunks)
-        if (!d["inv"][j]["fullBlock"].GetBool())
-          m_nodeStats->extInvSentBytes += d["inv"][j]["availableChunks"].Size();
-      }
-      break;
-    }
-    case GET_HEADERS:
-    {
-      m_nodeStats->getHeadersSentBytes += m_bitcoinMessageHeader + m_getHeadersSizeBytes;
-      break;
-    }
-    case EXT_GET_HEADERS:
-    {
-      m_nodeStats->extGetHeadersSentBytes += m_bitcoinMessageHeader + m_getHeadersSizeBytes;
-      break;
-    }
-    case HEADERS:
-    {
-      m_nodeStats->headersSentBytes += m_bitcoinMessageHeader + m_countBytes + d["blocks"].Size()*m_headersSizeBytes;
-      break;
-    }
-    case EXT_HEADERS:
-    {
-      m_nodeStats->extHeadersSentBytes += m_bitcoinMessageHeader + m_countBytes + d["blocks"].Size()*m_headersSizeBytes;
-      for (int j=0; j<d["blocks"].Size(); j++)
-      {
-        m_nodeStats->extHeadersSentBytes += 1;//fullBlock
-        if (!d["blocks"][j]["fullBlock"].GetBool())
-          m_nodeStats->extHeadersSentBytes += d["blocks"][j]["availableChunks"].Size()*1;
-      }
-      break;
-    }
-    case BLOCK:
-    {
-	  for(int k = 0; k < d["blocks"].Size(); k++)
-        m_nodeStats->blockSentBytes += d["blocks"][k]["size"].GetInt();
-      m_nodeStats->blockSentBytes += m_bitcoinMessageHeader;
-      break;
-    }
-    case CHUNK:
-    {
-      for(int k = 0; k < d["chunks"].Size(); k++)
-      {
-        int noChunks = ceil(d["chunks"][k]["size"].GetInt() / static_cast<double>(m_chunkSize));
-        if (d["chunks"][k]["chunk"] == noChunks -1 && d["chunks"][k]["size"].GetInt() % m_chunkSize > 0)
-          m_nodeStats->chunkSentBytes += d["chunks"][k]["size"].GetInt() % m_chunkSize;
-        else
-          m_nodeStats->chunkSentBytes += m_chunkSize;
-	  
-        m_nodeStats->chunkSentBytes += 1 + 1;//the requested chunk + the fullBlock
-        if (!d["chunks"][k]["fullBlock"].GetBool())
-          m_nodeStats->chunkSentBytes += d["chunks"][k]["availableChunks"].Size();
-        if (d["chunks"][k]["requestChunks"].Size() > 0)
-          m_nodeStats->chunkSentBytes += d["chunks"][k]["requestChunks"].Size() - 1;
-      }
-      m_nodeStats->chunkSentBytes += m_bitcoinMessageHeader;
-      break;
-    }
-    case GET_DATA:
-    {
-      m_nodeStats->getDataSentBytes += m_bitcoinMessageHeader + m_countBytes + d["blocks"].Size()*m_inventorySizeBytes;
-      break;
-    }
-    case EXT_GET_DATA:
-    {
-      m_nodeStats->extGetDataSentBytes += m_bitcoinMessageHeader + m_countBytes + d["chunks"].Size()*m_inventorySizeBytes;
-      for (int j=0; j<d["chunks"].Size(); j++)
-      {
-        m_nodeStats->extGetDataSentBytes += 6; //1Byte(fullBlock) + 4Bytes(numberOfChunks) + 1Byte(requested chunk)
-        if (!d["chunks"][j]["fullBlock"].GetBool())
-          m_nodeStats->extGetDataSentBytes += d["chunks"][j]["availableChunks"].Size();
-      }
-      break;
-    }
-  } 
+  CountSentBytes (responseMessage, messageBytes);
 }
 
 
@@ -3284,10 +3765,12 @@ BitcoinNode::PrintQueueChunks()
   
   for(auto &elem : m_queueChunks)
   {
+    std::vector<int> chunks = elem.second.GetChunks();
+
     std::cout <<  elem.first << " = [";
-    for (auto chunk_it = elem.second.begin();  chunk_it < elem.second.end(); chunk_it++)
+    for (auto chunk_it = chunks.begin();  chunk_it < chunks.end(); chunk_it++)
     {
-      if(chunk_it == elem.second.begin())
+      if(chunk_it == chunks.begin())
         std::cout << *chunk_it;
       else
         std::cout << ", " << *chunk_it;
@@ -3307,10 +3790,12 @@ BitcoinNode::PrintReceivedChunks()
   
   for(auto &elem : m_receivedChunks)
   {
+    std::vector<int> chunks = elem.second.GetChunks();
+
     std::cout <<  elem.first << " = [";
-    for (auto chunk_it = elem.second.begin();  chunk_it < elem.second.end(); chunk_it++)
+    for (auto chunk_it = chunks.begin();  chunk_it < chunks.end(); chunk_it++)
     {
-      if(chunk_it == elem.second.begin())
+      if(chunk_it == chunks.begin())
         std::cout << *chunk_it;
       else
         std::cout << ", " << *chunk_it;
@@ -3362,6 +3847,7 @@ BitcoinNode::PrintOnlyHeadersReceived()
 void
 BitcoinNode::InvTimeoutExpired(std::string blockHash)
 {
+  BitcoinEventProfiler::Scope profile (INV_TIMEOUT_EXPIRED_EVENT);
   NS_LOG_FUNCTION (this);
 
   std::string   invDelimiter = "/";
@@ -3385,7 +3871,7 @@ BitcoinNode::InvTimeoutExpired(std::string blockHash)
   
   if (!m_queueInv[blockHash].empty() && !m_blockchain.HasBlock(height, minerId) && !m_blockchain.IsOrphan(height, minerId) && !ReceivedButNotValidated(blockHash))
   {
-    rapidjson::Document   d; 
+    BitcoinJsonDocument   d (m_jsonPool); 
     EventId               timeout;
     rapidjson::Value      value(INV);
     rapidjson::Value      array(rapidjson::kArrayType);
@@ -3406,8 +3892,8 @@ BitcoinNode::InvTimeoutExpired(std::string blockHash)
     m_queueInv[blockHash][0] = m_queueInv[blockHash][index];
     m_queueInv[blockHash][index] = temp;
     	
-    SendMessage(INV, GET_HEADERS, d, *(m_queueInv[blockHash].begin()));				
-    SendMessage(INV, GET_DATA, d, *(m_queueInv[blockHash].begin()));	
+    SendMessage(INV, GET_HEADERS, d, MessageBytes<GET_HEADERS> (0), *(m_queueInv[blockHash].begin()));				
+    SendMessage(INV, GET_DATA, d, MessageBytes<GET_DATA> (1), *(m_queueInv[blockHash].begin()));	
 					
     timeout = Simulator::Schedule (m_invTimeoutMinutes, &BitcoinNode::InvTimeoutExpired, this, blockHash);
     m_invTimeouts[blockHash] = timeout;
@@ -3421,8 +3907,9 @@ BitcoinNode::InvTimeoutExpired(std::string blockHash)
 
 
 void
-BitcoinNode::ChunkTimeoutExpired(std::string chunk)
+BitcoinNode::ChunkTimeoutExpired(std::string chunk, Ipv4Address peer)
 {
+  BitcoinEventProfiler::Scope profile (CHUNK_TIMEOUT_EXPIRED_EVENT);
   NS_LOG_FUNCTION (this);
 
   std::string            invDelimiter = "/";
@@ -3444,7 +3931,7 @@ BitcoinNode::ChunkTimeoutExpired(std::string chunk)
   blockHash = help.str();
   
   NS_LOG_WARN ("Node " << GetNode ()->GetId () << ": At time "  << Simulator::Now ().GetSeconds ()
-                << " the timeout for chunk " << chunk << " expired");
+                << " the timeout for chunk " << chunk << " requested from " << peer << " expired");
 				
   m_nodeStats->chunkTimeouts ++;
 
@@ -3452,8 +3939,15 @@ BitcoinNode::ChunkTimeoutExpired(std::string chunk)
   PrintQueueChunks();
   PrintQueueChunkPeers(); */
   
-  m_chunkTimeouts.erase(chunk);
-  m_queueChunks[blockHash].push_back(chunkId);
+  m_chunkTimeouts.erase(GetChunkTimeoutKey(chunk, peer));
+  m_chunkScheduler.RemoveInFlight(blockHash, chunkId, peer);
+
+  /**
+   * Request the chunk again, unless it is still in flight from another peer
+   */
+  auto it = m_chunkTimeouts.lower_bound(chunk + "/");
+  if (it == m_chunkTimeouts.end() || it->first.compare(0, chunk.size() + 1, chunk + "/") != 0)
+    m_queueChunks[blockHash].Set(chunkId);
   
 /*   PrintChunkTimeouts();
   PrintQueueChunks();
@@ -3507,16 +4001,106 @@ BitcoinNode::HasChunk (std::string blockHash, int chunk)
 {
   NS_LOG_FUNCTION (this);
 
-  if (std::find(m_receivedChunks[blockHash].begin(), m_receivedChunks[blockHash].end(), chunk) != m_receivedChunks[blockHash].end())
+  auto it = m_receivedChunks.find(blockHash);
+
+  if (it != m_receivedChunks.end() && it->second.Test(chunk))
     return true;
   else
     return false;
 }
 
 
+void
+BitcoinNode::AddPeerChunks (const std::string &blockHash, int blockSize, const rapidjson::Value &chunkInfo, const Address &from)
+{
+  NS_LOG_FUNCTION (this);
+
+  int         noChunks = ceil(blockSize/static_cast<double>(m_chunkSize));
+  ChunkBitmap availableChunks (noChunks);
+
+  if (chunkInfo["fullBlock"].GetBool())
+    availableChunks.SetAll();
+  else
+    availableChunks = ChunkBitmap::Unpack(chunkInfo["availableChunks"].GetString());
+
+  m_chunkScheduler.AddPeerChunks (blockHash, noChunks, InetSocketAddress::ConvertFrom(from).GetIpv4 (), availableChunks);
+}
+
+
+std::vector<int>
+BitcoinNode::PickChunks (const std::string &blockHash, const Address &from, int maxChunks)
+{
+  NS_LOG_FUNCTION (this);
+
+  return m_chunkScheduler.PickChunks (blockHash, InetSocketAddress::ConvertFrom(from).GetIpv4 (), 
+                                      m_queueChunks[blockHash], m_receivedChunks[blockHash], maxChunks);
+}
+
+
+int
+BitcoinNode::GetChunkBatchSize (const Address &from) const
+{
+  NS_LOG_FUNCTION (this);
+
+  //The chunks are received at the speed used in ReceivedChunkMessage
+  double minSpeed = std::min(m_downloadSpeed, GetPeerUploadSpeed (InetSocketAddress::ConvertFrom(from).GetIpv4 ()) * 1000000 / 8);
+  return m_chunkScheduler.GetBatchSize (minSpeed);
+}
+
+
+void
+BitcoinNode::ScheduleChunkTimeout (const std::string &chunk, const Address &from, int blockSize)
+{
+  NS_LOG_FUNCTION (this);
+
+  Ipv4Address  peer = InetSocketAddress::ConvertFrom(from).GetIpv4 ();
+  std::string  key = GetChunkTimeoutKey(chunk, peer);
+
+  if (m_chunkTimeouts.find(key) != m_chunkTimeouts.end())
+    return;
+
+  m_chunkTimeouts[key] = Simulator::Schedule (Minutes(m_invTimeoutMinutes.GetMinutes() / ceil(blockSize/static_cast<double>(m_chunkSize))),
+                                              &BitcoinNode::ChunkTimeoutExpired, this, chunk, peer);
+}
+
+
+void
+BitcoinNode::CancelChunkTimeouts (const std::string &chunk)
+{
+  NS_LOG_FUNCTION (this);
+
+  std::string prefix = chunk + "/";
+  auto        it = m_chunkTimeouts.lower_bound(prefix);
+
+  while (it != m_chunkTimeouts.end() && it->first.compare(0, prefix.size(), prefix) == 0)
+  {
+    BitcoinEventProfiler::Cancel (it->second, CHUNK_TIMEOUT_EXPIRED_EVENT);
+    it = m_chunkTimeouts.erase(it);
+  }
+}
+
+
+uint64_t
+BitcoinNode::GetTotalAnnouncements (void)
+{
+  return m_totalAnnouncements;
+}
+
+
+std::string
+BitcoinNode::GetChunkTimeoutKey (const std::string &chunk, Ipv4Address peer)
+{
+  std::ostringstream key;
+
+  key << chunk << "/" << peer;
+  return key.str();
+}
+
+
 void 
 BitcoinNode::RemoveSendTime ()
 {
+  BitcoinEventProfiler::Scope profile (REMOVE_SEND_TIME_EVENT);
   NS_LOG_FUNCTION (this);
 
   NS_LOG_INFO ("RemoveSendTime: At Time " << Simulator::Now ().GetSeconds () << " " << m_sendBlockTimes.front() << " was removed");
@@ -3527,6 +4111,7 @@ BitcoinNode::RemoveSendTime ()
 void 
 BitcoinNode::RemoveCompressedBlockSendTime ()
 {
+  BitcoinEventProfiler::Scope profile (REMOVE_COMPRESSED_BLOCK_SEND_TIME_EVENT);
   NS_LOG_FUNCTION (this);
 
   NS_LOG_INFO ("RemoveCompressedBlockSendTime: At Time " << Simulator::Now ().GetSeconds () << " " << m_sendCompressedBlockTimes.front() << " was removed");
@@ -3537,6 +4122,7 @@ BitcoinNode::RemoveCompressedBlockSendTime ()
 void 
 BitcoinNode::RemoveReceiveTime ()
 {
+  BitcoinEventProfiler::Scope profile (REMOVE_RECEIVE_TIME_EVENT);
   NS_LOG_FUNCTION (this);
 
   NS_LOG_INFO ("RemoveReceiveTime: At Time " << Simulator::Now ().GetSeconds () << " " << m_receiveBlockTimes.front() << " was removed");
@@ -3547,6 +4133,7 @@ BitcoinNode::RemoveReceiveTime ()
 void 
 BitcoinNode::RemoveCompressedBlockReceiveTime ()
 {
+  BitcoinEventProfiler::Scope profile (REMOVE_COMPRESSED_BLOCK_RECEIVE_TIME_EVENT);
   NS_LOG_FUNCTION (this);
 
   NS_LOG_INFO ("RemoveCompressedBlockReceiveTime: At Time " << Simulator::Now ().GetSeconds () << " " << m_receiveCompressedBlockTimes.front() << " was removed");
@@ -3554,6 +4141,26 @@ BitcoinNode::RemoveCompressedBlockReceiveTime ()
 }
 
 
+double 
+BitcoinNode::GetPeerDownloadSpeed (Ipv4Address peer) const
+{
+  const std::map<Ipv4Address, double> &speeds = m_sharedPeersDownloadSpeeds ? *m_sharedPeersDownloadSpeeds : m_peersDownloadSpeeds;
+  auto it = speeds.find (peer);
+  
+  return it != speeds.end () ? it->second : 0;
+}
+
+
+double 
+BitcoinNode::GetPeerUploadSpeed (Ipv4Address peer) const
+{
+  const std::map<Ipv4Address, double> &speeds = m_sharedPeersUploadSpeeds ? *m_sharedPeersUploadSpeeds : m_peersUploadSpeeds;
+  auto it = speeds.find (peer);
+  
+  return it != speeds.end () ? it->second : 0;
+}
+
+
 void 
 BitcoinNode::HandlePeerClose (Ptr<Socket> socket)
 {
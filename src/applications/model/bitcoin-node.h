@@ -6,16 +6,25 @@
 #define BITCOIN_NODE_H
 
 #include <algorithm>
+#include <type_traits>
 #include "ns3/application.h"
 #include "ns3/event-id.h"
 #include "ns3/ptr.h"
 #include "ns3/traced-callback.h"
 #include "ns3/address.h"
 #include "bitcoin.h"
+#include "bitcoin-event-profiler.h"
+#include "bitcoin-chunk-scheduler.h"
+#include "bitcoin-receive-buffer.h"
+#include "bitcoin-known-inventory.h"
+#include "bitcoin-quantile-sketch.h"
+#include "bitcoin-json-pool.h"
+#include "bitcoin-message-size.h"
 #include "ns3/boolean.h"
 #include "../../rapidjson/document.h"
 #include "../../rapidjson/writer.h"
 #include "../../rapidjson/stringbuffer.h"
+#include "ns3/simple-ref-count.h"
 
 namespace ns3 {
 
@@ -24,6 +33,36 @@ class Socket;
 class Packet;
 
  
+/**
+ * A received message parsed once in HandleRead. It is shared by reference count with the events
+ * which handle it after the transmission delay (ReceivedBlockMessage, ReceivedChunkMessage),
+ * so neither the message is parsed again nor its payload copied.
+ */
+class BitcoinMessage : public SimpleRefCount<BitcoinMessage>
+{
+public:
+  BitcoinMessage (void);
+
+  virtual ~BitcoinMessage (void);
+
+  /**
+   * \brief Take the contents of d, leaving d empty. The message also takes the arena of d,
+   * since the values it takes live there.
+   */
+  void Take (BitcoinJsonDocument &d);
+
+  rapidjson::Document& GetDocument (void);
+
+  std::string ToString (void) const;
+
+private:
+  BitcoinMessage (const BitcoinMessage &);
+  BitcoinMessage& operator= (const BitcoinMessage &);
+
+  rapidjson::Document   m_document;
+  BitcoinJsonArena     *m_arena;              //!< The arena the values of m_document are allocated from
+};
+
 class BitcoinNode : public Application 
 {
 public:
@@ -37,6 +76,12 @@ public:
 
   virtual ~BitcoinNode (void);
 
+  /**
+   * \return the number of messages sent by all the nodes to announce the blocks they validated (INV, HEADERS,
+   * EXT_INV, EXT_HEADERS). With TrickleInterval, a message announcing several blocks is counted once.
+   */
+  static uint64_t GetTotalAnnouncements (void);
+
   /**
    * \return pointer to listening socket
    */
@@ -47,6 +92,49 @@ public:
    * \return a vector containing the addresses of peers
    */  
   std::vector<Ipv4Address> GetPeersAddresses (void) const;
+
+  /**
+   * \return true if the node is also a miner
+   */  
+  bool IsMiner (void) const;
+
+  /**
+   * \brief Get the approximate memory usage of the node's containers
+   * \return a vector indexed by BitcoinNodeContainer
+   */  
+  std::vector<containerUsage> GetMemoryUsage (void) const;
+
+  /**
+   * \return the sketch of the intervals between the receptions of two consecutive blocks (see meanBlockReceiveTime)
+   */
+  const BitcoinQuantileSketch& GetBlockReceiveTimeSketch (void) const;
+
+  /**
+   * \return the sketch of the propagation times of the received blocks (see meanBlockPropagationTime)
+   */
+  const BitcoinQuantileSketch& GetBlockPropagationTimeSketch (void) const;
+
+  /**
+   * \return the sketch of the sizes of the received blocks (see meanBlockSize)
+   */
+  const BitcoinQuantileSketch& GetBlockSizeSketch (void) const;
+
+  /**
+   * \return the largest number of Bytes held by the receive buffer of any connection
+   */
+  uint32_t GetReceiveBufferHighWaterMark (void) const;
+
+  /**
+   * \return the struct the node stats are collected to, or 0 if it has not been set
+   */
+  const nodeStatistics* GetNodeStats (void) const;
+
+  /**
+   * \brief Copy the mean block times and the blockchain counters (total and stale blocks, forks) to the
+   * node stats, which is otherwise only done when the application stops. The byte and timeout counters
+   * are always up to date.
+   */
+  void UpdateNodeStats (void);
   
   
   /**
@@ -66,6 +154,15 @@ public:
    * \param peersUploadSpeeds the reference of a map containing the Ipv4 addresses of peers and their corresponding upload speed
   */
   void SetPeersUploadSpeeds (const std::map<Ipv4Address, double> &peersUploadSpeeds);
+
+  /**
+   * \brief Use the download and upload speeds of peers kept by the topology instead of a private copy.
+   * The maps are not copied, so they must outlive the application.
+   * \param peersDownloadSpeeds a pointer to a map containing the Ipv4 addresses of peers and their corresponding download speed
+   * \param peersUploadSpeeds a pointer to a map containing the Ipv4 addresses of peers and their corresponding upload speed
+   */
+  void SetSharedPeersSpeeds (const std::map<Ipv4Address, double> *peersDownloadSpeeds, 
+                             const std::map<Ipv4Address, double> *peersUploadSpeeds);
   
   /**
    * \brief Set the internet speeds of the node
@@ -85,17 +182,81 @@ public:
    */
   void SetProtocolType (enum ProtocolType protocolType);
 
+  /**
+   * \brief Set the seed of the node's random number generators (default: 0, seeded from the clock)
+   * The generators are seeded with seed + nodeId when the application starts.
+   */
+  void SetSeed (uint32_t seed);
+
+  /**
+   * \brief Write the state of the node to a checkpoint (see BitcoinCheckpoint)
+   * \param state an empty json object, which is filled with the state of the node
+   * \param allocator the allocator of the checkpoint document
+   */
+  virtual void SaveCheckpoint (rapidjson::Value &state, rapidjson::Document::AllocatorType &allocator) const;
+
+  /**
+   * \brief Set the state the node restores when the application starts, instead of starting from the genesis block
+   * \param state the json object written by SaveCheckpoint, stringified
+   */
+  void SetCheckpoint (const std::string &state);
+
 protected:
   virtual void DoDispose (void);           // inherited from Application base class.
 
   virtual void StartApplication (void);    // Called at time specified by Start
   virtual void StopApplication (void);     // Called at time specified by Stop
 
+  /**
+   * \brief Seed the random number generators from m_seed, or from the clock if it is 0. Called at the beginning
+   * of StartApplication, so the subclasses which override StartApplication are seeded as well.
+   */
+  virtual void SeedGenerators (void);
+
+  /**
+   * \brief Restore the state set by SetCheckpoint. Called at the end of StartApplication.
+   * The validation of the blocks which had been received but not validated starts again.
+   */
+  void RestoreCheckpoint (void);
+
   /**
    * \brief Handle a packet received by the application
    * \param socket the receiving socket
    */
   void HandleRead (Ptr<Socket> socket);
+
+  /**
+   * \brief Handle a parsed message with the handlers of a protocol mode. The blockTorrent messages
+   * (EXT_* and CHUNK) are passed to HandleTorrentMessage. The standard messages are handled in
+   * every mode, because the miners send INV, HEADERS and unsolicited BLOCK messages to blockTorrent nodes too.
+   * \param d the parsed message
+   * \param from the address the message was received from
+   */
+  template <class Policy>
+  void HandleMessage (BitcoinJsonDocument &d, Address &from);
+
+  /**
+   * \brief Handle a blockTorrent message (EXT_* and CHUNK). The handlers are instantiated only for
+   * the policies with blockTorrent, the std::false_type overload aborts the simulation.
+   * \param d the parsed message
+   * \param from the address the message was received from
+   */
+  template <class Policy>
+  void HandleTorrentMessage (BitcoinJsonDocument &d, Address &from, std::true_type);
+  template <class Policy>
+  void HandleTorrentMessage (BitcoinJsonDocument &d, Address &from, std::false_type);
+
+  /**
+   * \brief Select the HandleMessage and Advertise functions of the protocol mode given by 
+   * m_protocolType, m_blockTorrent and m_spv. Called when the application starts.
+   */
+  virtual void SelectProtocolPolicy (void);
+
+  /**
+   * \brief Use the HandleMessage and Advertise functions compiled for Policy
+   */
+  template <class Policy>
+  void UseProtocolPolicy (void);
   
   /**
    * \brief Handle an incoming connection
@@ -118,17 +279,18 @@ protected:
 
   /**
    * \brief Handle an incoming BLOCK Message.
-   * \param blockInfo the block message info 
+   * \param blockInfo the parsed block message
    * \param from the address the connection is from
    */
-  void ReceivedBlockMessage(std::string &blockInfo, Address &from);	
+  void ReceivedBlockMessage(Ptr<BitcoinMessage> blockInfo, Address &from);	
 
   /**
    * \brief Handle an incoming CHUNK Message.
-   * \param chunkInfo the chunk message info 
+   * \param chunkInfo the parsed chunk message
    * \param from the address the connection is from
    */
-  void ReceivedChunkMessage(std::string &chunkInfo, Address &from);		
+  template <class Policy>
+  void ReceivedChunkMessage(Ptr<BitcoinMessage> chunkInfo, Address &from);		
 
   /**
    * \brief Called when a new block non-orphan block is received
@@ -145,16 +307,18 @@ protected:
   /**
    * \brief Sends a BLOCK message as a response to a GET_DATA message
    * \param packetInfo the info of the BLOCK message
+   * \param messageBytes the Bytes of the BLOCK message, counted when it is sent
    * \param from the address the GET_DATA was received from
    */
-  void SendBlock(std::string packetInfo, Address &from);
+  void SendBlock(std::string packetInfo, long messageBytes, Address &from);
 
   /**
    * \brief Sends a CHUNK message as a response to a EXT_GET_DATA/CHUNK message
    * \param packetInfo the info of the CHUNK message
+   * \param messageBytes the Bytes of the CHUNK message, counted when it is sent
    * \param from the address the EXT_GET_DATA/CHUNK was received from
    */
-  void SendChunk(std::string packetInfo, Address &from);				   
+  void SendChunk(std::string packetInfo, long messageBytes, Address &from);				   
 
   /**
    * \brief Called for blocks with higher score(height)
@@ -173,6 +337,11 @@ protected:
    * \param newBlock the new block
    */
   void AfterBlockValidation(const Block &newBlock);
+
+  /**
+   * \brief Adds a block to the quantile sketches, alongside the means it is averaged in
+   */
+  void AddToSketches (double receiveInterval, double propagationTime, double blockSize);
   
   /**
    * \brief Validates any ophan children of the newly received block
@@ -180,50 +349,158 @@ protected:
    */
   void ValidateOrphanChildren(const Block &newBlock);
 
+  /**
+   * \brief Advertises the newly validated block with AdvertiseNewBlock or AdvertiseFullBlock
+   * \param newBlock the new block
+   */
+  template <class Policy>
+  void AdvertiseBlock (const Block &newBlock);
+
   /**
    * \brief Advertises the newly validated block
    * \param newBlock the new block
    */
+  template <class Policy>
   void AdvertiseNewBlock (const Block &newBlock);
+
+  /**
+   * \brief Queues the announcement of a block for every peer which is not known to have it. When the queue
+   * of a peer was empty, its timer is started with an exponentially distributed delay of mean TrickleInterval.
+   * The SPV announcements of the first chunk (AdvertiseFirstChunk) are not queued.
+   * \param newBlock the new block
+   * \param exceptPeer the peer the block is not announced to
+   */
+  template <class Policy>
+  void QueueAnnouncement (const Block &newBlock, Ipv4Address exceptPeer);
+
+  /**
+   * \brief Builds the message announcing blocks: INV or HEADERS, or EXT_INV or EXT_HEADERS of
+   * full blocks when blockTorrent is used
+   * \param d the document of the message
+   * \param blocks the announced blocks
+   * \return the Bytes of the message, which is of type Policy::announcement
+   */
+  template <class Policy>
+  long BuildAnnouncement (rapidjson::Document &d, const std::vector<Block> &blocks);
+
+  /**
+   * \brief Sends the announcements queued for a peer in one message, when its timer expires
+   * \param peer the peer
+   */
+  template <class Policy>
+  void SendAnnouncements (Ipv4Address peer);
   
   /**
    * \brief Advertises the newly validated block when blockTorrent is used
    * \param newBlock the new block
    */
+  template <class Policy>
   void AdvertiseFullBlock (const Block &newBlock);
   
   /**
    * \brief Advertises the newly validated block when blockTorrent and spv are used
    * \param newBlock the new block
    */
+  template <class Policy>
   void AdvertiseFirstChunk (const Block &newBlock);
 
+  /**
+   * \brief Sends a HEADERS message with the headers of the requested blocks that the node knows
+   * \param receivedMessage the type of the request, GET_HEADERS or a GET_DATA which also requests the headers
+   * \param request the request, whose "blocks" contains the hashes of the blocks
+   * \param from the address the request was received from
+   */
+  void SendHeaders (enum Messages receivedMessage, const rapidjson::Document &request, Address &from);
+
   /**
    * \brief Sends a message to a peer
    * \param receivedMessage the type of the received message
    * \param responseMessage the type of the response message
    * \param d the rapidjson document containing the info of the outgoing message
+   * \param messageBytes the Bytes of the outgoing message, usually calculated with MessageBytes by the caller
    * \param outgoingSocket the socket of the peer
    */
-  void SendMessage(enum Messages receivedMessage,  enum Messages responseMessage, rapidjson::Document &d, Ptr<Socket> outgoingSocket);
+  void SendMessage(enum Messages receivedMessage,  enum Messages responseMessage, rapidjson::Document &d, long messageBytes, Ptr<Socket> outgoingSocket);
   
   /**
    * \brief Sends a message to a peer
    * \param receivedMessage the type of the received message
    * \param responseMessage the type of the response message
    * \param d the rapidjson document containing the info of the outgoing message
+   * \param messageBytes the Bytes of the outgoing message, usually calculated with MessageBytes by the caller
    * \param outgoingAddress the Address of the peer
    */
-  void SendMessage(enum Messages receivedMessage,  enum Messages responseMessage, rapidjson::Document &d, Address &outgoingAddress);
+  void SendMessage(enum Messages receivedMessage,  enum Messages responseMessage, rapidjson::Document &d, long messageBytes, Address &outgoingAddress);
   
   /**
    * \brief Sends a message to a peer
    * \param receivedMessage the type of the received message
    * \param responseMessage the type of the response message
    * \param packet a string containing the info of the outgoing message
+   * \param messageBytes the Bytes of the outgoing message, usually calculated with MessageBytes by the caller
    * \param outgoingAddress the Address of the peer
    */
-  void SendMessage(enum Messages receivedMessage,  enum Messages responseMessage, std::string packet, Address &outgoingAddress);
+  void SendMessage(enum Messages receivedMessage,  enum Messages responseMessage, std::string packet, long messageBytes, Address &outgoingAddress);
+
+  /**
+   * \brief Copies a stringified message, followed by the delimiter, into a packet
+   * \param message the stringified message
+   * \return the packet, which can be sent to many peers with BroadcastMessage
+   */
+  Ptr<Packet> CreateMessagePacket (const rapidjson::StringBuffer &message) const;
+
+  /**
+   * \brief Sends a message to all the peers. Each socket gets a copy-on-write copy of the packet,
+   * so the message is serialized once and its payload is shared by all the peers.
+   * \param message the packet created by CreateMessagePacket
+   * \param exceptPeer the peer the message is not sent to, e.g. the one the block was received from
+   * \return the number of peers the message was sent to
+   */
+  int BroadcastMessage (Ptr<const Packet> message, Ipv4Address exceptPeer = Ipv4Address ());
+
+  /**
+   * \brief Sends the announcement of a block to the peers which are not known to have it, and records
+   * that they now know it
+   * \param message the packet created by CreateMessagePacket
+   * \param block the announced block
+   * \param exceptPeer the peer the message is not sent to, e.g. the one the block was received from
+   * \return the number of peers the message was sent to
+   */
+  int BroadcastAnnouncement (Ptr<const Packet> message, const Block &block, Ipv4Address exceptPeer = Ipv4Address ());
+
+  /**
+   * \brief Records that a peer has a block, so that the block is not announced to it
+   * \param peer the address of the peer
+   * \param height the height of the block
+   * \param minerId the minerId of the block
+   */
+  void AddKnownBlock (Ipv4Address peer, int height, int minerId);
+
+  /**
+   * \brief Checks if a peer is known to have a block
+   */
+  bool IsKnownBlock (Ipv4Address peer, int height, int minerId) const;
+
+  /**
+   * \brief Calculates the Bytes a received message takes in the bitcoin protocol, from the MessageSizeTraits of its
+   * type. It walks the items of the message, so the senders pass the Bytes they already know to CountSentBytes instead.
+   * \param d the rapidjson document containing the info of the message
+   */
+  long GetMessageBytes (const rapidjson::Document &d) const;
+
+  /**
+   * \brief Adds Bytes, usually calculated with MessageBytes, to the sent Bytes of a message type
+   * \param message the type of the sent messages
+   * \param bytes the Bytes of all the sent messages
+   */
+  void CountSentBytes (enum Messages message, long bytes);
+
+  /**
+   * \brief Adds the Bytes of a received message to the nodeStatistics of its type. The Bytes are
+   * calculated as for the sent messages, so the sent and received Bytes agree.
+   * \param d the rapidjson document containing the info of the message
+   */
+  void CountReceivedBytes (const rapidjson::Document &d);
 
   /**
    * \brief Print m_queueInv to stdout
@@ -267,10 +544,11 @@ protected:
   void InvTimeoutExpired (std::string blockHash);
   
   /**
-   * \brief Called when a timeout for a chunk expires
-   * \param blockHash the chunk hash for which the timeout expired
+   * \brief Called when the timeout of a chunk request to a peer expires
+   * \param chunk the chunk hash for which the timeout expired
+   * \param peer the peer the chunk was requested from
    */
-  void ChunkTimeoutExpired (std::string chunk);
+  void ChunkTimeoutExpired (std::string chunk, Ipv4Address peer);
 
   /**
    * \brief Checks if a block has been received but not been validated yet (if it is included in m_receivedNotValidated)
@@ -299,6 +577,50 @@ protected:
    */
   bool HasChunk (std::string blockHash, int chunk);
 
+  /**
+   * \brief Adds the chunks advertised by a peer in a message entry to the chunk scheduler
+   * \param blockHash the block hash
+   * \param blockSize the block size in Bytes
+   * \param chunkInfo the message entry holding fullBlock and availableChunks
+   * \param from the address of the peer
+   */
+  void AddPeerChunks (const std::string &blockHash, int blockSize, const rapidjson::Value &chunkInfo, const Address &from);
+
+  /**
+   * \brief Picks the chunks of a block which will be requested from a peer and removes them from m_queueChunks
+   * \param blockHash the block hash
+   * \param from the address of the peer
+   * \param maxChunks the maximum number of chunks to pick
+   * \return the picked chunks
+   */
+  std::vector<int> PickChunks (const std::string &blockHash, const Address &from, int maxChunks);
+
+  /**
+   * \brief Gets the number of chunks which should be requested at once from a peer
+   * \param from the address of the peer
+   */
+  int GetChunkBatchSize (const Address &from) const;
+
+  /**
+   * \brief Schedules the timeout of a chunk request to a peer. Every peer a chunk is requested from (e.g. in the
+   * endgame) has its own timeout, keyed by GetChunkTimeoutKey
+   * \param chunk the chunk hash
+   * \param from the address of the peer
+   * \param blockSize the block size in Bytes
+   */
+  void ScheduleChunkTimeout (const std::string &chunk, const Address &from, int blockSize);
+
+  /**
+   * \brief Cancels the timeouts of the requests of a chunk to all the peers, when the chunk is received
+   * \param chunk the chunk hash
+   */
+  void CancelChunkTimeouts (const std::string &chunk);
+
+  /**
+   * \return the key of m_chunkTimeouts of the request of a chunk to a peer, i.e. chunk_hash/peer
+   */
+  static std::string GetChunkTimeoutKey (const std::string &chunk, Ipv4Address peer);
+
   /**
    * \brief Removes the fist element from m_sendBlockTimes, when a block is sent
    */
@@ -319,6 +641,20 @@ protected:
    */
   void RemoveCompressedBlockReceiveTime ();
 
+  /**
+   * \brief Gets the download speed of a peer
+   * \param peer the Ipv4 address of the peer
+   * \return the download speed of the peer in Mbps, 0 if the peer is unknown
+   */
+  double GetPeerDownloadSpeed (Ipv4Address peer) const;
+
+  /**
+   * \brief Gets the upload speed of a peer
+   * \param peer the Ipv4 address of the peer
+   * \return the upload speed of the peer in Mbps, 0 if the peer is unknown
+   */
+  double GetPeerUploadSpeed (Ipv4Address peer) const;
+
   // In the case of TCP, each socket accept returns a new socket, so the 
   // listening socket is stored separately from the accepted sockets
   Ptr<Socket>     m_socket;                           //!< Listening socket
@@ -329,7 +665,12 @@ protected:
   double		  m_previousBlockReceiveTime;         //!< The time that the node received the previous block
   double		  m_meanBlockPropagationTime;         //!< The mean time that the node has to wait in order to receive a newly mined block
   double		  m_meanBlockSize;                    //!< The mean block size
+  double          m_sketchRelativeAccuracy;           //!< The relative accuracy of the quantile sketches, 0 if they are not kept
+  BitcoinQuantileSketch m_blockReceiveTimeSketch;     //!< The quantiles of the intervals averaged by m_meanBlockReceiveTime
+  BitcoinQuantileSketch m_blockPropagationTimeSketch; //!< The quantiles of the times averaged by m_meanBlockPropagationTime
+  BitcoinQuantileSketch m_blockSizeSketch;            //!< The quantiles of the sizes averaged by m_meanBlockSize
   Blockchain 	  m_blockchain;                       //!< The node's blockchain
+  uint32_t        m_finalityDepth;                    //!< The finality depth of m_blockchain, 0 if it is not pruned
   Time            m_invTimeoutMinutes;                //!< The block timeout in minutes
   bool            m_isMiner;                          //!< True if the node is also a miner, False otherwise
   double          m_downloadSpeed;                    //!< The download speed of the node in Bytes/s
@@ -339,18 +680,35 @@ protected:
   bool            m_blockTorrent;                     //!< True if the blockTorrent mechanism is used, False otherwise
   uint32_t        m_chunkSize;                        //!< The size of the chunk in Bytes, when blockTorrent is used
   bool            m_spv;                              //!< Simplified Payment Verification. Used only in conjuction with blockTorrent
+  uint32_t        m_receiveBufferSize;                //!< The initial size of the receive buffer of each connection in Bytes
+  bool            m_rarestFirst;                      //!< True if the chunks are requested rarest-first, False otherwise. Used only in conjuction with blockTorrent
+  uint32_t        m_maxChunksInFlight;                //!< The maximum number of chunks in flight per peer, in the rarest-first mode
+  Time            m_chunkBatchTime;                   //!< The time a batch of chunk requests should keep the link to a peer busy, in the rarest-first mode
+  uint32_t        m_endgameChunks;                    //!< The number of missing chunks below which the endgame starts, in the rarest-first mode
+  BitcoinChunkScheduler m_chunkScheduler;             //!< Picks the chunks requested from each peer
+  bool            m_jsonPoolEnabled;                  //!< True if the arenas of the json documents are reused, False otherwise
+  uint32_t        m_jsonArenaSize;                    //!< The preallocated size of each json arena in Bytes
+  BitcoinJsonPool m_jsonPool;                         //!< The arenas and output buffers of the json messages
+  Time            m_trickleInterval;                  //!< The interval of the queued announcements, 0 if they are sent immediately
+  bool            m_mergeGetData;                     //!< True if INV is answered with a single GET_DATA which also requests the headers, False otherwise
+  uint32_t        m_knownInventorySize;               //!< The number of blocks remembered per peer to filter the announcements, 0 if they are not filtered
   
   std::vector<Ipv4Address>                            m_peersAddresses;                 //!< The addresses of peers
   std::map<Ipv4Address, double>                       m_peersDownloadSpeeds;            //!< The peersDownloadSpeeds of channels
   std::map<Ipv4Address, double>                       m_peersUploadSpeeds;              //!< The peersUploadSpeeds of channels
+  const std::map<Ipv4Address, double>                *m_sharedPeersDownloadSpeeds;      //!< The peersDownloadSpeeds kept by the topology, used instead of m_peersDownloadSpeeds when set
+  const std::map<Ipv4Address, double>                *m_sharedPeersUploadSpeeds;        //!< The peersUploadSpeeds kept by the topology, used instead of m_peersUploadSpeeds when set
   std::map<Ipv4Address, Ptr<Socket>>                  m_peersSockets;                   //!< The sockets of peers
   std::map<std::string, std::vector<Address>>         m_queueInv;                       //!< map holding the addresses of nodes which sent an INV for a particular block
   std::map<std::string, std::vector<Address>>         m_queueChunkPeers;                //!< map holding the addresses of nodes from which we are waiting for a CHUNK, key = block_hash
-  std::map<std::string, std::vector<int>>             m_queueChunks;                    //!< map holding the chunks of the blocks which we have not requested yet, key = block_hash
-  std::map<std::string, std::vector<int>>             m_receivedChunks;                 //!< map holding the chunks of the blocks which we are currently downloading, key = block_hash
+  std::map<std::string, ChunkBitmap>                  m_queueChunks;                    //!< map holding the chunks of the blocks which we have not requested yet, key = block_hash
+  std::map<std::string, ChunkBitmap>                  m_receivedChunks;                 //!< map holding the chunks of the blocks which we are currently downloading, key = block_hash
   std::map<std::string, EventId>                      m_invTimeouts;                    //!< map holding the event timeouts of inv messages
-  std::map<std::string, EventId>                      m_chunkTimeouts;                  //!< map holding the event timeouts of chunk messages
-  std::map<Address, std::string>                      m_bufferedData;                   //!< map holding the buffered data from previous handleRead events
+  std::map<std::string, EventId>                      m_chunkTimeouts;                  //!< map holding the event timeouts of chunk messages, key = chunk_hash/peer
+  std::map<Ipv4Address, std::vector<Block>>          m_pendingAnnouncements;           //!< map holding the blocks waiting to be announced to each peer
+  std::map<Ipv4Address, EventId>                      m_trickleEvents;                  //!< map holding the events sending the queued announcements of each peer
+  std::map<Ipv4Address, BitcoinKnownInventory>       m_knownInventory;                 //!< map holding the blocks each peer is known to have
+  std::map<Address, BitcoinReceiveBuffer>             m_bufferedData;                   //!< map holding the receive buffer of each connection with the data from previous handleRead events
   std::map<std::string, Block>                        m_receivedNotValidated;           //!< vector holding the received but not yet validated blocks
   std::map<std::string, Block>                        m_onlyHeadersReceived;            //!< vector holding the blocks that we know but not received
   nodeStatistics                                     *m_nodeStats;                      //!< struct holding the node stats
@@ -359,6 +717,10 @@ protected:
   std::vector<double>                                 m_receiveBlockTimes;              //!< contains the times of the next sendBlock events
   std::vector<double>                                 m_receiveCompressedBlockTimes;    //!< contains the times of the next sendBlock events
   enum ProtocolType                                   m_protocolType;                   //!< protocol type
+  void (BitcoinNode::*m_handleMessage) (BitcoinJsonDocument &d, Address &from);        //!< The HandleMessage of the protocol mode
+  void (BitcoinNode::*m_advertiseBlock) (const Block &newBlock);                       //!< The AdvertiseBlock of the protocol mode
+  uint32_t                                            m_seed;                           //!< The seed of the random number generators, 0 if not fixed
+  std::string                                         m_checkpoint;                     //!< The state restored when the application starts, empty if it starts from the genesis block
 
   const int       m_bitcoinPort;               //!< 8333
   const int       m_secondsPerMin;             //!< 60
@@ -368,6 +730,8 @@ protected:
   const int       m_getHeadersSizeBytes;       //!< The size of the GET_HEADERS message, 72 Bytes
   const int       m_headersSizeBytes;          //!< 81 Bytes
   const int       m_blockHeadersSizeBytes;     //!< 81 Bytes
+
+  static uint64_t m_totalAnnouncements;        //!< The announcements sent by all the nodes
   
   /// Traced Callback: received packets, source address.
   TracedCallback<Ptr<const Packet>, const Address &> m_rxTrace;
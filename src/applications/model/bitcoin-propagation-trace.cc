@@ -0,0 +1,115 @@
+/**
+ * This file contains the definitions of the functions declared in bitcoin-propagation-trace.h
+ */
+
+
+#include <cstring>
+#include "ns3/simulator.h"
+#include "ns3/log.h"
+#include "bitcoin-propagation-trace.h"
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("BitcoinPropagationTrace");
+
+bool                             BitcoinPropagationTrace::m_enabled = false;
+std::ofstream                    BitcoinPropagationTrace::m_file;
+std::vector<propagationRecord>   BitcoinPropagationTrace::m_buffer;
+uint32_t                         BitcoinPropagationTrace::m_bufferRecords = 0;
+uint64_t                         BitcoinPropagationTrace::m_totalRecords = 0;
+
+
+void
+BitcoinPropagationTrace::Open (std::string fileName, uint32_t systemId, uint32_t bufferRecords)
+{
+  NS_LOG_FUNCTION_NOARGS ();
+
+  if (m_enabled)
+    Close ();
+
+  m_file.open (fileName.c_str (), std::ios::out | std::ios::trunc | std::ios::binary);
+  if (!m_file.is_open ())
+    NS_FATAL_ERROR ("BitcoinPropagationTrace: cannot open " << fileName);
+
+  propagationTraceHeader header;
+
+  std::memcpy (header.magic, "BPTR", 4);
+  header.version = VERSION;
+  header.recordSize = sizeof(propagationRecord);
+  header.systemId = systemId;
+  m_file.write (reinterpret_cast<const char*>(&header), sizeof(header));
+
+  m_bufferRecords = bufferRecords > 0 ? bufferRecords : 1;
+  m_buffer.clear ();
+  m_buffer.reserve (m_bufferRecords);
+  m_totalRecords = 0;
+  m_enabled = true;
+}
+
+
+void
+BitcoinPropagationTrace::Close (void)
+{
+  NS_LOG_FUNCTION_NOARGS ();
+
+  if (!m_enabled)
+    return;
+
+  Flush ();
+  m_file.close ();
+  std::vector<propagationRecord>().swap(m_buffer);
+  m_enabled = false;
+
+  NS_LOG_INFO ("BitcoinPropagationTrace: wrote " << m_totalRecords << " records");
+}
+
+
+bool
+BitcoinPropagationTrace::IsEnabled (void)
+{
+  return m_enabled;
+}
+
+
+uint64_t
+BitcoinPropagationTrace::GetTotalRecords (void)
+{
+  return m_totalRecords;
+}
+
+
+void
+BitcoinPropagationTrace::Append (const Block &block, uint32_t nodeId)
+{
+  propagationRecord record;
+  double now = Simulator::Now ().GetSeconds ();
+
+  record.blockHeight = block.GetBlockHeight ();
+  record.minerId = block.GetMinerId ();
+  record.nodeId = nodeId;
+  record.receivedFromIpv4 = block.GetReceivedFromIpv4 ().Get ();
+  record.timeCreated = block.GetTimeCreated ();
+  record.receiveDelay = block.GetTimeReceived () - block.GetTimeCreated ();
+  record.validationDelay = now - block.GetTimeReceived ();
+
+  m_buffer.push_back (record);
+  m_totalRecords++;
+
+  if (m_buffer.size () >= m_bufferRecords)
+    Flush ();
+}
+
+
+void
+BitcoinPropagationTrace::Flush (void)
+{
+  if (m_buffer.empty ())
+    return;
+
+  m_file.write (reinterpret_cast<const char*>(m_buffer.data ()), m_buffer.size () * sizeof(propagationRecord));
+  if (!m_file)
+    NS_FATAL_ERROR ("BitcoinPropagationTrace: cannot write the trace file");
+  m_buffer.clear ();
+}
+
+}// Namespace ns3
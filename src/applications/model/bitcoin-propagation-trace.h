@@ -0,0 +1,96 @@
+/**
+ * This file declares the BitcoinPropagationTrace, which records every block validated by the bitcoin
+ * applications to a binary file, and the record format read by bitcoin-trace-analyzer.
+ */
+
+
+#ifndef BITCOIN_PROPAGATION_TRACE_H
+#define BITCOIN_PROPAGATION_TRACE_H
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <stdint.h>
+#include "bitcoin.h"
+
+namespace ns3 {
+
+/**
+ * The header at the beginning of a trace file
+ */
+typedef struct {
+  char       magic[4];                    //"BPTR"
+  uint32_t   version;
+  uint32_t   recordSize;                  //sizeof(propagationRecord)
+  uint32_t   systemId;
+} propagationTraceHeader;
+
+/**
+ * A fixed-size record of 32 Bytes, written for each block validated by a node. The times are kept
+ * as float offsets, like in Block: the receive delay from the creation of the block and the
+ * validation delay from its reception.
+ */
+typedef struct {
+  int32_t    blockHeight;
+  int32_t    minerId;
+  uint32_t   nodeId;                      //The node which validated the block
+  uint32_t   receivedFromIpv4;            //The peer the block was received from (the hop source)
+  double     timeCreated;
+  float      receiveDelay;                //Time received - time created
+  float      validationDelay;             //Time validated - time received
+} propagationRecord;
+
+/**
+ * Appends a propagationRecord to a buffered binary file every time a bitcoin application validates a block.
+ * It is disabled by default; when disabled, every hook costs a single branch. The records are kept in a
+ * buffer of a fixed number of records, which is written out when full, so the memory used does not grow
+ * with the number of nodes or blocks. Each MPI rank writes its own file.
+ */
+class BitcoinPropagationTrace
+{
+public:
+  static const uint32_t VERSION = 1;
+
+  /**
+   * \brief Start recording
+   * \param fileName the trace file, which is overwritten
+   * \param systemId the MPI rank written in the header
+   * \param bufferRecords the number of records buffered before they are written out
+   */
+  static void Open (std::string fileName, uint32_t systemId = 0, uint32_t bufferRecords = 65536);
+
+  /**
+   * \brief Write out the buffered records and stop recording
+   */
+  static void Close (void);
+
+  static bool IsEnabled (void);
+
+  /**
+   * \brief Record the validation of a block by a node, now
+   */
+  static void Record (const Block &block, uint32_t nodeId)
+  {
+    if (m_enabled)
+      Append (block, nodeId);
+  }
+
+  /**
+   * \return the number of records written since the trace was opened
+   */
+  static uint64_t GetTotalRecords (void);
+
+private:
+  static void Append (const Block &block, uint32_t nodeId);
+  static void Flush (void);
+
+  static bool                             m_enabled;           //!< Whether the blocks are recorded (DEFAULT: false)
+  static std::ofstream                    m_file;              //!< The trace file
+  static std::vector<propagationRecord>   m_buffer;            //!< The records not written out yet
+  static uint32_t                         m_bufferRecords;     //!< The capacity of m_buffer
+  static uint64_t                         m_totalRecords;      //!< The records since Open
+};
+
+}// Namespace ns3
+
+#endif /* BITCOIN_PROPAGATION_TRACE_H */
@@ -0,0 +1,233 @@
+/**
+ * This file contains the definitions of the functions declared in bitcoin-quantile-sketch.h
+ */
+
+
+#include <cmath>
+#include <algorithm>
+#include "ns3/log.h"
+#include "bitcoin-quantile-sketch.h"
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("BitcoinQuantileSketch");
+
+BitcoinQuantileSketch::BitcoinQuantileSketch (double relativeAccuracy, uint32_t maxBuckets)
+  : m_relativeAccuracy (relativeAccuracy), m_maxBuckets (maxBuckets > 0 ? maxBuckets : 1), m_offset (0),
+    m_zeroCount (0), m_count (0), m_sum (0), m_min (0), m_max (0)
+{
+  if (m_relativeAccuracy <= 0 || m_relativeAccuracy >= 1)
+    NS_FATAL_ERROR ("BitcoinQuantileSketch: the relative accuracy must be in (0, 1)");
+
+  m_gamma = (1 + m_relativeAccuracy) / (1 - m_relativeAccuracy);
+  m_multiplier = 1 / std::log (m_gamma);
+}
+
+
+BitcoinQuantileSketch::~BitcoinQuantileSketch (void)
+{
+}
+
+
+void
+BitcoinQuantileSketch::Add (double value)
+{
+  if (m_count == 0 || value < m_min)
+    m_min = value;
+  if (m_count == 0 || value > m_max)
+    m_max = value;
+  m_count++;
+  m_sum += value;
+
+  if (value <= 0)
+  {
+    m_zeroCount++;
+    return;
+  }
+
+  int index = GetIndex (value);
+
+  if (m_counts.empty () || index < m_offset || index >= m_offset + static_cast<int>(m_counts.size ()))
+    Extend (index, index);
+
+  //A collapsed index is counted in the lowest bucket
+  m_counts[std::max (index, m_offset) - m_offset]++;
+}
+
+
+void
+BitcoinQuantileSketch::Merge (const BitcoinQuantileSketch &sketch)
+{
+  if (sketch.m_count == 0)
+    return;
+
+  if (sketch.m_gamma != m_gamma)
+    NS_FATAL_ERROR ("BitcoinQuantileSketch: cannot merge sketches of different relative accuracy");
+
+  if (m_count == 0 || sketch.m_min < m_min)
+    m_min = sketch.m_min;
+  if (m_count == 0 || sketch.m_max > m_max)
+    m_max = sketch.m_max;
+  m_count += sketch.m_count;
+  m_sum += sketch.m_sum;
+  m_zeroCount += sketch.m_zeroCount;
+
+  if (sketch.m_counts.empty ())
+    return;
+
+  Extend (sketch.m_offset, sketch.m_offset + static_cast<int>(sketch.m_counts.size ()) - 1);
+  for (uint32_t i = 0; i < sketch.m_counts.size (); i++)
+    m_counts[std::max (sketch.m_offset + static_cast<int>(i), m_offset) - m_offset] += sketch.m_counts[i];
+}
+
+
+double
+BitcoinQuantileSketch::GetQuantile (double q) const
+{
+  if (m_count == 0)
+    return 0;
+  if (q <= 0)
+    return m_min;
+  if (q >= 1)
+    return m_max;
+
+  double   rank = q * (m_count - 1);
+  uint64_t sum = m_zeroCount;
+
+  if (sum > rank)
+    return std::min (0.0, m_max);
+
+  for (uint32_t i = 0; i < m_counts.size (); i++)
+  {
+    sum += m_counts[i];
+    if (sum > rank)
+      return std::max (m_min, std::min (m_max, GetValue (m_offset + i)));
+  }
+  return m_max;
+}
+
+
+uint64_t
+BitcoinQuantileSketch::GetCount (void) const
+{
+  return m_count;
+}
+
+
+double
+BitcoinQuantileSketch::GetMean (void) const
+{
+  return m_count > 0 ? m_sum / m_count : 0;
+}
+
+
+double
+BitcoinQuantileSketch::GetMin (void) const
+{
+  return m_min;
+}
+
+
+double
+BitcoinQuantileSketch::GetMax (void) const
+{
+  return m_max;
+}
+
+
+double
+BitcoinQuantileSketch::GetRelativeAccuracy (void) const
+{
+  return m_relativeAccuracy;
+}
+
+
+uint32_t
+BitcoinQuantileSketch::GetNoBuckets (void) const
+{
+  return m_counts.size ();
+}
+
+
+void
+BitcoinQuantileSketch::ToVector (std::vector<double> &values) const
+{
+  values.clear ();
+  values.reserve (9 + m_counts.size ());
+
+  values.push_back (m_relativeAccuracy);
+  values.push_back (m_maxBuckets);
+  values.push_back (m_zeroCount);
+  values.push_back (m_count);
+  values.push_back (m_sum);
+  values.push_back (m_min);
+  values.push_back (m_max);
+  values.push_back (m_offset);
+  values.push_back (m_counts.size ());
+  for (auto &count : m_counts)
+    values.push_back (count);
+}
+
+
+void
+BitcoinQuantileSketch::FromVector (const std::vector<double> &values)
+{
+  if (values.size () < 9 || values.size () != 9 + static_cast<size_t>(values[8]))
+    NS_FATAL_ERROR ("BitcoinQuantileSketch: the vector is not a sketch");
+
+  *this = BitcoinQuantileSketch (values[0], static_cast<uint32_t>(values[1]));
+  m_zeroCount = values[2];
+  m_count = values[3];
+  m_sum = values[4];
+  m_min = values[5];
+  m_max = values[6];
+  m_offset = values[7];
+  m_counts.assign (values.begin () + 9, values.end ());
+}
+
+
+void
+BitcoinQuantileSketch::Extend (int low, int high)
+{
+  if (m_counts.empty ())
+  {
+    low = std::max (low, high - static_cast<int>(m_maxBuckets) + 1);
+    m_offset = low;
+    m_counts.assign (high - low + 1, 0);
+    return;
+  }
+
+  int currentHigh = m_offset + static_cast<int>(m_counts.size ()) - 1;
+  int newLow = std::min (low, m_offset);
+  int newHigh = std::max (high, currentHigh);
+
+  if (newHigh - newLow + 1 > static_cast<int>(m_maxBuckets))
+    newLow = newHigh - static_cast<int>(m_maxBuckets) + 1;
+  if (newLow == m_offset && newHigh == currentHigh)
+    return;
+
+  std::vector<uint64_t> counts (newHigh - newLow + 1, 0);
+
+  for (uint32_t i = 0; i < m_counts.size (); i++)
+    counts[std::max (m_offset + static_cast<int>(i), newLow) - newLow] += m_counts[i];
+
+  m_offset = newLow;
+  m_counts.swap (counts);
+}
+
+
+int
+BitcoinQuantileSketch::GetIndex (double value) const
+{
+  return static_cast<int>(std::ceil (std::log (value) * m_multiplier));
+}
+
+
+double
+BitcoinQuantileSketch::GetValue (int index) const
+{
+  //The value within m_relativeAccuracy of every value of bucket (gamma^(index-1), gamma^index]
+  return 2 * std::pow (m_gamma, index) / (m_gamma + 1);
+}
+
+}// Namespace ns3
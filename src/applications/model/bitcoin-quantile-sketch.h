@@ -0,0 +1,94 @@
+/**
+ * This file declares the BitcoinQuantileSketch class.
+ */
+
+
+#ifndef BITCOIN_QUANTILE_SKETCH_H
+#define BITCOIN_QUANTILE_SKETCH_H
+
+#include <vector>
+#include <stdint.h>
+
+namespace ns3 {
+
+/**
+ * A mergeable quantile sketch with a relative accuracy guarantee (DDSketch). The positive values are
+ * counted in buckets whose bounds grow geometrically, so every quantile is returned within the relative
+ * accuracy of its true value; values <= 0 are counted separately. The buckets form a contiguous range
+ * of at most maxBuckets; when the range would grow beyond it, the lowest buckets are collapsed into one,
+ * which keeps the memory fixed and loses accuracy only at the lowest quantiles.
+ *
+ * Two sketches with the same relative accuracy are merged by adding their buckets, so the sketches of
+ * the nodes give the distribution over the whole network, and ToVector/FromVector pass them between MPI ranks.
+ */
+class BitcoinQuantileSketch
+{
+public:
+  /**
+   * \param relativeAccuracy the maximum relative error of the quantiles, in (0, 1)
+   * \param maxBuckets the maximum number of buckets
+   */
+  BitcoinQuantileSketch (double relativeAccuracy = 0.01, uint32_t maxBuckets = 2048);
+
+  virtual ~BitcoinQuantileSketch (void);
+
+  void Add (double value);
+
+  /**
+   * \brief Add the values counted by another sketch, which must have the same relative accuracy
+   */
+  void Merge (const BitcoinQuantileSketch &sketch);
+
+  /**
+   * \return the q-quantile, q in [0, 1], or 0 if the sketch is empty
+   */
+  double GetQuantile (double q) const;
+
+  uint64_t GetCount (void) const;
+
+  double GetMean (void) const;
+
+  double GetMin (void) const;
+
+  double GetMax (void) const;
+
+  double GetRelativeAccuracy (void) const;
+
+  uint32_t GetNoBuckets (void) const;
+
+  /**
+   * \brief Write the sketch as doubles, e.g. to send it with MPI_DOUBLE or save it in a checkpoint
+   */
+  void ToVector (std::vector<double> &values) const;
+
+  /**
+   * \brief Replace the sketch with the one written by ToVector
+   */
+  void FromVector (const std::vector<double> &values);
+
+private:
+  /**
+   * \brief Make the range of buckets cover the indices [low, high], collapsing the lowest buckets if needed
+   */
+  void Extend (int low, int high);
+
+  int GetIndex (double value) const;
+
+  double GetValue (int index) const;
+
+  double                   m_relativeAccuracy;    //!< The maximum relative error of the quantiles
+  double                   m_gamma;               //!< The ratio of the bounds of each bucket
+  double                   m_multiplier;          //!< 1/ln(m_gamma)
+  uint32_t                 m_maxBuckets;          //!< The maximum number of buckets
+  int                      m_offset;              //!< The index of m_counts[0]
+  std::vector<uint64_t>    m_counts;              //!< The counts of the buckets
+  uint64_t                 m_zeroCount;           //!< The count of values <= 0
+  uint64_t                 m_count;               //!< The count of all the values
+  double                   m_sum;                 //!< The sum of all the values
+  double                   m_min;                 //!< The smallest value
+  double                   m_max;                 //!< The largest value
+};
+
+}// Namespace ns3
+
+#endif /* BITCOIN_QUANTILE_SKETCH_H */
@@ -0,0 +1,143 @@
+/**
+ * This file contains the definitions of the functions declared in bitcoin-receive-buffer.h
+ */
+
+
+#include <algorithm>
+#include <string.h>
+#include "ns3/log.h"
+#include "bitcoin-receive-buffer.h"
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("BitcoinReceiveBuffer");
+
+BitcoinReceiveBuffer::BitcoinReceiveBuffer (uint32_t capacity) : m_data (std::max (capacity, static_cast<uint32_t>(1))), m_head (0), m_size (0),
+                                                                 m_scanned (0), m_handedOut (0), m_highWaterMark (0), m_delimiter ('#')
+{
+  NS_LOG_FUNCTION (this << capacity);
+}
+
+
+BitcoinReceiveBuffer::~BitcoinReceiveBuffer (void)
+{
+  NS_LOG_FUNCTION (this);
+}
+
+
+void
+BitcoinReceiveBuffer::Append (Ptr<const Packet> packet)
+{
+  NS_LOG_FUNCTION (this << packet);
+
+  uint32_t packetSize = packet->GetSize ();
+
+  Release ();
+
+  if (m_size + packetSize > m_data.size ())
+  {
+    uint32_t capacity = m_data.size ();
+    while (m_size + packetSize > capacity)
+      capacity *= 2;
+    Linearize (capacity);
+  }
+
+  uint32_t capacity = m_data.size ();
+  uint32_t tail = (m_head + m_size) % capacity;
+  uint32_t firstPart = std::min (packetSize, capacity - tail);
+
+  packet->CopyData (reinterpret_cast<uint8_t*>(&m_data[tail]), firstPart);
+  if (firstPart < packetSize)
+    packet->CreateFragment (firstPart, packetSize - firstPart)->CopyData (reinterpret_cast<uint8_t*>(&m_data[0]), packetSize - firstPart);
+
+  m_size += packetSize;
+  m_highWaterMark = std::max (m_highWaterMark, m_size);
+}
+
+
+const char*
+BitcoinReceiveBuffer::NextMessage (uint32_t &size)
+{
+  NS_LOG_FUNCTION (this);
+
+  Release ();
+
+  uint32_t capacity = m_data.size ();
+
+  while (m_scanned < m_size)
+  {
+    uint32_t start = (m_head + m_scanned) % capacity;
+    uint32_t length = std::min (m_size - m_scanned, capacity - start);
+    const char *found = static_cast<const char*>(memchr (&m_data[start], m_delimiter, length));
+
+    if (found == 0)
+    {
+      m_scanned += length;
+      continue;
+    }
+
+    size = m_scanned + (found - &m_data[start]);
+    if (m_head + size >= capacity)                   //the message wraps around the end of the buffer
+      Linearize (capacity);
+
+    m_data[m_head + size] = '\0';
+    m_handedOut = size + 1;
+    return &m_data[m_head];
+  }
+
+  return 0;
+}
+
+
+uint32_t
+BitcoinReceiveBuffer::GetSize (void) const
+{
+  return m_size;
+}
+
+
+uint32_t
+BitcoinReceiveBuffer::GetCapacity (void) const
+{
+  return m_data.size ();
+}
+
+
+uint32_t
+BitcoinReceiveBuffer::GetHighWaterMark (void) const
+{
+  return m_highWaterMark;
+}
+
+
+void
+BitcoinReceiveBuffer::Release (void)
+{
+  if (m_handedOut == 0)
+    return;
+
+  m_head = (m_head + m_handedOut) % m_data.size ();
+  m_size -= m_handedOut;
+  m_scanned = 0;
+  m_handedOut = 0;
+
+  if (m_size == 0)
+    m_head = 0;
+}
+
+
+void
+BitcoinReceiveBuffer::Linearize (uint32_t capacity)
+{
+  NS_LOG_FUNCTION (this << capacity);
+
+  std::vector<char> data (capacity);
+  uint32_t          firstPart = std::min (m_size, static_cast<uint32_t>(m_data.size ()) - m_head);
+
+  std::copy (m_data.begin () + m_head, m_data.begin () + m_head + firstPart, data.begin ());
+  std::copy (m_data.begin (), m_data.begin () + (m_size - firstPart), data.begin () + firstPart);
+  m_data.swap (data);
+  m_head = 0;
+}
+
+}// Namespace ns3
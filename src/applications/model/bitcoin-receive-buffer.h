@@ -0,0 +1,80 @@
+/**
+ * This file declares the BitcoinReceiveBuffer class.
+ */
+
+
+#ifndef BITCOIN_RECEIVE_BUFFER_H
+#define BITCOIN_RECEIVE_BUFFER_H
+
+#include <vector>
+#include <stdint.h>
+#include "ns3/ptr.h"
+#include "ns3/packet.h"
+
+namespace ns3 {
+
+/**
+ * The ring buffer holding the data received from a peer connection, until they form complete messages.
+ * Messages are delimited by '#'. The buffer remembers how far it has searched for the delimiter,
+ * so a message spanning many segments is scanned only once, and hands out each complete message
+ * in place, as a null-terminated view into the buffer. The buffer grows when a segment does not
+ * fit and keeps the largest amount of data it has held, so that its initial size can be tuned.
+ */
+class BitcoinReceiveBuffer
+{
+public:
+  /**
+   * \param capacity the initial capacity in Bytes
+   */
+  BitcoinReceiveBuffer (uint32_t capacity = 4096);
+
+  virtual ~BitcoinReceiveBuffer (void);
+
+  /**
+   * \brief Append the payload of a packet
+   */
+  void Append (Ptr<const Packet> packet);
+
+  /**
+   * \brief Get the next complete message. Its delimiter is replaced by '\0', so the message can be parsed in place.
+   * The message stays valid until the next call of Append or NextMessage.
+   * \param size the size of the message, without the delimiter
+   * \return the message, or 0 if no complete message has been received
+   */
+  const char* NextMessage (uint32_t &size);
+
+  /**
+   * \return the Bytes received but not handed out yet
+   */
+  uint32_t GetSize (void) const;
+
+  uint32_t GetCapacity (void) const;
+
+  /**
+   * \return the largest number of Bytes the buffer has held
+   */
+  uint32_t GetHighWaterMark (void) const;
+
+private:
+  /**
+   * \brief Release the message handed out by the last NextMessage
+   */
+  void Release (void);
+
+  /**
+   * \brief Move the unread data to the beginning of a buffer of the given capacity
+   */
+  void Linearize (uint32_t capacity);
+
+  std::vector<char>   m_data;               //!< The buffer
+  uint32_t            m_head;               //!< The offset of the first unread Byte
+  uint32_t            m_size;               //!< The number of unread Bytes
+  uint32_t            m_scanned;            //!< The number of unread Bytes already searched for the delimiter
+  uint32_t            m_handedOut;          //!< The Bytes of the message handed out by the last NextMessage, including the delimiter
+  uint32_t            m_highWaterMark;      //!< The largest number of Bytes the buffer has held
+  const char          m_delimiter;          //!< '#'
+};
+
+}// Namespace ns3
+
+#endif /* BITCOIN_RECEIVE_BUFFER_H */
@@ -0,0 +1,581 @@
+/**
+ * This file contains the definitions of the functions declared in bitcoin-selfish-mdp.h
+ */
+
+
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include "ns3/log.h"
+#include "bitcoin-selfish-mdp.h"
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("BitcoinSelfishMdp");
+
+static const char* const forkTypeNames[] = {"IRRELEVANT", "RELEVANT", "ACTIVE"};
+
+
+BitcoinSelfishMdp::BitcoinSelfishMdp (const selfishMdpParameters &parameters, double precision)
+  : m_parameters (parameters), m_precision (precision > 0 ? precision : 1e-5), m_revenue (-1)
+{
+  if (m_parameters.alpha < 0 || m_parameters.alpha > 1 || m_parameters.gamma < 0 || m_parameters.gamma > 1
+      || m_parameters.staleRate < 0 || m_parameters.staleRate >= 1 || m_parameters.doubleSpendValue < 0)
+    NS_FATAL_ERROR ("BitcoinSelfishMdp: alpha and gamma must be in [0, 1], the stale rate in [0, 1) and the double-spend value >= 0");
+  if (m_parameters.cutoff < 2)
+    NS_FATAL_ERROR ("BitcoinSelfishMdp: the cutoff must be at least 2");
+}
+
+
+BitcoinSelfishMdp::~BitcoinSelfishMdp (void)
+{
+}
+
+
+void
+BitcoinSelfishMdp::Solve (void)
+{
+  const int cutoff = m_parameters.cutoff;
+  double    low = 0;
+  double    high = 1 + m_parameters.doubleSpendValue;
+  double    lowerGain, upperGain;
+
+  Build ();
+  m_values.assign (3 * cutoff * cutoff, 0);
+
+  /**
+   * The gain of the attacker's blocks - rho * (all main chain blocks) decreases with rho
+   * and is 0 at the optimal relative revenue
+   */
+  while (high - low > m_precision)
+  {
+    double rho = (low + high) / 2;
+
+    Iterate (rho, lowerGain, upperGain, false);
+    if (lowerGain + upperGain > 0)
+      low = rho;
+    else
+      high = rho;
+  }
+  m_revenue = low;
+
+  //Converge at the revenue found and keep the greedy action of every state
+  Iterate (m_revenue, lowerGain, upperGain, true);
+  m_matrix.assign (3 * cutoff * cutoff, '*');
+  for (int state = 0; state < static_cast<int>(m_actions.size ()); state++)
+  {
+    double best = 0;
+
+    for (uint32_t i = 0; i < m_actions[state].size (); i++)
+    {
+      const mdpAction &action = m_actions[state][i];
+      double value = 0;
+
+      for (int t = action.first; t < action.last; t++)
+      {
+        const mdpTransition &transition = m_transitions[t];
+        value += transition.probability * (transition.attackerBlocks + m_parameters.doubleSpendValue * transition.doubleSpends
+                                           - m_revenue * (transition.attackerBlocks + transition.honestBlocks)
+                                           + m_values[transition.next]);
+      }
+
+      //Ties are resolved in favour of the earlier action
+      if (i == 0 || value > best + 1e-9)
+      {
+        best = value;
+        m_matrix[state] = action.action;
+      }
+    }
+  }
+
+  std::string error = CheckMatrix (m_matrix, cutoff);
+  if (!error.empty ())
+    NS_FATAL_ERROR ("BitcoinSelfishMdp: the solved policy " << error);
+
+  std::vector<std::vector<mdpAction>>().swap (m_actions);
+  std::vector<mdpTransition>().swap (m_transitions);
+  std::vector<double>().swap (m_values);
+}
+
+
+const selfishMdpParameters&
+BitcoinSelfishMdp::GetParameters (void) const
+{
+  return m_parameters;
+}
+
+
+double
+BitcoinSelfishMdp::GetRevenue (void) const
+{
+  return m_revenue;
+}
+
+
+char
+BitcoinSelfishMdp::GetAction (int forkType, int la, int lh) const
+{
+  if (m_matrix.empty () || forkType < 0 || forkType > 2 || la < 0 || la >= m_parameters.cutoff
+      || lh < 0 || lh >= m_parameters.cutoff)
+    return '*';
+  return m_matrix[GetState (forkType, la, lh)];
+}
+
+
+const std::vector<char>&
+BitcoinSelfishMdp::GetMatrix (void) const
+{
+  return m_matrix;
+}
+
+
+void
+BitcoinSelfishMdp::Save (std::string fileName) const
+{
+  const int cutoff = m_parameters.cutoff;
+  std::ofstream file (fileName.c_str (), std::ios::out | std::ios::trunc);
+
+  if (m_matrix.empty ())
+    NS_FATAL_ERROR ("BitcoinSelfishMdp: the MDP has not been solved");
+  if (!file.is_open ())
+    NS_FATAL_ERROR ("BitcoinSelfishMdp: cannot open " << fileName);
+
+  file << std::setprecision (10) << "# BitcoinSelfishMdp version = " << VERSION << ", alpha = " << m_parameters.alpha
+       << ", gamma = " << m_parameters.gamma << ", staleRate = " << m_parameters.staleRate
+       << ", doubleSpendValue = " << m_parameters.doubleSpendValue << ", confirmations = " << m_parameters.confirmations
+       << ", cutoff = " << cutoff << "\n";
+  file << "revenue " << m_revenue << "\n";
+
+  for (int f = 0; f < 3; f++)
+  {
+    file << forkTypeNames[f] << "\n";
+    for (int la = 0; la < cutoff; la++)
+    {
+      file.write (&m_matrix[GetState (f, la, 0)], cutoff);
+      file << "\n";
+    }
+  }
+
+  if (!file)
+    NS_FATAL_ERROR ("BitcoinSelfishMdp: cannot write " << fileName);
+}
+
+
+bool
+BitcoinSelfishMdp::Load (std::string fileName, std::vector<char> &matrix, int &cutoff, double *revenue)
+{
+  std::ifstream file (fileName.c_str ());
+  std::string   line;
+  int           forkType = -1;
+  double        fileRevenue = -1;
+
+  if (!file.is_open ())
+    return false;
+
+  matrix.clear ();
+  cutoff = 0;
+  while (std::getline (file, line))
+  {
+    if (line.empty () || line[0] == '#')
+      continue;
+    if (line.compare (0, 8, "revenue ") == 0)
+    {
+      fileRevenue = std::atof (line.c_str () + 8);
+      continue;
+    }
+    if (forkType < 2 && line == forkTypeNames[forkType + 1])
+    {
+      forkType++;
+      continue;
+    }
+
+    if (forkType < 0 || line.find_first_not_of ("aomwe*") != std::string::npos)
+      return false;
+    if (cutoff == 0)
+      cutoff = line.size ();
+    if (static_cast<int>(line.size ()) != cutoff)
+      return false;
+    matrix.insert (matrix.end (), line.begin (), line.end ());
+  }
+
+  if (forkType != 2 || cutoff == 0 || static_cast<int>(matrix.size ()) != 3 * cutoff * cutoff)
+    return false;
+
+  std::string error = CheckMatrix (matrix, cutoff);
+  if (!error.empty ())
+  {
+    NS_LOG_WARN ("BitcoinSelfishMdp: the decision matrix " << fileName << " " << error);
+    return false;
+  }
+  if (revenue)
+    *revenue = fileRevenue;
+  return true;
+}
+
+
+std::string
+BitcoinSelfishMdp::CheckMatrix (const std::vector<char> &matrix, int cutoff)
+{
+  std::vector<bool> reached (3 * cutoff * cutoff, false);
+  std::vector<int>  queue (1, 0);
+
+  if (cutoff < 2 || static_cast<int>(matrix.size ()) != 3 * cutoff * cutoff)
+    return "has the wrong size";
+
+  reached[0] = true;
+  while (!queue.empty ())
+  {
+    int  state = queue.back ();
+    int  f = state / (cutoff * cutoff);
+    int  la = state / cutoff % cutoff;
+    int  lh = state % cutoff;
+    char action = matrix[state];
+    bool handled;
+    bool active = false;
+
+    queue.pop_back ();
+    switch (action)
+    {
+      case 'a': handled = f != 2; break;
+      case 'o': handled = f != 2 && la > lh; break;
+      case 'm': handled = f == 1 && la >= lh; break;
+      case 'w': handled = true; active = f == 2; break;
+      case 'e': handled = f == 0 && la > lh; break;
+      default:  handled = false; break;
+    }
+
+    if (!handled)
+    {
+      std::ostringstream error;
+      error << "has the action '" << action << "' in the reachable state (" << forkTypeNames[f] << ", " << la << ", " << lh
+            << "), which BitcoinSelfishMiner cannot execute";
+      return error.str ();
+    }
+
+    //The state left by the action, as in BitcoinSelfishMiner::MineBlock and ReceiveBlock
+    if (action == 'a' || action == 'e')
+      la = lh = 0;
+    else if (action == 'o')
+    {
+      la = la - lh - 1;
+      lh = 0;
+    }
+    else if (action == 'm')
+      active = true;
+
+    //The states after the next block, with every transition of AddBlockTransitions taken as possible
+    int next[4];
+    int noNext = 0;
+
+    next[noNext++] = la + 1 == cutoff ? 0 : ((active ? 2 : 0) * cutoff + la + 1) * cutoff + lh;
+    next[noNext++] = ((active ? 2 : 0) * cutoff + la) * cutoff + lh;
+    if (active)
+      next[noNext++] = (cutoff + la - lh) * cutoff + 1;
+    next[noNext++] = lh + 1 == cutoff ? 0 : (cutoff + la) * cutoff + lh + 1;
+
+    for (int i = 0; i < noNext; i++)
+    {
+      if (!reached[next[i]])
+      {
+        reached[next[i]] = true;
+        queue.push_back (next[i]);
+      }
+    }
+  }
+  return "";
+}
+
+
+std::string
+BitcoinSelfishMdp::GetCacheFileName (const selfishMdpParameters &parameters, std::string cacheDir)
+{
+  std::ostringstream name;
+
+  name << std::fixed << std::setprecision (6);
+  if (!cacheDir.empty ())
+    name << cacheDir << "/";
+  name << "selfish-mdp-v" << VERSION << "-a" << parameters.alpha << "-g" << parameters.gamma
+       << "-r" << parameters.staleRate << "-ud" << parameters.doubleSpendValue
+       << "-k" << parameters.confirmations << "-c" << parameters.cutoff << ".txt";
+  return name.str ();
+}
+
+
+int
+BitcoinSelfishMdp::SolveGrid (const std::vector<selfishMdpParameters> &points, std::string cacheDir, int threads,
+                              std::vector<std::string> &files, std::vector<double> &revenues)
+{
+  std::atomic<size_t>  nextPoint (0);
+  std::atomic<int>     solved (0);
+  std::vector<std::thread> workers;
+
+  files.resize (points.size ());
+  revenues.assign (points.size (), -1);
+  if (threads < 1)
+    threads = std::max (1u, std::thread::hardware_concurrency ());
+  threads = std::min (threads, static_cast<int>(points.size ()));
+
+  auto worker = [&] ()
+  {
+    size_t point;
+
+    while ((point = nextPoint++) < points.size ())
+    {
+      std::vector<char> matrix;
+      int               cutoff;
+
+      files[point] = GetCacheFileName (points[point], cacheDir);
+      if (Load (files[point], matrix, cutoff, &revenues[point]) && cutoff == points[point].cutoff)
+        continue;
+
+      BitcoinSelfishMdp mdp (points[point]);
+      std::ostringstream temporary;
+
+      mdp.Solve ();
+      revenues[point] = mdp.GetRevenue ();
+
+      //Write to a temporary file first, so that a concurrent run never reads a partial file
+      temporary << files[point] << ".tmp" << std::this_thread::get_id ();
+      mdp.Save (temporary.str ());
+      if (std::rename (temporary.str ().c_str (), files[point].c_str ()) != 0)
+        NS_FATAL_ERROR ("BitcoinSelfishMdp: cannot write " << files[point]);
+      solved++;
+    }
+  };
+
+  for (int i = 0; i < threads; i++)
+    workers.push_back (std::thread (worker));
+  for (auto &thread : workers)
+    thread.join ();
+
+  return solved;
+}
+
+
+int
+BitcoinSelfishMdp::GetState (int forkType, int la, int lh) const
+{
+  return (forkType * m_parameters.cutoff + la) * m_parameters.cutoff + lh;
+}
+
+
+bool
+BitcoinSelfishMdp::IsValid (int forkType, int la, int lh) const
+{
+  if (forkType == 1)                      //RELEVANT: the last block was an honest one
+    return lh >= 1;
+  if (forkType == 2)                      //ACTIVE: the attacker has matched lh blocks
+    return lh >= 1 && la >= lh;
+  return true;
+}
+
+
+void
+BitcoinSelfishMdp::Build (void)
+{
+  const int cutoff = m_parameters.cutoff;
+  const bool doubleSpend = m_parameters.doubleSpendValue > 0;
+
+  m_actions.assign (3 * cutoff * cutoff, std::vector<mdpAction> ());
+  m_transitions.clear ();
+
+  for (int f = 0; f < 3; f++)
+  {
+    for (int la = 0; la < cutoff; la++)
+    {
+      for (int lh = 0; lh < cutoff; lh++)
+      {
+        std::vector<mdpAction> &actions = m_actions[GetState (f, la, lh)];
+        mdpAction action;
+
+        if (!IsValid (f, la, lh))
+          continue;
+
+        //After a MATCH, BitcoinSelfishMiner::MineBlock keeps the fork ACTIVE without reading the matrix
+        if (f == 2)
+        {
+          action.action = 'w';
+          action.first = m_transitions.size ();
+          AddBlockTransitions (la, lh, true, 0, 0, 0);
+          action.last = m_transitions.size ();
+          actions.push_back (action);
+          continue;
+        }
+
+        if (la > 0 || lh > 0)
+        {
+          action.action = 'a';
+          action.first = m_transitions.size ();
+          AddBlockTransitions (0, 0, false, 0, lh, 0);
+          action.last = m_transitions.size ();
+          actions.push_back (action);
+        }
+
+        if (la > lh)
+        {
+          action.action = 'o';
+          action.first = m_transitions.size ();
+          AddBlockTransitions (la - lh - 1, 0, false, lh + 1, 0, 0);
+          action.last = m_transitions.size ();
+          actions.push_back (action);
+        }
+
+        if (f == 1 && la >= lh)
+        {
+          action.action = 'm';
+          action.first = m_transitions.size ();
+          AddBlockTransitions (la, lh, true, 0, 0, 0);
+          action.last = m_transitions.size ();
+          actions.push_back (action);
+        }
+
+        action.action = 'w';
+        action.first = m_transitions.size ();
+        AddBlockTransitions (la, lh, false, 0, 0, 0);
+        action.last = m_transitions.size ();
+        actions.push_back (action);
+
+        //The miner exits only in IRRELEVANT states, after it mined a block or an honest block became stale
+        if (doubleSpend && f == 0 && la > lh && la > m_parameters.confirmations)
+        {
+          action.action = 'e';
+          action.first = m_transitions.size ();
+          AddBlockTransitions (0, 0, false, la, 0, 1);
+          action.last = m_transitions.size ();
+          actions.push_back (action);
+        }
+      }
+    }
+  }
+}
+
+
+void
+BitcoinSelfishMdp::AddBlockTransitions (int la, int lh, bool active, double attackerBlocks, double honestBlocks, double doubleSpends)
+{
+  const int    cutoff = m_parameters.cutoff;
+  const double alpha = m_parameters.alpha;
+  const double honest = (1 - alpha) * (1 - m_parameters.staleRate);
+  const double stale = (1 - alpha) * m_parameters.staleRate;
+  const double doubleSpend = m_parameters.doubleSpendValue > 0 ? 1 : 0;
+
+  mdpTransition transition;
+  transition.doubleSpends = doubleSpends;
+
+  //The attacker mines a block; at the cutoff it releases its chain like BitcoinSelfishMiner::MineBlock
+  transition.probability = alpha;
+  if (la + 1 == cutoff)
+  {
+    transition.next = GetState (0, 0, 0);
+    transition.attackerBlocks = attackerBlocks + la + 1;
+    transition.honestBlocks = honestBlocks;
+    transition.doubleSpends = doubleSpends + doubleSpend;
+  }
+  else
+  {
+    transition.next = GetState (active ? 2 : 0, la + 1, lh);
+    transition.attackerBlocks = attackerBlocks;
+    transition.honestBlocks = honestBlocks;
+  }
+  m_transitions.push_back (transition);
+  transition.doubleSpends = doubleSpends;
+
+  //An honest block becomes stale
+  transition.probability = stale;
+  transition.next = GetState (active ? 2 : 0, la, lh);
+  transition.attackerBlocks = attackerBlocks;
+  transition.honestBlocks = honestBlocks;
+  if (stale > 0)
+    m_transitions.push_back (transition);
+
+  //An honest miner mines on the attacker's matched chain, which wins the lh blocks of the fork
+  if (active)
+  {
+    transition.probability = m_parameters.gamma * honest;
+    transition.next = GetState (1, la - lh, 1);
+    transition.attackerBlocks = attackerBlocks + lh;
+    transition.honestBlocks = honestBlocks;
+    if (transition.probability > 0)
+      m_transitions.push_back (transition);
+  }
+
+  //An honest miner extends the honest chain; at the cutoff the attacker adopts it like BitcoinSelfishMiner::ReceiveBlock
+  transition.probability = (active ? 1 - m_parameters.gamma : 1) * honest;
+  if (lh + 1 == cutoff)
+  {
+    transition.next = GetState (0, 0, 0);
+    transition.attackerBlocks = attackerBlocks;
+    transition.honestBlocks = honestBlocks + lh + 1;
+  }
+  else
+  {
+    transition.next = GetState (1, la, lh + 1);
+    transition.attackerBlocks = attackerBlocks;
+    transition.honestBlocks = honestBlocks;
+  }
+  if (transition.probability > 0)
+    m_transitions.push_back (transition);
+}
+
+
+void
+BitcoinSelfishMdp::Iterate (double rho, double &lowerGain, double &upperGain, bool converge)
+{
+  const double        tau = 0.5;              //The aperiodicity transformation: stay in the state with probability 1 - tau
+  const double        tolerance = m_precision / 100;
+  const double        doubleSpendValue = m_parameters.doubleSpendValue;
+  const int           maxIterations = 1000000;
+  std::vector<double> values (m_values.size (), 0);
+
+  lowerGain = upperGain = 0;
+  for (int iteration = 0; iteration < maxIterations; iteration++)
+  {
+    lowerGain = 1e100;
+    upperGain = -1e100;
+
+    for (int state = 0; state < static_cast<int>(m_actions.size ()); state++)
+    {
+      double best = -1e100;
+
+      if (m_actions[state].empty ())
+        continue;
+
+      for (auto &action : m_actions[state])
+      {
+        double value = 0;
+
+        for (int t = action.first; t < action.last; t++)
+        {
+          const mdpTransition &transition = m_transitions[t];
+          value += transition.probability * (transition.attackerBlocks + doubleSpendValue * transition.doubleSpends
+                                             - rho * (transition.attackerBlocks + transition.honestBlocks)
+                                             + m_values[transition.next]);
+        }
+        best = std::max (best, value);
+      }
+
+      lowerGain = std::min (lowerGain, best - m_values[state]);
+      upperGain = std::max (upperGain, best - m_values[state]);
+      values[state] = m_values[state] + tau * (best - m_values[state]);
+    }
+
+    //Keep the values relative to the initial state (IRRELEVANT, 0, 0)
+    double reference = values[0];
+    for (auto &value : values)
+      value -= reference;
+    m_values.swap (values);
+
+    if (upperGain - lowerGain < tolerance || (!converge && (lowerGain > 0 || upperGain < 0)))
+      return;
+  }
+
+  NS_LOG_WARN ("BitcoinSelfishMdp: the value iteration did not converge for rho = " << rho);
+}
+
+}// Namespace ns3
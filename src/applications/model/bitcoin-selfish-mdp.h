@@ -0,0 +1,172 @@
+/**
+ * This file declares the BitcoinSelfishMdp class, which computes the decision matrices of the
+ * BitcoinSelfishMiner.
+ */
+
+
+#ifndef BITCOIN_SELFISH_MDP_H
+#define BITCOIN_SELFISH_MDP_H
+
+#include <vector>
+#include <string>
+
+namespace ns3 {
+
+/**
+ * The parameters of a selfish mining and double-spending MDP.
+ */
+typedef struct {
+  double   alpha;                         //The hash rate of the attacker
+  double   gamma;                         //The share of the honest hash rate which mines on the attacker's block after a match
+  double   staleRate;                     //The stale block rate of the honest network
+  double   doubleSpendValue;              //The value double-spent at every successful attack, in block rewards (0 for selfish mining)
+  int      confirmations;                 //The confirmations the merchant waits for; EXIT is possible when la > confirmations
+  int      cutoff;                        //The maximum attack blocks (m_maxAttackBlocks): the matrices are cutoff x cutoff
+} selfishMdpParameters;
+
+
+/**
+ * Solves the MDP of the selfish mining and double-spending attack played by the BitcoinSelfishMiner and
+ * writes its optimal policy as the decision matrices read by ReadActionMatrix: one cutoff x cutoff matrix
+ * per ForkType (IRRELEVANT, RELEVANT, ACTIVE), holding for each (la, lh) the action 'a' (ADOPT),
+ * 'o' (OVERRIDE), 'm' (MATCH), 'w' (WAIT), 'e' (EXIT), or '*' if the state is impossible.
+ *
+ * The states and transitions follow the ones of the BitcoinSelfishMiner, including its truncation: the
+ * attacker releases its chain when la reaches the cutoff and adopts the honest chain when lh does. The
+ * actions are the ones the miner can execute: only WAIT in the ACTIVE states, whose matrix MineBlock does
+ * not read, and EXIT only in the IRRELEVANT states. Each
+ * step is a block; an honest block becomes stale with the stale rate. The attacker maximizes its share of
+ * the main chain blocks, counting every double-spend (EXIT or release at the cutoff) as doubleSpendValue
+ * more blocks. The share is found by a binary search over rho, running at every rho a relative value
+ * iteration of the average reward of the attacker's blocks - rho * (all main chain blocks).
+ *
+ * The solved matrices are saved as text files, and SolveGrid solves the points of a parameter grid
+ * on several threads, keeping them in a cache directory keyed by their parameters.
+ */
+class BitcoinSelfishMdp
+{
+public:
+  static const int VERSION = 2;
+
+  /**
+   * \param parameters the parameters of the MDP
+   * \param precision the precision of the relative revenue
+   */
+  BitcoinSelfishMdp (const selfishMdpParameters &parameters, double precision = 1e-5);
+
+  virtual ~BitcoinSelfishMdp (void);
+
+  /**
+   * \brief Compute the optimal policy and the relative revenue
+   */
+  void Solve (void);
+
+  const selfishMdpParameters& GetParameters (void) const;
+
+  /**
+   * \return the optimal relative revenue of the attacker, or -1 if the MDP has not been solved
+   */
+  double GetRevenue (void) const;
+
+  /**
+   * \return the action of the state, indexed by forkType like ForkType
+   */
+  char GetAction (int forkType, int la, int lh) const;
+
+  /**
+   * \return the decision matrices, indexed by (forkType * cutoff + la) * cutoff + lh
+   */
+  const std::vector<char>& GetMatrix (void) const;
+
+  /**
+   * \brief Write the parameters, the revenue and the matrices to a text file
+   */
+  void Save (std::string fileName) const;
+
+  /**
+   * \brief Read the matrices written by Save
+   * \param matrix the matrices, indexed like GetMatrix
+   * \param cutoff the cutoff of the matrices
+   * \param revenue the relative revenue, if not 0
+   * \return false if the file cannot be read, is not a decision matrix or fails CheckMatrix
+   */
+  static bool Load (std::string fileName, std::vector<char> &matrix, int &cutoff, double *revenue = 0);
+
+  /**
+   * \brief Check that the action of every state reachable from (IRRELEVANT, 0, 0) under the matrices can be
+   * executed by the BitcoinSelfishMiner. All the transitions are taken as possible, whatever the parameters.
+   * \param matrix the matrices, indexed like GetMatrix
+   * \param cutoff the cutoff of the matrices
+   * \return an empty string if every reachable action is handled, otherwise the error
+   */
+  static std::string CheckMatrix (const std::vector<char> &matrix, int cutoff);
+
+  /**
+   * \return the name of the file of the parameters in the cache directory
+   */
+  static std::string GetCacheFileName (const selfishMdpParameters &parameters, std::string cacheDir);
+
+  /**
+   * \brief Solve the points which are not in the cache directory yet, on up to threads threads
+   * \param files the cache file of each point
+   * \param revenues the relative revenue of each point
+   * \return the number of points solved (not found in the cache)
+   */
+  static int SolveGrid (const std::vector<selfishMdpParameters> &points, std::string cacheDir, int threads,
+                        std::vector<std::string> &files, std::vector<double> &revenues);
+
+private:
+  /**
+   * A transition of an action: the next state, its probability and the rewards.
+   */
+  typedef struct {
+    int      next;
+    double   probability;
+    double   attackerBlocks;              //The attacker's blocks added to the main chain
+    double   honestBlocks;                //The honest blocks added to the main chain
+    double   doubleSpends;
+  } mdpTransition;
+
+  /**
+   * An action available in a state and the range of its transitions in m_transitions.
+   */
+  typedef struct {
+    char     action;
+    int      first;
+    int      last;
+  } mdpAction;
+
+  int GetState (int forkType, int la, int lh) const;
+  bool IsValid (int forkType, int la, int lh) const;
+
+  /**
+   * \brief Build the actions and transitions of all the valid states
+   */
+  void Build (void);
+
+  /**
+   * \brief Add the transitions of a block mined after an action, which left the attacker at (la, lh)
+   * \param active whether the honest network is split between the two chains (after a MATCH)
+   */
+  void AddBlockTransitions (int la, int lh, bool active, double attackerBlocks, double honestBlocks, double doubleSpends);
+
+  /**
+   * \brief Run the relative value iteration for rho, until the values converge or, if not converge,
+   * the sign of the gain is known
+   * \param lowerGain set to the lower bound of the gain
+   * \param upperGain set to the upper bound of the gain
+   */
+  void Iterate (double rho, double &lowerGain, double &upperGain, bool converge);
+
+  selfishMdpParameters            m_parameters;        //!< The parameters of the MDP
+  double                          m_precision;         //!< The precision of the relative revenue
+  double                          m_revenue;           //!< The optimal relative revenue
+  std::vector<char>               m_matrix;            //!< The decision matrices
+  std::vector<std::vector<mdpAction>> m_actions;       //!< The actions of each state (empty if the state is invalid)
+  std::vector<mdpTransition>      m_transitions;       //!< The transitions of all the actions
+  std::vector<double>             m_values;            //!< The relative values of the states
+};
+
+}// Namespace ns3
+
+#endif /* BITCOIN_SELFISH_MDP_H */
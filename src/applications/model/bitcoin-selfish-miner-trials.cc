@@ -179,7 +179,7 @@ void
 BitcoinSelfishMinerTrials::StopApplication ()
 {
   BitcoinNode::StopApplication ();  
-  Simulator::Cancel (m_nextMiningEvent);
+  BitcoinEventProfiler::Cancel (m_nextMiningEvent, MINE_BLOCK_EVENT);
   
   NS_LOG_WARN ("The selfish miner " << GetNode ()->GetId () << " with hash rate = " << m_hashRate << " generated " << m_minerGeneratedBlocks 
                 << " blocks "<< "(" << 100. * m_minerGeneratedBlocks / (m_blockchain.GetTotalBlocks() - 1) 
@@ -204,11 +204,12 @@ BitcoinSelfishMinerTrials::DoDispose (void)
 void 
 BitcoinSelfishMinerTrials::MineBlock (void)  
 {
+  BitcoinEventProfiler::Scope profile (MINE_BLOCK_EVENT);
   NS_LOG_FUNCTION (this);
-  rapidjson::Document d; 
-  int height =  m_blockchain.GetCurrentTopBlock()->GetBlockHeight() + 1;
+  BitcoinJsonDocument d (m_jsonPool); 
+  int height =  m_blockchain.GetCurrentTopBlock().GetBlockHeight() + 1;
   int minerId = GetNode ()->GetId ();
-  int parentBlockMinerId = m_blockchain.GetCurrentTopBlock()->GetMinerId();
+  int parentBlockMinerId = m_blockchain.GetCurrentTopBlock().GetMinerId();
   double currentTime = Simulator::Now ().GetSeconds ();
   std::ostringstream stringStream;  
   std::string blockHash = stringStream.str();
@@ -261,6 +262,8 @@ BitcoinSelfishMinerTrials::MineBlock (void)
   /**
    * Update m_meanBlockReceiveTime with the timeCreated of the newly generated block
    */
+  AddToSketches (currentTime - m_previousBlockReceiveTime, 0, m_nextBlockSize);
+
   m_meanBlockReceiveTime = (m_blockchain.GetTotalBlocks() - 1)/static_cast<double>(m_blockchain.GetTotalBlocks())*m_meanBlockReceiveTime + 
 						   (currentTime - m_previousBlockReceiveTime)/(m_blockchain.GetTotalBlocks());
   m_previousBlockReceiveTime = currentTime;	
@@ -273,30 +276,12 @@ BitcoinSelfishMinerTrials::MineBlock (void)
   m_blockchain.AddBlock(newBlock);
   
   // Stringify the DOM
-  rapidjson::StringBuffer packetInfo;
+  rapidjson::StringBuffer &packetInfo = m_jsonPool.GetBuffer ();
   rapidjson::Writer<rapidjson::StringBuffer> writer(packetInfo);
   d.Accept(writer);
   
   if (m_advertiseBlocks == 1)
-  {
-    for (std::vector<Ipv4Address>::const_iterator i = m_peersAddresses.begin(); i != m_peersAddresses.end(); ++i)
-    {
-	  const uint8_t delimiter[] = "#";
-
-      m_peersSockets[*i]->Send (reinterpret_cast<const uint8_t*>(packetInfo.GetString()), packetInfo.GetSize(), 0);
-	  m_peersSockets[*i]->Send (delimiter, 1, 0);
-	
-/* 	  //Send large packet
-	  int k;
-	  for (k = 0; k < 4; k++)
-	  {
-        ns3TcpSocket->Send (reinterpret_cast<const uint8_t*>(packetInfo.GetString()), packetInfo.GetSize(), 0);
-	    ns3TcpSocket->Send (delimiter, 1, 0);
-	  } */
-	
-
-    }
-  }
+    BroadcastMessage (CreateMessagePacket (packetInfo));
   
   m_minerAverageBlockGenInterval = m_minerGeneratedBlocks/static_cast<double>(m_minerGeneratedBlocks+1)*m_minerAverageBlockGenInterval 
                              + (Simulator::Now ().GetSeconds () - m_previousBlockGenerationTime)/(m_minerGeneratedBlocks+1);
@@ -327,7 +312,7 @@ BitcoinSelfishMinerTrials::ReceivedHigherBlock(const Block &newBlock)
   NS_LOG_WARN (m_winningStreak);
   m_winningStreak = 0;
   m_trials++;
-  Simulator::Cancel (m_nextMiningEvent);
+  BitcoinEventProfiler::Cancel (m_nextMiningEvent, MINE_BLOCK_EVENT);
   ScheduleNextMiningEvent();
 
 }
@@ -14,7 +14,9 @@
 #include "ns3/tcp-socket-factory.h"
 #include "ns3/uinteger.h"
 #include "ns3/double.h"
+#include "ns3/string.h"
 #include "ns3/bitcoin-selfish-miner.h"
+#include "bitcoin-selfish-mdp.h"
 #include "../../rapidjson/document.h"
 #include "../../rapidjson/writer.h"
 #include "../../rapidjson/stringbuffer.h"
@@ -82,6 +84,11 @@ BitcoinSelfishMiner::GetTypeId (void)
                    DoubleValue (10*60),
                    MakeDoubleAccessor (&BitcoinSelfishMiner::m_averageBlockGenIntervalSeconds),
                    MakeDoubleChecker<double> ())
+    .AddAttribute ("DecisionMatrixFile", 
+                   "The decision matrix computed by BitcoinSelfishMdp (empty uses the built-in matrix)",
+                   StringValue (""),
+                   MakeStringAccessor (&BitcoinSelfishMiner::m_decisionMatrixFile),
+                   MakeStringChecker ())
     .AddTraceSource ("Rx",
                      "A packet has been received",
                      MakeTraceSourceAccessor (&BitcoinSelfishMiner::m_rxTrace),
@@ -94,8 +101,8 @@ BitcoinSelfishMiner::GetTypeId (void)
 BitcoinSelfishMiner::BitcoinSelfishMiner () : BitcoinMiner(), m_attackFinished(false), m_la(0), m_lh(0), m_forkType(IRRELEVANT)
 {
   NS_LOG_FUNCTION (this);
-  m_attackerTopBlock = *(m_blockchain.GetCurrentTopBlock());
-  m_honestNetworkTopBlock = *(m_blockchain.GetCurrentTopBlock());
+  m_attackerTopBlock = m_blockchain.GetCurrentTopBlock();
+  m_honestNetworkTopBlock = m_blockchain.GetCurrentTopBlock();
   m_maxAttackBlocks = sqrt(sizeof(m_decisionMatrix)/sizeof(char)/3);
 }
 
@@ -110,6 +117,14 @@ void
 BitcoinSelfishMiner::StartApplication ()    // Called at time specified by Start
 {
   BitcoinNode::StartApplication ();
+  m_attackerTopBlock = m_blockchain.GetCurrentTopBlock();          //the blockchain may have been restored from a checkpoint
+  m_honestNetworkTopBlock = m_blockchain.GetCurrentTopBlock();
+
+  if (!m_decisionMatrixFile.empty ())
+  {
+    if (!BitcoinSelfishMdp::Load (m_decisionMatrixFile, m_solvedMatrix, m_maxAttackBlocks))
+      NS_FATAL_ERROR ("Selfish Miner " << GetNode()->GetId() << ": cannot read the decision matrix " << m_decisionMatrixFile);
+  }
   NS_LOG_WARN ("Selfish Miner " << GetNode()->GetId() << " m_realAverageBlockGenIntervalSeconds = " << m_realAverageBlockGenIntervalSeconds << "s");
   NS_LOG_WARN ("Selfish Miner " << GetNode()->GetId() << " m_averageBlockGenIntervalSeconds = " << m_averageBlockGenIntervalSeconds << "s");
   NS_LOG_WARN ("Selfish Miner " << GetNode()->GetId() << " m_fixedBlockTimeGeneration = " << m_fixedBlockTimeGeneration << "s");
@@ -171,7 +186,7 @@ void
 BitcoinSelfishMiner::StopApplication ()
 {
   BitcoinNode::StopApplication ();  
-  Simulator::Cancel (m_nextMiningEvent);
+  BitcoinEventProfiler::Cancel (m_nextMiningEvent, MINE_BLOCK_EVENT);
   
   NS_LOG_WARN ("The selfish miner " << GetNode ()->GetId () << " with hash rate = " << m_hashRate << " generated " << m_minerGeneratedBlocks 
                 << " blocks "<< "(" << 100. * m_minerGeneratedBlocks / (m_blockchain.GetTotalBlocks() - 1) 
@@ -184,18 +199,7 @@ BitcoinSelfishMiner::StopApplication ()
   m_nodeStats->minerAverageBlockGenInterval = m_minerAverageBlockGenInterval;
   m_nodeStats->minerAverageBlockSize = m_minerAverageBlockSize;
   
-  Block b = m_honestNetworkTopBlock;
-  bool stop = false;
-  
-  do
-  {
-    if (b.GetMinerId() == GetNode()->GetId())
-      m_nodeStats->minedBlocksInMainChain++;
-    if (m_blockchain.GetParent(b))
-      b = *(m_blockchain.GetParent(b));
-    else
-      stop = true;
-  }while (!stop);
+  m_nodeStats->minedBlocksInMainChain += m_blockchain.GetNoMinerBlocksInChain(m_honestNetworkTopBlock, GetNode()->GetId());
 }
 
 void 
@@ -209,6 +213,7 @@ BitcoinSelfishMiner::DoDispose (void)
 void 
 BitcoinSelfishMiner::MineBlock (void)  
 {
+  BitcoinEventProfiler::Scope profile (MINE_BLOCK_EVENT);
   NS_LOG_FUNCTION (this);
 
   int height =  m_attackerTopBlock.GetBlockHeight() + 1;
@@ -273,8 +278,8 @@ BitcoinSelfishMiner::MineBlock (void)
     for (int j = 0; j < m_la; j++)
     {
       blocks.insert(blocks.begin(), b);
-      if (m_blockchain.GetParent(b))
-        b = *(m_blockchain.GetParent(b));
+      if (m_blockchain.HasParent(b))
+        b = m_blockchain.GetParent(b);
     }
 	  
     ReleaseChain(blocks);
@@ -316,8 +321,8 @@ BitcoinSelfishMiner::MineBlock (void)
         for (int j = 0; j < m_lh + 1; j++)
         {
           blocks.insert(blocks.begin(), b);
-          if (m_blockchain.GetParent(b))
-           b = *(m_blockchain.GetParent(b));
+          if (m_blockchain.HasParent(b))
+           b = m_blockchain.GetParent(b);
         }
 	 
         ReleaseChain(blocks);
@@ -337,8 +342,8 @@ BitcoinSelfishMiner::MineBlock (void)
         for (int j = 0; j < m_lh; j++)
         {
           blocks.insert(blocks.begin(), b);
-		  if (m_blockchain.GetParent(b))
-            b = *(m_blockchain.GetParent(b));
+		  if (m_blockchain.HasParent(b))
+            b = m_blockchain.GetParent(b);
         }
 	  
         ReleaseChain(blocks);
@@ -361,8 +366,8 @@ BitcoinSelfishMiner::MineBlock (void)
         for (int j = 0; j < m_la; j++)
         {
           blocks.insert(blocks.begin(), b);
-		  if (m_blockchain.GetParent(b))
-            b = *(m_blockchain.GetParent(b));
+		  if (m_blockchain.HasParent(b))
+            b = m_blockchain.GetParent(b);
         }
 	  
         ReleaseChain(blocks);
@@ -389,6 +394,8 @@ BitcoinSelfishMiner::MineBlock (void)
   /**
    * Update m_meanBlockReceiveTime with the timeCreated of the newly generated block
    */
+  AddToSketches (currentTime - m_previousBlockReceiveTime, 0, m_nextBlockSize);
+
   m_meanBlockReceiveTime = (m_blockchain.GetTotalBlocks() - 1)/static_cast<double>(m_blockchain.GetTotalBlocks())*m_meanBlockReceiveTime 
                          + (currentTime - m_previousBlockReceiveTime)/(m_blockchain.GetTotalBlocks());
   m_previousBlockReceiveTime = currentTime;	
@@ -434,14 +441,15 @@ BitcoinSelfishMiner::ReceiveBlock(const Block &newBlock)
   stringStream << newBlock.GetBlockHeight() << "/" << newBlock.GetMinerId();
   blockHash = stringStream.str();
   
-  if (m_blockchain.HasBlock(newBlock) || m_blockchain.IsOrphan(newBlock) || ReceivedButNotValidated(blockHash))
+  if (m_blockchain.HasBlock(newBlock) || m_blockchain.IsOrphan(newBlock) 
+      || m_blockchain.IsPruned(newBlock.GetBlockHeight(), newBlock.GetMinerId()) || ReceivedButNotValidated(blockHash))
   {
     NS_LOG_INFO ("BitcoinSelfishMiner ReceiveBlock: Bitcoin node " << GetNode ()->GetId () << " has already added this block in the m_blockchain: " << newBlock);
     
     if (m_invTimeouts.find(blockHash) != m_invTimeouts.end())
     {
       m_queueInv.erase(blockHash);
-      Simulator::Cancel (m_invTimeouts[blockHash]);
+      BitcoinEventProfiler::Cancel (m_invTimeouts[blockHash], INV_TIMEOUT_EXPIRED_EVENT);
       m_invTimeouts.erase(blockHash);
     }
   }
@@ -454,7 +462,7 @@ BitcoinSelfishMiner::ReceiveBlock(const Block &newBlock)
 	//PrintInvTimeouts();
 	
     m_queueInv.erase(blockHash);
-    Simulator::Cancel (m_invTimeouts[blockHash]);
+    BitcoinEventProfiler::Cancel (m_invTimeouts[blockHash], INV_TIMEOUT_EXPIRED_EVENT);
     m_invTimeouts.erase(blockHash);
 	
     //PrintQueueInv();
@@ -499,7 +507,7 @@ BitcoinSelfishMiner::ReceiveBlock(const Block &newBlock)
         m_la = 0;
         m_lh = 0;
         m_attackerTopBlock = m_honestNetworkTopBlock;
-        Simulator::Cancel (m_nextMiningEvent);
+        BitcoinEventProfiler::Cancel (m_nextMiningEvent, MINE_BLOCK_EVENT);
         ScheduleNextMiningEvent();
         break;
       }
@@ -513,8 +521,8 @@ BitcoinSelfishMiner::ReceiveBlock(const Block &newBlock)
         for (int j = 0; j < m_lh + 1; j++)
         {
           blocks.insert(blocks.begin(), b);
-		  if (m_blockchain.GetParent(b))
-            b = *(m_blockchain.GetParent(b));
+		  if (m_blockchain.HasParent(b))
+            b = m_blockchain.GetParent(b);
         }
 	 
         ReleaseChain(blocks);
@@ -534,8 +542,8 @@ BitcoinSelfishMiner::ReceiveBlock(const Block &newBlock)
         for (int j = 0; j < m_lh; j++)
         {
           blocks.insert(blocks.begin(), b);
-		  if (m_blockchain.GetParent(b))
-            b = *(m_blockchain.GetParent(b));        
+		  if (m_blockchain.HasParent(b))
+            b = m_blockchain.GetParent(b);        
         }
 	  
         ReleaseChain(blocks);
@@ -550,7 +558,26 @@ BitcoinSelfishMiner::ReceiveBlock(const Block &newBlock)
       }
       case EXIT:
       {
-        NS_FATAL_ERROR("ReceiveBlock: EXIT");
+        NS_LOG_INFO("ReceiveBlock: EXIT");
+        std::vector<Block> blocks;
+
+        Block b = m_blockchain.ReturnBlock(m_attackerTopBlock.GetBlockHeight(), GetNode ()->GetId ());
+
+        for (int j = 0; j < m_la; j++)
+        {
+          blocks.insert(blocks.begin(), b);
+          if (m_blockchain.HasParent(b))
+            b = m_blockchain.GetParent(b);
+        }
+
+        ReleaseChain(blocks);
+
+        m_la = 0;
+        m_lh = 0;
+        m_forkType = IRRELEVANT;
+        m_honestNetworkTopBlock = m_attackerTopBlock;
+
+        m_nodeStats->attackSuccess++;
         break;
       }
       case ERROR:
@@ -572,8 +599,8 @@ BitcoinSelfishMiner::ReleaseChain(std::vector<Block> blocks)
 {
   NS_LOG_FUNCTION (this);
   
-  rapidjson::Document inv; 
-  rapidjson::Document block; 
+  BitcoinJsonDocument inv (m_jsonPool); 
+  BitcoinJsonDocument block (m_jsonPool); 
   
   inv.SetObject();
   block.SetObject();
@@ -856,53 +883,30 @@ BitcoinSelfishMiner::ReleaseChain(std::vector<Block> blocks)
   
 
   // Stringify the DOM
-  rapidjson::StringBuffer invInfo;
+  rapidjson::StringBuffer &invInfo = m_jsonPool.GetBuffer (0);
   rapidjson::Writer<rapidjson::StringBuffer> invWriter(invInfo);
   inv.Accept(invWriter);
   
-  rapidjson::StringBuffer blockInfo;
+  rapidjson::StringBuffer &blockInfo = m_jsonPool.GetBuffer (1);
   rapidjson::Writer<rapidjson::StringBuffer> blockWriter(blockInfo);
   block.Accept(blockWriter);
   
+  // Serialize the messages once, they are shared by all the peers
+  Ptr<Packet> invPacket = CreateMessagePacket (invInfo);
+  Ptr<Packet> blockPacket = CreateMessagePacket (blockInfo);
+  int         noInvs = 0;
+
   int count = 0;
   
   for (std::vector<Ipv4Address>::const_iterator i = m_peersAddresses.begin(); i != m_peersAddresses.end(); ++i, ++count)
   {
-    
-    const uint8_t delimiter[] = "#";
-
     switch(m_blockBroadcastType)				  
     {
       case STANDARD:
       {
-        m_peersSockets[*i]->Send (reinterpret_cast<const uint8_t*>(invInfo.GetString()), invInfo.GetSize(), 0);
-        m_peersSockets[*i]->Send (delimiter, 1, 0);
-		
-        if (m_protocolType == STANDARD_PROTOCOL && !m_blockTorrent)
-          m_nodeStats->invSentBytes += m_bitcoinMessageHeader + m_countBytes + inv["inv"].Size()*m_inventorySizeBytes;
-        else if (m_protocolType == SENDHEADERS && !m_blockTorrent)
-          m_nodeStats->headersSentBytes += m_bitcoinMessageHeader + m_countBytes + inv["blocks"].Size()*m_headersSizeBytes;
-        else if (m_protocolType == STANDARD_PROTOCOL && m_blockTorrent)
-        {
-          m_nodeStats->extInvSentBytes += m_bitcoinMessageHeader + m_countBytes + inv["inv"].Size()*m_inventorySizeBytes;
-          for (int j=0; j<inv["inv"].Size(); j++)
-          {
-            m_nodeStats->extInvSentBytes += 5; //1Byte(fullBlock) + 4Bytes(numberOfChunks)
-            if (!inv["inv"][j]["fullBlock"].GetBool())
-              m_nodeStats->extInvSentBytes += inv["inv"][j]["availableChunks"].Size()*1;
-          }
-        }
-        else if (m_protocolType == SENDHEADERS && m_blockTorrent)
-        {
-          m_nodeStats->extHeadersSentBytes += m_bitcoinMessageHeader + m_countBytes + inv["blocks"].Size()*m_headersSizeBytes;
-          for (int j=0; j<inv["blocks"].Size(); j++)
-          {
-            m_nodeStats->extHeadersSentBytes += 1;//fullBlock
-            if (!inv["blocks"][j]["fullBlock"].GetBool())
-              m_nodeStats->extHeadersSentBytes += inv["inv"][j]["availableChunks"].Size();
-          }	
-        }
-		
+        m_peersSockets[*i]->Send (invPacket->Copy ());
+        noInvs++;
+
         NS_LOG_INFO ("At time " << Simulator::Now ().GetSeconds ()
                      << "s bitcoin miner " << GetNode ()->GetId () 
                      << " sent a packet " << invInfo.GetString() 
@@ -922,7 +926,7 @@ BitcoinSelfishMiner::ReleaseChain(std::vector<Block> blocks)
         double eventTime;	
 				
 /*                 std::cout << "Node " << GetNode()->GetId() << "-" << InetSocketAddress::ConvertFrom(from).GetIpv4 () 
-                          << " " << m_peersDownloadSpeeds[InetSocketAddress::ConvertFrom(from).GetIpv4 ()] << " Mbps , time = "
+                          << " " << GetPeerDownloadSpeed (InetSocketAddress::ConvertFrom(from).GetIpv4 ()) << " Mbps , time = "
                           << Simulator::Now ().GetSeconds() << "s \n"; */
                 
         if (m_sendBlockTimes.size() == 0 || Simulator::Now ().GetSeconds() >  m_sendBlockTimes.back())
@@ -941,8 +945,7 @@ BitcoinSelfishMiner::ReleaseChain(std::vector<Block> blocks)
         NS_LOG_INFO("Node " << GetNode()->GetId() << " will start sending the block to " << *i 
                     << " at " << Simulator::Now ().GetSeconds() + eventTime << "\n");
 
-        std::string packet = blockInfo.GetString();
-        Simulator::Schedule (Seconds(eventTime), &BitcoinSelfishMiner::SendBlock, this, packet, m_peersSockets[*i]);
+        Simulator::Schedule (Seconds(eventTime), &BitcoinSelfishMiner::SendBlock, this, blockPacket, m_peersSockets[*i]);
         Simulator::Schedule (Seconds(eventTime + sendTime), &BitcoinSelfishMiner::RemoveSendTime, this);
 
         break;
@@ -967,7 +970,7 @@ BitcoinSelfishMiner::ReleaseChain(std::vector<Block> blocks)
           m_nodeStats->blockSentBytes += m_bitcoinMessageHeader + blockMessageSize;
 			  
 /* 				std::cout << "Node " << GetNode()->GetId() << "-" << *i 
-                            << " " << m_peersDownloadSpeeds[*i] << " Mbps , time = "
+                            << " " << GetPeerDownloadSpeed (*i) << " Mbps , time = "
                             << Simulator::Now ().GetSeconds() << "s \n"; */
                 
           if (m_sendCompressedBlockTimes.size() == 0 || Simulator::Now ().GetSeconds() >  m_sendCompressedBlockTimes.back())
@@ -988,41 +991,15 @@ BitcoinSelfishMiner::ReleaseChain(std::vector<Block> blocks)
           //sendTime = blockSize / m_uploadSpeed * count;		  
           //std::cout << sendTime << std::endl;
 
-          std::string packet = blockInfo.GetString();
-          Simulator::Schedule (Seconds(sendTime), &BitcoinSelfishMiner::SendBlock, this, packet, m_peersSockets[*i]);
+          Simulator::Schedule (Seconds(sendTime), &BitcoinSelfishMiner::SendBlock, this, blockPacket, m_peersSockets[*i]);
           Simulator::Schedule (Seconds(eventTime + sendTime), &BitcoinSelfishMiner::RemoveCompressedBlockSendTime, this);
 
         }
         else
         {	    
-          m_peersSockets[*i]->Send (reinterpret_cast<const uint8_t*>(invInfo.GetString()), invInfo.GetSize(), 0);
-          m_peersSockets[*i]->Send (delimiter, 1, 0);
-	  
-          if (m_protocolType == STANDARD_PROTOCOL && !m_blockTorrent)
-            m_nodeStats->invSentBytes += m_bitcoinMessageHeader + m_countBytes + inv["inv"].Size()*m_inventorySizeBytes;
-          else if (m_protocolType == SENDHEADERS && !m_blockTorrent)
-            m_nodeStats->headersSentBytes += m_bitcoinMessageHeader + m_countBytes + inv["blocks"].Size()*m_headersSizeBytes;
-          else if (m_protocolType == STANDARD_PROTOCOL && m_blockTorrent)
-          {
-            m_nodeStats->extInvSentBytes += m_bitcoinMessageHeader + m_countBytes + inv["inv"].Size()*m_inventorySizeBytes;
-            for (int j=0; j<inv["inv"].Size(); j++)
-            {
-              m_nodeStats->extInvSentBytes += 5; //1Byte(fullBlock) + 4Bytes(numberOfChunks)
-              if (!inv["inv"][j]["fullBlock"].GetBool())
-                m_nodeStats->extInvSentBytes += inv["inv"][j]["availableChunks"].Size()*1;
-            }
-          }
-          else if (m_protocolType == SENDHEADERS && m_blockTorrent)
-          {
-            m_nodeStats->extHeadersSentBytes += m_bitcoinMessageHeader + m_countBytes + inv["blocks"].Size()*m_headersSizeBytes;
-            for (int j=0; j<inv["blocks"].Size(); j++)
-            {
-            m_nodeStats->extHeadersSentBytes += 1;//fullBlock
-            if (!inv["blocks"][j]["fullBlock"].GetBool())
-                m_nodeStats->extHeadersSentBytes += inv["blocks"][j]["availableChunks"].Size()*1;
-            }	
-          }
-	  
+          m_peersSockets[*i]->Send (invPacket->Copy ());
+          noInvs++;
+
           NS_LOG_INFO ("At time " << Simulator::Now ().GetSeconds ()
                        << "s bitcoin miner " << GetNode ()->GetId () 
                        << " sent a packet " << invInfo.GetString() 
@@ -1034,10 +1011,9 @@ BitcoinSelfishMiner::ReleaseChain(std::vector<Block> blocks)
       {
         double sendTime;
         double eventTime;
-        std::string packet;
 			  
 /* 				std::cout << "Node " << GetNode()->GetId() << "-" << *i 
-                            << " " << m_peersDownloadSpeeds[*i] << " Mbps , time = "
+                            << " " << GetPeerDownloadSpeed (*i) << " Mbps , time = "
                             << Simulator::Now ().GetSeconds() << "s \n"; */
 							
         if(count < m_noMiners - 1)
@@ -1073,8 +1049,7 @@ BitcoinSelfishMiner::ReleaseChain(std::vector<Block> blocks)
           //sendTime = blockMessageSize / m_uploadSpeed * count;		  
           //std::cout << sendTime << std::endl;
 
-          std::string packet = blockInfo.GetString();
-          Simulator::Schedule (Seconds(sendTime), &BitcoinSelfishMiner::SendBlock, this, packet, m_peersSockets[*i]);
+          Simulator::Schedule (Seconds(sendTime), &BitcoinSelfishMiner::SendBlock, this, blockPacket, m_peersSockets[*i]);
           Simulator::Schedule (Seconds(eventTime + sendTime), &BitcoinSelfishMiner::RemoveCompressedBlockSendTime, this);
         }
         else
@@ -1097,20 +1072,25 @@ BitcoinSelfishMiner::ReleaseChain(std::vector<Block> blocks)
             eventTime = m_sendBlockTimes.back() - Simulator::Now ().GetSeconds(); 
           }
           m_sendBlockTimes.push_back(Simulator::Now ().GetSeconds() + eventTime + sendTime);
-          packet = invInfo.GetString();
 		  
           /* std::cout << sendTime << " " << eventTime << " " << m_sendBlockTimes.size() << std::endl; */
           NS_LOG_INFO("Node " << GetNode()->GetId() << " will send the block to " << *i 
                       << " at " << Simulator::Now ().GetSeconds() + eventTime << ", eventTime = " << eventTime  << "\n");
 
-          Simulator::Schedule (Seconds(eventTime), &BitcoinSelfishMiner::SendBlock, this, packet, m_peersSockets[*i]);
+          Simulator::Schedule (Seconds(eventTime), &BitcoinSelfishMiner::SendBlock, this, invPacket, m_peersSockets[*i]);
           Simulator::Schedule (Seconds(eventTime + sendTime), &BitcoinSelfishMiner::RemoveSendTime, this);
 
         }
 	   break;
       }
     }
-  } 
+  }
+
+  if (noInvs > 0)
+  {
+    enum Messages invMessage = m_protocolType == SENDHEADERS ? HEADERS : INV;
+    CountSentBytes (invMessage, noInvs * ns3::GetMessageBytes (invMessage, blocks.size()));
+  }
 }
 
 
@@ -1118,7 +1098,10 @@ enum Action
 BitcoinSelfishMiner::ReadActionMatrix(enum ForkType f, int la, int lh)
 {
   NS_LOG_FUNCTION (this);
-  switch (m_decisionMatrix[f][la][lh]) 
+  char action = m_solvedMatrix.empty () ? m_decisionMatrix[f][la][lh]
+                                        : m_solvedMatrix[(f * m_maxAttackBlocks + la) * m_maxAttackBlocks + lh];
+
+  switch (action) 
   {
     case 'a': return ADOPT;
     case 'o': return OVERRIDE;
@@ -1128,6 +1111,7 @@ BitcoinSelfishMiner::ReadActionMatrix(enum ForkType f, int la, int lh)
     case '*': return ERROR;
 
   }
+  return ERROR;
 }
 
 const char* getForkType(enum ForkType m)
@@ -65,6 +65,9 @@ protected:
    */
   void ReleaseChain(std::vector<Block> blocks);	
   
+  /**
+   * \brief Read the action of the state from the decision matrix loaded from m_decisionMatrixFile, or from m_decisionMatrix
+   */
   enum Action ReadActionMatrix(enum ForkType f, int la, int lh);
   
   bool       m_attackFinished;
@@ -74,6 +77,8 @@ protected:
   Block      m_attackerTopBlock;
   int        m_maxAttackBlocks;
   enum ForkType m_forkType;
+  std::string        m_decisionMatrixFile;          //!< The file of the decision matrix written by BitcoinSelfishMdp (empty uses m_decisionMatrix)
+  std::vector<char>  m_solvedMatrix;                //!< The decision matrix loaded from m_decisionMatrixFile, indexed like BitcoinSelfishMdp::GetMatrix
 
 //Stale block rate = 1%  
   char m_decisionMatrix[3][20][20] = 
@@ -0,0 +1,294 @@
+/**
+ * This file contains the definitions of the functions declared in bitcoin-stats-exporter.h
+ */
+
+
+#include <cstring>
+#include <cstddef>
+#include <limits>
+#include <iomanip>
+#include "ns3/log.h"
+#include "bitcoin-stats-exporter.h"
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("BitcoinStatsExporter");
+
+/**
+ * The exported fields of nodeStatistics, in the order of the struct
+ */
+typedef struct {
+  const char  *name;
+  char         type;                      //'i' int, 'l' long, 'd' double
+  size_t       offset;
+} statsColumn;
+
+#define STATS_COLUMN(field, type) {#field, type, offsetof(nodeStatistics, field)}
+
+static const statsColumn statsColumns[] = {
+  STATS_COLUMN(nodeId, 'i'),
+  STATS_COLUMN(meanBlockReceiveTime, 'd'),
+  STATS_COLUMN(meanBlockPropagationTime, 'd'),
+  STATS_COLUMN(meanBlockSize, 'd'),
+  STATS_COLUMN(totalBlocks, 'i'),
+  STATS_COLUMN(staleBlocks, 'i'),
+  STATS_COLUMN(miner, 'i'),
+  STATS_COLUMN(minerGeneratedBlocks, 'i'),
+  STATS_COLUMN(minerAverageBlockGenInterval, 'd'),
+  STATS_COLUMN(minerAverageBlockSize, 'd'),
+  STATS_COLUMN(hashRate, 'd'),
+  STATS_COLUMN(attackSuccess, 'i'),
+  STATS_COLUMN(invReceivedBytes, 'l'),
+  STATS_COLUMN(invSentBytes, 'l'),
+  STATS_COLUMN(getHeadersReceivedBytes, 'l'),
+  STATS_COLUMN(getHeadersSentBytes, 'l'),
+  STATS_COLUMN(headersReceivedBytes, 'l'),
+  STATS_COLUMN(headersSentBytes, 'l'),
+  STATS_COLUMN(getDataReceivedBytes, 'l'),
+  STATS_COLUMN(getDataSentBytes, 'l'),
+  STATS_COLUMN(blockReceivedBytes, 'l'),
+  STATS_COLUMN(blockSentBytes, 'l'),
+  STATS_COLUMN(extInvReceivedBytes, 'l'),
+  STATS_COLUMN(extInvSentBytes, 'l'),
+  STATS_COLUMN(extGetHeadersReceivedBytes, 'l'),
+  STATS_COLUMN(extGetHeadersSentBytes, 'l'),
+  STATS_COLUMN(extHeadersReceivedBytes, 'l'),
+  STATS_COLUMN(extHeadersSentBytes, 'l'),
+  STATS_COLUMN(extGetDataReceivedBytes, 'l'),
+  STATS_COLUMN(extGetDataSentBytes, 'l'),
+  STATS_COLUMN(chunkReceivedBytes, 'l'),
+  STATS_COLUMN(chunkSentBytes, 'l'),
+  STATS_COLUMN(longestFork, 'i'),
+  STATS_COLUMN(blocksInForks, 'i'),
+  STATS_COLUMN(connections, 'i'),
+  STATS_COLUMN(blockTimeouts, 'l'),
+  STATS_COLUMN(chunkTimeouts, 'l'),
+  STATS_COLUMN(minedBlocksInMainChain, 'i')
+};
+
+#undef STATS_COLUMN
+
+static const int noStatsColumns = sizeof(statsColumns)/sizeof(statsColumn);
+
+
+/**
+ * \return the value of a column of stats and append its binary representation to column, if not 0
+ */
+static double
+GetColumnValue (const nodeStatistics &stats, const statsColumn &desc, std::vector<char> *column)
+{
+  const char *field = reinterpret_cast<const char*>(&stats) + desc.offset;
+
+  if (desc.type == 'i')
+  {
+    int32_t value = *reinterpret_cast<const int*>(field);
+    if (column)
+      column->insert (column->end (), reinterpret_cast<const char*>(&value), reinterpret_cast<const char*>(&value) + sizeof(value));
+    return value;
+  }
+  else if (desc.type == 'l')
+  {
+    int64_t value = *reinterpret_cast<const long*>(field);
+    if (column)
+      column->insert (column->end (), reinterpret_cast<const char*>(&value), reinterpret_cast<const char*>(&value) + sizeof(value));
+    return value;
+  }
+  else
+  {
+    double value = *reinterpret_cast<const double*>(field);
+    if (column)
+      column->insert (column->end (), reinterpret_cast<const char*>(&value), reinterpret_cast<const char*>(&value) + sizeof(value));
+    return value;
+  }
+}
+
+
+BitcoinStatsExporter::BitcoinStatsExporter (std::string fileName, enum StatsExportFormat format, uint32_t rowGroupRows)
+  : m_format (format), m_fileBuffer (1 << 20), m_rowGroupRows (rowGroupRows > 0 ? rowGroupRows : 1), m_groupRows (0),
+    m_rows (0), m_sums (noStatsColumns, 0), m_mins (noStatsColumns, 0), m_maxs (noStatsColumns, 0)
+{
+  NS_LOG_FUNCTION (this << fileName);
+
+  m_file.rdbuf ()->pubsetbuf (m_fileBuffer.data (), m_fileBuffer.size ());
+  m_file.open (fileName.c_str (), std::ios::out | std::ios::trunc | std::ios::binary);
+  if (!m_file.is_open ())
+    NS_FATAL_ERROR ("BitcoinStatsExporter: cannot open " << fileName);
+
+  m_roles[0] = m_roles[1] = 0;
+  for (int i = 0; i <= OTHER; i++)
+    m_regions[i] = 0;
+
+  if (m_format == STATS_BINARY)
+    m_columns.resize (noStatsColumns + 2);
+  else
+    m_file << std::setprecision (std::numeric_limits<double>::digits10 + 2);
+
+  WriteHeader ();
+}
+
+
+BitcoinStatsExporter::~BitcoinStatsExporter (void)
+{
+  NS_LOG_FUNCTION (this);
+  Close ();
+}
+
+
+void
+BitcoinStatsExporter::Add (const nodeStatistics &stats, enum BitcoinRegion region)
+{
+  uint8_t role = stats.miner == 1 ? 1 : 0;
+
+  if (!m_file.is_open ())
+    NS_FATAL_ERROR ("BitcoinStatsExporter: the file has been closed");
+
+  for (int i = 0; i < noStatsColumns; i++)
+  {
+    double value = GetColumnValue (stats, statsColumns[i], m_format == STATS_BINARY ? &m_columns[i] : 0);
+
+    if (m_format == STATS_CSV)
+    {
+      if (i > 0)
+        m_file << ",";
+      if (statsColumns[i].type == 'd')
+        m_file << value;
+      else
+        m_file << static_cast<int64_t>(value);
+    }
+
+    m_sums[i] += value;
+    if (m_rows == 0 || value < m_mins[i])
+      m_mins[i] = value;
+    if (m_rows == 0 || value > m_maxs[i])
+      m_maxs[i] = value;
+  }
+
+  if (m_format == STATS_CSV)
+    m_file << "," << getBitcoinRegion (region) << "," << (role == 1 ? "miner" : "relay") << "\n";
+  else
+  {
+    m_columns[noStatsColumns].push_back (static_cast<char>(region));
+    m_columns[noStatsColumns + 1].push_back (static_cast<char>(role));
+    if (++m_groupRows >= m_rowGroupRows)
+      FlushRowGroup ();
+  }
+
+  m_roles[role]++;
+  if (static_cast<int>(region) <= OTHER)
+    m_regions[region]++;
+  m_rows++;
+}
+
+
+void
+BitcoinStatsExporter::Add (const nodeStatistics *stats, int totalNodes, const uint32_t *regions)
+{
+  NS_LOG_FUNCTION (this << totalNodes);
+
+  for (int i = 0; i < totalNodes; i++)
+    Add (stats[i], getBitcoinEnum (regions[stats[i].nodeId]));
+}
+
+
+void
+BitcoinStatsExporter::Close (void)
+{
+  NS_LOG_FUNCTION (this);
+
+  if (!m_file.is_open ())
+    return;
+
+  if (m_format == STATS_BINARY)
+    FlushRowGroup ();
+  m_file.close ();
+  if (m_file.fail ())
+    NS_FATAL_ERROR ("BitcoinStatsExporter: cannot write the stats file");
+}
+
+
+uint64_t
+BitcoinStatsExporter::GetRows (void) const
+{
+  return m_rows;
+}
+
+
+void
+BitcoinStatsExporter::PrintTotals (std::ostream &out) const
+{
+  NS_LOG_FUNCTION (this);
+
+  out << "\nStats of " << m_rows << " nodes (" << m_roles[1] << " miners, " << m_roles[0] << " relays):\n";
+  out << std::left << std::setw (30) << "Column" << std::right << std::setw (22) << "Sum" << std::setw (18) << "Mean"
+      << std::setw (18) << "Min" << std::setw (18) << "Max" << "\n";
+
+  std::ios::fmtflags flags = out.flags ();
+  std::streamsize precision = out.precision (3);
+
+  out << std::fixed;
+  for (int i = 0; i < noStatsColumns; i++)
+  {
+    out << std::left << std::setw (30) << statsColumns[i].name << std::right << std::setw (22) << m_sums[i]
+        << std::setw (18) << (m_rows > 0 ? m_sums[i] / m_rows : 0) << std::setw (18) << m_mins[i]
+        << std::setw (18) << m_maxs[i] << "\n";
+  }
+  out.flags (flags);
+  out.precision (precision);
+
+  out << "Nodes per region:";
+  for (int i = 0; i <= OTHER; i++)
+    out << " " << getBitcoinRegion (getBitcoinEnum (i)) << " = " << m_regions[i];
+  out << "\n";
+}
+
+
+void
+BitcoinStatsExporter::WriteHeader (void)
+{
+  if (m_format == STATS_CSV)
+  {
+    for (int i = 0; i < noStatsColumns; i++)
+      m_file << (i > 0 ? "," : "") << statsColumns[i].name;
+    m_file << ",region,role\n";
+    return;
+  }
+
+  statsExportHeader header;
+
+  std::memcpy (header.magic, "BSTS", 4);
+  header.version = VERSION;
+  header.noColumns = noStatsColumns + 2;
+  header.rowGroupRows = m_rowGroupRows;
+  m_file.write (reinterpret_cast<const char*>(&header), sizeof(header));
+
+  for (int i = 0; i < noStatsColumns + 2; i++)
+  {
+    const char *name = i < noStatsColumns ? statsColumns[i].name : (i == noStatsColumns ? "region" : "role");
+    char        type = i < noStatsColumns ? statsColumns[i].type : 'b';
+    uint8_t     length = std::strlen (name);
+
+    m_file.put (type);
+    m_file.put (static_cast<char>(length));
+    m_file.write (name, length);
+  }
+}
+
+
+void
+BitcoinStatsExporter::FlushRowGroup (void)
+{
+  if (m_groupRows == 0)
+    return;
+
+  m_file.write (reinterpret_cast<const char*>(&m_groupRows), sizeof(m_groupRows));
+  for (auto &column : m_columns)
+  {
+    m_file.write (column.data (), column.size ());
+    column.clear ();
+  }
+  if (!m_file)
+    NS_FATAL_ERROR ("BitcoinStatsExporter: cannot write the stats file");
+  m_groupRows = 0;
+}
+
+}// Namespace ns3
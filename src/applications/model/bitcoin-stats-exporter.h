@@ -0,0 +1,110 @@
+/**
+ * This file declares the BitcoinStatsExporter class, which writes the nodeStatistics of all the
+ * nodes to a csv or a binary columnar file.
+ */
+
+
+#ifndef BITCOIN_STATS_EXPORTER_H
+#define BITCOIN_STATS_EXPORTER_H
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <ostream>
+#include <stdint.h>
+#include "bitcoin.h"
+
+namespace ns3 {
+
+enum StatsExportFormat
+{
+  STATS_CSV,                   //0
+  STATS_BINARY                 //1
+};
+
+
+/**
+ * The header at the beginning of a binary stats file. It is followed by noColumns column descriptions,
+ * each a type ('i' int32, 'l' int64, 'd' double, 'b' uint8), the length of the name and the name.
+ * Then come the row groups: the number of rows of the group (uint32) followed by the values of each
+ * column for these rows, stored contiguously in the order of the columns.
+ */
+typedef struct {
+  char       magic[4];                    //"BSTS"
+  uint32_t   version;
+  uint32_t   noColumns;
+  uint32_t   rowGroupRows;                //The maximum rows of a row group
+} statsExportHeader;
+
+
+/**
+ * Writes every field of nodeStatistics, plus the region and the role (0->relay, 1->miner) of the node,
+ * as one column each, one row per node. The rows are streamed: the csv rows are written as they are
+ * added, and the binary rows are buffered column by column and written out as a row group every
+ * rowGroupRows, so the memory used does not grow with the number of nodes. The sum, minimum and
+ * maximum of every column are computed in the same pass and reported by PrintTotals.
+ */
+class BitcoinStatsExporter
+{
+public:
+  static const uint32_t VERSION = 1;
+
+  /**
+   * \param fileName the file to write, which is overwritten
+   * \param format csv, with a header line of the column names, or binary, with the schema in statsExportHeader
+   * \param rowGroupRows the rows of a binary row group
+   */
+  BitcoinStatsExporter (std::string fileName, enum StatsExportFormat format = STATS_CSV, uint32_t rowGroupRows = 65536);
+
+  virtual ~BitcoinStatsExporter (void);
+
+  /**
+   * \brief Add the row of a node
+   */
+  void Add (const nodeStatistics &stats, enum BitcoinRegion region);
+
+  /**
+   * \brief Add the rows of totalNodes nodes
+   * \param regions the region of each node, indexed by nodeId
+   */
+  void Add (const nodeStatistics *stats, int totalNodes, const uint32_t *regions);
+
+  /**
+   * \brief Write out the buffered rows and close the file
+   */
+  void Close (void);
+
+  /**
+   * \return the number of rows added
+   */
+  uint64_t GetRows (void) const;
+
+  /**
+   * \brief Print the sum, mean, minimum and maximum of every column, and the nodes per role and region
+   */
+  void PrintTotals (std::ostream &out) const;
+
+private:
+  BitcoinStatsExporter (const BitcoinStatsExporter &);
+  BitcoinStatsExporter& operator= (const BitcoinStatsExporter &);
+
+  void WriteHeader (void);
+  void FlushRowGroup (void);
+
+  enum StatsExportFormat             m_format;            //!< The format of the file
+  std::ofstream                      m_file;              //!< The exported file
+  std::vector<char>                  m_fileBuffer;        //!< The stream buffer of m_file
+  uint32_t                           m_rowGroupRows;      //!< The maximum rows of a binary row group
+  uint32_t                           m_groupRows;         //!< The rows buffered in m_columns
+  std::vector<std::vector<char>>     m_columns;           //!< The buffered values of each column of the row group
+  uint64_t                           m_rows;              //!< The rows added
+  std::vector<double>                m_sums;              //!< The sum of each column
+  std::vector<double>                m_mins;              //!< The minimum of each column
+  std::vector<double>                m_maxs;              //!< The maximum of each column
+  uint64_t                           m_roles[2];          //!< The rows of each role
+  uint64_t                           m_regions[OTHER + 1];//!< The rows of each region
+};
+
+}// Namespace ns3
+
+#endif /* BITCOIN_STATS_EXPORTER_H */
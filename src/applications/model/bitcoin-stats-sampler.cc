@@ -0,0 +1,183 @@
+/**
+ * This file contains the definitions of the functions declared in bitcoin-stats-sampler.h
+ */
+
+
+#include <algorithm>
+#include "ns3/simulator.h"
+#include "ns3/log.h"
+#include "bitcoin-node.h"
+#include "bitcoin-event-profiler.h"
+#include "bitcoin-stats-sampler.h"
+
+namespace ns3 {
+
+NS_LOG_COMPONENT_DEFINE ("BitcoinStatsSampler");
+
+/**
+ * The cumulative counters of nodeStatistics that are summed over the nodes, with their column names
+ */
+static long nodeStatistics::* const sampledCounters[] = {
+  &nodeStatistics::invReceivedBytes, &nodeStatistics::invSentBytes,
+  &nodeStatistics::getHeadersReceivedBytes, &nodeStatistics::getHeadersSentBytes,
+  &nodeStatistics::headersReceivedBytes, &nodeStatistics::headersSentBytes,
+  &nodeStatistics::getDataReceivedBytes, &nodeStatistics::getDataSentBytes,
+  &nodeStatistics::blockReceivedBytes, &nodeStatistics::blockSentBytes,
+  &nodeStatistics::extInvReceivedBytes, &nodeStatistics::extInvSentBytes,
+  &nodeStatistics::extGetHeadersReceivedBytes, &nodeStatistics::extGetHeadersSentBytes,
+  &nodeStatistics::extHeadersReceivedBytes, &nodeStatistics::extHeadersSentBytes,
+  &nodeStatistics::extGetDataReceivedBytes, &nodeStatistics::extGetDataSentBytes,
+  &nodeStatistics::chunkReceivedBytes, &nodeStatistics::chunkSentBytes,
+  &nodeStatistics::blockTimeouts, &nodeStatistics::chunkTimeouts
+};
+
+static const char* const sampledCounterNames[] = {
+  "invReceivedBytes", "invSentBytes",
+  "getHeadersReceivedBytes", "getHeadersSentBytes",
+  "headersReceivedBytes", "headersSentBytes",
+  "getDataReceivedBytes", "getDataSentBytes",
+  "blockReceivedBytes", "blockSentBytes",
+  "extInvReceivedBytes", "extInvSentBytes",
+  "extGetHeadersReceivedBytes", "extGetHeadersSentBytes",
+  "extHeadersReceivedBytes", "extHeadersSentBytes",
+  "extGetDataReceivedBytes", "extGetDataSentBytes",
+  "chunkReceivedBytes", "chunkSentBytes",
+  "blockTimeouts", "chunkTimeouts"
+};
+
+static const int noSampledCounters = sizeof(sampledCounters)/sizeof(sampledCounters[0]);
+
+/**
+ * The containers whose elements are reported as pending queues
+ */
+static const enum BitcoinNodeContainer sampledQueues[] = {QUEUE_INV, QUEUE_CHUNKS, RECEIVED_NOT_VALIDATED, INV_TIMEOUTS, CHUNK_TIMEOUTS};
+
+static const int noSampledQueues = sizeof(sampledQueues)/sizeof(sampledQueues[0]);
+
+
+BitcoinStatsSampler::BitcoinStatsSampler (ApplicationContainer apps)
+  : m_lastSimulatedTime (0), m_lastEvents (0)
+{
+  NS_LOG_FUNCTION (this);
+  Add (apps);
+}
+
+
+BitcoinStatsSampler::~BitcoinStatsSampler (void)
+{
+  NS_LOG_FUNCTION (this);
+  Simulator::Cancel (m_nextSample);
+  if (m_file.is_open ())
+    m_file.close ();
+}
+
+
+void
+BitcoinStatsSampler::Add (ApplicationContainer apps)
+{
+  NS_LOG_FUNCTION (this);
+
+  for (ApplicationContainer::Iterator i = apps.Begin (); i != apps.End (); ++i)
+  {
+    Ptr<BitcoinNode> node = DynamicCast<BitcoinNode> (*i);
+    if (node)
+      m_nodes.push_back (node);
+  }
+}
+
+
+void
+BitcoinStatsSampler::Start (Time interval, std::string fileName)
+{
+  NS_LOG_FUNCTION (this << interval << fileName);
+
+  if (!interval.IsStrictlyPositive ())
+    NS_FATAL_ERROR ("BitcoinStatsSampler: the interval must be positive");
+
+  m_interval = interval;
+  m_file.open (fileName.c_str (), std::ios::out | std::ios::app);
+  if (!m_file.is_open ())
+    NS_FATAL_ERROR ("BitcoinStatsSampler: cannot open " << fileName);
+
+  //Write the header only to a new file, so that a restored run continues the same series
+  m_file.seekp (0, std::ios::end);
+  if (m_file.tellp () == 0)
+  {
+    m_file << "time,nodes";
+    for (int i = 0; i < noSampledCounters; i++)
+      m_file << "," << sampledCounterNames[i];
+    m_file << ",maxTotalBlocks,meanStaleBlocks,staleRate,longestFork";
+    for (int i = 0; i < noSampledQueues; i++)
+      m_file << "," << getBitcoinNodeContainerName (sampledQueues[i]);
+    m_file << ",bufferedBytes,simulatedSecondsPerSecond,eventsPerSecond" << std::endl;
+  }
+
+  m_lastWallTime = std::chrono::steady_clock::now ();
+  m_lastSimulatedTime = Simulator::Now ().GetSeconds ();
+  m_lastEvents = BitcoinEventProfiler::GetTotalCount ();
+
+  Simulator::Cancel (m_nextSample);
+  m_nextSample = Simulator::Schedule (m_interval, &BitcoinStatsSampler::Sample, this);
+}
+
+
+void
+BitcoinStatsSampler::Sample (void)
+{
+  NS_LOG_FUNCTION (this);
+
+  std::vector<long> counters (noSampledCounters, 0);
+  std::vector<long> queues (noSampledQueues, 0);
+  long   bufferedBytes = 0;
+  long   totalBlocks = 0;
+  long   staleBlocks = 0;
+  int    maxTotalBlocks = 0;
+  int    longestFork = 0;
+  int    nodes = 0;
+
+  for (auto &node : m_nodes)
+  {
+    node->UpdateNodeStats ();
+
+    const nodeStatistics *stats = node->GetNodeStats ();
+    if (stats == 0)
+      continue;
+
+    for (int i = 0; i < noSampledCounters; i++)
+      counters[i] += stats->*sampledCounters[i];
+
+    totalBlocks += stats->totalBlocks;
+    staleBlocks += stats->staleBlocks;
+    maxTotalBlocks = std::max (maxTotalBlocks, stats->totalBlocks);
+    longestFork = std::max (longestFork, stats->longestFork);
+
+    std::vector<containerUsage> usage = node->GetMemoryUsage ();
+    for (int i = 0; i < noSampledQueues; i++)
+      queues[i] += usage[sampledQueues[i]].elements;
+    bufferedBytes += usage[BUFFERED_DATA].bytes;
+    nodes++;
+  }
+
+  std::chrono::steady_clock::time_point wallTime = std::chrono::steady_clock::now ();
+  double wallSeconds = std::chrono::duration<double> (wallTime - m_lastWallTime).count ();
+  double simulatedTime = Simulator::Now ().GetSeconds ();
+  long   events = BitcoinEventProfiler::GetTotalCount ();
+
+  m_file << simulatedTime << "," << nodes;
+  for (int i = 0; i < noSampledCounters; i++)
+    m_file << "," << counters[i];
+  m_file << "," << maxTotalBlocks << "," << (nodes > 0 ? static_cast<double>(staleBlocks) / nodes : 0)
+         << "," << (totalBlocks > 0 ? static_cast<double>(staleBlocks) / totalBlocks : 0) << "," << longestFork;
+  for (int i = 0; i < noSampledQueues; i++)
+    m_file << "," << queues[i];
+  m_file << "," << bufferedBytes
+         << "," << (wallSeconds > 0 ? (simulatedTime - m_lastSimulatedTime) / wallSeconds : 0)
+         << "," << (wallSeconds > 0 ? (events - m_lastEvents) / wallSeconds : 0) << std::endl;
+
+  m_lastWallTime = wallTime;
+  m_lastSimulatedTime = simulatedTime;
+  m_lastEvents = events;
+  m_nextSample = Simulator::Schedule (m_interval, &BitcoinStatsSampler::Sample, this);
+}
+
+}// Namespace ns3
@@ -0,0 +1,70 @@
+/**
+ * This file declares the BitcoinStatsSampler class.
+ */
+
+
+#ifndef BITCOIN_STATS_SAMPLER_H
+#define BITCOIN_STATS_SAMPLER_H
+
+#include <vector>
+#include <fstream>
+#include <chrono>
+#include "ns3/ptr.h"
+#include "ns3/nstime.h"
+#include "ns3/event-id.h"
+#include "ns3/application-container.h"
+#include "bitcoin.h"
+
+namespace ns3 {
+
+class BitcoinNode;
+
+/**
+ * Periodically snapshots the statistics of the bitcoin applications installed in this system while the
+ * simulation runs, instead of only at StopApplication. Every snapshot is appended as a single csv line
+ * to a time series file, which is flushed after each line so that it can be followed during a long run:
+ *  - the Bytes sent and received of every message type, summed over the nodes
+ *  - the most blocks of any node, the mean stale blocks per node, the stale rate and the longest fork
+ *  - the block and chunk timeouts, summed over the nodes
+ *  - the pending inv, chunk and validation queues and the buffered data, summed over the nodes
+ *  - the simulated seconds and the profiled events (0 if BitcoinEventProfiler is disabled) per wall second
+ * The counters are cumulative from the start of the run. The file is opened for appending, so a run
+ * restored from a checkpoint continues the series of the run that saved it.
+ */
+class BitcoinStatsSampler
+{
+public:
+  /**
+   * \param apps the applications to sample. Applications which are not BitcoinNodes are ignored.
+   */
+  BitcoinStatsSampler (ApplicationContainer apps);
+
+  virtual ~BitcoinStatsSampler (void);
+
+  /**
+   * \brief Add more applications to sample
+   */
+  void Add (ApplicationContainer apps);
+
+  /**
+   * \brief Take a snapshot every interval, from interval until the simulation stops
+   * \param interval the simulated time between two snapshots
+   * \param fileName the file the snapshots are appended to
+   */
+  void Start (Time interval, std::string fileName);
+
+private:
+  void Sample (void);
+
+  std::vector<Ptr<BitcoinNode>>           m_nodes;             //!< The sampled applications
+  Time                                    m_interval;          //!< The interval between two snapshots
+  std::ofstream                           m_file;              //!< The time series file
+  EventId                                 m_nextSample;        //!< Event of the next snapshot
+  std::chrono::steady_clock::time_point   m_lastWallTime;      //!< The wall time of the previous snapshot
+  double                                  m_lastSimulatedTime; //!< The simulated time of the previous snapshot
+  long                                    m_lastEvents;        //!< The profiled events at the previous snapshot
+};
+
+}// Namespace ns3
+
+#endif /* BITCOIN_STATS_SAMPLER_H */
@@ -9,10 +9,15 @@
 #include "ns3/traced-callback.h"
 #include "ns3/address.h"
 #include "ns3/log.h"
+#include <type_traits>
 #include "bitcoin.h"
+#include "bitcoin-memory-usage.h"
 
 namespace ns3 {
 
+static_assert (sizeof(Block) == 32, "The Block record must stay 32 Bytes");
+static_assert (std::is_trivially_copyable<Block>::value, "The Block record must stay trivially copyable");
+
 
 /**
  *
@@ -28,31 +33,13 @@ Block::Block(int blockHeight, int minerId, int parentBlockMinerId, int blockSize
   m_parentBlockMinerId = parentBlockMinerId;
   m_blockSizeBytes = blockSizeBytes;
   m_timeCreated = timeCreated;
-  m_timeReceived = timeReceived;
-  m_receivedFromIpv4 = receivedFromIpv4;
-
-}
-
-Block::Block()
-{  
-  Block(0, 0, 0, 0, 0, 0, Ipv4Address("0.0.0.0"));
+  m_propagationTime = static_cast<float>(timeReceived - timeCreated);
+  m_receivedFromIpv4 = receivedFromIpv4.Get();
 
 }
 
-Block::Block (const Block &blockSource)
+Block::Block() : Block(0, 0, 0, 0, 0, 0, Ipv4Address("0.0.0.0"))
 {  
-  m_blockHeight = blockSource.m_blockHeight;
-  m_minerId = blockSource.m_minerId;
-  m_parentBlockMinerId = blockSource.m_parentBlockMinerId;
-  m_blockSizeBytes = blockSource.m_blockSizeBytes;
-  m_timeCreated = blockSource.m_timeCreated;
-  m_timeReceived = blockSource.m_timeReceived;
-  m_receivedFromIpv4 = blockSource.m_receivedFromIpv4;
-
-}
-
-Block::~Block (void)
-{
 }
 
 int 
@@ -112,20 +99,20 @@ Block::GetTimeCreated (void) const
 double 
 Block::GetTimeReceived (void) const
 {
-  return m_timeReceived;
+  return m_timeCreated + m_propagationTime;
 }
   
 
 Ipv4Address 
 Block::GetReceivedFromIpv4 (void) const
 {
-  return m_receivedFromIpv4;
+  return Ipv4Address (m_receivedFromIpv4);
 }
   
 void 
 Block::SetReceivedFromIpv4 (Ipv4Address receivedFromIpv4)
 {
-  m_receivedFromIpv4 = receivedFromIpv4;
+  m_receivedFromIpv4 = receivedFromIpv4.Get();
 }
 
 bool 
@@ -147,20 +134,6 @@ Block::IsChild(const Block &block) const
 }
 
 
-Block& 
-Block::operator= (const Block &blockSource)
-{  
-  m_blockHeight = blockSource.m_blockHeight;
-  m_minerId = blockSource.m_minerId;
-  m_parentBlockMinerId = blockSource.m_parentBlockMinerId;
-  m_blockSizeBytes = blockSource.m_blockSizeBytes;
-  m_timeCreated = blockSource.m_timeCreated;
-  m_timeReceived = blockSource.m_timeReceived;
-  m_receivedFromIpv4 = blockSource.m_receivedFromIpv4;
-
-  return *this;
-}
-
 std::string Block::ToString(void) const
 {
   std::string result = "";
@@ -170,7 +143,7 @@ std::string Block::ToString(void) const
   result += "Parent Block Miner Id :  " + std::to_string(m_parentBlockMinerId) + "\n";
   result += "Block Size Bytes : " + std::to_string(m_blockSizeBytes) + "\n";
   result += "Time Created : " + std::to_string(m_timeCreated) + "\n";
-  result += "Time Received :  " + std::to_string(m_timeReceived) + "\n";
+  result += "Time Received :  " + std::to_string(GetTimeReceived()) + "\n";
 
   return result;
 }
@@ -183,32 +156,62 @@ std::string Block::ToString(void) const
  
 BitcoinChunk::BitcoinChunk(int blockHeight, int minerId, int chunkId, int parentBlockMinerId, int blockSizeBytes, 
              double timeCreated, double timeReceived, Ipv4Address receivedFromIpv4) :  
-             Block (blockHeight, minerId, parentBlockMinerId, blockSizeBytes, 
-                    timeCreated, timeReceived, receivedFromIpv4)
+             m_block (blockHeight, minerId, parentBlockMinerId, blockSizeBytes, 
+                      timeCreated, timeReceived, receivedFromIpv4)
 {  
   m_chunkId = chunkId;
 }
 
-BitcoinChunk::BitcoinChunk()
+BitcoinChunk::BitcoinChunk() : m_chunkId (0)
 {  
-  BitcoinChunk(0, 0, 0, 0, 0, 0, 0, Ipv4Address("0.0.0.0"));
 }
 
-BitcoinChunk::BitcoinChunk (const BitcoinChunk &chunkSource)
-{  
-  m_blockHeight = chunkSource.m_blockHeight;
-  m_minerId = chunkSource.m_minerId;
-  m_chunkId = chunkSource.m_chunkId;
-  m_parentBlockMinerId = chunkSource.m_parentBlockMinerId;
-  m_blockSizeBytes = chunkSource.m_blockSizeBytes;
-  m_timeCreated = chunkSource.m_timeCreated;
-  m_timeReceived = chunkSource.m_timeReceived;
-  m_receivedFromIpv4 = chunkSource.m_receivedFromIpv4;
+const Block&
+BitcoinChunk::GetBlock (void) const
+{
+  return m_block;
+}
 
+int 
+BitcoinChunk::GetBlockHeight (void) const
+{
+  return m_block.GetBlockHeight ();
 }
 
-BitcoinChunk::~BitcoinChunk (void)
+int 
+BitcoinChunk::GetMinerId (void) const
 {
+  return m_block.GetMinerId ();
+}
+
+int 
+BitcoinChunk::GetParentBlockMinerId (void) const
+{
+  return m_block.GetParentBlockMinerId ();
+}
+
+int 
+BitcoinChunk::GetBlockSizeBytes (void) const
+{
+  return m_block.GetBlockSizeBytes ();
+}
+
+double 
+BitcoinChunk::GetTimeCreated (void) const
+{
+  return m_block.GetTimeCreated ();
+}
+
+double 
+BitcoinChunk::GetTimeReceived (void) const
+{
+  return m_block.GetTimeReceived ();
+}
+
+Ipv4Address 
+BitcoinChunk::GetReceivedFromIpv4 (void) const
+{
+  return m_block.GetReceivedFromIpv4 ();
 }
 
 int 
@@ -223,19 +226,126 @@ BitcoinChunk::SetChunkId (int chunkId)
   m_chunkId = chunkId;
 }
 
-BitcoinChunk& 
-BitcoinChunk::operator= (const BitcoinChunk &chunkSource)
-{  
-  m_blockHeight = chunkSource.m_blockHeight;
-  m_minerId = chunkSource.m_minerId;
-  m_chunkId = chunkSource.m_chunkId;
-  m_parentBlockMinerId = chunkSource.m_parentBlockMinerId;
-  m_blockSizeBytes = chunkSource.m_blockSizeBytes;
-  m_timeCreated = chunkSource.m_timeCreated;
-  m_timeReceived = chunkSource.m_timeReceived;
-  m_receivedFromIpv4 = chunkSource.m_receivedFromIpv4;
 
-  return *this;
+/**
+ *
+ * Class ChunkBitmap functions
+ *
+ */
+ 
+ChunkBitmap::ChunkBitmap (int noChunks) : m_noChunks (noChunks), m_words ((noChunks + 63) / 64, 0)
+{
+}
+
+ChunkBitmap::~ChunkBitmap (void)
+{
+}
+
+int
+ChunkBitmap::GetNoChunks (void) const
+{
+  return m_noChunks;
+}
+
+void
+ChunkBitmap::Set (int chunk)
+{
+  if (chunk >= m_noChunks)
+  {
+    m_noChunks = chunk + 1;
+    m_words.resize ((m_noChunks + 63) / 64, 0);
+  }
+  m_words[chunk / 64] |= static_cast<uint64_t>(1) << (chunk % 64);
+}
+
+void
+ChunkBitmap::Reset (int chunk)
+{
+  if (chunk < m_noChunks)
+    m_words[chunk / 64] &= ~(static_cast<uint64_t>(1) << (chunk % 64));
+}
+
+bool
+ChunkBitmap::Test (int chunk) const
+{
+  return chunk >= 0 && chunk < m_noChunks && (m_words[chunk / 64] >> (chunk % 64)) & 1;
+}
+
+void
+ChunkBitmap::SetAll (void)
+{
+  std::fill (m_words.begin (), m_words.end (), ~static_cast<uint64_t>(0));
+  if (m_noChunks % 64 != 0)
+    m_words.back () = (static_cast<uint64_t>(1) << (m_noChunks % 64)) - 1;
+}
+
+int
+ChunkBitmap::Count (void) const
+{
+  int count = 0;
+
+  for (auto &word : m_words)
+    count += __builtin_popcountll (word);
+  return count;
+}
+
+ChunkBitmap
+ChunkBitmap::Intersect (const ChunkBitmap &other) const
+{
+  ChunkBitmap result (m_noChunks);
+  size_t      noWords = std::min (m_words.size (), other.m_words.size ());
+
+  for (size_t i = 0; i < noWords; i++)
+    result.m_words[i] = m_words[i] & other.m_words[i];
+  return result;
+}
+
+std::vector<int>
+ChunkBitmap::GetChunks (void) const
+{
+  std::vector<int> chunks;
+
+  chunks.reserve (Count ());
+  for (size_t i = 0; i < m_words.size (); i++)
+  {
+    uint64_t word = m_words[i];
+    while (word != 0)
+    {
+      chunks.push_back (i * 64 + __builtin_ctzll (word));
+      word &= word - 1;
+    }
+  }
+  return chunks;
+}
+
+std::string
+ChunkBitmap::Pack (void) const
+{
+  static const char hex[] = "0123456789abcdef";
+  int               noBytes = (m_noChunks + 7) / 8;
+  std::string       packed (2 * noBytes, '0');
+
+  for (int i = 0; i < noBytes; i++)
+  {
+    uint8_t byte = (m_words[i / 8] >> (8 * (i % 8))) & 0xff;
+    packed[2 * i] = hex[byte >> 4];
+    packed[2 * i + 1] = hex[byte & 0x0f];
+  }
+  return packed;
+}
+
+ChunkBitmap
+ChunkBitmap::Unpack (const std::string &packed)
+{
+  int          noBytes = packed.size () / 2;
+  ChunkBitmap  bitmap (8 * noBytes);
+
+  for (int i = 0; i < noBytes; i++)
+  {
+    uint64_t byte = std::stoul (packed.substr (2 * i, 2), 0, 16);
+    bitmap.m_words[i / 8] |= byte << (8 * (i % 8));
+  }
+  return bitmap;
 }
 
 
@@ -244,11 +354,65 @@ BitcoinChunk::operator= (const BitcoinChunk &chunkSource)
  * Class Blockchain functions
  *
  */
+
+/**
+ * Compares the heights of two block keys
+ */
+static bool
+IsKeyBelow (const blockKey &key1, const blockKey &key2)
+{
+  return key1.height < key2.height;
+}
+
+/**
+ * Check if the keys of the pruned or dropped blocks, which are sorted by height, list the block
+ */
+static bool
+HasPrunedKey (const std::vector<blockKey> &keys, int height, int minerId)
+{
+  blockKey key = {height, minerId};
+
+  for (auto it = std::lower_bound(keys.begin(), keys.end(), key, IsKeyBelow); it != keys.end() && it->height == height; it++)
+  {
+    if (it->minerId == minerId)
+      return true;
+  }
+  return false;
+}
+
+/**
+ * Adds the key of a block after the keys of the same height
+ */
+static void
+InsertPrunedKey (std::vector<blockKey> &keys, int height, int minerId)
+{
+  blockKey key = {height, minerId};
+
+  keys.insert(std::upper_bound(keys.begin(), keys.end(), key, IsKeyBelow), key);
+}
+
+/**
+ * Removes the keys below the height
+ */
+static void
+TrimPrunedKeys (std::vector<blockKey> &keys, int height)
+{
+  blockKey key = {height, 0};
+
+  keys.erase(keys.begin(), std::lower_bound(keys.begin(), keys.end(), key, IsKeyBelow));
+}
+
  
 Blockchain::Blockchain(void)
 {
   m_noStaleBlocks = 0;
   m_totalBlocks = 0;
+  m_finalityDepth = 0;
+  m_prunedHeight = 0;
+  m_prunedBlocksInForks = 0;
+  m_prunedForks.maxSize = 0;
+  m_noDroppedBlocks = 0;
+  m_heightOffsets.push_back(0);
   Block genesisBlock(0, -1, -2, 0, 0, 0, Ipv4Address("0.0.0.0"));
   AddBlock(genesisBlock); 
 }
@@ -280,57 +444,50 @@ Blockchain::GetTotalBlocks (void) const
 int 
 Blockchain::GetBlockchainHeight (void) const 
 {
-  return GetCurrentTopBlock()->GetBlockHeight();
+  return GetTopHeight();
 }
 
-bool 
-Blockchain::HasBlock (const Block &newBlock) const
+
+int 
+Blockchain::GetTopHeight (void) const 
 {
-  
-  if (newBlock.GetBlockHeight() > GetCurrentTopBlock()->GetBlockHeight())
+  return static_cast<int>(m_heightOffsets.size()) - 2;
+}
+
+
+int 
+Blockchain::FindBlock (int height, int minerId) const
+{
+  if (height < 0 || height > GetTopHeight())
+    return -1;
+
+  for (int i = m_heightOffsets[height]; i < m_heightOffsets[height + 1]; i++)
   {
-    /* The new block has a new blockHeight, so we haven't received it previously. */
-	
-	return false;
-  }
-  else														
-  {															
-    /*  The new block doesn't have a new blockHeight, so we have to check it is new or if we have already received it. */
-	
-    for (auto const &block: m_blocks[newBlock.GetBlockHeight()]) 
-    {
-      if (block == newBlock)
-	  {
-	    return true;
-	  }
-    }
+    if (m_minerIds[i] == minerId)
+      return i;
   }
-  return false;
+  return -1;
+}
+
+
+Block 
+Blockchain::GetBlockAt (int height, int index) const
+{
+  return Block(height, m_minerIds[index], m_parentBlockMinerIds[index], m_blockSizes[index], 
+               m_timesCreated[index], m_timesReceived[index], Ipv4Address(m_receivedFromIpv4[index]));
+}
+
+
+bool 
+Blockchain::HasBlock (const Block &newBlock) const
+{
+  return FindBlock(newBlock.GetBlockHeight(), newBlock.GetMinerId()) != -1;
 }
 
 bool 
 Blockchain::HasBlock (int height, int minerId) const
 {
-  
-  if (height > GetCurrentTopBlock()->GetBlockHeight())		
-  {
-    /* The new block has a new blockHeight, so we haven't received it previously. */
-	
-	return false;
-  }
-  else														
-  {															
-    /*  The new block doesn't have a new blockHeight, so we have to check it is new or if we have already received it. */
-	
-    for (auto const &block: m_blocks[height]) 
-    {
-      if (block.GetBlockHeight() == height && block.GetMinerId() == minerId)
-	  {
-	    return true;
-	  }
-    }
-  }
-  return false;
+  return FindBlock(height, minerId) != -1;
 }
 
 
@@ -338,15 +495,10 @@ Block
 Blockchain::ReturnBlock(int height, int minerId)
 {
   std::vector<Block>::iterator  block_it;
+  int                           index = FindBlock(height, minerId);
 
-  if (height <= GetBlockchainHeight() && height >= 0)
-  {
-    for (block_it = m_blocks[height].begin();  block_it < m_blocks[height].end(); block_it++)
-    {
-      if (block_it->GetBlockHeight() == height && block_it->GetMinerId() == minerId)
-        return *block_it;
-    }
-  }
+  if (index != -1)
+    return GetBlockAt(height, index);
   
   for (block_it = m_orphans.begin();  block_it < m_orphans.end(); block_it++)
   {
@@ -372,6 +524,13 @@ Blockchain::IsOrphan (const Block &newBlock) const
 }
 
 
+bool 
+Blockchain::IsPruned (int height, int minerId) const
+{
+  return HasPrunedKey(m_prunedBlocks, height, minerId) || HasPrunedKey(m_droppedOrphans, height, minerId);
+}
+
+
 bool 
 Blockchain::IsOrphan (int height, int minerId) const
 {													
@@ -386,36 +545,19 @@ Blockchain::IsOrphan (int height, int minerId) const
 }
 
 
-const Block* 
-Blockchain::GetBlockPointer (const Block &newBlock) const
+std::vector<Block> 
+Blockchain::GetChildren (const Block &block) const
 {
-  
-  for (auto const &block: m_blocks[newBlock.GetBlockHeight()]) 
-  {
-    if (block == newBlock)
-    {
-      return &block;
-    }
-  }
-  return nullptr;
-}
- 
-const std::vector<const Block *> 
-Blockchain::GetChildrenPointers (const Block &block)
-{
-  std::vector<const Block *> children;
-  std::vector<Block>::iterator  block_it;
+  std::vector<Block> children;
   int childrenHeight = block.GetBlockHeight() + 1;
   
-  if (childrenHeight > GetBlockchainHeight())
+  if (childrenHeight > GetTopHeight() || childrenHeight < 0)
     return children;
 
-  for (block_it = m_blocks[childrenHeight].begin();  block_it < m_blocks[childrenHeight].end(); block_it++)
+  for (int i = m_heightOffsets[childrenHeight]; i < m_heightOffsets[childrenHeight + 1]; i++)
   {
-    if (block.IsParent(*block_it))
-    {
-      children.push_back(&(*block_it));
-    }
+    if (m_parentBlockMinerIds[i] == block.GetMinerId())
+      children.push_back(GetBlockAt(childrenHeight, i));
   }
   return children;
 }
@@ -438,76 +580,155 @@ Blockchain::GetOrphanChildrenPointers (const Block &newBlock)
 }
 
 
-const Block* 
-Blockchain::GetParent (const Block &block) 
+bool 
+Blockchain::HasParent (const Block &block) const
+{
+  return FindBlock(block.GetBlockHeight() - 1, block.GetParentBlockMinerId()) != -1;
+}
+
+
+Block 
+Blockchain::GetParent (const Block &block) const
 {
-  std::vector<Block>::iterator  block_it;
   int parentHeight = block.GetBlockHeight() - 1;
+  int index = FindBlock(parentHeight, block.GetParentBlockMinerId());
 
-  if (parentHeight > GetBlockchainHeight() || parentHeight < 0)
-    return nullptr;
-  
-  for (block_it = m_blocks[parentHeight].begin();  block_it < m_blocks[parentHeight].end(); block_it++)  {
-    if (block.IsChild(*block_it))
-    {
-      return &(*block_it);
-    }
-  }
+  if (index == -1)
+    NS_FATAL_ERROR ("The parent of the block " << block << " is not in the blockchain");
 
-  return nullptr;
+  return GetBlockAt(parentHeight, index);
 }
 
 
-const Block* 
+Block 
 Blockchain::GetCurrentTopBlock (void) const
 {
-  return &m_blocks[m_blocks.size() - 1][0];
+  int topHeight = GetTopHeight();
+
+  return GetBlockAt(topHeight, m_heightOffsets[topHeight]);
+}
+
+
+int 
+Blockchain::GetNoMinerBlocksInChain (const Block &topBlock, int minerId) const
+{
+  int count = topBlock.GetMinerId() == minerId ? 1 : 0;
+  int height = topBlock.GetBlockHeight() - 1;
+  int index = FindBlock(height, topBlock.GetParentBlockMinerId());
+
+  while (index != -1)
+  {
+    if (m_minerIds[index] == minerId)
+      count++;
+    index = FindBlock(height - 1, m_parentBlockMinerIds[index]);
+    height--;
+  }
+  return count;
 }
 
 
 void 
 Blockchain::AddBlock (const Block& newBlock)
 {
+  int height = newBlock.GetBlockHeight();
+  int index;
 
-  if (m_blocks.size() == 0)
+  if (height < GetKeyWindowHeight())
   {
-    std::vector<Block> newHeight(1, newBlock);
-	m_blocks.push_back(newHeight);
-  }	
-  else if (newBlock.GetBlockHeight() > GetCurrentTopBlock()->GetBlockHeight())   		
+    /* The keys of these rows are not kept any more, so the block cannot be told from one received before */
+    if (FindBlock(height, newBlock.GetMinerId()) == -1)
+      m_noDroppedBlocks++;
+    return;
+  }
+
+  if (height < m_prunedHeight && m_heightOffsets[height + 1] > m_heightOffsets[height])
   {
     /**
-     * The new block has a new blockHeight, so have to create a new vector (row)
-     * If we receive an orphan block we have to create the dummy rows for the missing blocks as well
+     * The row has been collapsed to its main chain block, so the new block can only be stale. The row counts
+     * in the blocks in forks with the blocks removed from it, as on an unpruned chain, but the forks through
+     * the pruned rows are not extended.
      */
-    int dummyRows = newBlock.GetBlockHeight() - GetCurrentTopBlock()->GetBlockHeight() - 1;
-	
-    for(int i = 0; i < dummyRows; i++)
-    {  
-      std::vector<Block> newHeight; 
-      m_blocks.push_back(newHeight);
+    blockKey key = {height, newBlock.GetMinerId()};
+
+    if (FindBlock(height, newBlock.GetMinerId()) != -1 || HasPrunedKey(m_prunedBlocks, height, newBlock.GetMinerId()))
+      return;
+
+    auto row = std::lower_bound(m_prunedBlocks.begin(), m_prunedBlocks.end(), key, IsKeyBelow);
+    if (row == m_prunedBlocks.end() || row->height != height)
+    {
+      m_prunedBlocksInForks += 2;
+      if (m_prunedForks.maxSize < 1)
+        m_prunedForks.maxSize = 1;
     }
-	
-    std::vector<Block> newHeight(1, newBlock);
-    m_blocks.push_back(newHeight);
+    else
+      m_prunedBlocksInForks++;
+
+    InsertPrunedKey(m_prunedBlocks, height, newBlock.GetMinerId());
+    m_noStaleBlocks++;
+    m_noDroppedBlocks++;
+    m_totalBlocks++;
+    return;
+  }
+
+  if (height > GetTopHeight())   		
+  {
+    /**
+     * The new block has a new blockHeight, so have to create a new row
+     * If we receive an orphan block we have to create the dummy (empty) rows for the missing blocks as well
+     */
+    while (GetTopHeight() < height)
+      m_heightOffsets.push_back(m_heightOffsets.back());
+
+    index = m_heightOffsets.back();
   }
   else
   {
-    /* The new block doesn't have a new blockHeight, so we have to add it in an existing row */
+    /* The new block doesn't have a new blockHeight, so we have to add it at the end of an existing row */
 	
-    if (m_blocks[newBlock.GetBlockHeight()].size() > 0)
+    if (m_heightOffsets[height + 1] > m_heightOffsets[height])
       m_noStaleBlocks++;									
 
-    m_blocks[newBlock.GetBlockHeight()].push_back(newBlock);   
+    index = m_heightOffsets[height + 1];
   }
+
+  /**
+   * The columns are kept sorted by height, so inserting the block shifts the blocks of the greater heights
+   * and their offsets. A new tip costs O(1). A late sibling costs O(blocks above its height): since siblings
+   * arrive within a few blocks of the tip this is small, and with a finality depth it is bounded by the
+   * unpruned rows. An append-only layout with per-height index lists would avoid the shift at the cost of
+   * the contiguous rows which FindBlock, GetChildren and ScanForks iterate over.
+   */
+  for (int h = height + 1; h < static_cast<int>(m_heightOffsets.size()); h++)
+    m_heightOffsets[h]++;
+
+  m_minerIds.insert(m_minerIds.begin() + index, newBlock.GetMinerId());
+  m_parentBlockMinerIds.insert(m_parentBlockMinerIds.begin() + index, newBlock.GetParentBlockMinerId());
+  m_blockSizes.insert(m_blockSizes.begin() + index, newBlock.GetBlockSizeBytes());
+  m_timesCreated.insert(m_timesCreated.begin() + index, newBlock.GetTimeCreated());
+  m_timesReceived.insert(m_timesReceived.begin() + index, newBlock.GetTimeReceived());
+  m_receivedFromIpv4.insert(m_receivedFromIpv4.begin() + index, newBlock.GetReceivedFromIpv4().Get());
   
   m_totalBlocks++;
+
+  if (m_finalityDepth > 0 && GetTopHeight() - m_finalityDepth > m_prunedHeight)
+    Prune();
 }
 
 
 void 
 Blockchain::AddOrphan (const Block& newBlock)
 {
+  if (newBlock.GetBlockHeight() <= m_prunedHeight && !HasParent(newBlock))
+  {
+    if (newBlock.GetBlockHeight() < GetKeyWindowHeight())
+      m_noDroppedBlocks++;
+    else if (!IsPruned(newBlock.GetBlockHeight(), newBlock.GetMinerId()))
+    {
+      InsertPrunedKey(m_droppedOrphans, newBlock.GetBlockHeight(), newBlock.GetMinerId());
+      m_noDroppedBlocks++;
+    }
+    return;
+  }
   m_orphans.push_back(newBlock);
 }
 
@@ -551,16 +772,24 @@ Blockchain::PrintOrphans (void)
 }
 
 
+const std::vector<Block>&
+Blockchain::GetOrphans (void) const
+{
+  return m_orphans;
+}
+
+
 int 
-Blockchain::GetBlocksInForks (void)
+Blockchain::GetBlocksInForks (void) const
 {
-  std::vector< std::vector<Block>>::iterator blockHeight_it;
-  int count = 0;
+  int count = m_prunedBlocksInForks;
   
-  for (blockHeight_it = m_blocks.begin(); blockHeight_it < m_blocks.end(); blockHeight_it++) 
+  for (int height = m_prunedHeight; height <= GetTopHeight(); height++) 
   {
-    if (blockHeight_it->size() > 1)
-      count += blockHeight_it->size();
+    int noBlocks = m_heightOffsets[height + 1] - m_heightOffsets[height];
+
+    if (noBlocks > 1)
+      count += noBlocks;
   }
   
   return count;
@@ -568,78 +797,306 @@ Blockchain::GetBlocksInForks (void)
 
 
 int 
-Blockchain::GetLongestForkSize (void)
+Blockchain::GetLongestForkSize (void) const
+{
+  forkScanState state = m_prunedForks;
+  int maxSize;
+
+  ScanForks(state, m_prunedHeight, GetTopHeight() + 1);
+  maxSize = state.maxSize;
+  
+  for (auto &block : state.forkedBlocksParentId)
+  {
+    if(block.second > maxSize)
+      maxSize = block.second;
+  }
+   
+  return maxSize;
+}
+
+
+void 
+Blockchain::ScanForks (forkScanState &state, int fromHeight, int toHeight) const
 {
-  std::vector< std::vector<Block>>::iterator   blockHeight_it;
-  std::vector<Block>::iterator                 block_it;
-  std::map<int, int>                           forkedBlocksParentId;
-  std::vector<int>                             newForks; 
-  int maxSize = 0;
+  std::map<int, int>  &forkedBlocksParentId = state.forkedBlocksParentId;
+  std::vector<int>    &newForks = state.newForks;
   
-  for (blockHeight_it = m_blocks.begin(); blockHeight_it < m_blocks.end(); blockHeight_it++) 
+  for (int height = fromHeight; height < toHeight; height++) 
   {
+    int first = m_heightOffsets[height];
+    int noBlocks = m_heightOffsets[height + 1] - first;
 	
-    if (blockHeight_it->size() > 1 && forkedBlocksParentId.size() == 0)
+    if (noBlocks > 1 && forkedBlocksParentId.size() == 0)
     {
-      for (block_it = blockHeight_it->begin();  block_it < blockHeight_it->end(); block_it++)
+      for (int i = first; i < first + noBlocks; i++)
       {
-        forkedBlocksParentId[block_it->GetMinerId()] = 1;
+        forkedBlocksParentId[m_minerIds[i]] = 1;
       }
     }
-    else if (blockHeight_it->size() > 1)
+    else if (noBlocks > 1)
     {
-      for (block_it = blockHeight_it->begin();  block_it < blockHeight_it->end(); block_it++)
+      for (int i = first; i < first + noBlocks; i++)
       {
-        std::map<int, int>::iterator mapIndex = forkedBlocksParentId.find(block_it->GetParentBlockMinerId());
+        std::map<int, int>::iterator mapIndex = forkedBlocksParentId.find(m_parentBlockMinerIds[i]);
         
         if(mapIndex != forkedBlocksParentId.end())
         {
-          forkedBlocksParentId[block_it->GetMinerId()] = mapIndex->second + 1;
-          if(block_it->GetMinerId() != mapIndex->first)
+          forkedBlocksParentId[m_minerIds[i]] = mapIndex->second + 1;
+          if(m_minerIds[i] != mapIndex->first)
             forkedBlocksParentId.erase(mapIndex);	
-          newForks.push_back(block_it->GetMinerId());		  
+          newForks.push_back(m_minerIds[i]);		  
         }
         else
         {
-          forkedBlocksParentId[block_it->GetMinerId()] = 1;
+          forkedBlocksParentId[m_minerIds[i]] = 1;
         }		  
       }
 	  
-      for (auto &block : forkedBlocksParentId)
+      for (std::map<int, int>::iterator block_it = forkedBlocksParentId.begin(); block_it != forkedBlocksParentId.end();)
       {
-       if (std::find(newForks.begin(), newForks.end(), block.first) == newForks.end() )
+       if (std::find(newForks.begin(), newForks.end(), block_it->first) == newForks.end() )
        {
-         if(block.second > maxSize)
-           maxSize = block.second;
-         forkedBlocksParentId.erase(block.first);
+         if(block_it->second > state.maxSize)
+           state.maxSize = block_it->second;
+         block_it = forkedBlocksParentId.erase(block_it);
        }
+       else
+         block_it++;
 	  }
     }
-    else if (blockHeight_it->size() == 1 && forkedBlocksParentId.size() > 0)
+    else if (noBlocks == 1 && forkedBlocksParentId.size() > 0)
     {
 
       for (auto &block : forkedBlocksParentId)
       {
-        if(block.second > maxSize)
-          maxSize = block.second;
+        if(block.second > state.maxSize)
+          state.maxSize = block.second;
       }
 	
       forkedBlocksParentId.clear();
+      newForks.clear();
     }
+    else if (noBlocks == 1)
+      newForks.clear();
   }
-  
-  for (auto &block : forkedBlocksParentId)
+}
+
+
+void 
+Blockchain::SetFinalityDepth (int finalityDepth)
+{
+  m_finalityDepth = finalityDepth > 0 ? finalityDepth : 0;
+
+  if (m_finalityDepth > 0 && GetTopHeight() - m_finalityDepth > m_prunedHeight)
+    Prune();
+}
+
+
+int 
+Blockchain::GetNoDroppedBlocks (void) const
+{
+  return m_noDroppedBlocks;
+}
+
+
+int 
+Blockchain::GetKeyWindowHeight (void) const
+{
+  return m_prunedHeight - m_finalityDepth;
+}
+
+
+blockchainState
+Blockchain::GetState (void) const
+{
+  blockchainState state;
+
+  state.noStaleBlocks = m_noStaleBlocks;
+  state.totalBlocks = m_totalBlocks;
+  state.noDroppedBlocks = m_noDroppedBlocks;
+  state.prunedHeight = m_prunedHeight;
+  state.prunedBlocksInForks = m_prunedBlocksInForks;
+  state.prunedMaxForkSize = m_prunedForks.maxSize;
+  state.prunedForks = m_prunedForks.forkedBlocksParentId;
+  state.prunedNewForks = m_prunedForks.newForks;
+  state.prunedBlocks = m_prunedBlocks;
+  state.droppedOrphans = m_droppedOrphans;
+  return state;
+}
+
+
+void
+Blockchain::SetState (const blockchainState &state)
+{
+  if (m_finalityDepth > 0 || m_prunedHeight > 0)
+    NS_FATAL_ERROR ("Blockchain::SetState: the blockchain has already been pruned");
+  if (state.prunedHeight < 0 || state.prunedHeight > GetTopHeight() + 1)
+    NS_FATAL_ERROR ("Blockchain::SetState: the pruned height " << state.prunedHeight << " is above the top");
+
+  for (int height = 0; height < state.prunedHeight; height++)
   {
-    if(block.second > maxSize)
-      maxSize = block.second;
+    if (m_heightOffsets[height + 1] - m_heightOffsets[height] > 1)
+      NS_FATAL_ERROR ("Blockchain::SetState: the pruned row " << height << " holds more than one block");
   }
-   
-  return maxSize;
+  if (!std::is_sorted(state.prunedBlocks.begin(), state.prunedBlocks.end(), IsKeyBelow)
+      || !std::is_sorted(state.droppedOrphans.begin(), state.droppedOrphans.end(), IsKeyBelow))
+    NS_FATAL_ERROR ("Blockchain::SetState: the keys of the pruned blocks are not sorted by height");
+
+  m_noStaleBlocks = state.noStaleBlocks;
+  m_totalBlocks = state.totalBlocks;
+  m_noDroppedBlocks = state.noDroppedBlocks;
+  m_prunedHeight = state.prunedHeight;
+  m_prunedBlocksInForks = state.prunedBlocksInForks;
+  m_prunedForks.maxSize = state.prunedMaxForkSize;
+  m_prunedForks.forkedBlocksParentId = state.prunedForks;
+  m_prunedForks.newForks = state.prunedNewForks;
+  m_prunedBlocks = state.prunedBlocks;
+  m_droppedOrphans = state.droppedOrphans;
+}
+
+
+void 
+Blockchain::Prune (void)
+{
+  int                          topHeight = GetTopHeight();
+  int                          prunedHeight = topHeight - m_finalityDepth;
+  std::vector<int>             mainChain (prunedHeight - m_prunedHeight, -1);
+  int                          index = m_heightOffsets[topHeight];
+  int                          next;
+  int                          shift;
+  std::vector<Block>::iterator block_it;
+
+  /* Move the fork statistics of the pruned rows to the pruning boundary */
+  ScanForks(m_prunedForks, m_prunedHeight, prunedHeight);
+  for (int height = m_prunedHeight; height < prunedHeight; height++)
+  {
+    int noBlocks = m_heightOffsets[height + 1] - m_heightOffsets[height];
+
+    if (noBlocks > 1)
+      m_prunedBlocksInForks += noBlocks;
+    if (noBlocks > 0)
+      mainChain[height - m_prunedHeight] = m_heightOffsets[height];
+  }
+
+  /**
+   * Follow the parents of the top block to find the main chain block of each pruned row. The rows the chain does
+   * not reach keep the block received first.
+   */
+  for (int height = topHeight; height > m_prunedHeight && index != -1; height--)
+  {
+    index = FindBlock(height - 1, m_parentBlockMinerIds[index]);
+    if (index != -1 && height - 1 < prunedHeight)
+      mainChain[height - 1 - m_prunedHeight] = index;
+  }
+
+  /* Compact the columns: keep one block per pruned row and shift the rows above them */
+  next = m_heightOffsets[m_prunedHeight];
+  for (int height = m_prunedHeight; height < prunedHeight; height++)
+  {
+    int row = mainChain[height - m_prunedHeight];
+
+    /* Keep the keys of the removed blocks, whose indices are not overwritten before the row is compacted */
+    for (int i = m_heightOffsets[height]; i < m_heightOffsets[height + 1]; i++)
+    {
+      if (i != row)
+        InsertPrunedKey(m_prunedBlocks, height, m_minerIds[i]);
+    }
+
+    m_heightOffsets[height] = next;
+    if (row == -1)
+      continue;
+
+    m_minerIds[next] = m_minerIds[row];
+    m_parentBlockMinerIds[next] = m_parentBlockMinerIds[row];
+    m_blockSizes[next] = m_blockSizes[row];
+    m_timesCreated[next] = m_timesCreated[row];
+    m_timesReceived[next] = m_timesReceived[row];
+    m_receivedFromIpv4[next] = m_receivedFromIpv4[row];
+    next++;
+  }
+
+  shift = m_heightOffsets[prunedHeight] - next;
+  if (shift > 0)
+  {
+    for (int i = m_heightOffsets[prunedHeight]; i < static_cast<int>(m_minerIds.size()); i++)
+    {
+      m_minerIds[i - shift] = m_minerIds[i];
+      m_parentBlockMinerIds[i - shift] = m_parentBlockMinerIds[i];
+      m_blockSizes[i - shift] = m_blockSizes[i];
+      m_timesCreated[i - shift] = m_timesCreated[i];
+      m_timesReceived[i - shift] = m_timesReceived[i];
+      m_receivedFromIpv4[i - shift] = m_receivedFromIpv4[i];
+    }
+    for (int height = prunedHeight; height < static_cast<int>(m_heightOffsets.size()); height++)
+      m_heightOffsets[height] -= shift;
+
+    m_minerIds.resize(m_minerIds.size() - shift);
+    m_parentBlockMinerIds.resize(m_parentBlockMinerIds.size() - shift);
+    m_blockSizes.resize(m_blockSizes.size() - shift);
+    m_timesCreated.resize(m_timesCreated.size() - shift);
+    m_timesReceived.resize(m_timesReceived.size() - shift);
+    m_receivedFromIpv4.resize(m_receivedFromIpv4.size() - shift);
+  }
+  m_prunedHeight = prunedHeight;
+  TrimPrunedKeys(m_prunedBlocks, GetKeyWindowHeight());
+  TrimPrunedKeys(m_droppedOrphans, GetKeyWindowHeight());
+
+  /* Drop the orphans whose parent can no longer be added */
+  for (block_it = m_orphans.begin(); block_it != m_orphans.end();)
+  {
+    if (block_it->GetBlockHeight() <= m_prunedHeight && !HasParent(*block_it))
+    {
+      InsertPrunedKey(m_droppedOrphans, block_it->GetBlockHeight(), block_it->GetMinerId());
+      block_it = m_orphans.erase(block_it);
+      m_noDroppedBlocks++;
+    }
+    else
+      block_it++;
+  }
+}
+
+std::vector<ns3::Block> Blockchain::GetBlocksInSameHeight(int height) const
+{
+  std::vector<ns3::Block> blocks;
+
+  for (int i = m_heightOffsets[height]; i < m_heightOffsets[height + 1]; i++)
+    blocks.push_back(GetBlockAt(height, i));
+  return blocks;
 }
 
-std::vector<ns3::Block> Blockchain::GetBlocksInSameHeight(int height)
+containerUsage
+Blockchain::GetBlocksMemoryUsage (void) const
 {
-  return m_blocks[height];
+  containerUsage usage = GetContainerUsage (m_heightOffsets);
+
+  AddContainerUsage (usage, GetContainerUsage (m_minerIds));
+  AddContainerUsage (usage, GetContainerUsage (m_parentBlockMinerIds));
+  AddContainerUsage (usage, GetContainerUsage (m_blockSizes));
+  AddContainerUsage (usage, GetContainerUsage (m_timesCreated));
+  AddContainerUsage (usage, GetContainerUsage (m_timesReceived));
+  AddContainerUsage (usage, GetContainerUsage (m_receivedFromIpv4));
+  AddContainerUsage (usage, GetContainerUsage (m_prunedBlocks));
+  usage.elements = m_minerIds.size();
+  return usage;
+}
+
+containerUsage
+Blockchain::GetOrphansMemoryUsage (void) const
+{
+  containerUsage usage = GetContainerUsage (m_orphans);
+
+  AddContainerUsage (usage, GetContainerUsage (m_droppedOrphans));
+  usage.elements = m_orphans.size();
+  return usage;
+}
+
+containerUsage
+Blockchain::GetPrunedKeysMemoryUsage (void) const
+{
+  containerUsage usage = GetContainerUsage (m_prunedBlocks);
+
+  AddContainerUsage (usage, GetContainerUsage (m_droppedOrphans));
+  return usage;
 }
 
 
@@ -703,16 +1160,12 @@ std::ostream& operator<< (std::ostream &out, const BitcoinChunk &chunk)
 std::ostream& operator<< (std::ostream &out, Blockchain &blockchain)
 {
   
-  std::vector< std::vector<Block>>::iterator blockHeight_it;
-  std::vector<Block>::iterator  block_it;
-  int i;
-  
-  for (blockHeight_it = blockchain.m_blocks.begin(), i = 0; blockHeight_it < blockchain.m_blocks.end(); blockHeight_it++, i++) 
+  for (int height = 0; height <= blockchain.GetTopHeight(); height++) 
   {
-    out << "  BLOCK HEIGHT " << i << ":\n";
-    for (block_it = blockHeight_it->begin();  block_it < blockHeight_it->end(); block_it++)
+    out << "  BLOCK HEIGHT " << height << ":\n";
+    for (int i = blockchain.m_heightOffsets[height]; i < blockchain.m_heightOffsets[height + 1]; i++)
     {
-      out << *block_it << "\n";
+      out << blockchain.GetBlockAt(height, i) << "\n";
     }
   }
   
@@ -747,6 +1200,8 @@ const char* getMinerType(enum MinerType m)
     case SIMPLE_ATTACKER: return "SIMPLE_ATTACKER";
     case SELFISH_MINER: return "SELFISH_MINER";
     case SELFISH_MINER_TRIALS: return "SELFISH_MINER_TRIALS";
+    case MY_SELFISH_MINER: return "MY_SELFISH_MINER";
+    case MY_HONEST_MINER: return "MY_HONEST_MINER";
   }
 }
 
@@ -780,6 +1235,30 @@ const char* getCryptocurrency(enum Cryptocurrency m)
   }
 }
 
+const char* getBitcoinNodeContainerName(enum BitcoinNodeContainer m)
+{
+  switch (m) 
+  {
+    case BLOCKCHAIN_BLOCKS: return "BLOCKCHAIN_BLOCKS";
+    case BLOCKCHAIN_ORPHANS: return "BLOCKCHAIN_ORPHANS";
+    case QUEUE_INV: return "QUEUE_INV";
+    case QUEUE_CHUNK_PEERS: return "QUEUE_CHUNK_PEERS";
+    case QUEUE_CHUNKS: return "QUEUE_CHUNKS";
+    case RECEIVED_CHUNKS: return "RECEIVED_CHUNKS";
+    case INV_TIMEOUTS: return "INV_TIMEOUTS";
+    case CHUNK_TIMEOUTS: return "CHUNK_TIMEOUTS";
+    case BUFFERED_DATA: return "BUFFERED_DATA";
+    case RECEIVED_NOT_VALIDATED: return "RECEIVED_NOT_VALIDATED";
+    case ONLY_HEADERS_RECEIVED: return "ONLY_HEADERS_RECEIVED";
+    case SEND_RECEIVE_TIMES: return "SEND_RECEIVE_TIMES";
+    case PEERS: return "PEERS";
+    case CHUNK_SCHEDULER: return "CHUNK_SCHEDULER";
+    case QUANTILE_SKETCHES: return "QUANTILE_SKETCHES";
+    case NO_OF_NODE_CONTAINERS: break;
+  }
+  return "";
+}
+
 const char* getBitcoinRegion(enum BitcoinRegion m)
 {
   switch (m) 
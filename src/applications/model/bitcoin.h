@@ -11,6 +11,8 @@
 #include <map>
 #include "ns3/address.h"
 #include <algorithm>
+#include <string>
+#include <stdint.h>
 
 namespace ns3 {
 	
@@ -149,6 +151,66 @@ typedef struct {
 } nodeInternetSpeeds;
 
 
+/**
+ * The containers of a BitcoinNode whose memory usage is reported by BitcoinNode::GetMemoryUsage.
+ */
+enum BitcoinNodeContainer
+{
+  BLOCKCHAIN_BLOCKS,           //0
+  BLOCKCHAIN_ORPHANS,          //1
+  QUEUE_INV,                   //2
+  QUEUE_CHUNK_PEERS,           //3
+  QUEUE_CHUNKS,                //4
+  RECEIVED_CHUNKS,             //5
+  INV_TIMEOUTS,                //6
+  CHUNK_TIMEOUTS,              //7
+  BUFFERED_DATA,               //8
+  RECEIVED_NOT_VALIDATED,      //9
+  ONLY_HEADERS_RECEIVED,       //10
+  SEND_RECEIVE_TIMES,          //11
+  PEERS,                       //12
+  CHUNK_SCHEDULER,             //13
+  QUANTILE_SKETCHES,           //14
+  NO_OF_NODE_CONTAINERS        //must always be the last one
+};
+
+
+/**
+ * The approximate memory footprint of a container.
+ */
+typedef struct {
+  long     bytes;                            //including the heap allocations of the elements
+  long     elements;
+} containerUsage;
+
+
+/**
+ * The key of a block removed or dropped below the finality depth.
+ */
+typedef struct {
+  int32_t  height;
+  int32_t  minerId;
+} blockKey;
+
+
+/**
+ * The counters of a Blockchain and the state of its pruned rows, which the blocks kept in the rows cannot
+ * rebuild. Saved with the checkpoints.
+ */
+typedef struct {
+  int                               noStaleBlocks;
+  int                               totalBlocks;
+  int                               noDroppedBlocks;
+  int                               prunedHeight;
+  int                               prunedBlocksInForks;
+  int                               prunedMaxForkSize;     //the longest fork which has ended below prunedHeight
+  std::map<int, int>                prunedForks;           //the forks still open at prunedHeight
+  std::vector<int>                  prunedNewForks;
+  std::vector<blockKey>             prunedBlocks;          //the blocks removed from the pruned rows of the key window
+  std::vector<blockKey>             droppedOrphans;        //the orphans dropped in the key window
+} blockchainState;
+
+
 /**
  * Fuctions used to convert enumeration values to the corresponding strings.
  */
@@ -158,16 +220,19 @@ const char* getBlockBroadcastType(enum BlockBroadcastType m);
 const char* getProtocolType(enum ProtocolType m);
 const char* getBitcoinRegion(enum BitcoinRegion m);
 const char* getCryptocurrency(enum Cryptocurrency m);
+const char* getBitcoinNodeContainerName(enum BitcoinNodeContainer m);
 enum BitcoinRegion getBitcoinEnum(uint32_t n);
 
+/**
+ * A trivially copyable block record of 32 Bytes. The time received is kept as a float offset from
+ * the time created (the propagation time), and the Ipv4 of the sender as its 32-bit value.
+ */
 class Block
 {
 public:
   Block (int blockHeight, int minerId, int parentBlockMinerId = 0, int blockSizeBytes = 0, 
          double timeCreated = 0, double timeReceived = 0, Ipv4Address receivedFromIpv4 = Ipv4Address("0.0.0.0"));
   Block ();
-  Block (const Block &blockSource);  // Copy constructor
-  virtual ~Block (void);
  
   int GetBlockHeight (void) const;
   void SetBlockHeight (int blockHeight);
@@ -197,46 +262,111 @@ public:
    */
   bool IsChild (const Block &block) const; 
   
-  Block& operator= (const Block &blockSource); //Assignment Constructor
-  
   friend bool operator== (const Block &block1, const Block &block2);
   friend std::ostream& operator<< (std::ostream &out, const Block &block);
 
   std::string ToString() const;
   
-protected:	
-  int           m_blockHeight;                // The height of the block
-  int           m_minerId;                    // The id of the miner which mined this block
-  int           m_parentBlockMinerId;         // The id of the miner which mined the parent of this block
-  int           m_blockSizeBytes;             // The size of the block in bytes
+private:	
+  int32_t       m_blockHeight;                // The height of the block
+  int32_t       m_minerId;                    // The id of the miner which mined this block
+  int32_t       m_parentBlockMinerId;         // The id of the miner which mined the parent of this block
+  int32_t       m_blockSizeBytes;             // The size of the block in bytes
   double        m_timeCreated;                // The time the block was created
-  double        m_timeReceived;               // The time the block was received from the node
-  Ipv4Address   m_receivedFromIpv4;           // The Ipv4 of the node which sent the block to the receiving node
+  float         m_propagationTime;            // The time the block was received from the node minus m_timeCreated
+  uint32_t      m_receivedFromIpv4;           // The Ipv4 of the node which sent the block to the receiving node
 };
 
-class BitcoinChunk : public Block
+/**
+ * A chunk of a block. It holds the block record instead of inheriting from Block, so that Block stays trivially copyable.
+ */
+class BitcoinChunk
 {
 public:
   BitcoinChunk (int blockHeight, int minerId, int chunkId, int parentBlockMinerId = 0, int blockSizeBytes = 0, 
                 double timeCreated = 0, double timeReceived = 0, Ipv4Address receivedFromIpv4 = Ipv4Address("0.0.0.0"));
   BitcoinChunk ();
-  BitcoinChunk (const BitcoinChunk &chunkSource);  // Copy constructor
-  virtual ~BitcoinChunk (void);
  
+  const Block& GetBlock (void) const;
+
+  int GetBlockHeight (void) const;
+  int GetMinerId (void) const;
+  int GetParentBlockMinerId (void) const;
+  int GetBlockSizeBytes (void) const;
+  double GetTimeCreated (void) const;
+  double GetTimeReceived (void) const;
+  Ipv4Address GetReceivedFromIpv4 (void) const;
+
   int GetChunkId (void) const;
   void SetChunkId (int minerId);
   
-  BitcoinChunk& operator= (const BitcoinChunk &chunkSource); //Assignment Constructor
-  
   friend bool operator== (const BitcoinChunk &chunk, const BitcoinChunk &chunk2);
   friend bool operator< (const BitcoinChunk &chunk, const BitcoinChunk &chunk2);
   friend std::ostream& operator<< (std::ostream &out, const BitcoinChunk &chunk);
   
-protected:	
+private:	
+  Block         m_block;
   int           m_chunkId;
 
 };
 
+/**
+ * The chunks of a block, one bit per chunk. Used by the blockTorrent protocol to keep track
+ * of the chunks that have been received or not requested yet, and to advertise the available
+ * chunks as packed bits ("availableChunks").
+ */
+class ChunkBitmap
+{
+public:
+  ChunkBitmap (int noChunks = 0);
+  virtual ~ChunkBitmap (void);
+
+  int GetNoChunks (void) const;
+
+  /**
+   * Sets the bit of chunk. The bitmap grows if chunk >= GetNoChunks().
+   */
+  void Set (int chunk);
+  void Reset (int chunk);
+  bool Test (int chunk) const;
+
+  /**
+   * Sets the bits of all the chunks.
+   */
+  void SetAll (void);
+
+  /**
+   * Returns the number of set chunks.
+   */
+  int Count (void) const;
+
+  /**
+   * Returns the chunks which are set both in this bitmap and in other.
+   */
+  ChunkBitmap Intersect (const ChunkBitmap &other) const;
+
+  /**
+   * Returns the set chunks in ascending order.
+   */
+  std::vector<int> GetChunks (void) const;
+
+  /**
+   * Packs the bitmap in (GetNoChunks() + 7)/8 bytes, the first chunk being the least significant bit
+   * of the first byte. Each byte is written as 2 hex characters, so that it can be sent as a JSON string.
+   */
+  std::string Pack (void) const;
+
+  /**
+   * The inverse of Pack. The trailing bits of the last byte are counted as chunks too, but are never set.
+   */
+  static ChunkBitmap Unpack (const std::string &packed);
+
+private:
+  int                     m_noChunks;
+  std::vector<uint64_t>   m_words;
+};
+
+
 class Blockchain
 {
 public:
@@ -265,20 +395,23 @@ public:
   Block ReturnBlock(int height, int minerId);  
 
   /**
-   * Check if the block is an orphan.
+   * Check if the block was removed from a pruned row, refused below the finality depth or dropped as an orphan
+   * which could no longer be connected. Such blocks are neither in the blockchain nor orphans, but they have
+   * been received and are counted. Only the keys of the finality depth heights below the pruned rows are
+   * kept, so the older blocks are not reported.
    */
-  bool IsOrphan (const Block &newBlock) const;
-  bool IsOrphan (int height, int minerId) const;
+  bool IsPruned (int height, int minerId) const;
 
   /**
-   * Gets a pointer to the block.
+   * Check if the block is an orphan.
    */
-  const Block* GetBlockPointer (const Block &newBlock) const;
+  bool IsOrphan (const Block &newBlock) const;
+  bool IsOrphan (int height, int minerId) const;
 
   /**
    * Gets the children of a block that are not orphans.
    */
-  const std::vector<const Block *> GetChildrenPointers (const Block &block);  
+  std::vector<Block> GetChildren (const Block &block) const;  
   
   /**
    * Gets the children of a newBlock that used to be orphans before receiving the newBlock.
@@ -286,14 +419,25 @@ public:
   const std::vector<const Block *> GetOrphanChildrenPointers (const Block &newBlock);  
 
   /**
-   * Gets the parent of a block
+   * Check if the parent of a block is in the blockchain.
+   */
+  bool HasParent (const Block &block) const;
+
+  /**
+   * Gets the parent of a block. Should be called after HasParent(): aborts the simulation if the parent does not exist.
    */
-  const Block* GetParent (const Block &block);  //Get the parent of newBlock
+  Block GetParent (const Block &block) const;
 
   /**
    * Gets the current top block. If there are two block with the same height (siblings), returns the one received first.
    */
-  const Block* GetCurrentTopBlock (void) const;
+  Block GetCurrentTopBlock (void) const;
+
+  /**
+   * Gets the number of blocks mined by minerId in the chain ending at topBlock, including topBlock.
+   * Only the minerIds and the parentBlockMinerIds of the chain are read.
+   */
+  int GetNoMinerBlocksInChain (const Block &topBlock, int minerId) const;
 
   /**
    * Adds a new block in the blockchain.
@@ -315,26 +459,131 @@ public:
    */
   void PrintOrphans (void);
 
+  /**
+   * Gets the orphan blocks, in the order they were added.
+   */
+  const std::vector<Block>& GetOrphans (void) const;
+
   /**
    * Gets the total number of blocks in forks.
    */
-  int GetBlocksInForks (void);
+  int GetBlocksInForks (void) const;
 
   /**
    * Gets the longest fork size
    */
-  int GetLongestForkSize (void);
+  int GetLongestForkSize (void) const;
+
+  std::vector<ns3::Block> GetBlocksInSameHeight(int height) const;
+
+  /**
+   * Sets the finality depth k. The rows more than k heights below the top are collapsed to their main chain
+   * block, after adding their siblings to the fork statistics, and the orphans which can no longer be connected
+   * below them are dropped. k should exceed the deepest reorganization, e.g. the maxAttackBlocks of a selfish
+   * miner, since the blocks which still arrive below it are dropped too. The keys of the removed and dropped
+   * blocks are kept for k heights below the pruned rows, so that the blocks received again are ignored and
+   * GetBlocksInForks counts these rows as if they were whole. The blocks which arrive below this key window
+   * are refused and counted as dropped. 0 disables the pruning (default).
+   */
+  void SetFinalityDepth (int finalityDepth);
+
+  /**
+   * Gets the number of orphans and blocks dropped because they were below the finality depth.
+   */
+  int GetNoDroppedBlocks (void) const;
+
+  /**
+   * Gets the counters and the state of the pruned rows, which GetBlocksInSameHeight does not return.
+   */
+  blockchainState GetState (void) const;
+
+  /**
+   * Restores the state returned by GetState. Should be called after adding the blocks of GetBlocksInSameHeight
+   * again without a finality depth and before SetFinalityDepth: the rows below the saved pruned height must
+   * hold only their main chain block.
+   */
+  void SetState (const blockchainState &state);
+
+  /**
+   * Gets the approximate memory usage of the blocks and the orphans.
+   */
+  containerUsage GetBlocksMemoryUsage (void) const;
+  containerUsage GetOrphansMemoryUsage (void) const;
 
-  std::vector<ns3::Block> GetBlocksInSameHeight(int height);
+  /**
+   * Gets the approximate memory usage of the keys of the removed and dropped blocks, which GetBlocksMemoryUsage
+   * and GetOrphansMemoryUsage include.
+   */
+  containerUsage GetPrunedKeysMemoryUsage (void) const;
 
   friend std::ostream& operator<< (std::ostream &out, Blockchain &blockchain);
 
 private:
+  /**
+   * The height of the top row, -1 if the blockchain is empty.
+   */
+  int GetTopHeight (void) const;
+
+  /**
+   * Returns the index of the block in the columns, or -1 if it is not in the blockchain.
+   */
+  int FindBlock (int height, int minerId) const;
+
+  /**
+   * Builds the block record stored at index of the columns.
+   */
+  Block GetBlockAt (int height, int index) const;
+
+  /**
+   * The state of the fork scan of GetLongestForkSize, which is kept at the pruning boundary.
+   */
+  typedef struct {
+    std::map<int, int>   forkedBlocksParentId;     //the size of each fork, keyed by the minerId of its top block
+    std::vector<int>     newForks;                 //the minerIds of the forks extended since the last row without forks
+    int                  maxSize;                  //the longest fork which has ended
+  } forkScanState;
+
+  /**
+   * Advances the fork scan over the rows [fromHeight, toHeight).
+   */
+  void ScanForks (forkScanState &state, int fromHeight, int toHeight) const;
+
+  /**
+   * Collapses the rows below the top height minus m_finalityDepth to their main chain block and drops the
+   * orphans which can no longer be connected.
+   */
+  void Prune (void);
+
+  /**
+   * The lowest height whose keys are kept in m_prunedBlocks and m_droppedOrphans: the blocks below it are refused.
+   */
+  int GetKeyWindowHeight (void) const;
+
   int                                m_noStaleBlocks;     //total number of stale blocks
   int                                m_totalBlocks;       //total number of blocks including the genesis block
-  std::vector<std::vector<Block>>    m_blocks;            //2d vector containing all the blocks of the blockchain. (row->blockHeight, col->sibling blocks)
+
+  /**
+   * The blocks of the blockchain are stored as columns (structure-of-arrays), sorted by height and, for the
+   * sibling blocks, by the time they were added. The blocks of height h are at the indices
+   * [m_heightOffsets[h], m_heightOffsets[h+1]), so m_heightOffsets has one entry more than the number of heights.
+   */
+  std::vector<int>                   m_heightOffsets;     //the index of the first block of each height
+  std::vector<int32_t>               m_minerIds;          //the minerId of each block
+  std::vector<int32_t>               m_parentBlockMinerIds; //the parentBlockMinerId of each block
+  std::vector<int32_t>               m_blockSizes;        //the size of each block in bytes
+  std::vector<double>                m_timesCreated;      //the time each block was created
+  std::vector<double>                m_timesReceived;     //the time each block was received
+  std::vector<uint32_t>              m_receivedFromIpv4;  //the Ipv4 of the node which sent each block
   std::vector<Block>                 m_orphans;           //vector containing the orphans
 
+  int                                m_finalityDepth;     //the finality depth, 0 if the blockchain is not pruned
+  int                                m_prunedHeight;      //the rows below m_prunedHeight hold only their main chain block
+  int                                m_prunedBlocksInForks; //the blocks in forks of the pruned rows
+  forkScanState                      m_prunedForks;       //the fork scan state at m_prunedHeight
+  int                                m_noDroppedBlocks;   //the orphans and blocks dropped below the finality depth
+  std::vector<blockKey>              m_prunedBlocks;      //the blocks removed from or refused by the pruned rows, sorted by height
+  std::vector<blockKey>              m_droppedOrphans;    //the orphans dropped below the finality depth, sorted by height
+
 
 };
 
@@ -134,6 +134,7 @@ namespace blockchain_attacks{
 
     void HonestMiner::MineBlock(void)
     {
+        ns3::BitcoinEventProfiler::Scope profile(ns3::MINE_BLOCK_EVENT);
         std::cout << "honest number : " << m_hashRate << " mine a block" << std::endl;
         m_selfishMinerStatus->HonestTry ++;
 
@@ -155,13 +156,13 @@ namespace blockchain_attacks{
         //std::cout << "*******************************" << std::endl;
 
 
-        int height = m_blockchain.GetCurrentTopBlock()->GetBlockHeight() + 1;
+        int height = m_blockchain.GetCurrentTopBlock().GetBlockHeight() + 1;
         int minerId = GetNode()->GetId();
         int parentBlockMinerId;
         double currentTime = ns3::Simulator::Now().GetSeconds();
 
         if(!DoesTossUpHappen()){
-            parentBlockMinerId = m_blockchain.GetCurrentTopBlock()->GetMinerId();
+            parentBlockMinerId = m_blockchain.GetCurrentTopBlock().GetMinerId();
         }
         else{
             //std::cout << "starting toss up condition" << std::endl;
@@ -196,8 +197,8 @@ namespace blockchain_attacks{
 
         std::cout << "block height is : " << height << std::endl;
 
-        rapidjson::Document inv;
-        rapidjson::Document block;
+        ns3::BitcoinJsonDocument inv(m_jsonPool);
+        ns3::BitcoinJsonDocument block(m_jsonPool);
 
         inv.SetObject();
         block.SetObject();
@@ -278,6 +279,8 @@ namespace blockchain_attacks{
             inv.AddMember("blocks", array, inv.GetAllocator());
         }
 
+        AddToSketches(currentTime - m_previousBlockReceiveTime, 0, m_nextBlockSize);
+
         m_meanBlockReceiveTime = (m_blockchain.GetTotalBlocks() - 1) / static_cast<double>(m_blockchain.GetTotalBlocks()) * m_meanBlockReceiveTime + (currentTime - m_previousBlockReceiveTime) / (m_blockchain.GetTotalBlocks());
         m_previousBlockReceiveTime = currentTime;
 
@@ -287,49 +290,18 @@ namespace blockchain_attacks{
 
         m_blockchain.AddBlock(newBlock);
 
-        rapidjson::StringBuffer invInfo;
+        rapidjson::StringBuffer &invInfo = m_jsonPool.GetBuffer(0);
         rapidjson::Writer<rapidjson::StringBuffer> invWriter(invInfo);
         inv.Accept(invWriter);
 
-        rapidjson::StringBuffer blockInfoBuffer;
+        rapidjson::StringBuffer &blockInfoBuffer = m_jsonPool.GetBuffer(1);
         rapidjson::Writer<rapidjson::StringBuffer> blockWriter(blockInfoBuffer);
         block.Accept(blockWriter);
 
-        int count = 0;
-
-        for (std::vector<ns3::Ipv4Address>::const_iterator i = m_peersAddresses.begin(); i != m_peersAddresses.end(); ++i, ++count)
-        {
-
-            const uint8_t delimiter[] = "#";
-
-            m_peersSockets[*i]->Send(reinterpret_cast<const uint8_t *>(invInfo.GetString()), invInfo.GetSize(), 0);
-            m_peersSockets[*i]->Send(delimiter, 1, 0);
-
-            if (m_protocolType == ns3::STANDARD_PROTOCOL && !m_blockTorrent)
-                m_nodeStats->invSentBytes += m_bitcoinMessageHeader + m_countBytes + inv["inv"].Size() * m_inventorySizeBytes;
-            else if (m_protocolType == ns3::SENDHEADERS && !m_blockTorrent)
-                m_nodeStats->headersSentBytes += m_bitcoinMessageHeader + m_countBytes + inv["blocks"].Size() * m_headersSizeBytes;
-            else if (m_protocolType == ns3::STANDARD_PROTOCOL && m_blockTorrent)
-            {
-                m_nodeStats->extInvSentBytes += m_bitcoinMessageHeader + m_countBytes + inv["inv"].Size() * m_inventorySizeBytes;
-                for (int j = 0; j < inv["inv"].Size(); j++)
-                {
-                    m_nodeStats->extInvSentBytes += 5; //1Byte(fullBlock) + 4Bytes(numberOfChunks)
-                    if (!inv["inv"][j]["fullBlock"].GetBool())
-                        m_nodeStats->extInvSentBytes += inv["inv"][j]["availableChunks"].Size() * 1;
-                }
-            }
-            else if (m_protocolType == ns3::SENDHEADERS && m_blockTorrent)
-            {
-                m_nodeStats->extHeadersSentBytes += m_bitcoinMessageHeader + m_countBytes + inv["blocks"].Size() * m_headersSizeBytes;
-                for (int j = 0; j < inv["blocks"].Size(); j++)
-                {
-                    m_nodeStats->extHeadersSentBytes += 1; //fullBlock
-                    if (!inv["blocks"][j]["fullBlock"].GetBool())
-                        m_nodeStats->extHeadersSentBytes += inv["inv"][j]["availableChunks"].Size();
-                }
-            }
-        }
+        int noPeers = BroadcastMessage(CreateMessagePacket(invInfo));
+        enum ns3::Messages invMessage = m_protocolType == ns3::SENDHEADERS ? (m_blockTorrent ? ns3::EXT_HEADERS : ns3::HEADERS)
+                                                                          : (m_blockTorrent ? ns3::EXT_INV : ns3::INV);
+        CountSentBytes(invMessage, noPeers * ns3::GetMessageBytes(invMessage, 1));
 
         m_minerAverageBlockGenInterval = m_minerGeneratedBlocks / static_cast<double>(m_minerGeneratedBlocks + 1) * m_minerAverageBlockGenInterval + (ns3::Simulator::Now().GetSeconds() - m_previousBlockGenerationTime) / (m_minerGeneratedBlocks + 1);
         m_minerAverageBlockSize = m_minerGeneratedBlocks / static_cast<double>(m_minerGeneratedBlocks + 1) * m_minerAverageBlockSize + static_cast<double>(m_nextBlockSize) / (m_minerGeneratedBlocks + 1);
@@ -355,7 +327,7 @@ namespace blockchain_attacks{
             if (m_invTimeouts.find(blockHash) != m_invTimeouts.end())
             {
                 m_queueInv.erase(blockHash);
-                ns3::Simulator::Cancel(m_invTimeouts[blockHash]);
+                ns3::BitcoinEventProfiler::Cancel(m_invTimeouts[blockHash], ns3::INV_TIMEOUT_EXPIRED_EVENT);
                 m_invTimeouts.erase(blockHash);
             }
         }
@@ -365,7 +337,7 @@ namespace blockchain_attacks{
             m_receivedNotValidated[blockHash] = newBlock;
 
             m_queueInv.erase(blockHash);
-            ns3::Simulator::Cancel(m_invTimeouts[blockHash]);
+            ns3::BitcoinEventProfiler::Cancel(m_invTimeouts[blockHash], ns3::INV_TIMEOUT_EXPIRED_EVENT);
             m_invTimeouts.erase(blockHash);
 
             m_blockchain.AddBlock(newBlock);
@@ -378,11 +350,9 @@ namespace blockchain_attacks{
 
     double HonestMiner::generateRandomGamma(void)
     {
-        std::random_device rd;
-        std::mt19937 gen(rd());
         std::uniform_real_distribution<> dis(0, 1);
 
-        return dis(gen);
+        return dis(m_generator);
     }
 
     bool HonestMiner::DoesTossUpHappen(void)
@@ -428,7 +398,7 @@ namespace blockchain_attacks{
         {
             m_selfishMinerStatus->HonestMinerWinBlock += 2;
 
-            parentMinerId = m_blockchain.GetCurrentTopBlock()->GetMinerId();
+            parentMinerId = m_blockchain.GetCurrentTopBlock().GetMinerId();
         }   
         
         return parentMinerId;
@@ -152,6 +152,7 @@ namespace blockchain_attacks{
 
     void SelfishMiner::MineBlock(void)
     {
+        ns3::BitcoinEventProfiler::Scope profile(ns3::MINE_BLOCK_EVENT);
         std::cout << "selfish number : " << m_hashRate << " mine a block" << std::endl;
 
         m_selfishMinerStatus->MinedBlock ++;
@@ -191,7 +192,7 @@ namespace blockchain_attacks{
         ns3::Block newBlock(height, minerId, parentBlockMinerId, m_nextBlockSize,
                        currentTime, currentTime, ns3::Ipv4Address("127.0.0.1"));
 
-        //std::cout << "top block : " << (*m_blockchain.GetCurrentTopBlock()).GetBlockHeight() << std::endl;
+        //std::cout << "top block : " << m_blockchain.GetCurrentTopBlock().GetBlockHeight() << std::endl;
         //std::cout << "block height is : " << height << std::endl;
 
         updateDelta();
@@ -227,8 +228,8 @@ namespace blockchain_attacks{
         }
         std::cout << "**********************************" << std::endl;
 
-        rapidjson::Document inv;
-        rapidjson::Document block;
+        ns3::BitcoinJsonDocument inv(m_jsonPool);
+        ns3::BitcoinJsonDocument block(m_jsonPool);
 
         inv.SetObject();
         block.SetObject();
@@ -289,49 +290,17 @@ namespace blockchain_attacks{
             inv.AddMember("blocks", array, inv.GetAllocator());
         }
 
-        rapidjson::StringBuffer invInfo;
+        rapidjson::StringBuffer &invInfo = m_jsonPool.GetBuffer(0);
         rapidjson::Writer<rapidjson::StringBuffer> invWriter(invInfo);
         inv.Accept(invWriter);
 
-        rapidjson::StringBuffer blockInfoBuffer;
+        rapidjson::StringBuffer &blockInfoBuffer = m_jsonPool.GetBuffer(1);
         rapidjson::Writer<rapidjson::StringBuffer> blockWriter(blockInfoBuffer);
         block.Accept(blockWriter);
 
-        int count = 0;
-
-        for (std::vector<ns3::Ipv4Address>::const_iterator i = m_peersAddresses.begin(); i != m_peersAddresses.end(); ++i, ++count)
-        {
-
-            const uint8_t delimiter[] = "#";
-
-            m_peersSockets[*i]->Send(reinterpret_cast<const uint8_t *>(invInfo.GetString()), invInfo.GetSize(), 0);
-            m_peersSockets[*i]->Send(delimiter, 1, 0);
-
-            if (m_protocolType == ns3::STANDARD_PROTOCOL && !m_blockTorrent)
-                m_nodeStats->invSentBytes += m_bitcoinMessageHeader + m_countBytes + inv["inv"].Size() * m_inventorySizeBytes;
-            else if (m_protocolType == ns3::SENDHEADERS && !m_blockTorrent)
-                m_nodeStats->headersSentBytes += m_bitcoinMessageHeader + m_countBytes + inv["blocks"].Size() * m_headersSizeBytes;
-            else if (m_protocolType == ns3::STANDARD_PROTOCOL && m_blockTorrent)
-            {
-                m_nodeStats->extInvSentBytes += m_bitcoinMessageHeader + m_countBytes + inv["inv"].Size() * m_inventorySizeBytes;
-                for (int j = 0; j < inv["inv"].Size(); j++)
-                {
-                    m_nodeStats->extInvSentBytes += 5; //1Byte(fullBlock) + 4Bytes(numberOfChunks)
-                    if (!inv["inv"][j]["fullBlock"].GetBool())
-                        m_nodeStats->extInvSentBytes += inv["inv"][j]["availableChunks"].Size() * 1;
-                }
-            }
-            else if (m_protocolType == ns3::SENDHEADERS && m_blockTorrent)
-            {
-                m_nodeStats->extHeadersSentBytes += m_bitcoinMessageHeader + m_countBytes + inv["blocks"].Size() * m_headersSizeBytes;
-                for (int j = 0; j < inv["blocks"].Size(); j++)
-                {
-                    m_nodeStats->extHeadersSentBytes += 1; //fullBlock
-                    if (!inv["blocks"][j]["fullBlock"].GetBool())
-                        m_nodeStats->extHeadersSentBytes += inv["inv"][j]["availableChunks"].Size();
-                }
-            }
-        }
+        int noPeers = BroadcastMessage(CreateMessagePacket(invInfo));
+        enum ns3::Messages invMessage = m_protocolType == ns3::SENDHEADERS ? ns3::HEADERS : ns3::INV;
+        CountSentBytes(invMessage, noPeers * ns3::GetMessageBytes(invMessage, blocks.size()));
     }
 
     void SelfishMiner::ReceiveBlock(const ns3::Block &newBlock)
@@ -353,7 +322,7 @@ namespace blockchain_attacks{
             if (m_invTimeouts.find(blockHash) != m_invTimeouts.end())
             {
                 m_queueInv.erase(blockHash);
-                ns3::Simulator::Cancel(m_invTimeouts[blockHash]);
+                ns3::BitcoinEventProfiler::Cancel(m_invTimeouts[blockHash], ns3::INV_TIMEOUT_EXPIRED_EVENT);
                 m_invTimeouts.erase(blockHash);
             }
         }
@@ -363,10 +332,10 @@ namespace blockchain_attacks{
             m_receivedNotValidated[blockHash] = newBlock;
 
             m_queueInv.erase(blockHash);
-            ns3::Simulator::Cancel(m_invTimeouts[blockHash]);
+            ns3::BitcoinEventProfiler::Cancel(m_invTimeouts[blockHash], ns3::INV_TIMEOUT_EXPIRED_EVENT);
             m_invTimeouts.erase(blockHash);
 
-            if(newBlock.GetBlockHeight() < (*m_blockchain.GetCurrentTopBlock()).GetBlockHeight()){
+            if(newBlock.GetBlockHeight() < m_blockchain.GetCurrentTopBlock().GetBlockHeight()){
                 return;
             }
             
@@ -440,7 +409,7 @@ namespace blockchain_attacks{
         NS_LOG_INFO("Stop Selfish Mining");
 
         BitcoinNode::StopApplication();
-        ns3::Simulator::Cancel(m_nextMiningEvent);
+        ns3::BitcoinEventProfiler::Cancel(m_nextMiningEvent, ns3::MINE_BLOCK_EVENT);
 
         return;
     }
@@ -462,7 +431,7 @@ namespace blockchain_attacks{
                                    currentTime, currentTime, ns3::Ipv4Address("127.0.0.1"));
         ns3::Block publicChainTop(-100, -100, -100, m_nextBlockSize,
                                   currentTime, currentTime, ns3::Ipv4Address("127.0.0.1"));
-        ns3::Block mainChainTop = *(m_blockchain.GetCurrentTopBlock());
+        ns3::Block mainChainTop = m_blockchain.GetCurrentTopBlock();
 
         if(m_privateChain.size() > 0){
             privateChainTop = m_privateChain[m_privateChain.size() - 1];
@@ -483,7 +452,7 @@ namespace blockchain_attacks{
         }
         else{
 
-            m_topBlock = *(m_blockchain.GetCurrentTopBlock());
+            m_topBlock = m_blockchain.GetCurrentTopBlock();
         }
 
         return;
@@ -126,6 +126,8 @@ Ipv4AddressHelperCustom::NewNetwork (void)
 {
   NS_LOG_FUNCTION_NOARGS ();
   ++m_network;
+  NS_ASSERT_MSG (m_network < (static_cast<uint64_t> (1) << (32 - m_shift)),
+                 "Ipv4AddressHelperCustom::NewNetwork(): Network overflow");
   m_address = m_base;
   return Ipv4Address (m_network << m_shift);
 }
@@ -135,33 +137,56 @@ Ipv4AddressHelperCustom::Assign (const NetDeviceContainer &c)
 {
   NS_LOG_FUNCTION_NOARGS ();
   Ipv4InterfaceContainer retval;
-  for (uint32_t i = 0; i < c.GetN (); ++i) {
-      Ptr<NetDevice> device = c.Get (i);
+  for (uint32_t i = 0; i < c.GetN (); ++i)
+    AssignDevice (c.Get (i), retval);
+  return retval;
+}
 
-      Ptr<Node> node = device->GetNode ();
-      NS_ASSERT_MSG (node, "Ipv4AddressHelperCustom::Assign(): NetDevice is not not associated "
-                     "with any node -> fail");
+std::pair<Ipv4Address, Ipv4Address>
+Ipv4AddressHelperCustom::AssignLink (Ptr<NetDevice> first, Ptr<NetDevice> second,
+                                     Ipv4InterfaceContainer &interfaces)
+{
+  NS_LOG_FUNCTION_NOARGS ();
+  Ipv4Address firstAddress = AssignDevice (first, interfaces);
+  Ipv4Address secondAddress = AssignDevice (second, interfaces);
 
-      Ptr<Ipv4> ipv4 = node->GetObject<Ipv4> ();
-      NS_ASSERT_MSG (ipv4, "Ipv4AddressHelperCustom::Assign(): NetDevice is associated"
-                     " with a node without IPv4 stack installed -> fail "
-                     "(maybe need to use InternetStackHelper?)");
+  NewNetwork ();
+  return std::make_pair (firstAddress, secondAddress);
+}
 
-      int32_t interface = ipv4->GetInterfaceForDevice (device);
-      if (interface == -1)
-        {
-          interface = ipv4->AddInterface (device);
-        }
-      NS_ASSERT_MSG (interface >= 0, "Ipv4AddressHelperCustom::Assign(): "
-                     "Interface index not found");
-
-      Ipv4InterfaceAddress ipv4Addr = Ipv4InterfaceAddress (NewAddress (), m_mask);
-      ipv4->AddAddress (interface, ipv4Addr);
-      ipv4->SetMetric (interface, 1);
-      ipv4->SetUp (interface);
-      retval.Add (ipv4, interface);
+Ipv4Mask
+Ipv4AddressHelperCustom::GetMask (void) const
+{
+  return Ipv4Mask (m_mask);
+}
+
+Ipv4Address
+Ipv4AddressHelperCustom::AssignDevice (Ptr<NetDevice> device, Ipv4InterfaceContainer &interfaces)
+{
+  Ptr<Node> node = device->GetNode ();
+  NS_ASSERT_MSG (node, "Ipv4AddressHelperCustom::Assign(): NetDevice is not not associated "
+                 "with any node -> fail");
+
+  Ptr<Ipv4> ipv4 = node->GetObject<Ipv4> ();
+  NS_ASSERT_MSG (ipv4, "Ipv4AddressHelperCustom::Assign(): NetDevice is associated"
+                 " with a node without IPv4 stack installed -> fail "
+                 "(maybe need to use InternetStackHelper?)");
+
+  int32_t interface = ipv4->GetInterfaceForDevice (device);
+  if (interface == -1)
+    {
+      interface = ipv4->AddInterface (device);
     }
-  return retval;
+  NS_ASSERT_MSG (interface >= 0, "Ipv4AddressHelperCustom::Assign(): "
+                 "Interface index not found");
+
+  Ipv4Address address = NewAddress ();
+  Ipv4InterfaceAddress ipv4Addr = Ipv4InterfaceAddress (address, m_mask);
+  ipv4->AddAddress (interface, ipv4Addr);
+  ipv4->SetMetric (interface, 1);
+  ipv4->SetUp (interface);
+  interfaces.Add (ipv4, interface);
+  return address;
 }
 
 const uint32_t N_BITS = 32; //!< number of bits in a IPv4 address
@@ -22,6 +22,7 @@
 #include "ns3/ipv4-address.h"
 #include "ns3/net-device-container.h"
 #include "ipv4-interface-container.h"
+#include <utility>
 
 namespace ns3 {
 
@@ -178,7 +179,42 @@ public:
  */
   Ipv4InterfaceContainer Assign (const NetDeviceContainer &c);
 
+/**
+ * @brief Assign IP addresses to the two ends of a point-to-point link and
+ * move on to the next network.
+ *
+ * This is meant for topologies where every link gets its own subnet.  With a
+ * /30 mask (255.255.255.252) each link consumes exactly four addresses, so
+ * millions of links fit in the address space that a /24-per-link scheme
+ * exhausts after 65k links.  The next subnet is a single increment of the
+ * network number.
+ *
+ * Instead of returning a new Ipv4InterfaceContainer per link, the two
+ * interfaces are appended to the container provided by the caller.
+ *
+ * @param first the NetDevice on the first end of the link
+ * @param second the NetDevice on the second end of the link
+ * @param interfaces the container to which the two interfaces are added
+ * @returns the addresses assigned to the first and second NetDevice
+ * @see NewNetwork
+ */
+  std::pair<Ipv4Address, Ipv4Address> AssignLink (Ptr<NetDevice> first, Ptr<NetDevice> second,
+                                                  Ipv4InterfaceContainer &interfaces);
+
+/**
+ * @returns the network mask used for allocation
+ */
+  Ipv4Mask GetMask (void) const;
+
 private:
+  /**
+   * \brief Assigns a new address to a single NetDevice
+   * \param device the NetDevice
+   * \param interfaces the container to which the interface is added
+   * \returns the address assigned to the device
+   */
+  Ipv4Address AssignDevice (Ptr<NetDevice> device, Ipv4InterfaceContainer &interfaces);
+
   /**
    * \brief Returns the number of address bits (hostpart) for a given netmask
    * \param maskbits the netmask